@@ -0,0 +1,110 @@
+﻿/**
+ * Traces every bundled scene with every acceleration structure and reports
+ * build time, memory used by the structure, traced rays per second and
+ * the average number of rays of a path.
+ * Paths are traced on one thread, one sample per pixel.
+ */
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Accelerator.h"
+#include "Config.h"
+#include "Pixel.h"
+#include "Sampler.h"
+#include "benchmark_info.h"
+
+namespace {
+/** Forwards queries to the wrapped structure and counts them*/
+class CountingAccelerator : public Accelerator {
+ public:
+  explicit CountingAccelerator(const Accelerator& accel) : accel_(accel) {}
+
+  std::optional<HitRecord> GetClosestHit(const Ray& ray) const override {
+    ++ray_num_;
+    return accel_.GetClosestHit(ray);
+  }
+  bool IsOccluded(const Ray& ray, Real max_dist) const override {
+    ++ray_num_;
+    return accel_.IsOccluded(ray, max_dist);
+  }
+  size_t GetMemorySize() const override { return accel_.GetMemorySize(); }
+
+  size_t GetRayNumber() const { return ray_num_; }
+
+ private:
+  const Accelerator& accel_;
+  mutable size_t ray_num_ = 0;
+};
+
+struct BackendInfo {
+  AcceleratorType type;
+  const char* name;
+};
+
+void BenchmarkScene(const std::string& scene_dir,
+                    const std::string& scene_file) {
+  // mesh descriptions are referenced relative to the scene directory
+  std::filesystem::path prev_dir = std::filesystem::current_path();
+  std::filesystem::current_path(scene_dir);
+  Config cfg(scene_file);
+  std::filesystem::current_path(prev_dir);
+  if (!cfg.GetCameraSettings() || !cfg.GetGeneralSettings() ||
+      cfg.GetObjects().empty()) {
+    std::cout << "Config " << scene_file << " was not parsed correctly\n";
+    return;
+  }
+  const GeneralSettings& general = cfg.GetGeneralSettings().value();
+  const CameraSettings& camera = cfg.GetCameraSettings().value();
+  std::vector<pixel::Tile> tiles = pixel::CreateTiles(
+      camera.screen_top_left_coor, camera.screen_top_right_coor,
+      camera.screen_bot_left_coor, general.pic_width_in_pixel,
+      general.pic_height_in_pixel);
+  GeoVec viewer = pixel::CreateViewerPoint(camera);
+  std::cout << scene_file << ", " << cfg.GetObjects().size() << " objects\n";
+
+  for (const BackendInfo& backend :
+       {BackendInfo{AcceleratorType::kBvh, "BVH"},
+        BackendInfo{AcceleratorType::kWideBvh, "WIDE_BVH"},
+        BackendInfo{AcceleratorType::kGrid, "GRID"},
+        BackendInfo{AcceleratorType::kKdTree, "KD_TREE"}}) {
+    auto build_start = std::chrono::steady_clock::now();
+    std::unique_ptr<Accelerator> accel =
+        CreateAccelerator(backend.type, cfg.GetObjects());
+    auto build_end = std::chrono::steady_clock::now();
+
+    CountingAccelerator counter{*accel};
+    Sampler sampler{general.seed};
+    auto trace_start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < tiles.size(); ++i) {
+      sampler.StartPixel(i, 0);
+      std::vector<Ray> rays = pixel::CreateRays(tiles[i], viewer, sampler, 1);
+      sampler.StartSample(0);
+      pixel::RenderRay(rays[0], counter, general.max_bounce_number, sampler);
+    }
+    auto trace_end = std::chrono::steady_clock::now();
+    double trace_sec =
+        std::chrono::duration<double>(trace_end - trace_start).count();
+    std::cout << "  " << std::left << std::setw(10) << backend.name
+              << "build "
+              << std::chrono::duration<double, std::milli>(build_end -
+                                                           build_start)
+                     .count()
+              << " ms\tmemory " << accel->GetMemorySize() / 1024.0
+              << " KiB\t" << counter.GetRayNumber() / trace_sec * 1e-6
+              << " Mrays/s\t"
+              << static_cast<double>(counter.GetRayNumber()) / tiles.size()
+              << " rays/path\n";
+  }
+}
+}  // namespace
+
+int main() {
+  std::string scenes = std::string(BENCHMARK_DIR_PATH) + "../scenes/";
+  BenchmarkScene(scenes, "simple_scene.json");
+  BenchmarkScene(scenes + "triangle_simple_scenes", "scene_with_lamp.json");
+  return 0;
+}
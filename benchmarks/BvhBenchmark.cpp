@@ -0,0 +1,142 @@
+﻿/**
+ * Measures closest hit search in random triangle soups of growing size. With
+ * the hierarchy time per ray should grow logarithmically with the number of
+ * triangles, linear scan is measured for small scenes for comparison. Wide
+ * hierarchy is collapsed from the same binary one. Refit after small motion
+ * of all triangles and load of the cached hierarchy are compared with the
+ * build time.
+ */
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "AcceleratorCache.h"
+#include "Bvh.h"
+#include "Objects.h"
+#include "Ray.h"
+#include "ThreadPool.h"
+#include "WideBvh.h"
+
+namespace {
+/** Searches hit of every ray and returns spent nanoseconds per ray. Sum of
+ * distances is printed, so the compiler cannot drop the loop*/
+template <typename Search>
+double MeasureNsPerRay(const char* name, size_t obj_num,
+                       const std::vector<Ray>& rays, Search&& search) {
+  auto start = std::chrono::steady_clock::now();
+  double sum = 0.0;
+  for (const auto& ray : rays) {
+    std::optional<HitRecord> hit = search(ray);
+    if (hit) sum += hit->dist;
+  }
+  auto end = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(end - start).count();
+  std::cout << name << " " << obj_num << " triangles:\t" << ns / rays.size()
+            << " ns/ray\t(sum " << sum << ")\n";
+  return ns / rays.size();
+}
+}  // namespace
+
+int main() {
+  constexpr size_t kRayNum = 200'000;
+  constexpr size_t kMaxLinearNum = 10'000;
+  std::mt19937 rnd{42};
+  std::uniform_real_distribution<double> coor{-100.0, 100.0};
+  ThreadPool pool{0};
+  std::vector<Ray> rays;
+  rays.reserve(kRayNum);
+  for (size_t i = 0; i < kRayNum; ++i) {
+    rays.emplace_back(GeoVec{coor(rnd), coor(rnd), coor(rnd)},
+                      GeoVec{coor(rnd), coor(rnd), coor(rnd)});
+  }
+  for (size_t obj_num : {100, 1'000, 10'000, 100'000, 1'000'000}) {
+    // triangles become smaller, so the scene occupies the same volume
+    double size = 200.0 / std::cbrt(static_cast<double>(obj_num));
+    std::uniform_real_distribution<double> shift{-size, size};
+    std::vector<std::unique_ptr<Triangle>> storage;
+    std::vector<const Object*> objects;
+    storage.reserve(obj_num);
+    for (size_t i = 0; i < obj_num; ++i) {
+      GeoVec p{coor(rnd), coor(rnd), coor(rnd)};
+      storage.push_back(std::make_unique<Triangle>(
+          p, p + GeoVec{shift(rnd), shift(rnd), shift(rnd)},
+          p + GeoVec{shift(rnd), shift(rnd), shift(rnd)}));
+      objects.push_back(storage.back().get());
+    }
+    auto build_start = std::chrono::steady_clock::now();
+    Bvh bvh{objects};
+    auto build_end = std::chrono::steady_clock::now();
+    std::cout << "Build " << obj_num << " triangles:\t"
+              << std::chrono::duration<double, std::milli>(build_end -
+                                                           build_start)
+                     .count()
+              << " ms\n";
+    build_start = std::chrono::steady_clock::now();
+    Bvh parallel_bvh{objects, &pool};
+    build_end = std::chrono::steady_clock::now();
+    std::cout << "Parallel build " << obj_num << " triangles, "
+              << pool.GetThreadNumber() << " threads:\t"
+              << std::chrono::duration<double, std::milli>(build_end -
+                                                           build_start)
+                     .count()
+              << " ms\n";
+    const std::string cache_file = "bench_bvh_cache.accel";
+    SaveAccelerator(cache_file, bvh, objects);
+    auto load_start = std::chrono::steady_clock::now();
+    std::unique_ptr<Accelerator> loaded =
+        LoadAccelerator(cache_file, AcceleratorType::kBvh, objects);
+    auto load_end = std::chrono::steady_clock::now();
+    std::cout << "Cache load " << obj_num << " triangles:\t"
+              << std::chrono::duration<double, std::milli>(load_end -
+                                                           load_start)
+                     .count()
+              << " ms" << (loaded ? "" : " (failed)") << '\n';
+    std::filesystem::remove(cache_file);
+    MeasureNsPerRay("BVH", obj_num, rays,
+                    [&](const Ray& ray) { return bvh.GetClosestHit(ray); });
+    WideBvh wide_bvh{bvh};
+    MeasureNsPerRay("Wide BVH", obj_num, rays, [&](const Ray& ray) {
+      return wide_bvh.GetClosestHit(ray);
+    });
+    // next animation frame: every triangle moves a bit
+    std::uniform_real_distribution<double> motion{-size / 4, size / 4};
+    for (auto& tri : storage) {
+      GeoVec move{motion(rnd), motion(rnd), motion(rnd)};
+      tri->SetPoints(tri->GetPoint0() + move, tri->GetPoint1() + move,
+                     tri->GetPoint2() + move);
+    }
+    double built_cost = bvh.GetCost();
+    auto refit_start = std::chrono::steady_clock::now();
+    bvh.Refit();
+    auto refit_end = std::chrono::steady_clock::now();
+    std::cout << "Refit " << obj_num << " triangles:\t"
+              << std::chrono::duration<double, std::milli>(refit_end -
+                                                           refit_start)
+                     .count()
+              << " ms, cost " << bvh.GetCost() / built_cost
+              << " of the built one\n";
+    refit_start = std::chrono::steady_clock::now();
+    wide_bvh.Refit();
+    refit_end = std::chrono::steady_clock::now();
+    std::cout << "Wide refit " << obj_num << " triangles:\t"
+              << std::chrono::duration<double, std::milli>(refit_end -
+                                                           refit_start)
+                     .count()
+              << " ms\n";
+    if (obj_num > kMaxLinearNum) continue;
+    MeasureNsPerRay("Linear", obj_num, rays, [&](const Ray& ray) {
+      std::optional<HitRecord> result;
+      for (const Object* obj : objects) {
+        std::optional<double> dist = obj->GetClosesDist(ray);
+        if (dist && (!result || *dist < result->dist)) {
+          result = HitRecord{*dist, obj};
+        }
+      }
+      return result;
+    });
+  }
+  return 0;
+}
@@ -0,0 +1,100 @@
+﻿/**
+ * Compares images rendered with and without light sampling (next event
+ * estimation) against a reference image of many samples per pixel. Mean
+ * brightness and root mean square error of the image are reported for
+ * several numbers of samples per pixel together with the render time.
+ */
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "AccumulationBuffer.h"
+#include "Config.h"
+#include "Renderer.h"
+#include "benchmark_info.h"
+
+namespace {
+constexpr int kPicWidth = 60;
+constexpr int kPicHeight = 40;
+constexpr int kReferenceSamplePerPixel = 256;
+
+/** Renders the scene on one thread and returns the time in seconds*/
+double RenderImage(const Config& cfg, bool light_sampling, int sample_num,
+                   std::vector<PixelAccum>& image) {
+  GeneralSettings general = cfg.GetGeneralSettings().value();
+  general.pic_width_in_pixel = kPicWidth;
+  general.pic_height_in_pixel = kPicHeight;
+  general.thread_number = 1;
+  general.sample_per_pixel = sample_num;
+  general.light_sampling = light_sampling;
+  // reference should not share random numbers with measured images
+  general.seed = 2 * sample_num + light_sampling;
+  Renderer renderer{general, cfg.GetCameraSettings().value(),
+                    cfg.GetObjects()};
+  auto start = std::chrono::steady_clock::now();
+  renderer.Render();
+  auto end = std::chrono::steady_clock::now();
+  image = renderer.GetAccumulation().GetPixels();
+  return std::chrono::duration<double>(end - start).count();
+}
+
+double GetMean(const PixelAccum& pixel, double PixelAccum::*channel) {
+  return pixel.*channel / pixel.sample_num;
+}
+
+void BenchmarkScene(const std::string& scene_dir,
+                    const std::string& scene_file) {
+  // mesh descriptions are referenced relative to the scene directory
+  std::filesystem::path prev_dir = std::filesystem::current_path();
+  std::filesystem::current_path(scene_dir);
+  Config cfg(scene_file);
+  std::filesystem::current_path(prev_dir);
+  if (!cfg.GetCameraSettings() || !cfg.GetGeneralSettings() ||
+      cfg.GetObjects().empty()) {
+    std::cout << "Config " << scene_file << " was not parsed correctly\n";
+    return;
+  }
+  std::vector<PixelAccum> reference;
+  double ref_sec =
+      RenderImage(cfg, true, kReferenceSamplePerPixel, reference);
+  std::cout << scene_file << ", reference " << kReferenceSamplePerPixel
+            << " samples per pixel in " << ref_sec << " s\n";
+  std::cout << std::setw(6) << "spp" << std::setw(12) << "sampling"
+            << std::setw(12) << "mean" << std::setw(12) << "rmse"
+            << std::setw(12) << "time, s" << '\n';
+  for (int sample_num : {1, 4, 16, 64}) {
+    for (bool light_sampling : {false, true}) {
+      std::vector<PixelAccum> image;
+      double sec = RenderImage(cfg, light_sampling, sample_num, image);
+      double mean = 0.0;
+      double sq_err = 0.0;
+      for (size_t i = 0; i < image.size(); ++i) {
+        for (auto channel :
+             {&PixelAccum::red, &PixelAccum::green, &PixelAccum::blue}) {
+          double val = GetMean(image[i], channel);
+          double diff = val - GetMean(reference[i], channel);
+          mean += val;
+          sq_err += diff * diff;
+        }
+      }
+      std::cout << std::setw(6) << sample_num << std::setw(12)
+                << (light_sampling ? "on" : "off") << std::setw(12)
+                << mean / (3.0 * image.size()) << std::setw(12)
+                << std::sqrt(sq_err / (3.0 * image.size())) << std::setw(12)
+                << sec << '\n';
+    }
+  }
+}
+}  // namespace
+
+int main() {
+  std::string scene_dir = std::string(BENCHMARK_DIR_PATH) + "../scenes";
+  BenchmarkScene(scene_dir, "simple_scene.json");
+  // lamp of the scene is the box_lamp.json mesh
+  BenchmarkScene(scene_dir + "/triangle_simple_scenes", "scene_with_lamp.json");
+  return 0;
+}
@@ -0,0 +1,139 @@
+﻿/**
+ * Compares visibility checks done by the any hit query with the closest hit
+ * query for every acceleration structure. Segments connect random points of
+ * a scene of random triangles, spheres and instanced meshes, so most of them
+ * are occluded by several objects.
+ */
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "Accelerator.h"
+#include "Instance.h"
+#include "Objects.h"
+#include "Ray.h"
+#include "TriangleMesh.h"
+
+namespace {
+struct Segment {
+  GeoVec from;
+  GeoVec to;
+};
+
+/** Checks every segment and returns spent nanoseconds per segment*/
+template <typename Check>
+double MeasureNsPerSegment(const std::vector<Segment>& segments,
+                           Check&& is_occluded, size_t& occluded_num) {
+  occluded_num = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (const Segment& seg : segments) {
+    occluded_num += is_occluded(seg);
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+         segments.size();
+}
+
+/** Unit sphere approximated by a mesh of faces_per_side^2 * 2 * 6 faces*/
+TriangleMesh MakeBallMesh(int faces_per_side) {
+  std::vector<GeoVec> points;
+  std::vector<TriangleMesh::Face> faces;
+  for (int axis = 0; axis < 3; ++axis) {
+    for (int side : {-1, 1}) {
+      uint32_t first = points.size();
+      for (int i = 0; i <= faces_per_side; ++i) {
+        for (int j = 0; j <= faces_per_side; ++j) {
+          double u = 2.0 * i / faces_per_side - 1.0;
+          double v = 2.0 * j / faces_per_side - 1.0;
+          double coor[3];
+          coor[axis] = side;
+          coor[(axis + 1) % 3] = u;
+          coor[(axis + 2) % 3] = v;
+          points.push_back(GeoVec{coor[0], coor[1], coor[2]}.Norm());
+        }
+      }
+      for (int i = 0; i < faces_per_side; ++i) {
+        for (int j = 0; j < faces_per_side; ++j) {
+          uint32_t p = first + i * (faces_per_side + 1) + j;
+          uint32_t row = faces_per_side + 1;
+          faces.push_back({p, p + row, p + 1});
+          faces.push_back({p + 1, p + row, p + row + 1});
+        }
+      }
+    }
+  }
+  return TriangleMesh{points, faces};
+}
+}  // namespace
+
+int main() {
+  constexpr int kTriangleNum = 100'000;
+  constexpr int kSphereNum = 20'000;
+  constexpr int kInstanceNum = 200;
+  constexpr size_t kSegmentNum = 50'000;
+  std::mt19937 rnd{42};
+  std::uniform_real_distribution<double> coor{-100.0, 100.0};
+  std::uniform_real_distribution<double> shift{-2.0, 2.0};
+  std::uniform_real_distribution<double> radius{0.2, 1.0};
+  std::vector<std::unique_ptr<Object>> storage;
+  for (int i = 0; i < kTriangleNum; ++i) {
+    GeoVec p{coor(rnd), coor(rnd), coor(rnd)};
+    storage.push_back(std::make_unique<Triangle>(
+        p, p + GeoVec{shift(rnd), shift(rnd), shift(rnd)},
+        p + GeoVec{shift(rnd), shift(rnd), shift(rnd)}));
+  }
+  for (int i = 0; i < kSphereNum; ++i) {
+    storage.push_back(std::make_unique<Sphere>(
+        GeoVec{coor(rnd), coor(rnd), coor(rnd)}, radius(rnd)));
+  }
+  TriangleMesh ball = MakeBallMesh(16);
+  for (int i = 0; i < kInstanceNum; ++i) {
+    Transform transform;
+    transform.scale = {3.0, 3.0, 3.0};
+    transform.translation = {coor(rnd), coor(rnd), coor(rnd)};
+    storage.push_back(std::make_unique<Instance>(ball, transform));
+  }
+  std::vector<const Object*> objects;
+  for (const auto& el : storage) {
+    objects.push_back(el.get());
+  }
+  std::vector<Segment> segments;
+  segments.reserve(kSegmentNum);
+  for (size_t i = 0; i < kSegmentNum; ++i) {
+    segments.push_back({{coor(rnd), coor(rnd), coor(rnd)},
+                        {coor(rnd), coor(rnd), coor(rnd)}});
+  }
+  std::cout << objects.size() << " objects, " << kSegmentNum
+            << " segments\n";
+
+  for (auto [type, name] : {std::pair{AcceleratorType::kBvh, "BVH"},
+                            std::pair{AcceleratorType::kWideBvh, "WIDE_BVH"},
+                            std::pair{AcceleratorType::kGrid, "GRID"},
+                            std::pair{AcceleratorType::kKdTree, "KD_TREE"}}) {
+    std::unique_ptr<Accelerator> accel = CreateAccelerator(type, objects);
+    size_t closest_occluded = 0;
+    double closest_ns = MeasureNsPerSegment(
+        segments,
+        [&](const Segment& seg) {
+          GeoVec dir{seg.from, seg.to};
+          std::optional<HitRecord> hit = accel->GetClosestHit({seg.from, dir});
+          return hit && hit->dist < dir.Len();
+        },
+        closest_occluded);
+    size_t any_occluded = 0;
+    double any_ns = MeasureNsPerSegment(
+        segments,
+        [&](const Segment& seg) {
+          return IsSegmentOccluded(*accel, seg.from, seg.to);
+        },
+        any_occluded);
+    std::cout << "  " << std::left << std::setw(10) << name << "closest hit "
+              << closest_ns << " ns\tany hit " << any_ns << " ns\tspeedup "
+              << closest_ns / any_ns << "\toccluded " << any_occluded << " / "
+              << closest_occluded << '\n';
+  }
+  return 0;
+}
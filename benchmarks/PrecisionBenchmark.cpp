@@ -0,0 +1,128 @@
+﻿/**
+ * Measures the simple scene rendered with the geometry precision of this
+ * build (see Real). Image and render time are saved next to the binary, so
+ * after running the benchmark of a build with the other precision (the
+ * FLOAT_PRECISION option) the image difference and the speedup are printed.
+ */
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "Color.h"
+#include "Config.h"
+#include "GeoVec.h"
+#include "Renderer.h"
+#include "WideBvh.h"
+#include "benchmark_info.h"
+
+namespace {
+constexpr int kSamplePerPixel = 16;
+constexpr bool kIsFloat = std::is_same_v<Real, float>;
+
+std::string GetImageFileName(bool is_float) {
+  return is_float ? "precision_float.raw" : "precision_double.raw";
+}
+
+/** Saves render time in seconds followed by RGB values of all pixels*/
+bool SaveImage(const std::string& file_name, double sec,
+               const std::vector<Color>& image) {
+  std::ofstream fout{file_name, std::ios::binary};
+  fout.write(reinterpret_cast<const char*>(&sec), sizeof(sec));
+  for (const Color& col : image) {
+    uint8_t rgb[3] = {col.red, col.green, col.blue};
+    fout.write(reinterpret_cast<const char*>(rgb), sizeof(rgb));
+  }
+  return static_cast<bool>(fout);
+}
+
+/** Loads image saved by SaveImage, false if there is no image of the given
+ * size*/
+bool LoadImage(const std::string& file_name, size_t pixel_num, double& sec,
+               std::vector<Color>& image) {
+  std::ifstream fin{file_name, std::ios::binary};
+  if (!fin.read(reinterpret_cast<char*>(&sec), sizeof(sec))) return false;
+  image.clear();
+  image.reserve(pixel_num);
+  uint8_t rgb[3];
+  while (fin.read(reinterpret_cast<char*>(rgb), sizeof(rgb))) {
+    image.emplace_back(rgb[0], rgb[1], rgb[2]);
+  }
+  return image.size() == pixel_num;
+}
+
+/** Prints mean, root mean square and largest channel difference and part of
+ * changed pixels*/
+void PrintDifference(const std::vector<Color>& lhs,
+                     const std::vector<Color>& rhs) {
+  double diff_sum = 0.0;
+  double square_sum = 0.0;
+  int max_diff = 0;
+  size_t changed_num = 0;
+  for (size_t i = 0; i < lhs.size(); ++i) {
+    int diff[3] = {std::abs(lhs[i].red - rhs[i].red),
+                   std::abs(lhs[i].green - rhs[i].green),
+                   std::abs(lhs[i].blue - rhs[i].blue)};
+    bool is_changed = false;
+    for (int channel : diff) {
+      diff_sum += channel;
+      square_sum += channel * channel;
+      max_diff = std::max(max_diff, channel);
+      is_changed |= channel != 0;
+    }
+    changed_num += is_changed;
+  }
+  double channel_num = 3.0 * lhs.size();
+  std::cout << "Image difference: mean " << diff_sum / channel_num
+            << " per channel, RMSE " << std::sqrt(square_sum / channel_num)
+            << ", max " << max_diff << ", changed pixels "
+            << 100.0 * changed_num / lhs.size() << "%\n";
+}
+}  // namespace
+
+int main() {
+  Config cfg(std::string(BENCHMARK_DIR_PATH) + "../scenes/simple_scene.json");
+  if (!cfg.GetCameraSettings() || !cfg.GetGeneralSettings() ||
+      cfg.GetObjects().empty()) {
+    std::cout << "Config was not parsed correctly\n";
+    return 1;
+  }
+  GeneralSettings general = cfg.GetGeneralSettings().value();
+  general.sample_per_pixel = kSamplePerPixel;
+  general.thread_number = 1;
+  const CameraSettings& camera = cfg.GetCameraSettings().value();
+
+  std::cout << "Geometry precision: " << (kIsFloat ? "float" : "double")
+            << ", vector " << sizeof(GeoVec) << " bytes, wide node "
+            << sizeof(WideBvhNode) << " bytes\n";
+  Renderer renderer{general, camera, cfg.GetObjects()};
+  auto start = std::chrono::steady_clock::now();
+  std::vector<Color> image = renderer.Render();
+  double sec =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+  std::cout << "Render time: " << sec << " s\n";
+  if (!SaveImage(GetImageFileName(kIsFloat), sec, image)) {
+    std::cout << "Unable to save the image\n";
+  }
+
+  double other_sec = 0.0;
+  std::vector<Color> other_image;
+  if (!LoadImage(GetImageFileName(!kIsFloat), image.size(), other_sec,
+                 other_image)) {
+    std::cout << "Run the benchmark built with "
+              << (kIsFloat ? "double" : "float")
+              << " geometry to compare the images\n";
+    return 0;
+  }
+  double double_sec = kIsFloat ? other_sec : sec;
+  double float_sec = kIsFloat ? sec : other_sec;
+  std::cout << "Float speedup over double: " << double_sec / float_sec << '\n';
+  PrintDifference(image, other_image);
+  return 0;
+}
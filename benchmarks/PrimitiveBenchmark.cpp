@@ -0,0 +1,102 @@
+﻿/**
+ * Compares leaf tests through primitive arrays with virtual calls of scene
+ * objects. Both ways traverse the same hierarchy over shuffled spheres and
+ * triangles allocated one by one on the heap, so only the leaf test differs.
+ * Run under "perf stat -e branches,branch-misses,L1-icache-load-misses" to
+ * see the effect on branch prediction and the instruction cache.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <random>
+#include <vector>
+
+#include "Bvh.h"
+#include "BvhNode.h"
+#include "Objects.h"
+#include "Ray.h"
+
+namespace {
+/** Runs rays and returns spent nanoseconds per ray. Sum of distances is
+ * printed, so the compiler cannot drop the loop*/
+template <typename Trace>
+double MeasureNsPerRay(const char* name, const std::vector<Ray>& rays,
+                       Trace&& trace) {
+  auto start = std::chrono::steady_clock::now();
+  double sum = 0.0;
+  size_t hits = 0;
+  for (const Ray& ray : rays) {
+    std::optional<HitRecord> hit = trace(ray);
+    if (!hit) continue;
+    sum += hit->dist;
+    ++hits;
+  }
+  auto end = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(end - start).count() /
+              rays.size();
+  std::cout << name << ":\t" << ns << " ns/ray\t(" << hits << " hits, sum "
+            << sum << ")\n";
+  return ns;
+}
+}  // namespace
+
+int main() {
+  constexpr int kTriangleNum = 200'000;
+  constexpr int kSphereNum = 50'000;
+  constexpr size_t kRayNum = 500'000;
+  std::mt19937 rnd{42};
+  std::uniform_real_distribution<double> coor{-100.0, 100.0};
+  std::uniform_real_distribution<double> shift{-2.0, 2.0};
+  std::uniform_real_distribution<double> radius{0.2, 1.0};
+  std::vector<std::unique_ptr<Object>> storage;
+  for (int i = 0; i < kTriangleNum; ++i) {
+    GeoVec p{coor(rnd), coor(rnd), coor(rnd)};
+    storage.push_back(std::make_unique<Triangle>(
+        p, p + GeoVec{shift(rnd), shift(rnd), shift(rnd)},
+        p + GeoVec{shift(rnd), shift(rnd), shift(rnd)}));
+  }
+  for (int i = 0; i < kSphereNum; ++i) {
+    storage.push_back(std::make_unique<Sphere>(
+        GeoVec{coor(rnd), coor(rnd), coor(rnd)}, radius(rnd)));
+  }
+  // objects are listed in random order of types and heap addresses
+  std::shuffle(storage.begin(), storage.end(), rnd);
+  std::vector<const Object*> objects;
+  for (const auto& el : storage) {
+    objects.push_back(el.get());
+  }
+  Bvh bvh{objects};
+
+  std::vector<Ray> rays;
+  rays.reserve(kRayNum);
+  for (size_t i = 0; i < kRayNum; ++i) {
+    rays.emplace_back(GeoVec{coor(rnd), coor(rnd), coor(rnd)},
+                      GeoVec{coor(rnd), coor(rnd), coor(rnd)});
+  }
+
+  const std::vector<const Object*>& leaf_objects = bvh.GetObjects();
+  double virtual_ns =
+      MeasureNsPerRay("Virtual calls", rays, [&](const Ray& ray) {
+        HitRecord closest{std::numeric_limits<Real>::max(), nullptr};
+        TraverseBvh(bvh.GetNodes(), ray, closest.dist,
+                    [&](uint32_t first, uint32_t num) {
+                      for (uint32_t i = first; i < first + num; ++i) {
+                        std::optional<Real> dist =
+                            leaf_objects[i]->GetClosesDist(ray);
+                        if (dist && *dist < closest.dist) {
+                          closest = {*dist, leaf_objects[i]};
+                        }
+                      }
+                    });
+        return closest.obj ? std::optional<HitRecord>{closest} : std::nullopt;
+      });
+  double arrays_ns = MeasureNsPerRay(
+      "Primitive arrays", rays,
+      [&](const Ray& ray) { return bvh.GetClosestHit(ray); });
+  std::cout << "Speedup: " << virtual_ns / arrays_ns << '\n';
+  return 0;
+}
@@ -0,0 +1,86 @@
+﻿/**
+ * Measures primary visibility throughput of the simple scene: every sample
+ * traces only the camera ray, which is traced alone or in packets of 4x4 and
+ * 8x8 neighbouring pixels. Images of all modes should be equal. The scene is
+ * measured as is and with small spheres added inside the room, where the
+ * traversal takes a larger part of the time.
+ */
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Color.h"
+#include "Config.h"
+#include "Objects.h"
+#include "Renderer.h"
+#include "benchmark_info.h"
+
+namespace {
+constexpr int kSamplePerPixel = 16;
+constexpr int kAddedSphereNum = 10'000;
+
+/** Renders the objects with every accelerator which supports packets and
+ * every packet side, prints camera rays per second*/
+void MeasureScene(const std::string& scene_name,
+                  const std::vector<const Object*>& objects,
+                  GeneralSettings general, const CameraSettings& camera) {
+  general.sample_per_pixel = kSamplePerPixel;
+  general.max_bounce_number = 1;
+  general.thread_number = 1;
+  double ray_num = static_cast<double>(general.pic_width_in_pixel) *
+                   general.pic_height_in_pixel * kSamplePerPixel;
+  std::vector<std::pair<AcceleratorType, std::string>> accelerators{
+      {AcceleratorType::kBvh, "BVH"}, {AcceleratorType::kWideBvh, "WIDE_BVH"}};
+  for (const auto& [type, name] : accelerators) {
+    general.accelerator = type;
+    std::vector<Color> single_image;
+    double single_rate = 0.0;
+    for (int side : {0, 4, kMaxRayPacketSide}) {
+      general.ray_packet_side = side;
+      Renderer renderer{general, camera, objects};
+      auto start = std::chrono::steady_clock::now();
+      std::vector<Color> image = renderer.Render();
+      double sec = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+      double rate = ray_num / sec / 1e6;
+      if (!side) {
+        single_image = image;
+        single_rate = rate;
+      }
+      std::cout << scene_name << ", " << name << ", packet side " << side
+                << ":\t" << rate << " Mrays/s\tspeedup " << rate / single_rate
+                << (image == single_image ? "" : "\tIMAGE DIFFERS") << '\n';
+    }
+  }
+}
+}  // namespace
+
+int main() {
+  Config cfg(std::string(BENCHMARK_DIR_PATH) + "../scenes/simple_scene.json");
+  if (!cfg.GetCameraSettings() || !cfg.GetGeneralSettings() ||
+      cfg.GetObjects().empty()) {
+    std::cout << "Config was not parsed correctly\n";
+    return 1;
+  }
+  const GeneralSettings& general = cfg.GetGeneralSettings().value();
+  const CameraSettings& camera = cfg.GetCameraSettings().value();
+  std::vector<const Object*> objects = cfg.GetObjects();
+  MeasureScene("Simple scene", objects, general, camera);
+
+  std::vector<std::unique_ptr<Sphere>> spheres;
+  std::mt19937 rnd{42};
+  std::uniform_real_distribution<double> part{0.0, 1.0};
+  for (int i = 0; i < kAddedSphereNum; ++i) {
+    spheres.push_back(std::make_unique<Sphere>(
+        GeoVec{600 * part(rnd), 400 * part(rnd), 100 + 300 * part(rnd)}, 2.0));
+    spheres.back()->SetMaterial(Material::kReflective);
+    objects.push_back(spheres.back().get());
+  }
+  MeasureScene("With spheres", objects, general, camera);
+  return 0;
+}
@@ -0,0 +1,44 @@
+﻿#include <chrono>
+#include <iostream>
+#include <random>
+
+#include "Sampler.h"
+
+namespace {
+/** Draws values by the given generator and returns spent nanoseconds per
+ * value. Sum is printed, so the compiler cannot drop the loop*/
+template <typename Generator>
+double MeasureNsPerValue(const char* name, size_t num, Generator&& gen) {
+  auto start = std::chrono::steady_clock::now();
+  double sum = 0.0;
+  for (size_t i = 0; i < num; ++i) {
+    sum += gen(i);
+  }
+  auto end = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(end - start).count();
+  std::cout << name << ":\t" << ns / num << " ns/value\t(sum " << sum
+            << ")\n";
+  return ns / num;
+}
+}  // namespace
+
+int main() {
+  constexpr size_t kValueNum = 100'000'000;
+  constexpr size_t kDimPerBounce = 4;
+
+  std::mt19937 rnd{42};
+  std::uniform_real_distribution<double> dist{0.0, 1.0};
+  double mt_ns = MeasureNsPerValue(
+      "mt19937 + uniform_real_distribution", kValueNum,
+      [&](size_t /*i*/) { return dist(rnd); });
+
+  Sampler sampler{42};
+  double sampler_ns = MeasureNsPerValue(
+      "Sampler (pixel, sample, bounce, dim)", kValueNum, [&](size_t i) {
+        // typical pattern - new bounce every few dimensions
+        if (i % kDimPerBounce == 0) sampler.StartBounce(i / kDimPerBounce);
+        return sampler.Get1D();
+      });
+  std::cout << "Speedup: " << mt_ns / sampler_ns << '\n';
+  return 0;
+}
@@ -0,0 +1,84 @@
+﻿/**
+ * Compares closest hit search over spheres stored as separate objects of a
+ * BVH with the same spheres stored as one sphere set, whose leaves are
+ * tested in SIMD batches. Spheres fill a cube with the same density for
+ * every count, rays start inside the cube in random directions.
+ */
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <vector>
+
+#include "Accelerator.h"
+#include "Bvh.h"
+#include "Objects.h"
+#include "Ray.h"
+#include "SphereSet.h"
+#include "SpherePacket.h"
+
+namespace {
+constexpr size_t kRayNum = 200'000;
+
+/** Traces every ray and returns spent nanoseconds per ray*/
+template <typename Trace>
+double MeasureNsPerRay(const std::vector<Ray>& rays, Trace&& trace,
+                       size_t& hit_num) {
+  hit_num = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (const Ray& ray : rays) {
+    hit_num += trace(ray);
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+         rays.size();
+}
+}  // namespace
+
+int main() {
+  std::cout << kSpherePacketWidth << " spheres per leaf batch, "
+            << vec_math::Pack<Real>::kWidth << " lanes per register\n";
+  std::mt19937 rnd{42};
+  std::uniform_real_distribution<double> radius{0.2, 1.0};
+  std::uniform_real_distribution<double> unit{-1.0, 1.0};
+  for (size_t sphere_num : {1'000, 10'000, 100'000, 1'000'000}) {
+    double half_side = 2.0 * std::cbrt(static_cast<double>(sphere_num));
+    std::vector<GeoVec> centers;
+    std::vector<Real> radii;
+    std::vector<std::unique_ptr<Object>> storage;
+    std::vector<const Object*> objects;
+    for (size_t i = 0; i < sphere_num; ++i) {
+      centers.push_back(GeoVec{unit(rnd), unit(rnd), unit(rnd)} * half_side);
+      radii.push_back(radius(rnd));
+      storage.push_back(std::make_unique<Sphere>(centers[i], radii[i]));
+      objects.push_back(storage.back().get());
+    }
+    std::vector<Ray> rays;
+    rays.reserve(kRayNum);
+    for (size_t i = 0; i < kRayNum; ++i) {
+      rays.emplace_back(GeoVec{unit(rnd), unit(rnd), unit(rnd)} * half_side,
+                        GeoVec{unit(rnd), unit(rnd), unit(rnd)});
+    }
+
+    Bvh bvh{objects};
+    SphereSet set{centers, radii};
+    size_t object_hits = 0;
+    double object_ns = MeasureNsPerRay(
+        rays,
+        [&](const Ray& ray) { return bvh.GetClosestHit(ray).has_value(); },
+        object_hits);
+    size_t set_hits = 0;
+    double set_ns = MeasureNsPerRay(
+        rays,
+        [&](const Ray& ray) { return set.GetClosesDist(ray).has_value(); },
+        set_hits);
+    std::cout << sphere_num << " spheres:\tobjects " << object_ns
+              << " ns\tset " << set_ns << " ns\tspeedup "
+              << object_ns / set_ns << "\thits " << set_hits << " / "
+              << object_hits << "\tset memory "
+              << set.GetMemorySize() / 1024 << " KiB\n";
+  }
+  return 0;
+}
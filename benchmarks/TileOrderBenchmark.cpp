@@ -0,0 +1,68 @@
+﻿/**
+ * Renders the triangle scene with every tile order. Each order is written to
+ * its own TileOrderBenchmark_<order>.txt file.
+ *
+ * To see the cache effect run one order at a time under perf, e.g.
+ *   perf stat -e L1-dcache-loads,L1-dcache-load-misses,l2_rqsts.references,\
+ *   l2_rqsts.miss ./bench_tile_order hilbert
+ * Cache events need access to hardware counters, virtual machines often
+ * do not expose them and only durations are comparable there.
+ */
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "BenchmarkBase.h"
+#include "Color.h"
+#include "Config.h"
+#include "Renderer.h"
+#include "benchmark_info.h"
+
+class TileOrderBenchmark : public BenchmarkBase {
+ public:
+  TileOrderBenchmark(TileOrder order, const std::string& order_name)
+      : BenchmarkBase(BENCHMARK_DIR_PATH, "TileOrderBenchmark_" + order_name),
+        order_(order) {}
+
+  void MkPicture() override {
+    // mesh descriptions are referenced relative to the scene directory
+    std::filesystem::path prev_dir = std::filesystem::current_path();
+    std::filesystem::current_path(GetPath() + "../scenes/triangle_simple_scenes");
+    Config cfg("scene_with_lamp.json");
+    std::filesystem::current_path(prev_dir);
+    if (!cfg.GetCameraSettings() || !cfg.GetGeneralSettings() ||
+        cfg.GetObjects().empty()) {
+      std::cout << "Config was not parsed correctly\n";
+      return;
+    }
+    GeneralSettings cfg_general = cfg.GetGeneralSettings().value();
+    cfg_general.sample_per_pixel = kSamplePerPixel;
+    cfg_general.tile_order = order_;
+    Renderer renderer{cfg_general, cfg.GetCameraSettings().value(),
+                      cfg.GetObjects()};
+    std::vector<Color> col_vec = renderer.Render();
+    std::cout << GetName() << ": " << col_vec.size() << " pixels\n";
+  }
+
+ private:
+  static constexpr int kSamplePerPixel = 4;
+  TileOrder order_;
+};
+
+int main(int argc, char* argv[]) {
+  std::vector<std::pair<TileOrder, std::string>> orders{
+      {TileOrder::kScanline, "scanline"},
+      {TileOrder::kMorton, "morton"},
+      {TileOrder::kHilbert, "hilbert"}};
+  std::string selected = argc > 1 ? argv[1] : "";
+  for (const auto& [order, name] : orders) {
+    if (!selected.empty() && selected != name) continue;
+    TileOrderBenchmark bench{order, name};
+    bench.SetGitBranch(CURRENT_GIT_BRANCH)
+        .SetGitCommit(CURRENT_GIT_COMMIT)
+        .SetCompilerInfo(COMPILER_INFO);
+    bench.MkPicture();
+  }
+  return 0;
+}
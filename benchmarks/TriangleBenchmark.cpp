@@ -0,0 +1,201 @@
+﻿/**
+ * Compares the watertight triangle test with the previous point in triangle
+ * check done in the triangle basis. Time per test is measured for leaf sized
+ * groups of triangles hit by the same ray. Rays aimed at edges shared by two
+ * triangles count how often they pass between the triangles.
+ */
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <vector>
+
+#include "Matrix.h"
+#include "Objects.h"
+#include "Ray.h"
+
+namespace {
+/** Copy of the triangle test which was used before the watertight one*/
+class BasisTriangle {
+ public:
+  BasisTriangle(const GeoVec& p0, const GeoVec& p1, const GeoVec& p2) {
+    GeoVec x{p0, p1};
+    GeoVec z = x.Cross({p0, p2});
+    norm_ = z;
+    norm_.Norm();
+    d_ = -norm_.Dot(p0);
+    conversion_ = GetReverse3x3(Matrix3x3{x, z.Cross(x), z});
+    std::array<GeoVec, 3> x_sorted{ApplyToVec(conversion_, p0),
+                                   ApplyToVec(conversion_, p1),
+                                   ApplyToVec(conversion_, p2)};
+    std::array<GeoVec, 3> y_sorted = x_sorted;
+    auto by_x = [](const auto& lhs, const auto& rhs) { return lhs.x_ < rhs.x_; };
+    auto by_y = [](const auto& lhs, const auto& rhs) { return lhs.y_ < rhs.y_; };
+    std::sort(y_sorted.begin(), y_sorted.end(), by_y);
+    Matrix3x3 shear{{1, 0, 0},
+                    {-(y_sorted[2].x_ - y_sorted[0].x_) /
+                         (y_sorted[2].y_ - y_sorted[0].y_),
+                     1, 0},
+                    {0, 0, 1}};
+    for (auto& el : x_sorted) el = ApplyToVec(shear, el);
+    for (auto& el : y_sorted) el = ApplyToVec(shear, el);
+    std::sort(x_sorted.begin(), x_sorted.end(), by_x);
+    conversion_ = shear * conversion_;
+    x_min_ = x_sorted[0].x_;
+    x_max_ = x_sorted[2].x_;
+    y_sorted_ = y_sorted;
+    k_min_mid_ = (y_sorted[1].y_ - y_sorted[0].y_) /
+                 (y_sorted[1].x_ - y_sorted[0].x_);
+    b_min_mid_ = y_sorted[1].y_ - k_min_mid_ * y_sorted[1].x_;
+    k_mid_max_ = (y_sorted[2].y_ - y_sorted[1].y_) /
+                 (y_sorted[2].x_ - y_sorted[1].x_);
+    b_mid_max_ = y_sorted[2].y_ - k_mid_max_ * y_sorted[2].x_;
+  }
+
+  std::optional<double> GetClosesDist(const Ray& ray) const {
+    double den = ray.GetDir().Dot(norm_);
+    if (den >= 0) return std::nullopt;
+    double t = -(d_ + ray.GetPos().Dot(norm_)) / den;
+    if (t <= 0) return std::nullopt;
+    GeoVec point = ray.GetPos() + t * ray.GetDir();
+    double x = TransformXCoor(conversion_, point);
+    double y = TransformYCoor(conversion_, point);
+    if (x < x_min_ || x > x_max_ || y < y_sorted_[0].y_ ||
+        y > y_sorted_[2].y_) {
+      return std::nullopt;
+    }
+    bool inside = y < y_sorted_[1].y_ ? k_min_mid_ * x + b_min_mid_ < y
+                                      : k_mid_max_ * x + b_mid_max_ > y;
+    if (!inside) return std::nullopt;
+    return t;
+  }
+
+ private:
+  GeoVec norm_;
+  double d_;
+  Matrix3x3 conversion_;
+  std::array<GeoVec, 3> y_sorted_;
+  double x_min_;
+  double x_max_;
+  double k_min_mid_;
+  double b_min_mid_;
+  double k_mid_max_;
+  double b_mid_max_;
+};
+
+/** Runs every ray against every triangle of its group and returns spent
+ * nanoseconds per test. Sum of distances is printed, so the compiler cannot
+ * drop the loop*/
+template <typename Test>
+double MeasureNsPerTest(const char* name, size_t group_size,
+                        const std::vector<Ray>& rays, Test&& test) {
+  auto start = std::chrono::steady_clock::now();
+  double sum = 0.0;
+  size_t hits = 0;
+  for (size_t i = 0; i < rays.size(); ++i) {
+    test(rays[i], i, sum, hits);
+  }
+  auto end = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(end - start).count() /
+              (rays.size() * group_size);
+  std::cout << name << ":\t" << ns << " ns/test\t(" << hits << " hits, sum "
+            << sum << ")\n";
+  return ns;
+}
+}  // namespace
+
+int main() {
+  constexpr size_t kGroupSize = 16;
+  constexpr size_t kGroupNum = 1024;
+  constexpr size_t kRayNum = 1'000'000;
+  std::mt19937 rnd{42};
+  std::uniform_real_distribution<double> coor{-1.0, 1.0};
+  std::uniform_real_distribution<double> shift{-0.3, 0.3};
+  std::uniform_int_distribution<size_t> group_idx{0, kGroupNum - 1};
+
+  std::vector<Triangle> triangles;
+  std::vector<BasisTriangle> basis_triangles;
+  triangles.reserve(kGroupSize * kGroupNum);
+  basis_triangles.reserve(kGroupSize * kGroupNum);
+  std::vector<GeoVec> group_centers;
+  for (size_t g = 0; g < kGroupNum; ++g) {
+    GeoVec center{coor(rnd), coor(rnd), coor(rnd)};
+    group_centers.push_back(center);
+    for (size_t i = 0; i < kGroupSize; ++i) {
+      GeoVec p0 = center + GeoVec{shift(rnd), shift(rnd), shift(rnd)};
+      GeoVec p1 = center + GeoVec{shift(rnd), shift(rnd), shift(rnd)};
+      GeoVec p2 = center + GeoVec{shift(rnd), shift(rnd), shift(rnd)};
+      triangles.emplace_back(p0, p1, p2);
+      basis_triangles.emplace_back(p0, p1, p2);
+    }
+  }
+  // every ray goes through the center of its group
+  std::vector<Ray> rays;
+  std::vector<size_t> ray_groups;
+  rays.reserve(kRayNum);
+  for (size_t i = 0; i < kRayNum; ++i) {
+    size_t g = group_idx(rnd);
+    GeoVec pos = 5.0 * GeoVec{coor(rnd), coor(rnd), coor(rnd)};
+    rays.emplace_back(pos, group_centers[g] - pos);
+    ray_groups.push_back(g);
+  }
+
+  std::cout << "Bytes per triangle: " << sizeof(Triangle)
+            << ", previous test " << sizeof(Object) + sizeof(BasisTriangle)
+            << '\n';
+  auto count = [](const std::optional<double>& dist, double& sum,
+                  size_t& hits) {
+    if (!dist) return;
+    sum += *dist;
+    ++hits;
+  };
+  double basis_ns = MeasureNsPerTest(
+      "Basis check", kGroupSize, rays,
+      [&](const Ray& ray, size_t i, double& sum, size_t& hits) {
+        const BasisTriangle* group =
+            &basis_triangles[ray_groups[i] * kGroupSize];
+        for (size_t t = 0; t < kGroupSize; ++t) {
+          count(group[t].GetClosesDist(ray), sum, hits);
+        }
+      });
+  double watertight_ns = MeasureNsPerTest(
+      "Watertight test", kGroupSize, rays,
+      [&](const Ray& ray, size_t i, double& sum, size_t& hits) {
+        const Triangle* group = &triangles[ray_groups[i] * kGroupSize];
+        for (size_t t = 0; t < kGroupSize; ++t) {
+          count(group[t].GetClosesDist(ray), sum, hits);
+        }
+      });
+  std::cout << "Speedup: " << basis_ns / watertight_ns << '\n';
+
+  // pairs of triangles sharing an edge, rays aim at points of the edge
+  size_t basis_leaks = 0;
+  size_t watertight_leaks = 0;
+  std::uniform_real_distribution<double> along{0.0, 1.0};
+  for (size_t i = 0; i < kRayNum; ++i) {
+    GeoVec a{coor(rnd), coor(rnd), coor(rnd)};
+    GeoVec b{coor(rnd), coor(rnd), coor(rnd)};
+    GeoVec c{coor(rnd), coor(rnd), coor(rnd)};
+    // fourth point is on the other side of the edge, in the same plane
+    GeoVec d = a + b - c;
+    GeoVec target = a + along(rnd) * (b - a);
+    GeoVec norm = GeoVec{a, b}.Cross({a, c});
+    GeoVec pos = target + GeoVec{coor(rnd), coor(rnd), coor(rnd)} +
+                 3.0 * norm / norm.Len();
+    Ray ray{pos, target - pos};
+    if (!BasisTriangle(a, b, c).GetClosesDist(ray) &&
+        !BasisTriangle(b, a, d).GetClosesDist(ray)) {
+      ++basis_leaks;
+    }
+    if (!Triangle(a, b, c).GetClosesDist(ray) &&
+        !Triangle(b, a, d).GetClosesDist(ray)) {
+      ++watertight_leaks;
+    }
+  }
+  std::cout << "Rays through shared edges: " << kRayNum
+            << ", passed between triangles with basis check " << basis_leaks
+            << ", with watertight test " << watertight_leaks << '\n';
+  return 0;
+}
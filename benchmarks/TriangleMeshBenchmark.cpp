@@ -0,0 +1,124 @@
+﻿/**
+ * Compares a grid surface of about a million faces stored as separate
+ * triangle objects in the scene hierarchy with the same surface stored as
+ * one triangle mesh. Memory of objects and hierarchies and time per ray are
+ * printed.
+ */
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <vector>
+
+#include "Accelerator.h"
+#include "Objects.h"
+#include "Ray.h"
+#include "TriangleMesh.h"
+
+namespace {
+/** Runs rays and returns spent nanoseconds per ray. Sum of distances is
+ * printed, so the compiler cannot drop the loop*/
+template <typename Trace>
+double MeasureNsPerRay(const char* name, const std::vector<Ray>& rays,
+                       Trace&& trace) {
+  auto start = std::chrono::steady_clock::now();
+  double sum = 0.0;
+  size_t hits = 0;
+  for (const Ray& ray : rays) {
+    std::optional<double> dist = trace(ray);
+    if (!dist) continue;
+    sum += *dist;
+    ++hits;
+  }
+  auto end = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(end - start).count() /
+              rays.size();
+  std::cout << name << ":\t" << ns << " ns/ray\t(" << hits << " hits, sum "
+            << sum << ")\n";
+  return ns;
+}
+
+double ToMb(size_t bytes) { return bytes / (1024.0 * 1024.0); }
+}  // namespace
+
+int main() {
+  constexpr uint32_t kSide = 708;
+  constexpr size_t kRayNum = 200'000;
+  // wavy height field, neighbouring faces share grid points
+  std::vector<GeoVec> points;
+  points.reserve((kSide + 1) * (kSide + 1));
+  for (uint32_t y = 0; y <= kSide; ++y) {
+    for (uint32_t x = 0; x <= kSide; ++x) {
+      double height = 5.0 * std::sin(0.05 * x) * std::cos(0.03 * y);
+      points.push_back(
+          {static_cast<double>(x), static_cast<double>(y), height});
+    }
+  }
+  std::vector<TriangleMesh::Face> faces;
+  faces.reserve(2 * kSide * kSide);
+  for (uint32_t y = 0; y < kSide; ++y) {
+    for (uint32_t x = 0; x < kSide; ++x) {
+      uint32_t p = y * (kSide + 1) + x;
+      faces.push_back({p, p + 1, p + kSide + 2});
+      faces.push_back({p, p + kSide + 2, p + kSide + 1});
+    }
+  }
+  std::cout << "Faces: " << faces.size() << '\n';
+
+  std::vector<std::unique_ptr<Triangle>> triangles;
+  std::vector<const Object*> objects;
+  triangles.reserve(faces.size());
+  objects.reserve(faces.size());
+  for (const auto& f : faces) {
+    triangles.push_back(
+        std::make_unique<Triangle>(points[f[0]], points[f[1]], points[f[2]]));
+    objects.push_back(triangles.back().get());
+  }
+  auto start = std::chrono::steady_clock::now();
+  std::unique_ptr<Accelerator> bvh =
+      CreateAccelerator(AcceleratorType::kBvh, objects);
+  double bvh_build = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+  start = std::chrono::steady_clock::now();
+  TriangleMesh mesh{points, faces};
+  double mesh_build = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+  size_t triangles_size = triangles.size() * sizeof(Triangle) +
+                          objects.capacity() * sizeof(const Object*) +
+                          bvh->GetMemorySize();
+  std::cout << "Separate triangles: " << ToMb(triangles_size) << " MB ("
+            << sizeof(Triangle) << " bytes per triangle), build " << bvh_build
+            << " s\n";
+  std::cout << "Triangle mesh: " << ToMb(mesh.GetMemorySize()) << " MB ("
+            << mesh.GetVertexNumber() << " vertices), build " << mesh_build
+            << " s\n";
+
+  // rays from above the surface to random points of it
+  std::mt19937 rnd{42};
+  std::uniform_real_distribution<double> coor{0.0, kSide};
+  std::uniform_real_distribution<double> spread{-100.0, 100.0};
+  std::vector<Ray> rays;
+  rays.reserve(kRayNum);
+  for (size_t i = 0; i < kRayNum; ++i) {
+    GeoVec target{coor(rnd), coor(rnd), 0.0};
+    GeoVec pos = target + GeoVec{spread(rnd), spread(rnd), 50.0};
+    rays.emplace_back(pos, target - pos);
+  }
+  double triangles_ns =
+      MeasureNsPerRay("Separate triangles", rays, [&](const Ray& ray) {
+        std::optional<HitRecord> hit = bvh->GetClosestHit(ray);
+        return hit ? std::optional<double>(hit->dist) : std::nullopt;
+      });
+  double mesh_ns =
+      MeasureNsPerRay("Triangle mesh", rays,
+                      [&](const Ray& ray) { return mesh.GetClosesDist(ray); });
+  std::cout << "Memory ratio: "
+            << static_cast<double>(triangles_size) / mesh.GetMemorySize()
+            << ", speedup: " << triangles_ns / mesh_ns << '\n';
+  return 0;
+}
@@ -0,0 +1,120 @@
+﻿/**
+ * Compares the SIMD test of one ray against a leaf of 4 triangles with
+ * testing the same triangles one by one through Triangle::GetClosesDist.
+ * Triangles of a leaf are stored as indices into arrays of vertex
+ * coordinates, as in meshes. As during traversal, every ray is tested against
+ * several leaves, only one of which lies on its way.
+ */
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <random>
+#include <vector>
+
+#include "Objects.h"
+#include "Ray.h"
+#include "TrianglePacket.h"
+
+namespace {
+constexpr uint32_t kLeavesPerRay = 16;
+
+/** Runs every ray against its leaves and returns spent nanoseconds per leaf.
+ * Sum of distances is printed, so the compiler cannot drop the loop*/
+template <typename Test>
+double MeasureNsPerLeaf(const char* name, const std::vector<Ray>& rays,
+                        const std::vector<uint32_t>& ray_leaves, Test&& test) {
+  auto start = std::chrono::steady_clock::now();
+  double sum = 0.0;
+  size_t hits = 0;
+  for (size_t i = 0; i < rays.size(); ++i) {
+    Real dist = std::numeric_limits<Real>::max();
+    bool is_hit = false;
+    for (uint32_t j = 0; j < kLeavesPerRay; ++j) {
+      is_hit |= test(rays[i], ray_leaves[i * kLeavesPerRay + j], dist);
+    }
+    if (is_hit) {
+      sum += dist;
+      ++hits;
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(end - start).count() /
+              (rays.size() * kLeavesPerRay);
+  std::cout << name << ":\t" << ns << " ns/leaf\t(" << hits << " hits, sum "
+            << sum << ")\n";
+  return ns;
+}
+}  // namespace
+
+int main() {
+  constexpr uint32_t kLeafSize = kTrianglePacketWidth;
+  constexpr uint32_t kLeafNum = 4096;
+  constexpr size_t kRayNum = 200'000;
+  std::mt19937 rnd{42};
+  std::uniform_real_distribution<double> coor{-1.0, 1.0};
+  std::uniform_real_distribution<double> shift{-0.3, 0.3};
+  std::uniform_int_distribution<uint32_t> leaf_dist{0, kLeafNum - 1};
+
+  std::vector<Triangle> triangles;
+  std::vector<Real> coors[3];
+  std::vector<uint32_t> vertices[3];
+  std::vector<GeoVec> leaf_centers;
+  for (uint32_t leaf = 0; leaf < kLeafNum; ++leaf) {
+    GeoVec center{coor(rnd), coor(rnd), coor(rnd)};
+    leaf_centers.push_back(center);
+    for (uint32_t i = 0; i < kLeafSize; ++i) {
+      GeoVec p[3];
+      for (int k = 0; k < 3; ++k) {
+        p[k] = center + GeoVec{shift(rnd), shift(rnd), shift(rnd)};
+        vertices[k].push_back(coors[0].size());
+        coors[0].push_back(p[k].x_);
+        coors[1].push_back(p[k].y_);
+        coors[2].push_back(p[k].z_);
+      }
+      triangles.emplace_back(p[0], p[1], p[2]);
+    }
+  }
+  TriangleSoA tris{{coors[0].data(), coors[1].data(), coors[2].data()},
+                   {vertices[0].data(), vertices[1].data(),
+                    vertices[2].data()}};
+  // every ray goes through the center of the first of its leaves
+  std::vector<Ray> rays;
+  std::vector<uint32_t> ray_leaves;
+  rays.reserve(kRayNum);
+  ray_leaves.reserve(kRayNum * kLeavesPerRay);
+  for (size_t i = 0; i < kRayNum; ++i) {
+    uint32_t leaf = leaf_dist(rnd);
+    GeoVec pos = 5.0 * GeoVec{coor(rnd), coor(rnd), coor(rnd)};
+    rays.emplace_back(pos, leaf_centers[leaf] - pos);
+    ray_leaves.push_back(leaf);
+    for (uint32_t j = 1; j < kLeavesPerRay; ++j) {
+      ray_leaves.push_back(leaf_dist(rnd));
+    }
+  }
+
+  double scalar_ns = MeasureNsPerLeaf(
+      "Scalar triangles", rays, ray_leaves,
+      [&](const Ray& ray, uint32_t leaf_idx, Real& dist) {
+        bool is_hit = false;
+        const Triangle* leaf = &triangles[leaf_idx * kLeafSize];
+        for (uint32_t t = 0; t < kLeafSize; ++t) {
+          std::optional<Real> t_dist = leaf[t].GetClosesDist(ray);
+          if (t_dist && *t_dist < dist) {
+            dist = *t_dist;
+            is_hit = true;
+          }
+        }
+        return is_hit;
+      });
+  double packet_ns = MeasureNsPerLeaf(
+      "Triangle packet", rays, ray_leaves,
+      [&](const Ray& ray, uint32_t leaf_idx, Real& dist) {
+        return IntersectTrianglePacket(ray, tris, leaf_idx * kLeafSize,
+                                       kLeafSize, dist)
+            .has_value();
+      });
+  std::cout << "Speedup: " << scalar_ns / packet_ns << '\n';
+  return 0;
+}
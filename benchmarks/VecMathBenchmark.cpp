@@ -0,0 +1,116 @@
+﻿/**
+ * Compares vector math done one vector at a time with the wide types, which
+ * process vec_math::kWideWidth vectors with SIMD lanes. Arrays fit into the
+ * cache and are processed many times, so arithmetic rather than memory is
+ * measured.
+ */
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "GeoVec.h"
+#include "Matrix.h"
+
+namespace {
+constexpr size_t kVecNum = 512;
+constexpr size_t kWideNum = kVecNum / GeoVec8::kWidth;
+constexpr int kRepeatNum = 20000;
+
+/** Runs the operation over all vectors kRepeatNum times and returns spent
+ * nanoseconds per vector. The checksum is printed, so the compiler cannot
+ * drop the loop*/
+template <typename Op>
+double MeasureNsPerVec(const char* name, Op&& op) {
+  auto start = std::chrono::steady_clock::now();
+  double sum = 0.0;
+  for (int rep = 0; rep < kRepeatNum; ++rep) {
+    sum += op();
+  }
+  auto end = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(end - start).count() /
+              (static_cast<double>(kVecNum) * kRepeatNum);
+  std::cout << name << ":\t" << ns << " ns/vector\t(sum " << sum << ")\n";
+  return ns;
+}
+
+void PrintSpeedup(double base_ns, double ns) {
+  std::cout << "Speedup: " << base_ns / ns << "\n\n";
+}
+}  // namespace
+
+int main() {
+  std::mt19937 rnd{42};
+  std::uniform_real_distribution<double> coor{-1.0, 1.0};
+  auto random_vec = [&] { return GeoVec{coor(rnd), coor(rnd), coor(rnd)}; };
+  std::vector<GeoVec> lhs(kVecNum);
+  std::vector<GeoVec> rhs(kVecNum);
+  std::vector<Matrix3x3> matrices(kVecNum);
+  for (size_t i = 0; i < kVecNum; ++i) {
+    lhs[i] = random_vec();
+    rhs[i] = random_vec();
+    matrices[i] = {random_vec(), random_vec(), random_vec()};
+  }
+  std::vector<GeoVec8> wide_lhs;
+  std::vector<GeoVec8> wide_rhs;
+  std::vector<Matrix3x3x8> wide_matrices(kWideNum);
+  for (size_t i = 0; i < kWideNum; ++i) {
+    wide_lhs.emplace_back(lhs.data() + i * GeoVec8::kWidth);
+    wide_rhs.emplace_back(rhs.data() + i * GeoVec8::kWidth);
+    for (size_t j = 0; j < GeoVec8::kWidth; ++j) {
+      wide_matrices[i].Set(j, matrices[i * GeoVec8::kWidth + j]);
+    }
+  }
+  std::vector<GeoVec> out(kVecNum);
+  std::vector<GeoVec8> wide_out(kWideNum);
+  std::vector<Matrix3x3> out_matrices(kVecNum);
+  std::vector<Matrix3x3x8> wide_out_matrices(kWideNum);
+  std::cout << "Vector precision: " << sizeof(Real) * 8 << " bits, "
+            << vec_math::Pack<Real>::kWidth << " SIMD lanes\n\n";
+
+  double scalar = MeasureNsPerVec("Norm scalar", [&] {
+    for (size_t i = 0; i < kVecNum; ++i) {
+      out[i] = lhs[i];
+      out[i].Norm();
+    }
+    return out[kVecNum / 2].x_;
+  });
+  double wide = MeasureNsPerVec("Norm wide", [&] {
+    for (size_t i = 0; i < kWideNum; ++i) {
+      wide_out[i] = wide_lhs[i];
+      wide_out[i].Norm();
+    }
+    return wide_out[kWideNum / 2].x_[0];
+  });
+  PrintSpeedup(scalar, wide);
+
+  scalar = MeasureNsPerVec("Cross scalar", [&] {
+    for (size_t i = 0; i < kVecNum; ++i) {
+      out[i] = lhs[i].Cross(rhs[i]);
+    }
+    return out[kVecNum / 2].x_;
+  });
+  wide = MeasureNsPerVec("Cross wide", [&] {
+    for (size_t i = 0; i < kWideNum; ++i) {
+      wide_out[i] = wide_lhs[i].Cross(wide_rhs[i]);
+    }
+    return wide_out[kWideNum / 2].x_[0];
+  });
+  PrintSpeedup(scalar, wide);
+
+  scalar = MeasureNsPerVec("GetReverse3x3 scalar", [&] {
+    for (size_t i = 0; i < kVecNum; ++i) {
+      out_matrices[i] = GetReverse3x3(matrices[i]);
+    }
+    return out_matrices[kVecNum / 2].c0.x_;
+  });
+  wide = MeasureNsPerVec("GetReverse3x3 wide", [&] {
+    for (size_t i = 0; i < kWideNum; ++i) {
+      wide_out_matrices[i] = GetReverse3x3(wide_matrices[i]);
+    }
+    return wide_out_matrices[kWideNum / 2].c0.x_[0];
+  });
+  PrintSpeedup(scalar, wide);
+  return 0;
+}
@@ -0,0 +1,126 @@
+﻿/**
+ * @file Accelerator.h
+ * Contain interface of structures which speed up search of the object hit by
+ * a ray
+ */
+#ifndef ACCELERATOR_H
+#define ACCELERATOR_H
+
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "ArrayView.h"
+#include "Config.h"
+#include "Objects.h"
+#include "Ray.h"
+#include "RayPacket.h"
+#include "ThreadPool.h"
+
+/** Information about the closest object crossed by a ray*/
+struct HitRecord {
+  Real dist = 0.0;
+  const Object* obj = nullptr;
+};
+
+/**
+ * Interface of acceleration structures. Structure is built once over scene
+ * objects and is immutable afterwards, so it can be shared between render
+ * threads. Objects are not owned and should outlive the structure.
+ */
+class Accelerator {
+ public:
+  /** @return the closest object crossed by the ray or nullopt if ray does not
+   * cross anything*/
+  virtual std::optional<HitRecord> GetClosestHit(const Ray& ray) const = 0;
+  /**
+   * Finds closest hits of several rays, e.g. of camera rays of neighbouring
+   * pixels. Hierarchies trace such coherent rays together as packets, by
+   * default rays are traced one by one.
+   * @param[out] hits - closest hit for every ray, has the size of rays
+   */
+  virtual void GetClosestHits(ArrayView<Ray> rays,
+                              std::optional<HitRecord>* hits) const {
+    for (size_t i = 0; i < rays.size(); ++i) {
+      hits[i] = GetClosestHit(rays[i]);
+    }
+  }
+  /**
+   * Any hit query for visibility checks (shadow rays, ambient occlusion).
+   * Search stops at the first object crossed closer than max_dist and no hit
+   * details are computed. By default the closest hit is found.
+   * @return true if the ray crosses anything closer than max_dist
+   */
+  virtual bool IsOccluded(const Ray& ray, Real max_dist) const {
+    std::optional<HitRecord> hit = GetClosestHit(ray);
+    return hit && hit->dist < max_dist;
+  }
+  /** @return number of bytes allocated by the structure*/
+  virtual size_t GetMemorySize() const = 0;
+  /**
+   * Updates bounds of the structure after objects were moved. Set of objects
+   * should stay the same.
+   * @return false if the structure does not support refit and should be
+   * rebuilt instead
+   */
+  virtual bool Refit() { return false; }
+  /** @return expected cost of tracing a ray by the surface area heuristic,
+   * grows when refitted bounds become loose. 0 if structure does not support
+   * refit*/
+  virtual double GetCost() const { return 0.0; }
+
+  virtual ~Accelerator() = default;
+};
+
+/**
+ * Splits rays into packets and finds closest hits of every packet by
+ * trace_packet(packet_rays, packet, closest). It is called with the closest
+ * hits of rays set to infinite distance and should reduce both closest hits
+ * and max_dist in the packet.
+ * @param[out] hits - closest hit for every ray
+ */
+template <typename TracePacket>
+void TraceRayPackets(ArrayView<Ray> rays, std::optional<HitRecord>* hits,
+                     TracePacket&& trace_packet) {
+  for (size_t first = 0; first < rays.size(); first += RayPacket::kMaxSize) {
+    ArrayView<Ray> part{rays.data() + first,
+                        std::min(RayPacket::kMaxSize, rays.size() - first)};
+    RayPacket packet{part};
+    HitRecord closest[RayPacket::kMaxSize];
+    for (auto& el : closest) el.dist = std::numeric_limits<Real>::max();
+    trace_packet(part, packet, closest);
+    for (size_t i = 0; i < part.size(); ++i) {
+      hits[first + i] =
+          closest[i].obj ? std::optional<HitRecord>{closest[i]} : std::nullopt;
+    }
+  }
+}
+
+/**
+ * Checks visibility between two points, e.g. between a surface point and a
+ * point sampled on a light source. Objects crossed near the end point are
+ * ignored, so the surface which contains it does not hide it. Ray leaves the
+ * start point without offset: surfaces are not crossed by rays leaving them
+ * from the side of their normal
+ * @return true if anything is crossed between the points
+ */
+inline bool IsSegmentOccluded(const Accelerator& accel, const GeoVec& from,
+                              const GeoVec& to) {
+  // part of the segment length left near the end point
+  constexpr Real kEndMargin = ToReal(1e-4);
+  GeoVec dir{from, to};
+  Real len = dir.Len();
+  if (len == 0) return false;
+  return accel.IsOccluded(Ray{from, dir}, len * (1 - kEndMargin));
+}
+
+/** Builds acceleration structure of the given type over the objects. Pool,
+ * if given, is used by structures which support parallel build*/
+std::unique_ptr<Accelerator> CreateAccelerator(
+    AcceleratorType type, std::vector<const Object*> objects,
+    ThreadPool* pool = nullptr);
+
+#endif  // ACCELERATOR_H
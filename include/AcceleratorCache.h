@@ -0,0 +1,65 @@
+﻿/**
+ * @file AcceleratorCache.h
+ * Contain binary cache of built acceleration structures, so later runs over
+ * the same geometry skip the build
+ */
+#ifndef ACCELERATOR_CACHE_H
+#define ACCELERATOR_CACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Accelerator.h"
+#include "Config.h"
+#include "GeoVec.h"
+#include "Objects.h"
+#include "ThreadPool.h"
+#include "TriangleMesh.h"
+
+/** @return hash of the object types, positions and sizes in the given order.
+ * Materials are not hashed, they do not change the structure*/
+uint64_t HashGeometry(const std::vector<const Object*>& objects);
+/**
+ * Saves the structure into the cache file. Objects are stored as indices in
+ * the given list. Only hierarchies (BVH and wide BVH) can be saved.
+ * Meshes keep their hierarchies in their own cache files (see
+ * CreateCachedMesh).
+ * @return false if the structure cannot be saved or file cannot be written
+ */
+bool SaveAccelerator(const std::string& file_name, const Accelerator& accel,
+                     const std::vector<const Object*>& objects);
+/**
+ * Maps the cache file and creates structure which uses nodes directly from
+ * the mapped pages, so processes rendering the same scene share them.
+ * @return nullptr if file is missing, was saved by other version, for other
+ * structure type or for other geometry
+ */
+std::unique_ptr<Accelerator> LoadAccelerator(
+    const std::string& file_name, AcceleratorType type,
+    const std::vector<const Object*>& objects);
+/**
+ * Loads structure from the cache directory if it contains one built over the
+ * same geometry, otherwise builds it and saves into the directory. Empty
+ * directory disables the cache.
+ */
+std::unique_ptr<Accelerator> CreateCachedAccelerator(
+    AcceleratorType type, const std::vector<const Object*>& objects,
+    ThreadPool* pool, const std::string& cache_dir);
+
+/** @return hash of the mesh points and faces, which names its cache file*/
+uint64_t HashMesh(const std::vector<GeoVec>& points,
+                  const std::vector<TriangleMesh::Face>& faces);
+/**
+ * Loads arrays of the mesh from the cache directory if it contains a mesh
+ * built over the same points and faces, otherwise builds the mesh with the
+ * pool and saves its vertices, faces and hierarchy into the directory. Empty
+ * directory disables the cache.
+ */
+std::unique_ptr<TriangleMesh> CreateCachedMesh(
+    const std::vector<GeoVec>& points,
+    const std::vector<TriangleMesh::Face>& faces, ThreadPool* pool,
+    const std::string& cache_dir);
+
+#endif  // ACCELERATOR_CACHE_H
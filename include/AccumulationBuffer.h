@@ -0,0 +1,98 @@
+﻿/**
+ * @file AccumulationBuffer.h
+ * Contain buffer which accumulates traced samples of every pixel
+ */
+#ifndef ACCUMULATION_BUFFER_H
+#define ACCUMULATION_BUFFER_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "Color.h"
+
+/** Sum of all samples traced for one pixel*/
+struct PixelAccum {
+  double red = 0.0;
+  double green = 0.0;
+  double blue = 0.0;
+  uint64_t sample_num = 0;
+
+  /** Adds one traced sample. Empty colors are ignored*/
+  void Add(const Color& col) {
+    if (!col.IsColor()) return;
+    red += col.red;
+    green += col.green;
+    blue += col.blue;
+    ++sample_num;
+  }
+  /** Adds one traced sample with unrounded channels*/
+  void Add(const Radiance& col) {
+    red += col.red;
+    green += col.green;
+    blue += col.blue;
+    ++sample_num;
+  }
+  /** Adds all samples accumulated in other*/
+  void Add(const PixelAccum& other) {
+    red += other.red;
+    green += other.green;
+    blue += other.blue;
+    sample_num += other.sample_num;
+  }
+  /** @return average color of all added samples, black if there are none*/
+  Color GetColor() const {
+    if (!sample_num) return colors::kBlack;
+    double num = static_cast<double>(sample_num);
+    return {static_cast<int64_t>(red / num), static_cast<int64_t>(green / num),
+            static_cast<int64_t>(blue / num)};
+  }
+};
+
+/**
+ * Running sums of samples for every pixel of the picture. Pixels are listed
+ * from left to right, from up to bottom
+ */
+class AccumulationBuffer {
+ public:
+  AccumulationBuffer(int width_in_pixel, int height_in_pixel)
+      : width_(width_in_pixel),
+        height_(height_in_pixel),
+        pixels_(static_cast<size_t>(width_in_pixel) *
+                static_cast<size_t>(height_in_pixel)) {}
+
+  int GetWidth() const { return width_; }
+  int GetHeight() const { return height_; }
+
+  PixelAccum& operator[](size_t idx) { return pixels_[idx]; }
+  const PixelAccum& operator[](size_t idx) const { return pixels_[idx]; }
+  const std::vector<PixelAccum>& GetPixels() const { return pixels_; }
+  /** @return current average color of every pixel*/
+  std::vector<Color> GetColors() const;
+  /**
+   * Saves sums of pixels [pixel_begin, pixel_end) into raw binary file.
+   * Several such files can be combined with AddRaw.
+   * @return false if file cannot be written
+   */
+  bool SaveRaw(const std::string& file_name, size_t pixel_begin,
+               size_t pixel_end) const;
+  /**
+   * Adds sums stored in the raw file to the current ones.
+   * @return false if file cannot be read or it was saved for picture of other
+   * size
+   */
+  bool AddRaw(const std::string& file_name);
+  /** Creates buffer of picture size stored in the raw file and adds its sums.
+   * Returns nullopt if file cannot be read*/
+  static std::optional<AccumulationBuffer> LoadRaw(
+      const std::string& file_name);
+
+ private:
+  int width_ = 0;
+  int height_ = 0;
+  std::vector<PixelAccum> pixels_;
+};
+
+#endif  // ACCUMULATION_BUFFER_H
@@ -0,0 +1,36 @@
+﻿/**
+ * @file ArrayView.h
+ * Contain read only view of elements stored in a vector or in a mapped file
+ */
+#ifndef ARRAY_VIEW_H
+#define ARRAY_VIEW_H
+
+#include <cassert>
+#include <cstdlib>
+#include <vector>
+
+/** Read only view of contiguous elements owned by someone else. View becomes
+ * dangling if the owner reallocates or frees them*/
+template <typename T>
+class ArrayView {
+ public:
+  ArrayView() = default;
+  ArrayView(const T* data, size_t size) : data_(data), size_(size) {}
+  ArrayView(const std::vector<T>& vec) : data_(vec.data()), size_(vec.size()) {}
+
+  const T* begin() const { return data_; }
+  const T* end() const { return data_ + size_; }
+  const T* data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  const T& operator[](size_t idx) const {
+    assert(idx < size_);
+    return data_[idx];
+  }
+
+ private:
+  const T* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+#endif  // ARRAY_VIEW_H
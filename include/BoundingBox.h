@@ -0,0 +1,93 @@
+﻿/**
+ * @file BoundingBox.h
+ * Contain axis aligned bounding box
+ */
+#ifndef BOUNDING_BOX_H
+#define BOUNDING_BOX_H
+
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+#include "GeoVec.h"
+
+/** Axis aligned box. Default box is empty - it contains no points*/
+struct BoundingBox {
+  GeoVec min{std::numeric_limits<Real>::infinity(),
+             std::numeric_limits<Real>::infinity(),
+             std::numeric_limits<Real>::infinity()};
+  GeoVec max{-std::numeric_limits<Real>::infinity(),
+             -std::numeric_limits<Real>::infinity(),
+             -std::numeric_limits<Real>::infinity()};
+
+  constexpr bool IsEmpty() const {
+    return min.x_ > max.x_ || min.y_ > max.y_ || min.z_ > max.z_;
+  }
+  /** Grows box so it contains the given point*/
+  BoundingBox& Extend(const GeoVec& p) {
+    min = {std::min(min.x_, p.x_), std::min(min.y_, p.y_),
+           std::min(min.z_, p.z_)};
+    max = {std::max(max.x_, p.x_), std::max(max.y_, p.y_),
+           std::max(max.z_, p.z_)};
+    return *this;
+  }
+  /** Grows box so it contains the given box*/
+  BoundingBox& Extend(const BoundingBox& other) {
+    if (other.IsEmpty()) return *this;
+    return Extend(other.min).Extend(other.max);
+  }
+  constexpr GeoVec GetCenter() const { return 0.5 * (min + max); }
+  /** @return surface area of the box, 0 for the empty box*/
+  constexpr Real GetSurfaceArea() const {
+    if (IsEmpty()) return 0.0;
+    GeoVec d = max - min;
+    return Real{2} * (d.x_ * d.y_ + d.y_ * d.z_ + d.z_ * d.x_);
+  }
+  /** @return index of the longest axis: 0 - x, 1 - y, 2 - z*/
+  constexpr int GetLongestAxis() const {
+    GeoVec d = max - min;
+    if (d.x_ >= d.y_ && d.x_ >= d.z_) return 0;
+    return d.y_ >= d.z_ ? 1 : 2;
+  }
+  /**
+   * Slab test of the ray given by its start point and inverted direction.
+   * NaN values which appear when ray starts on the box plane and is parallel
+   * to it are ignored by comparisons.
+   * @param[in,out] t_near, t_far - segment of the ray, on return clipped to
+   * the part inside the box
+   * @return false if the segment does not cross the box
+   */
+  bool ClipRay(const GeoVec& pos, const GeoVec& inv_dir, Real& t_near,
+               Real& t_far) const;
+};
+
+/** @return coordinate of the vector along the axis: 0 - x, 1 - y, 2 - z.
+ * Axis may be of any integer type, signed loop counters and unsigned node
+ * fields are both passed without conversion*/
+template <typename Axis>
+inline constexpr Real GetAxis(const GeoVec& v, Axis axis) {
+  static_assert(std::is_integral_v<Axis>);
+  return axis == 0 ? v.x_ : (axis == 1 ? v.y_ : v.z_);
+}
+template <typename Axis>
+inline constexpr Real& GetAxis(GeoVec& v, Axis axis) {
+  static_assert(std::is_integral_v<Axis>);
+  return axis == 0 ? v.x_ : (axis == 1 ? v.y_ : v.z_);
+}
+
+inline bool BoundingBox::ClipRay(const GeoVec& pos, const GeoVec& inv_dir,
+                                 Real& t_near, Real& t_far) const {
+  for (int axis = 0; axis < 3; ++axis) {
+    Real inv = GetAxis(inv_dir, axis);
+    Real origin = GetAxis(pos, axis);
+    Real t0 = (GetAxis(min, axis) - origin) * inv;
+    Real t1 = (GetAxis(max, axis) - origin) * inv;
+    if (inv < 0) std::swap(t0, t1);
+    t_near = t0 > t_near ? t0 : t_near;
+    t_far = t1 < t_far ? t1 : t_far;
+  }
+  return t_near <= t_far;
+}
+
+#endif  // BOUNDING_BOX_H
@@ -0,0 +1,76 @@
+﻿/**
+ * @file Bvh.h
+ * Contain bounding volume hierarchy which speeds up search of the object hit
+ * by a ray
+ */
+#ifndef BVH_H
+#define BVH_H
+
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "Accelerator.h"
+#include "ArrayView.h"
+#include "BoundingBox.h"
+#include "BvhNode.h"
+#include "MappedFile.h"
+#include "Objects.h"
+#include "PrimitiveArrays.h"
+#include "Ray.h"
+#include "ThreadPool.h"
+
+/**
+ * Binary hierarchy of bounding boxes built with the binned surface area
+ * heuristic. Makes search of the closest hit logarithmic in the number of
+ * objects. Objects of a leaf are grouped by their kind (see PrimitiveArrays),
+ * so switch over kinds during leaf test is well predicted. Objects are not
+ * owned and should outlive the hierarchy.
+ */
+class Bvh : public Accelerator {
+ public:
+  /**
+   * Builds hierarchy over the objects. If pool is given, bounds and bins of
+   * the top nodes are computed in parallel and then independent subtrees are
+   * built by separate tasks. Result does not depend on the number of threads.
+   */
+  explicit Bvh(std::vector<const Object*> objects, ThreadPool* pool = nullptr);
+  /** Uses nodes stored in the mapped cache file, file is kept mapped while
+   * the hierarchy exists*/
+  Bvh(std::shared_ptr<const MappedFile> file, ArrayView<BvhNode> nodes,
+      std::vector<const Object*> objects)
+      : node_view_(nodes),
+        file_(std::move(file)),
+        objects_(std::move(objects)),
+        primitives_(objects_) {}
+  Bvh(const Bvh&) = delete;
+  Bvh& operator=(const Bvh&) = delete;
+
+  std::optional<HitRecord> GetClosestHit(const Ray& ray) const override;
+  /** Rays are traced by packets of up to RayPacket::kMaxSize rays*/
+  void GetClosestHits(ArrayView<Ray> rays,
+                      std::optional<HitRecord>* hits) const override;
+  bool IsOccluded(const Ray& ray, Real max_dist) const override;
+  size_t GetMemorySize() const override {
+    return node_view_.size() * sizeof(BvhNode) +
+           objects_.capacity() * sizeof(const Object*) +
+           primitives_.GetMemorySize();
+  }
+  /** Recomputes node boxes bottom up, tree topology is kept*/
+  bool Refit() override;
+  double GetCost() const override;
+
+  ArrayView<BvhNode> GetNodes() const { return node_view_; }
+  /** Objects in the order referenced by leaves*/
+  const std::vector<const Object*>& GetObjects() const { return objects_; }
+
+ private:
+  /** Nodes built by this process, empty if nodes are in the mapped file*/
+  std::vector<BvhNode> nodes_;
+  ArrayView<BvhNode> node_view_;
+  std::shared_ptr<const MappedFile> file_;
+  std::vector<const Object*> objects_;
+  PrimitiveArrays primitives_;
+};
+
+#endif  // BVH_H
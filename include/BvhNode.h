@@ -0,0 +1,164 @@
+﻿/**
+ * @file BvhNode.h
+ * Contain nodes of the binary bounding volume hierarchy together with their
+ * build, traversal and refit, which are shared by hierarchies over scene
+ * objects and over faces of a mesh
+ */
+#ifndef BVH_NODE_H
+#define BVH_NODE_H
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "ArrayView.h"
+#include "BoundingBox.h"
+#include "GeoVec.h"
+#include "Ray.h"
+#include "RayPacket.h"
+#include "ThreadPool.h"
+
+/** Node of the flattened hierarchy. First child of an inner node is stored
+ * right after it*/
+struct BvhNode {
+  BoundingBox box;
+  /** Leaf - index of its first object, inner node - index of its second
+   * child*/
+  uint32_t offset = 0;
+  /** Number of objects in the leaf, 0 for inner nodes*/
+  uint32_t obj_num = 0;
+  /** Axis along which children of the inner node are split*/
+  uint32_t axis = 0;
+};
+
+/** Tag of constructors of composite objects (meshes, sphere sets) which keep
+ * their primitives in the given order and build no hierarchy. Such objects
+ * are never crossed by rays, they only give positions of the next animation
+ * frame to the objects which are rendered*/
+struct NoHierarchy {};
+
+/** Deeper nodes are not split, so traversal stack cannot overflow*/
+inline constexpr size_t kBvhMaxDepth = 60;
+
+/**
+ * Builds nodes of the binary hierarchy (see Bvh) over box_num boxes
+ * @param get_box - returns box by its index, may be called from pool threads
+ * @param[out] order - index of the box for every leaf slot, leaves refer to
+ * ranges of slots
+ * @param leaf_width - number of primitives which leaf test checks at the cost
+ * of one (e.g. with SIMD), leaves of up to this size are preferred then
+ */
+std::vector<BvhNode> BuildBvhNodes(
+    size_t box_num, const std::function<BoundingBox(size_t)>& get_box,
+    ThreadPool* pool, std::vector<uint32_t>& order, size_t leaf_width = 1);
+
+/**
+ * Visits leaves of the hierarchy crossed by the ray closer than max_dist, the
+ * nearer child first
+ * @param test_leaf - called as test_leaf(first_slot, slot_num), should reduce
+ * max_dist when it finds a closer hit, so further nodes are skipped. May
+ * return bool, true stops the traversal (e.g. when any hit is enough)
+ */
+template <typename LeafTest>
+void TraverseBvh(ArrayView<BvhNode> nodes, const Ray& ray, Real& max_dist,
+                 LeafTest&& test_leaf) {
+  if (nodes.empty()) return;
+  const GeoVec& pos = ray.GetPos();
+  const GeoVec& dir = ray.GetDir();
+  GeoVec inv_dir{Real{1} / dir.x_, Real{1} / dir.y_, Real{1} / dir.z_};
+  std::array<uint32_t, kBvhMaxDepth + 1> stack;
+  size_t stack_size = 0;
+  uint32_t node_idx = 0;
+  while (true) {
+    const BvhNode& node = nodes[node_idx];
+    Real t_near = 0.0;
+    Real t_far = max_dist;
+    if (node.box.ClipRay(pos, inv_dir, t_near, t_far)) {
+      if (!node.obj_num) {
+        // visit the child which is closer along the ray first
+        if (GetAxis(dir, node.axis) < 0) {
+          stack[stack_size++] = node_idx + 1;
+          node_idx = node.offset;
+        } else {
+          stack[stack_size++] = node.offset;
+          node_idx = node_idx + 1;
+        }
+        continue;
+      }
+      if constexpr (std::is_same_v<std::invoke_result_t<LeafTest, uint32_t,
+                                                        uint32_t>,
+                                   bool>) {
+        if (test_leaf(node.offset, node.obj_num)) return;
+      } else {
+        test_leaf(node.offset, node.obj_num);
+      }
+    }
+    if (!stack_size) break;
+    node_idx = stack[--stack_size];
+  }
+}
+
+/** Recomputes boxes of the nodes bottom up, leaf_box(slot) should return box
+ * of the primitive in the leaf slot*/
+template <typename LeafBox>
+void RefitBvhNodes(std::vector<BvhNode>& nodes, LeafBox&& leaf_box) {
+  // children are stored after their parent, so going backwards visits them
+  // before the parent
+  for (size_t i = nodes.size(); i-- > 0;) {
+    BvhNode& node = nodes[i];
+    node.box = BoundingBox{};
+    if (node.obj_num) {
+      for (uint32_t slot = node.offset; slot < node.offset + node.obj_num;
+           ++slot) {
+        node.box.Extend(leaf_box(slot));
+      }
+    } else {
+      node.box.Extend(nodes[i + 1].box).Extend(nodes[node.offset].box);
+    }
+  }
+}
+
+/**
+ * Visits leaves of the hierarchy crossed by any active ray of the packet.
+ * Rays share traversal decisions, the child which is nearer for the first
+ * ray entering the node is visited first.
+ * @param test_leaf - called as test_leaf(first_slot, slot_num, rays) with
+ * mask of rays entering the leaf, should reduce max_dist of rays in the
+ * packet when it finds closer hits
+ */
+template <typename LeafTest>
+void TraverseBvhPacket(ArrayView<BvhNode> nodes, RayPacket& packet,
+                       LeafTest&& test_leaf) {
+  if (nodes.empty() || !packet.size) return;
+  struct StackEntry {
+    uint32_t node;
+    uint64_t rays;
+  };
+  std::array<StackEntry, kBvhMaxDepth + 1> stack;
+  size_t stack_size = 0;
+  stack[stack_size++] = {0, packet.GetAllMask()};
+  while (stack_size) {
+    StackEntry entry = stack[--stack_size];
+    const BvhNode& node = nodes[entry.node];
+    Real t_near = 0.0;
+    uint64_t rays = IntersectPacket(node.box, packet, entry.rays, t_near);
+    if (!rays) continue;
+    if (node.obj_num) {
+      test_leaf(node.offset, node.obj_num, rays);
+      continue;
+    }
+    uint32_t first_child = entry.node + 1;
+    uint32_t second_child = node.offset;
+    if (packet.inv_dir[node.axis][GetFirstRay(rays)] < 0) {
+      std::swap(first_child, second_child);
+    }
+    stack[stack_size++] = {second_child, rays};
+    stack[stack_size++] = {first_child, rays};
+  }
+}
+
+#endif  // BVH_NODE_H
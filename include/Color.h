@@ -5,6 +5,7 @@
 #ifndef COLOR_H
 #define COLOR_H
 
+#include <cstdint>
 #include <cstdlib>
 #include <iostream>
 #include <limits>
@@ -73,6 +74,74 @@ struct Color {
   constexpr bool IsColor() const { return is_color == ColorValidity::kYes; }
 };
 
+/**
+ * Color with real channels which are neither clamped nor rounded, e.g.
+ * weighted color of one traced path. Channels of Color are in the same scale
+ */
+struct Radiance {
+  double red = 0.0;
+  double green = 0.0;
+  double blue = 0.0;
+
+  constexpr Radiance() = default;
+  constexpr Radiance(double r, double g, double b)
+      : red(r), green(g), blue(b) {}
+  /** Same channels as the color, empty color gives zero*/
+  constexpr explicit Radiance(const Color& col)
+      : red(col.red), green(col.green), blue(col.blue) {}
+
+  constexpr Radiance& operator+=(const Radiance& other) {
+    red += other.red;
+    green += other.green;
+    blue += other.blue;
+    return *this;
+  }
+  friend constexpr Radiance operator*(double scale, const Radiance& col) {
+    return {scale * col.red, scale * col.green, scale * col.blue};
+  }
+};
+
+/**
+ * Colors of one ray trace from the first hit to the last one. Colors are
+ * truncated by all later colors and by the light source as in
+ * Color::TruncColorsInTrace, but the truncation is kept while the trace
+ * grows: every channel stores only distinct truncated values and their
+ * numbers. So adding a color and finding the color of the trace for a light
+ * source take time which does not depend on the trace length
+ */
+class ColorTrace {
+ public:
+  /** Adds color of the next hit. Empty color is not averaged, but truncates
+   * all previous colors to black as in Color::TruncColorsInTrace*/
+  void Push(const Color& col);
+  /** @return average of the light color and of the trace colors truncated by
+   * it, same as Color::GetAverageColor after Color::TruncColorsInTrace, but
+   * without rounding*/
+  Radiance GetColor(const Color& light) const;
+  /** @return number of not empty colors in the trace*/
+  size_t GetColorNumber() const { return color_num_; }
+
+ private:
+  struct Level {
+    uint8_t value;
+    uint32_t count;
+  };
+  /** Truncated values of one channel, levels ascend from the first hit*/
+  struct Channel {
+    std::vector<Level> levels;
+    uint64_t sum = 0;
+
+    void Push(uint8_t value, bool is_counted);
+    /** @return sum of values truncated by the given one*/
+    uint64_t GetSum(uint8_t trunc_value) const;
+  };
+
+  Channel red_;
+  Channel green_;
+  Channel blue_;
+  uint32_t color_num_ = 0;
+};
+
 inline constexpr bool operator==(const Color& lhs, const Color& rhs) {
   return lhs.red == rhs.red && lhs.blue == rhs.blue && lhs.green == rhs.green;
 }
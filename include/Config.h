@@ -1,6 +1,7 @@
 ﻿#ifndef PATH_TRACER_CONFIG_H
 #define PATH_TRACER_CONFIG_H
 
+#include <cstdint>
 #include <fstream>
 #include <nlohmann/json.hpp>
 #include <optional>
@@ -9,7 +10,10 @@
 
 #include "Color.h"
 #include "GeoVec.h"
+#include "Instance.h"
 #include "Objects.h"
+#include "ThreadPool.h"
+#include "TriangleMesh.h"
 
 struct CameraSettings {
   GeoVec screen_top_left_coor;
@@ -18,17 +22,57 @@ struct CameraSettings {
   double distance_to_screen = 0.0;
 };
 
+/** Order in which pixel blocks and pixels inside a block are traced*/
+enum class TileOrder { kScanline = 0, kMorton, kHilbert };
+/** Structure used to search objects hit by rays*/
+enum class AcceleratorType { kBvh = 0, kWideBvh, kGrid, kKdTree };
+
+/** Camera ray packets of this side have the maximal number of rays which
+ * are traced together (see RayPacket)*/
+inline constexpr int kMaxRayPacketSide = 8;
+
 struct GeneralSettings {
   int sample_per_pixel = 1;
   int max_bounce_number = 1;
   int pic_width_in_pixel = 1;
   int pic_height_in_pixel = 1;
+  /** Number of render threads, 0 - use all hardware threads*/
+  int thread_number = 0;
+  /** Seed of the random numbers used by the render*/
+  uint64_t seed = 0;
+  /** Number of samples per pixel traced in one progressive pass, 0 - trace
+   * all samples in one pass*/
+  int samples_per_pass = 0;
+  /** Minimal time between two intermediate pictures in progressive mode*/
+  double snapshot_interval_in_sec = 0.0;
+  TileOrder tile_order = TileOrder::kHilbert;
+  /** Camera rays of squares of ray_packet_side x ray_packet_side pixels are
+   * traced together as one packet, 0 - trace camera rays one by one. Side
+   * should not exceed kMaxRayPacketSide*/
+  int ray_packet_side = 0;
+  AcceleratorType accelerator = AcceleratorType::kWideBvh;
+  /** Light sources are sampled directly at every diffuse reflection (next
+   * event estimation), see pixel::RenderRay*/
+  bool light_sampling = true;
+  /** In frame sequences the acceleration structure is refitted while its
+   * cost stays below this ratio of the cost after the last build, otherwise
+   * it is rebuilt. 0 - rebuild for every frame*/
+  double refit_cost_ratio = 1.5;
+  /** Directory where built acceleration structures and mesh hierarchies are
+   * cached between runs, empty - do not cache*/
+  std::string accelerator_cache_dir;
   std::string out_file_name;
 };
 
 class Config {
  public:
   Config(const std::string& file_name);
+  /**
+   * Reads config of the next animation frame, which is only passed to
+   * UpdateGeometry. Meshes and sphere sets of the frame get no hierarchies
+   * (see NoHierarchy), so reading it costs a fraction of the full parse.
+   */
+  static Config ReadFrame(const std::string& file_name);
   /**
    * @brief Returns parsed camera settings. If the returned value is not empty,
    * than and parameters are set correctly and there is no need to make some
@@ -49,6 +93,21 @@ class Config {
     }
     return result;
   }
+  /**
+   * Moves objects to positions given in the config of the next animation
+   * frame. Frame should list objects of the same types in the same order,
+   * meshes should have the same faces and sphere sets the same number of
+   * spheres. Instances take transforms of the frame and their shared meshes
+   * take points of the frame meshes once. Pointers from GetObjects stay valid.
+   * @return false if topology of the frame differs, instances of one mesh
+   * use different meshes in the frame or the frame has objects of types which
+   * cannot be moved, nothing is changed then
+   */
+  bool UpdateGeometry(const Config& frame);
+  /** Returns meshes shared by instances listed in GetObjects*/
+  const std::vector<std::unique_ptr<TriangleMesh>>& GetMeshes() const {
+    return meshes_;
+  }
   /**
    * @brief Returns parsed general settings. If the returned value is not empty,
    * than and parameters are set correctly and there is no need to make some
@@ -65,11 +124,21 @@ class Config {
   static std::optional<CameraSettings> ParseCameraSettings(
       const nlohmann::json& input);
 
+  /** Objects of the frame get no hierarchies if build_hierarchies is
+   * false*/
+  Config(const std::string& file_name, bool build_hierarchies);
+
+  /** Meshes placed by instances are stored into meshes. Mesh hierarchies
+   * are built with the pool and cached in cache_dir if it is not empty. Pool
+   * is nullptr if hierarchies are not built*/
   static std::vector<std::unique_ptr<Object>> ParseObjects(
-      const nlohmann::json& input);
+      const nlohmann::json& input,
+      std::vector<std::unique_ptr<TriangleMesh>>& meshes, ThreadPool* pool,
+      const std::string& cache_dir);
 
   std::optional<CameraSettings> camera_settings_;
   std::optional<GeneralSettings> general_settings_;
+  std::vector<std::unique_ptr<TriangleMesh>> meshes_;
   std::vector<std::unique_ptr<Object>> objects_;
 };
 
@@ -9,81 +9,251 @@
 
 #include <cmath>
 #include <limits>
+#include <type_traits>
+
+#include "VecMath.h"
+
 /**
- * Simple realization of an geometrical vector
+ * Scalar type of scene geometry: points, directions, boxes and distances.
+ * Double by default, the FLOAT_PRECISION build option (PATH_TRACER_FLOAT
+ * definition) switches it to float, which halves memory of meshes and
+ * hierarchies and doubles the number of SIMD lanes. Colors and sampling stay
+ * in double in both modes
  */
-struct GeoVec {
-  double x_ = std::numeric_limits<double>::quiet_NaN();
-  double y_ = std::numeric_limits<double>::quiet_NaN();
-  double z_ = std::numeric_limits<double>::quiet_NaN();
+#ifdef PATH_TRACER_FLOAT
+using Real = float;
+#else
+using Real = double;
+#endif
+
+/** @return value promoted to double, explicitly for float and without a cast
+ * for double, so neither precision warns about promotions or useless casts*/
+constexpr double ToDouble(float val) { return static_cast<double>(val); }
+constexpr double ToDouble(double val) { return val; }
+
+/** @return value rounded to Real, which is a no-op for double geometry*/
+#ifdef PATH_TRACER_FLOAT
+constexpr Real ToReal(double val) { return static_cast<Real>(val); }
+#else
+constexpr Real ToReal(double val) { return val; }
+#endif
+
+/**
+ * Simple realization of an geometrical vector. Operations on one vector are
+ * scalar: three coordinates fill a register only partially and packing them
+ * costs more than the saved instructions, batches should use BasicGeoVec8
+ */
+template <typename T>
+struct BasicGeoVec {
+  static_assert(std::is_floating_point_v<T>);
+
+  T x_ = std::numeric_limits<T>::quiet_NaN();
+  T y_ = std::numeric_limits<T>::quiet_NaN();
+  T z_ = std::numeric_limits<T>::quiet_NaN();
 
   /** By defaul all coordinate values are NaN*/
-  constexpr GeoVec() = default;
-  /** Creates vector using passed coordinate values*/
-  constexpr GeoVec(double x, double y, double z) : x_(x), y_(y), z_(z) {}
+  constexpr BasicGeoVec() = default;
+  /** Creates vector using passed coordinate values, they are rounded to the
+   * vector precision*/
+  template <typename X, typename Y, typename Z,
+            typename = std::enable_if_t<std::is_arithmetic_v<X> &&
+                                        std::is_arithmetic_v<Y> &&
+                                        std::is_arithmetic_v<Z>>>
+  constexpr BasicGeoVec(X x, Y y, Z z)
+      : x_(static_cast<T>(x)), y_(static_cast<T>(y)), z_(static_cast<T>(z)) {}
+  /** Converts vector of other precision*/
+  template <typename U>
+  constexpr explicit BasicGeoVec(const BasicGeoVec<U>& other)
+      : BasicGeoVec(other.x_, other.y_, other.z_) {}
   /** Creates vector connecting two points - start and end*/
-  constexpr GeoVec(const GeoVec& start, const GeoVec& end) {
+  constexpr BasicGeoVec(const BasicGeoVec& start, const BasicGeoVec& end) {
     x_ = end.x_ - start.x_;
     y_ = end.y_ - start.y_;
     z_ = end.z_ - start.z_;
   }
   /** @return length of the vector*/
-  double Len() const { return std::sqrt(x_ * x_ + y_ * y_ + z_ * z_); }
+  T Len() const { return std::sqrt(x_ * x_ + y_ * y_ + z_ * z_); }
   /** Normalizes current vector to have length equal to 1*/
-  GeoVec& Norm() {
+  BasicGeoVec& Norm() {
     assert(Len() != 0);
-    double mult = 1.0 / Len();
+    T mult = T{1} / Len();
     x_ *= mult;
     y_ *= mult;
     z_ *= mult;
     return *this;
   }
   /** @return dot prodact of current vector and the given one*/
-  constexpr double Dot(const GeoVec& other) const {
+  constexpr T Dot(const BasicGeoVec& other) const {
     return other.x_ * x_ + other.y_ * y_ + other.z_ * z_;
   }
   /** @return cross product between current vector and the given one*/
-  constexpr GeoVec Cross(const GeoVec& other) const {
+  constexpr BasicGeoVec Cross(const BasicGeoVec& other) const {
     return {y_ * other.z_ - z_ * other.y_, z_ * other.x_ - x_ * other.z_,
             x_ * other.y_ - y_ * other.x_};
   }
+
+  // operators are found by argument dependent lookup only, so scalars of
+  // other types are converted to T as for the ordinary functions
+  friend constexpr BasicGeoVec operator/(const BasicGeoVec& lhs, T rhs) {
+    assert(rhs != 0);
+    return {lhs.x_ / rhs, lhs.y_ / rhs, lhs.z_ / rhs};
+  }
+  friend constexpr BasicGeoVec operator*(const BasicGeoVec& lhs, T rhs) {
+    return {lhs.x_ * rhs, lhs.y_ * rhs, lhs.z_ * rhs};
+  }
+  friend constexpr BasicGeoVec operator*(T lhs, const BasicGeoVec& rhs) {
+    return rhs * lhs;
+  }
+  friend constexpr BasicGeoVec operator+(const BasicGeoVec& lhs,
+                                         const BasicGeoVec& rhs) {
+    return {lhs.x_ + rhs.x_, lhs.y_ + rhs.y_, lhs.z_ + rhs.z_};
+  }
+  friend constexpr BasicGeoVec operator-(const BasicGeoVec& lhs,
+                                         const BasicGeoVec& rhs) {
+    return {lhs.x_ - rhs.x_, lhs.y_ - rhs.y_, lhs.z_ - rhs.z_};
+  }
+  friend constexpr bool operator==(const BasicGeoVec& lhs,
+                                   const BasicGeoVec& rhs) {
+    return lhs.x_ == rhs.x_ && lhs.y_ == rhs.y_ && lhs.z_ == rhs.z_;
+  }
+  friend constexpr bool operator!=(const BasicGeoVec& lhs,
+                                   const BasicGeoVec& rhs) {
+    return !(lhs == rhs);
+  }
+  friend constexpr BasicGeoVec operator-(const BasicGeoVec& v) {
+    return {-v.x_, -v.y_, -v.z_};
+  }
 };
 
-inline constexpr GeoVec operator/(const GeoVec& lhs, double rhs) {
-  assert(rhs != 0);
-  return {lhs.x_ / rhs, lhs.y_ / rhs, lhs.z_ / rhs};
-}
+/** Vector of the scene geometry precision*/
+using GeoVec = BasicGeoVec<Real>;
 
-inline constexpr GeoVec operator*(const GeoVec& lhs, double rhs) {
-  return {lhs.x_ * rhs, lhs.y_ * rhs, lhs.z_ * rhs};
+/** @return distance between two given points*/
+template <typename T>
+inline T dist_btw_points(const BasicGeoVec<T>& lhs,
+                         const BasicGeoVec<T>& rhs) {
+  return BasicGeoVec<T>{lhs, rhs}.Len();
 }
-
-inline constexpr GeoVec operator*(double lhs, const GeoVec& rhs) {
-  return rhs * lhs;
+/**
+ * @return a * b - c * d with the exact sign. When fused multiply-add is
+ * available compiler may contract the plain expression, which rounds only
+ * one of the products, so a * b - c * d and c * d - a * b would differ not
+ * only in sign. Kahan's algorithm is used then
+ */
+template <typename T>
+inline T DiffOfProducts(T a, T b, T c, T d) {
+#ifdef __FMA__
+  T cd = c * d;
+  T err = std::fma(-c, d, cd);
+  return std::fma(a, b, -cd) + err;
+#else
+  return a * b - c * d;
+#endif
 }
 
-inline constexpr GeoVec operator+(const GeoVec& lhs, const GeoVec& rhs) {
-  return {lhs.x_ + rhs.x_, lhs.y_ + rhs.y_, lhs.z_ + rhs.z_};
-}
+/**
+ * vec_math::kWideWidth vectors stored as arrays of their coordinates, so
+ * operations process several vectors at once with SIMD lanes of
+ * vec_math::Pack. Coordinates are not initialized by default
+ */
+template <typename T>
+struct alignas(32) BasicGeoVec8 {
+  static_assert(std::is_floating_point_v<T>);
+  using P = vec_math::Pack<T>;
+  using Reg = typename P::Reg;
+  static constexpr size_t kWidth = vec_math::kWideWidth;
 
-inline constexpr GeoVec operator-(const GeoVec& lhs, const GeoVec& rhs) {
-  return {lhs.x_ - rhs.x_, lhs.y_ - rhs.y_, lhs.z_ - rhs.z_};
-}
+  T x_[kWidth];
+  T y_[kWidth];
+  T z_[kWidth];
 
-inline constexpr bool operator==(const GeoVec& lhs, const GeoVec& rhs) {
-  return lhs.x_ == rhs.x_ && lhs.y_ == rhs.y_ && lhs.z_ == rhs.z_;
-}
+  BasicGeoVec8() = default;
+  /** Copies move whole registers. Compiler copies may use registers of other
+   * width, then following loads of lanes wait for the stores instead of
+   * being forwarded from them*/
+  BasicGeoVec8(const BasicGeoVec8& other) { CopyFrom(other); }
+  BasicGeoVec8& operator=(const BasicGeoVec8& other) {
+    CopyFrom(other);
+    return *this;
+  }
+  /** Loads kWidth consecutive vectors*/
+  explicit BasicGeoVec8(const BasicGeoVec<T>* vecs) {
+    for (size_t i = 0; i < kWidth; ++i) {
+      Set(i, vecs[i]);
+    }
+  }
+  /** @return vector with the given index*/
+  BasicGeoVec<T> Get(size_t idx) const {
+    assert(idx < kWidth);
+    return {x_[idx], y_[idx], z_[idx]};
+  }
+  /** Replaces vector with the given index*/
+  void Set(size_t idx, const BasicGeoVec<T>& vec) {
+    assert(idx < kWidth);
+    x_[idx] = vec.x_;
+    y_[idx] = vec.y_;
+    z_[idx] = vec.z_;
+  }
+  /** Writes kWidth lengths of the vectors to out*/
+  void Len(T* out) const {
+    for (size_t i = 0; i < kWidth; i += P::kWidth) {
+      P::Store(out + i, P::Sqrt(SquaredLen(i)));
+    }
+  }
+  /** Normalizes all vectors to have length equal to 1*/
+  BasicGeoVec8& Norm() {
+    for (size_t i = 0; i < kWidth; i += P::kWidth) {
+      Reg mult = P::Div(P::Set1(T{1}), P::Sqrt(SquaredLen(i)));
+      P::Store(x_ + i, P::Mul(P::Load(x_ + i), mult));
+      P::Store(y_ + i, P::Mul(P::Load(y_ + i), mult));
+      P::Store(z_ + i, P::Mul(P::Load(z_ + i), mult));
+    }
+    return *this;
+  }
+  /** Writes kWidth dot products with vectors of the same index to out*/
+  void Dot(const BasicGeoVec8& other, T* out) const {
+    for (size_t i = 0; i < kWidth; i += P::kWidth) {
+      Reg xx = P::Mul(P::Load(x_ + i), P::Load(other.x_ + i));
+      Reg yy = P::Mul(P::Load(y_ + i), P::Load(other.y_ + i));
+      Reg zz = P::Mul(P::Load(z_ + i), P::Load(other.z_ + i));
+      P::Store(out + i, P::Add(P::Add(xx, yy), zz));
+    }
+  }
+  /** @return cross products with vectors of the same index*/
+  BasicGeoVec8 Cross(const BasicGeoVec8& other) const {
+    BasicGeoVec8 res;
+    for (size_t i = 0; i < kWidth; i += P::kWidth) {
+      Reg ax = P::Load(x_ + i);
+      Reg ay = P::Load(y_ + i);
+      Reg az = P::Load(z_ + i);
+      Reg bx = P::Load(other.x_ + i);
+      Reg by = P::Load(other.y_ + i);
+      Reg bz = P::Load(other.z_ + i);
+      P::Store(res.x_ + i, P::Sub(P::Mul(ay, bz), P::Mul(az, by)));
+      P::Store(res.y_ + i, P::Sub(P::Mul(az, bx), P::Mul(ax, bz)));
+      P::Store(res.z_ + i, P::Sub(P::Mul(ax, by), P::Mul(ay, bx)));
+    }
+    return res;
+  }
 
-inline constexpr bool operator!=(const GeoVec& lhs, const GeoVec& rhs) {
-  return lhs.x_ != rhs.x_ || lhs.y_ != rhs.y_ || lhs.z_ == rhs.z_;
-}
+ private:
+  void CopyFrom(const BasicGeoVec8& other) {
+    for (size_t i = 0; i < kWidth; i += P::kWidth) {
+      P::Store(x_ + i, P::Load(other.x_ + i));
+      P::Store(y_ + i, P::Load(other.y_ + i));
+      P::Store(z_ + i, P::Load(other.z_ + i));
+    }
+  }
+  /** @return squared lengths of vectors [idx, idx + P::kWidth)*/
+  Reg SquaredLen(size_t idx) const {
+    Reg x = P::Load(x_ + idx);
+    Reg y = P::Load(y_ + idx);
+    Reg z = P::Load(z_ + idx);
+    return P::Add(P::Add(P::Mul(x, x), P::Mul(y, y)), P::Mul(z, z));
+  }
+};
 
-inline constexpr GeoVec operator-(const GeoVec& v) {
-  return {-v.x_, -v.y_, -v.z_};
-}
-/** @return distance between two given points*/
-inline double dist_btw_points(const GeoVec& lhs, const GeoVec& rhs) {
-  return GeoVec{lhs, rhs}.Len();
-}
+/** Wide vector of the scene geometry precision*/
+using GeoVec8 = BasicGeoVec8<Real>;
 
 #endif  // GEO_VEC_H
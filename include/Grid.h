@@ -0,0 +1,67 @@
+﻿/**
+ * @file Grid.h
+ * Contain uniform grid acceleration structure
+ */
+#ifndef GRID_H
+#define GRID_H
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "Accelerator.h"
+#include "BoundingBox.h"
+#include "Objects.h"
+#include "PrimitiveArrays.h"
+#include "Ray.h"
+
+/**
+ * Uniform grid of cells over the scene box. Every cell lists objects whose
+ * bounding boxes overlap it. Ray walks through cells in order along its
+ * direction (3D DDA), so search stops in the first cell which contains a
+ * hit. Works best for evenly distributed objects of similar size.
+ */
+class Grid : public Accelerator {
+ public:
+  explicit Grid(std::vector<const Object*> objects);
+
+  std::optional<HitRecord> GetClosestHit(const Ray& ray) const override;
+  bool IsOccluded(const Ray& ray, Real max_dist) const override;
+  size_t GetMemorySize() const override {
+    return objects_.capacity() * sizeof(const Object*) +
+           primitives_.GetMemorySize() +
+           cell_start_.capacity() * sizeof(uint32_t) +
+           cell_objects_.capacity() * sizeof(uint32_t);
+  }
+
+  /** @return number of cells along every axis*/
+  const std::array<size_t, 3>& GetResolution() const { return res_; }
+
+ private:
+  size_t GetCellIdx(const std::array<size_t, 3>& cell) const {
+    return (cell[2] * res_[1] + cell[1]) * res_[0] + cell[0];
+  }
+  /** @return cell which contains the point, clamped to the grid*/
+  std::array<size_t, 3> GetCell(const GeoVec& p) const;
+  /**
+   * Visits cells crossed by the ray closer than max_dist in the order of
+   * crossing
+   * @param test_cell - called with the cell index, should reduce max_dist
+   * when it finds a closer hit and return true to stop the traversal
+   */
+  template <typename CellTest>
+  void Traverse(const Ray& ray, Real& max_dist, CellTest&& test_cell) const;
+
+  std::vector<const Object*> objects_;
+  PrimitiveArrays primitives_;
+  BoundingBox bounds_;
+  std::array<size_t, 3> res_{0, 0, 0};
+  GeoVec cell_size_;
+  /** Objects of the i-th cell are cell_objects_[cell_start_[i],
+   * cell_start_[i + 1])*/
+  std::vector<uint32_t> cell_start_;
+  std::vector<uint32_t> cell_objects_;
+};
+
+#endif  // GRID_H
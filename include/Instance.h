@@ -0,0 +1,77 @@
+﻿/**
+ * @file Instance.h
+ * Contain triangle meshes which are loaded once and placed into the scene
+ * several times with different transforms
+ */
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include <optional>
+
+#include "BoundingBox.h"
+#include "GeoVec.h"
+#include "Matrix.h"
+#include "Objects.h"
+#include "Ray.h"
+#include "TriangleMesh.h"
+
+/**
+ * Placement of a mesh in the scene. Mesh points are scaled along the axes,
+ * rotated around x, y and z axes (in this order) and then moved
+ */
+struct Transform {
+  GeoVec scale{1.0, 1.0, 1.0};
+  GeoVec rotation_in_deg{0.0, 0.0, 0.0};
+  GeoVec translation{0.0, 0.0, 0.0};
+
+  /** @return matrix of scale and rotation parts of the transform*/
+  Matrix3x3 GetLinearPart() const;
+};
+
+/**
+ * One placement of a mesh. Rays are moved into mesh coordinates and traced
+ * through the mesh own hierarchy, so top level structure contains only one
+ * object per instance. Mesh is shared by all its instances, so memory depends
+ * only on the number of unique meshes. Mesh is not owned and should outlive
+ * the instance.
+ */
+class Instance : public Object {
+ public:
+  /** Mesh should contain at least one triangle and the transform should not
+   * have zero scale*/
+  Instance(const TriangleMesh& mesh, const Transform& transform);
+
+  /** Moves the instance, e.g. to the next animation frame. Transform should
+   * not have zero scale. Should not be called during render*/
+  void SetTransform(const Transform& transform);
+  const Transform& GetTransform() const { return transform_; }
+
+  std::optional<Real> GetClosesDist(const Ray& ray) const override;
+  bool IsCrossed(const Ray& ray, Real max_dist) const override;
+  /** Normal depends on the crossed triangle, so it cannot be found by the
+   * point only. Throws, GetSurfacePoint should be used instead*/
+  GeoVec GetNorm(const GeoVec& p) const override;
+  BoundingBox GetBoundingBox() const override { return box_; }
+  SurfacePoint GetSurfacePoint(const Ray& ray, Real dist) const override;
+
+  const TriangleMesh& GetMesh() const { return *mesh_; }
+
+ private:
+  /**
+   * Moves ray into mesh coordinates
+   * @param[out] dist_scale - mesh distance along the ray which corresponds to
+   * the unit world distance
+   */
+  Ray ToLocal(const Ray& ray, Real& dist_scale) const;
+
+  const TriangleMesh* mesh_;
+  Transform transform_;
+  Matrix3x3 to_local_;
+  /** Inverse transpose of the linear part, which keeps normals orthogonal to
+   * the transformed surface*/
+  Matrix3x3 norm_to_world_;
+  GeoVec translation_;
+  BoundingBox box_;
+};
+
+#endif  // INSTANCE_H
@@ -0,0 +1,76 @@
+﻿/**
+ * @file KdTree.h
+ * Contain kd-tree acceleration structure
+ */
+#ifndef KD_TREE_H
+#define KD_TREE_H
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "Accelerator.h"
+#include "BoundingBox.h"
+#include "Objects.h"
+#include "PrimitiveArrays.h"
+#include "Ray.h"
+
+/** Node of the flattened kd-tree. Child below the split plane is stored right
+ * after its parent*/
+struct KdNode {
+  static constexpr uint32_t kLeaf = 3;
+
+  Real split = 0.0;
+  /** Inner node - index of the child above the split plane, leaf - index of
+   * its first object in the leaf object list*/
+  uint32_t offset = 0;
+  /** Number of objects in the leaf, 0 for inner nodes*/
+  uint32_t obj_num = 0;
+  /** Split axis, kLeaf for leaves*/
+  uint32_t axis = kLeaf;
+};
+
+/**
+ * Kd-tree built with binned surface area heuristic. Space is split by axis
+ * aligned planes, objects crossing a plane are referenced from both sides.
+ * Leaves are visited strictly front to back, so search stops in the first
+ * leaf which contains a hit. Works well for scenes with large empty regions.
+ */
+class KdTree : public Accelerator {
+ public:
+  explicit KdTree(std::vector<const Object*> objects);
+
+  std::optional<HitRecord> GetClosestHit(const Ray& ray) const override;
+  bool IsOccluded(const Ray& ray, Real max_dist) const override;
+  size_t GetMemorySize() const override {
+    return nodes_.capacity() * sizeof(KdNode) +
+           leaf_objects_.capacity() * sizeof(uint32_t) +
+           objects_.capacity() * sizeof(const Object*) +
+           primitives_.GetMemorySize();
+  }
+
+  const std::vector<KdNode>& GetNodes() const { return nodes_; }
+
+ private:
+  /** Appends subtree over the given objects within the bounds*/
+  void BuildNode(const std::vector<BoundingBox>& boxes,
+                 const std::vector<uint32_t>& obj_ids,
+                 const BoundingBox& bounds, size_t depth, size_t max_depth);
+
+  /**
+   * Visits leaves crossed by the ray closer than max_dist front to back
+   * @param test_leaf - called as test_leaf(first, num) for objects
+   * leaf_objects_[first, first + num), should reduce max_dist when it finds
+   * a closer hit and return true to stop the traversal
+   */
+  template <typename LeafTest>
+  void Traverse(const Ray& ray, Real& max_dist, LeafTest&& test_leaf) const;
+
+  std::vector<KdNode> nodes_;
+  std::vector<uint32_t> leaf_objects_;
+  std::vector<const Object*> objects_;
+  PrimitiveArrays primitives_;
+  BoundingBox bounds_;
+};
+
+#endif  // KD_TREE_H
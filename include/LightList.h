@@ -0,0 +1,94 @@
+﻿/**
+ * @file LightList.h
+ * Contain light sources of the scene which are sampled directly by next
+ * event estimation
+ */
+#ifndef LIGHT_LIST_H
+#define LIGHT_LIST_H
+
+#include <cstdlib>
+#include <optional>
+#include <vector>
+
+#include "Color.h"
+#include "GeoVec.h"
+#include "Objects.h"
+#include "Sampler.h"
+
+/** Point of a light source picked for a shaded point*/
+struct LightSample {
+  /** Point on the light surface*/
+  GeoVec point;
+  /** Light source object the point belongs to*/
+  const Object* light = nullptr;
+  /** Inverse of the probability density of the direction to the point over
+   * the solid angle seen from the shaded point*/
+  double inv_pdf = 0.0;
+};
+
+/**
+ * Light source spheres and triangles of the scene, meshes and sphere sets are
+ * split into their faces and spheres. Points are picked uniformly over the
+ * total area of all lights, so the density of a point over the solid angle
+ * depends only on its distance and on the angle to the light surface, same
+ * for every light. Light sources of other types (e.g. instances) are not
+ * sampled and are found by traced rays only. Objects are not owned and should
+ * outlive the list.
+ */
+class LightList {
+ public:
+  LightList() = default;
+  /** If sample_points is false only the brightest light color is found and
+   * the list stays empty*/
+  explicit LightList(const std::vector<const Object*>& objects,
+                     bool sample_points = true);
+
+  bool IsEmpty() const { return area_cdf_.empty(); }
+  /** @return largest channels among colors of all light sources of the
+   * scene, including not sampled ones. Black if there are no lights*/
+  const Color& GetMaxColor() const { return max_color_; }
+  /** @return number of light spheres and triangles*/
+  size_t GetLightNumber() const { return area_cdf_.size(); }
+  /** @return true if points of the object are sampled by the list*/
+  bool Contains(const Object* obj) const;
+  /**
+   * Picks a point of a light source for the given shaded point
+   * @return nullopt if the list is empty or if the picked point faces away
+   * from the shaded one (back side of a triangle or of a sphere)
+   */
+  std::optional<LightSample> Sample(const GeoVec& from,
+                                    Sampler& sampler) const;
+  /** @return LightSample::inv_pdf of the given point of a light surface with
+   * the given normal, e.g. of the point found by a traced ray*/
+  double GetInvPdf(const GeoVec& from, const GeoVec& point,
+                   const GeoVec& norm) const;
+
+ private:
+  struct SphereLight {
+    GeoVec center;
+    Real r = 0.0;
+    const Object* obj = nullptr;
+  };
+  struct TriangleLight {
+    GeoVec p0;
+    GeoVec edge1;
+    GeoVec edge2;
+    /** Unit normal of the visible side*/
+    GeoVec norm;
+    const Object* obj = nullptr;
+  };
+
+  void AddSphere(const GeoVec& center, Real r, const Object* obj);
+  void AddTriangle(const GeoVec& p0, const GeoVec& p1, const GeoVec& p2,
+                   const Object* obj);
+
+  std::vector<SphereLight> spheres_;
+  std::vector<TriangleLight> triangles_;
+  /** Running sums of areas of spheres followed by triangles*/
+  std::vector<double> area_cdf_;
+  /** Sampled objects sorted by address*/
+  std::vector<const Object*> objects_;
+  Color max_color_ = colors::kBlack;
+};
+
+#endif  // LIGHT_LIST_H
@@ -0,0 +1,45 @@
+﻿/**
+ * @file MappedFile.h
+ * Contain read only file mapped into memory
+ */
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Whole file mapped into memory for reading. Pages of the file are shared by
+ * all processes which map it. On systems without mmap file is read into
+ * memory instead.
+ */
+class MappedFile {
+ public:
+  static constexpr size_t kAlignment = 64;
+
+  /** @return mapped file or nullptr if it cannot be opened or is empty*/
+  static std::shared_ptr<const MappedFile> Open(const std::string& file_name);
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  ~MappedFile();
+
+  /** @return begin of the file data, aligned at least to kAlignment*/
+  const char* GetData() const { return data_; }
+  size_t GetSize() const { return size_; }
+
+ private:
+  MappedFile() = default;
+
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+  struct alignas(kAlignment) Chunk {
+    char bytes[kAlignment];
+  };
+  /** File content when it is read instead of being mapped*/
+  std::vector<Chunk> buffer_;
+};
+
+#endif  // MAPPED_FILE_H
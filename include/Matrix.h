@@ -5,61 +5,130 @@
 #ifndef MATRIX_H
 #define MATRIX_H
 
+#include <cstddef>
 #include <utility>
 
 #include "GeoVec.h"
 /** 3x3 matrix representation. Each field represent corresponding column*/
-struct Matrix3x3 {
-  GeoVec c0;
-  GeoVec c1;
-  GeoVec c2;
+template <typename T>
+struct BasicMatrix3x3 {
+  BasicGeoVec<T> c0;
+  BasicGeoVec<T> c1;
+  BasicGeoVec<T> c2;
 };
+/** Matrix of the scene geometry precision*/
+using Matrix3x3 = BasicMatrix3x3<Real>;
+
 /** Calculates deterimnant of the 2x2 matrix. input - separate matrix values*/
-inline constexpr double Det2x2(double v00, double v01, double v10, double v11) {
+template <typename T>
+inline constexpr T Det2x2(T v00, T v01, T v10, T v11) {
   return v00 * v11 - v10 * v01;
 }
 /** Calculates determinatn of the given 3x3 matrix*/
-inline constexpr double Det3x3(const Matrix3x3& m) {
+template <typename T>
+inline constexpr T Det3x3(const BasicMatrix3x3<T>& m) {
   return m.c0.x_ * Det2x2(m.c1.y_, m.c2.y_, m.c1.z_, m.c2.z_) -
          m.c1.x_ * Det2x2(m.c0.y_, m.c2.y_, m.c0.z_, m.c2.z_) +
          m.c2.x_ * Det2x2(m.c0.y_, m.c1.y_, m.c0.z_, m.c1.z_);
 }
 /** Returns transpose matrix obtained from the give one*/
-inline constexpr Matrix3x3 GetTranspose(const Matrix3x3& m) {
-  return {GeoVec{m.c0.x_, m.c1.x_, m.c2.x_}, GeoVec{m.c0.y_, m.c1.y_, m.c2.y_},
-          GeoVec{m.c0.z_, m.c1.z_, m.c2.z_}};
+template <typename T>
+inline constexpr BasicMatrix3x3<T> GetTranspose(const BasicMatrix3x3<T>& m) {
+  return {BasicGeoVec<T>{m.c0.x_, m.c1.x_, m.c2.x_},
+          BasicGeoVec<T>{m.c0.y_, m.c1.y_, m.c2.y_},
+          BasicGeoVec<T>{m.c0.z_, m.c1.z_, m.c2.z_}};
 }
 /**
  * Separately calculates value which will ocure in the first row of the given
  * vector after applying to it given matrix
  */
-inline constexpr double TransformXCoor(const Matrix3x3& m, const GeoVec& vec) {
+template <typename T>
+inline constexpr T TransformXCoor(const BasicMatrix3x3<T>& m,
+                                  const BasicGeoVec<T>& vec) {
   return vec.Dot({m.c0.x_, m.c1.x_, m.c2.x_});
 }
 /**
  * Separately calculates value which will ocure in the second row of the given
  * vector after applying to it given matrix
  */
-inline constexpr double TransformYCoor(const Matrix3x3& m, const GeoVec& vec) {
+template <typename T>
+inline constexpr T TransformYCoor(const BasicMatrix3x3<T>& m,
+                                  const BasicGeoVec<T>& vec) {
   return vec.Dot({m.c0.y_, m.c1.y_, m.c2.y_});
 }
 /**
  * Separately calculates value which will ocure in the third row of the given
  * vector after applying to it given matrix
  */
-inline constexpr double TransformZCoor(const Matrix3x3& m, const GeoVec& vec) {
+template <typename T>
+inline constexpr T TransformZCoor(const BasicMatrix3x3<T>& m,
+                                  const BasicGeoVec<T>& vec) {
   return vec.Dot({m.c0.z_, m.c1.z_, m.c2.z_});
 }
 /** @return result vector after applying given matrix to the given vector*/
-inline constexpr GeoVec ApplyToVec(const Matrix3x3& m, const GeoVec& vec) {
+template <typename T>
+inline constexpr BasicGeoVec<T> ApplyToVec(const BasicMatrix3x3<T>& m,
+                                           const BasicGeoVec<T>& vec) {
   return {TransformXCoor(m, vec), TransformYCoor(m, vec),
           TransformZCoor(m, vec)};
 }
-/** Calculates reverse 3x3 matrix to the given one*/
-Matrix3x3 GetReverse3x3(const Matrix3x3& m);
+/** Calculates reverse 3x3 matrix to the given one. Instantiated for float
+ * and double*/
+template <typename T>
+BasicMatrix3x3<T> GetReverse3x3(const BasicMatrix3x3<T>& m);
+
+/** vec_math::kWideWidth matrices, each field holds corresponding columns of
+ * all of them*/
+template <typename T>
+struct BasicMatrix3x3x8 {
+  BasicGeoVec8<T> c0;
+  BasicGeoVec8<T> c1;
+  BasicGeoVec8<T> c2;
+
+  /** @return matrix with the given index*/
+  BasicMatrix3x3<T> Get(size_t idx) const {
+    return {c0.Get(idx), c1.Get(idx), c2.Get(idx)};
+  }
+  /** Replaces matrix with the given index*/
+  void Set(size_t idx, const BasicMatrix3x3<T>& m) {
+    c0.Set(idx, m.c0);
+    c1.Set(idx, m.c1);
+    c2.Set(idx, m.c2);
+  }
+};
+/** Wide matrix of the scene geometry precision*/
+using Matrix3x3x8 = BasicMatrix3x3x8<Real>;
+
+/** Calculates reverse matrices of all given ones at once. Instantiated for
+ * float and double*/
+template <typename T>
+BasicMatrix3x3x8<T> GetReverse3x3(const BasicMatrix3x3x8<T>& m);
+
+/** @return vectors after applying matrices of the same index to them*/
+template <typename T>
+inline BasicGeoVec8<T> ApplyToVec(const BasicMatrix3x3x8<T>& m,
+                                  const BasicGeoVec8<T>& vec) {
+  using P = vec_math::Pack<T>;
+  BasicGeoVec8<T> res;
+  for (size_t i = 0; i < vec_math::kWideWidth; i += P::kWidth) {
+    auto x = P::Load(vec.x_ + i);
+    auto y = P::Load(vec.y_ + i);
+    auto z = P::Load(vec.z_ + i);
+    auto row = [&](const T* v0, const T* v1, const T* v2) {
+      return P::Add(P::Add(P::Mul(P::Load(v0 + i), x),
+                           P::Mul(P::Load(v1 + i), y)),
+                    P::Mul(P::Load(v2 + i), z));
+    };
+    P::Store(res.x_ + i, row(m.c0.x_, m.c1.x_, m.c2.x_));
+    P::Store(res.y_ + i, row(m.c0.y_, m.c1.y_, m.c2.y_));
+    P::Store(res.z_ + i, row(m.c0.z_, m.c1.z_, m.c2.z_));
+  }
+  return res;
+}
 
-inline constexpr Matrix3x3 operator*(const Matrix3x3& lhs,
-                                     const Matrix3x3& rhs) {
+template <typename T>
+inline constexpr BasicMatrix3x3<T> operator*(const BasicMatrix3x3<T>& lhs,
+                                             const BasicMatrix3x3<T>& rhs) {
   return {ApplyToVec(lhs, rhs.c0), ApplyToVec(lhs, rhs.c1),
           ApplyToVec(lhs, rhs.c2)};
 }
@@ -4,24 +4,36 @@
 #include <cmath>
 #include <memory>
 #include <optional>
-#include <random>
+#include <type_traits>
 
+#include "BoundingBox.h"
 #include "Color.h"
 #include "GeoVec.h"
-#include "Matrix.h"
 #include "Ray.h"
 #include "Reflector.h"
+#include "Sampler.h"
 
 // TODO here is an opportunity to add kRefractive material
 enum class Material { kNoMaterial = 0, kReflective, kLightSource };
-/** Interface object class*/
+
+class Object;
+/** Point of a surface crossed by a ray*/
+struct SurfacePoint {
+  /** Object which material and color are seen in the point*/
+  const Object* obj = nullptr;
+  /** Surface normal in the point in world coordinates*/
+  GeoVec norm;
+};
+
+/** Interface object class. Objects are immutable during rendering, so they
+ * can be shared between render threads. Geometry can be changed between
+ * frames of an animation, acceleration structures should be refitted then*/
 class Object {
  private:
   double polishness_ = 0.0;
   double refl_coef_ = 1.0;
   Color color_ = colors::kNoColor;
   Material mat_ = Material::kNoMaterial;
-  mutable std::mt19937 rnd_{0};
 
  public:
   constexpr Object& SetColor(Color col) {
@@ -54,11 +66,6 @@ class Object {
     return *this;
   }
 
-  Object& SetSeed(size_t s) {
-    rnd_.seed(s);
-    return *this;
-  }
-
   constexpr const Color& GetColor() const { return color_; }
   constexpr Material GetMaterial() const { return mat_; }
   constexpr double GetPolishness() const { return polishness_; }
@@ -71,18 +78,31 @@ class Object {
    * @param ray - in/out incident ray. If reflection happened will contain new
    * direction and new ray position.
    * @param dist - distance from the current point to the reflective surface
+   * @param sampler - source of random numbers for the current path
    *
    * @return true - if reflection happened, false - otherwise
    */
-  bool TryReflect(Ray& ray, double dist) const {
+  bool TryReflect(Ray& ray, Real dist, Sampler& sampler) const {
+    return TryReflect(ray, dist, GetNorm(ray.GetPos() + dist * ray.GetDir()),
+                      sampler);
+  }
+  /** Same as above, but surface normal in the hit point is already known*/
+  bool TryReflect(Ray& ray, Real dist, const GeoVec& norm,
+                  Sampler& sampler) const {
+    bool is_diffuse = false;
+    return TryReflect(ray, dist, norm, sampler, is_diffuse);
+  }
+  /** Same as above, is_diffuse tells whether the new direction was chosen
+   * randomly rather than mirror like (see HybridReflect)*/
+  bool TryReflect(Ray& ray, Real dist, const GeoVec& norm, Sampler& sampler,
+                  bool& is_diffuse) const {
     assert(refl_coef_ >= 0);
     assert(refl_coef_ <= 1);
-    std::uniform_real_distribution<double> d{0, 1};
-    if (d(rnd_) < refl_coef_) {
+    if (sampler.Get1D() < refl_coef_) {
       ray.Advance(dist);
-      assert(ray.GetDir().Dot(GetNorm(ray.GetPos())) < 0);
-      ray.UpdateDirection(HybridReflect(rnd_, polishness_, ray.GetDir(),
-                                        GetNorm(ray.GetPos())));
+      assert(ray.GetDir().Dot(norm) < 0);
+      ray.UpdateDirection(HybridReflect(sampler, polishness_, ray.GetDir(),
+                                        norm, is_diffuse));
       return true;
     }
     return false;
@@ -91,126 +111,185 @@ class Object {
    * Returnes minimal distance from the given ray to this object. If ray does
    * not cross this object nullopt is returned
    */
-  virtual std::optional<double> GetClosesDist(const Ray& ray) const = 0;
+  virtual std::optional<Real> GetClosesDist(const Ray& ray) const = 0;
+  /**
+   * Returns true if the ray crosses this object closer than max_dist. Any
+   * crossing is enough, composite objects stop at the first found one
+   */
+  virtual bool IsCrossed(const Ray& ray, Real max_dist) const {
+    std::optional<Real> dist = GetClosesDist(ray);
+    return dist && *dist < max_dist;
+  }
   /**
    * Returns this object normal in the given point. All normals point to the
    * direction of surface reflection
    */
   virtual GeoVec GetNorm(const GeoVec& p) const = 0;
+  /** Returns the smallest axis aligned box which contains this object*/
+  virtual BoundingBox GetBoundingBox() const = 0;
+  /**
+   * Returns surface point which the ray crosses at the given distance. Simple
+   * objects return themselves, composite ones return the crossed part
+   */
+  virtual SurfacePoint GetSurfacePoint(const Ray& ray, Real dist) const {
+    return {this, GetNorm(ray.GetPos() + dist * ray.GetDir())};
+  }
 
   virtual ~Object() = default;
 };
 
+/**
+ * Ray-sphere test, ray direction should be normalized
+ * @return distance to the first crossing of the sphere surface in front of
+ * the ray or nullopt if the ray misses the sphere
+ */
+inline std::optional<Real> IntersectSphere(const Ray& ray,
+                                           const GeoVec& center, Real r) {
+  GeoVec ray_to_c{ray.GetPos(), center};
+  Real dist_proj = ray_to_c.Dot(ray.GetDir());
+  if (dist_proj <= 0) return std::nullopt;  // ray directed away!
+  // squared distance from the center to the ray line is taken from the
+  // perpendicular itself, difference of squared lengths of ray_to_c and its
+  // projection cancels out for spheres far from the ray start
+  GeoVec perp = ray_to_c - dist_proj * ray.GetDir();
+  Real D_quarter = r * r - perp.Dot(perp);
+  if (D_quarter <= 0)
+    return std::nullopt;  //==0 - ignore when ray only touch the surface
+  return dist_proj - std::sqrt(D_quarter);
+}
+
 class Sphere : public Object {
  private:
   GeoVec center_;
-  double r_;
+  Real r_;
 
  public:
   Sphere() = delete;
-  constexpr Sphere(const GeoVec& gc, double gr) : center_(gc), r_(gr) {
+  constexpr Sphere(const GeoVec& gc, Real gr) : center_(gc), r_(gr) {
     assert(r_ > 0);
   }
 
-  double GetRadius() const { return r_; }
+  Real GetRadius() const { return r_; }
   const GeoVec& GetCenter() const { return center_; }
+  /** Moves sphere to the new position. Should not be called during render*/
+  void SetCenter(const GeoVec& center) { center_ = center; }
 
-  std::optional<double> GetClosesDist(const Ray& ray) const override {
-    GeoVec ray_to_c{ray.GetPos(), center_};
-    double dist_proj = ray_to_c.Dot(ray.GetDir());
-    if (dist_proj <= 0) return std::nullopt;  // ray directed away!
-    double dist_to_c = ray_to_c.Len();
-    double D_quarter = dist_proj * dist_proj - dist_to_c * dist_to_c + r_ * r_;
-    if (D_quarter <= 0)
-      return std::nullopt;  //==0 - ignore when ray only touch the surface
-    return dist_proj - std::sqrt(D_quarter);
+  std::optional<Real> GetClosesDist(const Ray& ray) const override {
+    return IntersectSphere(ray, center_, r_);
   }
 
   GeoVec GetNorm(const GeoVec& p) const override { return (p - center_) / r_; }
+  BoundingBox GetBoundingBox() const override {
+    GeoVec r{r_, r_, r_};
+    return {center_ - r, center_ + r};
+  }
 };
-/** Struct for representing line like y = k*x + b*/
-struct Line {
-  double k;
-  double b;
+/** Triangle vertices moved into the ray space, see RayShear. Ray starts in
+ * the origin and goes along z axis there*/
+struct ShearedTriangle {
+  Real x[3];
+  Real y[3];
+  Real z[3];
 };
+
 /**
- * Utlitiy struct for more effective check whether point is in triangle or not.
+ * Checks the triangle moved into the ray space against the ray, see
+ * IntersectTriangle. Edge functions are found with precision T.
+ * @param shear_z - shear_z of the ray, scales depths of the vertices to
+ * distances along the ray
  */
-struct InTriangleChecker {
-  /**
-   * Matrix for changing basis from original to triangle. All other fields
-   * coordinates are in triangle basis.
-   * Triangle basis is the one where z coordinate is 0 for all 3 points in
-   * current triangle
-   */
-  Matrix3x3 conversion_matrix;
-  /** Current triangle coordinates in triangle basis sorted acording to y
-   * coordinate*/
-  std::array<GeoVec, 3> y_sorted;
-  /** Current triangle coordinates in triangle basis sorted acording to x
-   * coordinate*/
-  std::array<GeoVec, 3> x_sorted;
-  /** Equation for line connecting y_min and y_mid points from y_sorted*/
-  Line y_min_mid;
-  /** Equation for line connecting y_mid and y_max points from y_sorted*/
-  Line y_mid_max;
-};
+template <typename T = Real>
+inline std::optional<Real> IntersectShearedTriangle(const ShearedTriangle& tri,
+                                                    Real shear_z) {
+  // Edge functions are all positive when the ray crosses the front side.
+  // Zero means the ray goes exactly through the edge, then it hits both
+  // triangles sharing the edge
+  T u = DiffOfProducts<T>(tri.x[2], tri.y[1], tri.y[2], tri.x[1]);
+  T v = DiffOfProducts<T>(tri.x[0], tri.y[2], tri.y[0], tri.x[2]);
+  T w = DiffOfProducts<T>(tri.x[1], tri.y[0], tri.y[1], tri.x[0]);
+  if constexpr (!std::is_same_v<T, double>) {
+    // float products may round to the same value for rays passing near the
+    // edge. Products of floats are exact in double, so the side is decided
+    // there, as proposed by Woop et al.
+    if ((u == 0) | (v == 0) | (w == 0)) {
+      return IntersectShearedTriangle<double>(tri, shear_z);
+    }
+  }
+  // Terms of the plane distance have different signs when vertices lie on
+  // both sides of the ray start, so they are summed in double, where the
+  // cancellation does not eat all digits of float edge functions. det is
+  // zero for parallel rays
+  double det = ToDouble(u) + ToDouble(v) + ToDouble(w);
+  double t = ToDouble(shear_z) * (ToDouble(u) * ToDouble(tri.z[0]) +
+                                  ToDouble(v) * ToDouble(tri.z[1]) +
+                                  ToDouble(w) * ToDouble(tri.z[2]));
+  // all conditions are combined without branches, which are hard to
+  // predict. t<=0 - means that the ray_pos is situated behind the triangle
+  bool is_hit = (u >= 0) & (v >= 0) & (w >= 0) & (det > 0) & (t > 0);
+  Real dist = ToReal(t / det);
+  return is_hit ? std::optional<Real>{dist} : std::nullopt;
+}
 
+/**
+ * Watertight ray-triangle test of Woop, Benthin and Wald. Vertices are moved
+ * into the ray space (see RayShear) and the ray is checked against the signed
+ * edge functions there. Shared edge gets exactly the same edge function (with
+ * the opposite sign) in both neighbouring triangles, so rays cannot pass
+ * between them. Triangle is visible only from the side of the normal
+ * (p1 - p0) x (p2 - p0)
+ * @return distance along the ray or nullopt if the ray misses the triangle
+ */
+inline std::optional<Real> IntersectTriangle(const Ray& ray, const GeoVec& p0,
+                                             const GeoVec& p1,
+                                             const GeoVec& p2) {
+  const RayShear& s = ray.GetShear();
+  const GeoVec& pos = ray.GetPos();
+  ShearedTriangle tri;
+  const GeoVec* vertices[3] = {&p0, &p1, &p2};
+  for (int k = 0; k < 3; ++k) {
+    const GeoVec& p = *vertices[k];
+    tri.z[k] = p.*s.z - pos.*s.z;
+    tri.x[k] = p.*s.x - pos.*s.x - s.shear_x * tri.z[k];
+    tri.y[k] = p.*s.y - pos.*s.y - s.shear_y * tri.z[k];
+  }
+  return IntersectShearedTriangle(tri, s.shear_z);
+}
+
+/** Triangle visible only from the side its normal points to. Only vertices
+ * and the normal are stored, see IntersectTriangle*/
 class Triangle : public Object {
  private:
   GeoVec p0_;
   GeoVec p1_;
   GeoVec p2_;
   GeoVec norm_;
-  double D_;  // coefficient for plain Ax + By + Cz + D = 0
-  InTriangleChecker checker_;
-  /** Method which prepares checker struct for effective check ehether point are
-   * inside the triangle or not*/
-  InTriangleChecker CalcInTriangleChecker(const GeoVec& p0, const GeoVec& p1,
-                                          const GeoVec& p2);
 
  public:
   Triangle() = delete;
-  Triangle(const GeoVec& gp0, const GeoVec& gp1, const GeoVec& gp2)
-      : p0_(gp0), p1_(gp1), p2_(gp2) {
+  Triangle(const GeoVec& gp0, const GeoVec& gp1, const GeoVec& gp2) {
+    SetPoints(gp0, gp1, gp2);
+  }
+  /** Moves triangle vertices to the new positions. Should not be called
+   * during render*/
+  void SetPoints(const GeoVec& gp0, const GeoVec& gp1, const GeoVec& gp2) {
+    p0_ = gp0;
+    p1_ = gp1;
+    p2_ = gp2;
     GeoVec lhs{p0_, p1_};
     GeoVec rhs{p0_, p2_};
     norm_ = lhs.Cross(rhs).Norm();
-    D_ = -norm_.Dot(p0_);
-    checker_ = CalcInTriangleChecker(p0_, p1_, p2_);
   }
 
-  std::optional<double> GetClosesDist(const Ray& ray) const override {
-    // find ray crossection with the plain
-    const auto& ray_dir = ray.GetDir();
-    const auto& ray_pos = ray.GetPos();
-    double den = ray_dir.Dot(norm_);
-    if (den >= 0) return std::nullopt;  // ray is directed away!
-    double t = -(D_ + ray_pos.Dot(norm_)) / den;
-    // t<0 - means that the ray_pos is situated from the wrong side to the
-    // triangle
-    if (t <= 0 || !CheckInTriangle(ray_pos + t * ray_dir)) return std::nullopt;
-    return t;
+  std::optional<Real> GetClosesDist(const Ray& ray) const override {
+    return IntersectTriangle(ray, p0_, p1_, p2_);
   }
 
   const GeoVec& GetPoint0() const { return p0_; }
   const GeoVec& GetPoint1() const { return p1_; }
   const GeoVec& GetPoint2() const { return p2_; }
   GeoVec GetNorm(const GeoVec& /*p*/) const override { return norm_; }
-
-  /** @return true if point is in triangle, false - otherwise*/
-  constexpr bool CheckInTriangle(const GeoVec& point) const {
-    double norm_x = TransformXCoor(checker_.conversion_matrix, point);
-    double norm_y = TransformYCoor(checker_.conversion_matrix, point);
-    if (norm_x < checker_.x_sorted[0].x_ || norm_x > checker_.x_sorted[2].x_ ||
-        norm_y < checker_.y_sorted[0].y_ || norm_y > checker_.y_sorted[2].y_) {
-      return false;
-    }
-    if (norm_y < checker_.y_sorted[1].y_) {
-      return checker_.y_min_mid.k * norm_x + checker_.y_min_mid.b < norm_y;
-    } else {
-      return checker_.y_mid_max.k * norm_x + checker_.y_mid_max.b > norm_y;
-    }
+  BoundingBox GetBoundingBox() const override {
+    return BoundingBox{}.Extend(p0_).Extend(p1_).Extend(p2_);
   }
 };
 
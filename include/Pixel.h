@@ -2,19 +2,30 @@
 #define PIXEL_H
 
 #include <cstdlib>
-#include <random>
+#include <optional>
 #include <vector>
 
+#include "Accelerator.h"
+#include "AccumulationBuffer.h"
 #include "Color.h"
 #include "Config.h"
+#include "LightList.h"
 #include "Objects.h"
 #include "Ray.h"
+#include "Sampler.h"
 
 /** Struct contains information about material and color of an object which was
  * hit by ray*/
 struct BounceRecord {
   Material hit_obj_mat_;
   Color hit_obj_color_;
+  const Object* hit_obj_ = nullptr;
+  GeoVec hit_point_{};
+  /** Surface normal in the hit point, faces the incident ray*/
+  GeoVec hit_norm_{};
+  /** True if the ray was reflected in a random direction, see
+   * HybridReflect*/
+  bool is_diffuse_ = false;
 };
 namespace pixel {
 /**Each Tile instance describes phisical coordinates of certain pixel.*/
@@ -25,12 +36,16 @@ struct Tile {
 };
 /**Creates point from which all screen rays will be emitted.*/
 GeoVec CreateViewerPoint(const CameraSettings& cs);
+/** Creates ray from the ray_start to a random point in the tile, point is
+ * given by the current sample of the sampler*/
+Ray CreateRay(const Tile& tile, const GeoVec& ray_start, Sampler& sampler);
 /**
  * Creates collecciton of rays pointing from the ray_start to a random point
- * in the tile
+ * in the tile. Ray with index n uses n-th sample of the pixel selected in
+ * the sampler
  */
 std::vector<Ray> CreateRays(const Tile& tile, const GeoVec& ray_start,
-                            std::mt19937& rnd, int ray_num);
+                            Sampler& sampler, int ray_num);
 /**
  * Creates tiles for the given plane. Note that tiles are listed frol left to
  * right, from up to bottom
@@ -41,34 +56,55 @@ std::vector<Tile> CreateTiles(const GeoVec& top_left_point,
                               int height_in_pixel);
 /**
  * Method calculates trace of the given ray in the universe and returns
- * average color for this trace
+ * average color for this trace. After a few reflections traces which stay
+ * dark even if the next ray hits the brightest light source are stopped at
+ * random by Russian roulette, the survived ones are weighted up, so the
+ * average color over many paths stays the same. Nothing is traced if there
+ * is no light source of not black color
  *
  * @param[in] bounce_limit - maximum number of reflextion that one ray can
  * make, before it is decided that ray has not meet light source
+ * @param[in] sampler - source of random numbers for the path
+ * @param[in] lights - if given, a point of a light source of the list is
+ * checked at every diffuse reflection (next event estimation). Such points
+ * and hits of the same lights by diffuse reflected rays are weighted by the
+ * balance heuristic, so the average color over many paths stays the same
+ * while it converges faster. The list should be built over all scene
+ * objects, the brightest light is white if there is no list
  */
-Color RenderRay(const Ray& ray, const std::vector<const Object*>& universe,
-                size_t bounce_limit);
+Radiance RenderRay(const Ray& ray, const Accelerator& universe,
+                   size_t bounce_limit, Sampler& sampler,
+                   const LightList* lights = nullptr);
+/** Same as RenderRay, but the first hit of the ray is already found (e.g. by
+ * tracing camera rays as packets). Bounce limit should be positive*/
+Radiance RenderRay(const Ray& ray, const std::optional<HitRecord>& first_hit,
+                   const Accelerator& universe, size_t bounce_limit,
+                   Sampler& sampler, const LightList* lights = nullptr);
 /**
  * Method checks if given ray hits anything in the universe.
  * if it does - then method will perform reflection.
  *
  * @return information about hit material and its color
  */
-BounceRecord MakeRayBounce(Ray& ray,
-                           const std::vector<const Object*>& all_objects);
+BounceRecord MakeRayBounce(Ray& ray, const Accelerator& all_objects,
+                           Sampler& sampler);
+/** Same as MakeRayBounce for the already found closest hit of the ray*/
+BounceRecord MakeRayBounce(Ray& ray, const std::optional<HitRecord>& hit,
+                           Sampler& sampler);
 /**
  * Traces each ray in the given collection and returns averaged color for all
- * these rays.
+ * these rays. Ray with index n is traced with n-th sample of the pixel
+ * selected in the sampler
  */
 inline Color TraceRays(const std::vector<Ray>& in_rays,
-                       const std::vector<const Object*>& universe,
-                       size_t bounce_limit) {
-  std::vector<Color> accum_colors;
-  accum_colors.reserve(in_rays.size());
-  for (const auto& ray : in_rays) {
-    accum_colors.push_back(RenderRay(ray, universe, bounce_limit));
+                       const Accelerator& universe, size_t bounce_limit,
+                       Sampler& sampler, const LightList* lights = nullptr) {
+  PixelAccum accum;
+  for (size_t n = 0; n < in_rays.size(); ++n) {
+    sampler.StartSample(n);
+    accum.Add(RenderRay(in_rays[n], universe, bounce_limit, sampler, lights));
   }
-  return Color::GetAverageColor(accum_colors);
+  return accum.GetColor();
 }
 
 }  // namespace pixel
@@ -0,0 +1,68 @@
+﻿/**
+ * @file PngStreamWriter.h
+ * Contain png writer which encodes rows in background while they are rendered
+ */
+#ifndef PNG_STREAM_WRITER_H
+#define PNG_STREAM_WRITER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Color.h"
+#include "PngWriter.h"
+
+/**
+ * Writes png image row by row on a background thread. Rows can be pushed from
+ * any thread as soon as they are finished. Rows are encoded in their order and
+ * at most a window of rows ahead of the encoder is kept in memory. Pushing a
+ * row beyond the window blocks until the encoder catches up, so rows should
+ * be pushed roughly in order, e.g. as Renderer reports them.
+ */
+class PngStreamWriter {
+ public:
+  /** Default number of rows which can wait for the encoder*/
+  static constexpr uint32_t kDefaultRowWindow = 64;
+
+  PngStreamWriter(const char* filename, uint32_t width, uint32_t height,
+                  uint32_t row_window = kDefaultRowWindow);
+  /** Waits until all pushed rows are written*/
+  ~PngStreamWriter();
+
+  PngStreamWriter(const PngStreamWriter&) = delete;
+  PngStreamWriter& operator=(const PngStreamWriter&) = delete;
+  PngStreamWriter(PngStreamWriter&&) = delete;
+  PngStreamWriter& operator=(PngStreamWriter&&) = delete;
+
+  bool IsOk() const { return writer_.IsOk(); }
+  /** Hands finished row over to the encoder. Row should contain image width
+   * colors. Blocks while the row is row_window or more rows ahead of the
+   * next row to encode*/
+  void PushRow(uint32_t row_idx, std::vector<Color> row);
+  /**
+   * Waits until all pushed rows are encoded and stops background thread.
+   * @return true if every row of the image was written
+   */
+  bool Finish();
+
+ private:
+  void EncoderLoop();
+
+  PngWriter writer_;
+  const uint32_t row_window_;
+  std::mutex mut_;
+  /** Wakes encoder when a row is pushed or writer is finishing*/
+  std::condition_variable cv_;
+  /** Wakes pushers waiting for the window to move*/
+  std::condition_variable window_cv_;
+  /** Finished rows which are not encoded yet*/
+  std::map<uint32_t, std::vector<Color>> pending_;
+  uint32_t next_row_ = 0;
+  bool finishing_ = false;
+  std::thread encoder_;
+};
+
+#endif  // PNG_STREAM_WRITER_H
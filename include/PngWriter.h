@@ -17,6 +17,7 @@ class PngWriter {
 
   uint32_t img_width_ = 0;
   uint32_t img_height_ = 0;
+  std::vector<uint8_t> row_bytes_;
 
  public:
   PngWriter(const char *filename, uint32_t width, uint32_t height);
@@ -29,7 +30,12 @@ class PngWriter {
 
   bool IsOk() const { return png_struct_ && info_; }
 
+  uint32_t GetWidth() const { return img_width_; }
+  uint32_t GetHeight() const { return img_height_; }
+
   void SaveVectorToImage(const std::vector<Color> &vec);
+  /** Writes next row of the image. Row should contain GetWidth() colors*/
+  void WriteRow(const Color *row);
 };
 
 #endif  // PNG_WRITER_H
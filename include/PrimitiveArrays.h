@@ -0,0 +1,149 @@
+﻿/**
+ * @file PrimitiveArrays.h
+ * Contain copies of scene primitives grouped into contiguous arrays by their
+ * type, which acceleration structures test without virtual calls
+ */
+#ifndef PRIMITIVE_ARRAYS_H
+#define PRIMITIVE_ARRAYS_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <optional>
+#include <vector>
+
+#include "Accelerator.h"
+#include "GeoVec.h"
+#include "Instance.h"
+#include "Objects.h"
+#include "Ray.h"
+#include "SphereSet.h"
+#include "TriangleMesh.h"
+
+/** Types of objects which get their own array. Derived classes of these
+ * types are kOther, so their overridden methods are still used*/
+enum class PrimitiveKind : uint32_t {
+  kSphere = 0,
+  kTriangle,
+  kMesh,
+  kInstance,
+  kSphereSet,
+  kOther
+};
+
+PrimitiveKind GetPrimitiveKind(const Object& obj);
+
+/**
+ * Scene objects referenced by an acceleration structure through slot
+ * indices. Geometry of spheres and triangles is copied into arrays of plain
+ * structures, meshes, instances and sphere sets are kept in arrays of their
+ * own type, so
+ * the slot test is a switch over the kind followed by an inlined or direct
+ * call instead of a virtual call through a scattered heap object. Objects
+ * keep material and are returned in hit records. Objects are not owned and
+ * should outlive the arrays.
+ */
+class PrimitiveArrays {
+ public:
+  PrimitiveArrays() = default;
+  /** Object of the i-th slot is objects[i]*/
+  explicit PrimitiveArrays(const std::vector<const Object*>& objects);
+
+  /**
+   * Tests object of the slot and replaces the closest hit if the object is
+   * crossed closer
+   */
+  void Intersect(const Ray& ray, uint32_t slot, HitRecord& closest) const {
+    uint32_t ref = slots_[slot];
+    uint32_t idx = ref & kIndexMask;
+    std::optional<Real> dist;
+    const Object* obj = nullptr;
+    switch (static_cast<PrimitiveKind>(ref >> kKindShift)) {
+      case PrimitiveKind::kSphere:
+        dist = IntersectSphere(ray, spheres_[idx].center, spheres_[idx].r);
+        if (dist && *dist < closest.dist) obj = sphere_objects_[idx];
+        break;
+      case PrimitiveKind::kTriangle: {
+        const TriangleData& tri = triangles_[idx];
+        dist = IntersectTriangle(ray, tri.p0, tri.p1, tri.p2);
+        if (dist && *dist < closest.dist) obj = triangle_objects_[idx];
+        break;
+      }
+      case PrimitiveKind::kMesh:
+        obj = meshes_[idx];
+        dist = meshes_[idx]->TriangleMesh::GetClosesDist(ray);
+        break;
+      case PrimitiveKind::kInstance:
+        obj = instances_[idx];
+        dist = instances_[idx]->Instance::GetClosesDist(ray);
+        break;
+      case PrimitiveKind::kSphereSet:
+        obj = sphere_sets_[idx];
+        dist = sphere_sets_[idx]->SphereSet::GetClosesDist(ray);
+        break;
+      default:
+        obj = others_[idx];
+        dist = others_[idx]->GetClosesDist(ray);
+    }
+    if (dist && *dist < closest.dist) closest = {*dist, obj};
+  }
+
+  /** @return true if object of the slot is crossed closer than max_dist*/
+  bool IsCrossed(const Ray& ray, uint32_t slot, Real max_dist) const {
+    uint32_t ref = slots_[slot];
+    uint32_t idx = ref & kIndexMask;
+    std::optional<Real> dist;
+    switch (static_cast<PrimitiveKind>(ref >> kKindShift)) {
+      case PrimitiveKind::kSphere:
+        dist = IntersectSphere(ray, spheres_[idx].center, spheres_[idx].r);
+        break;
+      case PrimitiveKind::kTriangle: {
+        const TriangleData& tri = triangles_[idx];
+        dist = IntersectTriangle(ray, tri.p0, tri.p1, tri.p2);
+        break;
+      }
+      case PrimitiveKind::kMesh:
+        return meshes_[idx]->TriangleMesh::IsCrossed(ray, max_dist);
+      case PrimitiveKind::kInstance:
+        return instances_[idx]->Instance::IsCrossed(ray, max_dist);
+      case PrimitiveKind::kSphereSet:
+        return sphere_sets_[idx]->SphereSet::IsCrossed(ray, max_dist);
+      default:
+        return others_[idx]->IsCrossed(ray, max_dist);
+    }
+    return dist && *dist < max_dist;
+  }
+
+  /** Copies positions of moved spheres and triangles, set of objects should
+   * stay the same*/
+  void Update();
+  /** @return number of bytes allocated by the arrays*/
+  size_t GetMemorySize() const;
+
+ private:
+  /** Slot reference keeps the kind in the top bits and the index in the
+   * array of the kind in the rest*/
+  static constexpr uint32_t kKindShift = 29;
+  static constexpr uint32_t kIndexMask = (1U << kKindShift) - 1;
+
+  struct SphereData {
+    GeoVec center;
+    Real r = 0.0;
+  };
+  struct TriangleData {
+    GeoVec p0;
+    GeoVec p1;
+    GeoVec p2;
+  };
+
+  std::vector<uint32_t> slots_;
+  std::vector<SphereData> spheres_;
+  std::vector<TriangleData> triangles_;
+  std::vector<const Sphere*> sphere_objects_;
+  std::vector<const Triangle*> triangle_objects_;
+  std::vector<const TriangleMesh*> meshes_;
+  std::vector<const Instance*> instances_;
+  std::vector<const SphereSet*> sphere_sets_;
+  std::vector<const Object*> others_;
+};
+
+#endif  // PRIMITIVE_ARRAYS_H
@@ -1,41 +1,108 @@
 ﻿#ifndef RAY_H
 #define RAY_H
 
+#include <cmath>
 #include <utility>
 
 #include "GeoVec.h"
+/**
+ * Permutation and shear of coordinates which move the ray start point to the
+ * origin and turn the ray along z axis. Largest direction component becomes
+ * z, so the shear is bounded. Used by the watertight triangle test
+ */
+template <typename T>
+struct BasicRayShear {
+  /** Original coordinates which become x, y and z of the ray space*/
+  T BasicGeoVec<T>::*x;
+  T BasicGeoVec<T>::*y;
+  T BasicGeoVec<T>::*z;
+  /** Indices of the same coordinates (0 - x, 1 - y, 2 - z), for points
+   * stored as separate arrays of coordinates*/
+  int axis_x;
+  int axis_y;
+  int axis_z;
+  /** Point p goes to (p.x - shear_x * p.z, p.y - shear_y * p.z,
+   * shear_z * p.z), for the ray start point at the origin*/
+  T shear_x;
+  T shear_y;
+  T shear_z;
+};
+
 /** Ray reprasentation as point and direction. Direction in this class is
  * guaranteed to be normalized*/
-class Ray {
-  GeoVec pos_;
-  GeoVec dir_;
+template <typename T>
+class BasicRay {
+  using Vec = BasicGeoVec<T>;
+
+  Vec pos_;
+  Vec dir_;
+  BasicRayShear<T> shear_;
+
+  /** Prepares shear for the current direction*/
+  void UpdateShear() {
+    T abs_x = std::abs(dir_.x_);
+    T abs_y = std::abs(dir_.y_);
+    T abs_z = std::abs(dir_.z_);
+    if (abs_x >= abs_y && abs_x >= abs_z) {
+      shear_.x = &Vec::y_;
+      shear_.y = &Vec::z_;
+      shear_.z = &Vec::x_;
+    } else if (abs_y >= abs_z) {
+      shear_.x = &Vec::z_;
+      shear_.y = &Vec::x_;
+      shear_.z = &Vec::y_;
+    } else {
+      shear_.x = &Vec::x_;
+      shear_.y = &Vec::y_;
+      shear_.z = &Vec::z_;
+    }
+    // keeps the winding order, so front sides have positive edge functions
+    if (dir_.*shear_.z < 0) std::swap(shear_.x, shear_.y);
+    auto axis_of = [](T Vec::*coor) {
+      return coor == &Vec::x_ ? 0 : coor == &Vec::y_ ? 1 : 2;
+    };
+    shear_.axis_x = axis_of(shear_.x);
+    shear_.axis_y = axis_of(shear_.y);
+    shear_.axis_z = axis_of(shear_.z);
+    shear_.shear_z = T{1} / dir_.*shear_.z;
+    shear_.shear_x = dir_.*shear_.x * shear_.shear_z;
+    shear_.shear_y = dir_.*shear_.y * shear_.shear_z;
+  }
 
  public:
-  Ray() = delete;
-  Ray(GeoVec pos, GeoVec dir)
-      : pos_(std::move(pos)), dir_(std::move(dir.Norm())) {}
+  BasicRay() = delete;
+  BasicRay(Vec pos, Vec dir)
+      : pos_(std::move(pos)), dir_(std::move(dir.Norm())) {
+    UpdateShear();
+  }
   /** Moves ray start point to the given distance along its direction*/
-  constexpr Ray& Advance(double dist) {
+  constexpr BasicRay& Advance(T dist) {
     assert(dist > 0);
     pos_ = pos_ + dist * dir_;
     return *this;
   }
   /** Moves ray start point on the given distance in the direction opposite to
    * the ray direction*/
-  constexpr Ray& StepBack(double dist) {
+  constexpr BasicRay& StepBack(T dist) {
     assert(dist > 0);
     pos_ = pos_ - dist * dir_;
     return *this;
   }
   /** Sets new direction and normalizes it*/
-  Ray& UpdateDirection(const GeoVec& new_dir) {
+  BasicRay& UpdateDirection(const Vec& new_dir) {
     dir_ = new_dir;
     dir_.Norm();
+    UpdateShear();
     return *this;
   }
 
-  constexpr const GeoVec& GetPos() const { return pos_; }
-  constexpr const GeoVec& GetDir() const { return dir_; }
+  constexpr const Vec& GetPos() const { return pos_; }
+  constexpr const Vec& GetDir() const { return dir_; }
+  constexpr const BasicRayShear<T>& GetShear() const { return shear_; }
 };
 
+/** Ray and its shear in the scene geometry precision*/
+using Ray = BasicRay<Real>;
+using RayShear = BasicRayShear<Real>;
+
 #endif  // RAY_H
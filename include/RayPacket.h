@@ -0,0 +1,201 @@
+﻿/**
+ * @file RayPacket.h
+ * Contain group of coherent rays which are traced through hierarchies
+ * together, so node boxes are loaded once for all of them and tested against
+ * several rays at once with SIMD instructions
+ */
+#ifndef RAY_PACKET_H
+#define RAY_PACKET_H
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#include "ArrayView.h"
+#include "BoundingBox.h"
+#include "GeoVec.h"
+#include "Ray.h"
+#include "VecMath.h"
+
+/**
+ * Rays of a packet as structure of arrays, so the same coordinate of
+ * neighbouring rays is loaded into one register. Rays are selected by bit
+ * masks, ray i is active if bit i is set.
+ */
+struct RayPacket {
+  /** Maximal number of rays, masks of rays fit into uint64_t*/
+  static constexpr size_t kMaxSize = 64;
+
+  /** Rays should not be more than kMaxSize. Empty packet has no active rays
+   * and no valid slots*/
+  explicit RayPacket(ArrayView<Ray> rays) : size(rays.size()) {
+    assert(size <= kMaxSize);
+    std::fill(std::begin(max_dist), std::end(max_dist),
+              std::numeric_limits<Real>::max());
+    if (rays.empty()) {
+      is_coherent = false;
+      return;
+    }
+    for (size_t i = 0; i < kMaxSize; ++i) {
+      // unused slots repeat the last ray, they are never active
+      const Ray& ray = rays[std::min(i, size - 1)];
+      for (int axis = 0; axis < 3; ++axis) {
+        origin[axis][i] = GetAxis(ray.GetPos(), axis);
+        inv_dir[axis][i] = Real{1} / GetAxis(ray.GetDir(), axis);
+      }
+    }
+    is_coherent = true;
+    for (int axis = 0; axis < 3; ++axis) {
+      auto [origin_min, origin_max] =
+          std::minmax_element(origin[axis], origin[axis] + kMaxSize);
+      auto [inv_min, inv_max] =
+          std::minmax_element(inv_dir[axis], inv_dir[axis] + kMaxSize);
+      origin_bounds[axis][0] = *origin_min;
+      origin_bounds[axis][1] = *origin_max;
+      inv_dir_bounds[axis][0] = *inv_min;
+      inv_dir_bounds[axis][1] = *inv_max;
+      is_coherent &= std::isfinite(*inv_min) && std::isfinite(*inv_max) &&
+                     (*inv_min > 0) == (*inv_max > 0);
+    }
+  }
+
+  /** @return mask of all rays of the packet*/
+  uint64_t GetAllMask() const {
+    return size == kMaxSize ? ~0ULL : (1ULL << size) - 1;
+  }
+
+  /**
+   * Interval arithmetic test of the whole packet: slab distances are bounded
+   * for all rays at once by the bounds of their origins and inverse
+   * directions. Works only for coherent packets.
+   * @return false if none of the rays enters the box
+   */
+  bool MayEnter(const BoundingBox& box) const {
+    Real t_in = 0.0;
+    Real t_out = std::numeric_limits<Real>::max();
+    for (int axis = 0; axis < 3; ++axis) {
+      // bounds of distances to the lower and the upper planes of the axis
+      Real t_bounds[2][2];
+      for (int side = 0; side < 2; ++side) {
+        Real plane = GetAxis(side ? box.max : box.min, axis);
+        Real products[4];
+        for (int k = 0; k < 4; ++k) {
+          products[k] = (plane - origin_bounds[axis][k & 1]) *
+                        inv_dir_bounds[axis][k >> 1];
+        }
+        auto [low, high] = std::minmax_element(products, products + 4);
+        t_bounds[side][0] = *low;
+        t_bounds[side][1] = *high;
+      }
+      // for negative directions the upper plane is entered first
+      int near_side = inv_dir_bounds[axis][0] < 0;
+      t_in = std::max(t_in, t_bounds[near_side][0]);
+      t_out = std::min(t_out, t_bounds[1 - near_side][1]);
+    }
+    return t_in <= t_out;
+  }
+
+  alignas(32) Real origin[3][kMaxSize];
+  alignas(32) Real inv_dir[3][kMaxSize];
+  /** Distance of the closest hit found so far for every ray*/
+  alignas(32) Real max_dist[kMaxSize];
+  size_t size;
+  /** Smallest and largest origin coordinate and inverse direction component
+   * for every axis*/
+  Real origin_bounds[3][2];
+  Real inv_dir_bounds[3][2];
+  /** Direction components of all rays are finite and have the same signs
+   * along every axis, so bounds can be used by MayEnter*/
+  bool is_coherent;
+};
+
+/** Calls func(i) for every ray i selected by the mask in increasing order*/
+template <typename Func>
+void ForEachRay(uint64_t mask, Func&& func) {
+  for (size_t i = 0; mask; ++i, mask >>= 1) {
+    if (mask & 1) func(i);
+  }
+}
+
+/** @return index of the first ray selected by the non-empty mask*/
+inline size_t GetFirstRay(uint64_t mask) {
+  size_t result = 0;
+  for (; !(mask & 1); mask >>= 1) ++result;
+  return result;
+}
+
+/**
+ * Slab test of the active rays against the box, as BoundingBox::ClipRay.
+ * Rays of coherent packets usually enter the same boxes, so if the first
+ * active ray enters the box, all active rays are sent into it without
+ * testing them. Otherwise the whole packet is culled by interval arithmetic
+ * or rays are tested by groups, groups without active rays are skipped.
+ * @param[out] t_near_min - distance at which the first entering ray enters
+ * the box
+ * @return mask of active rays which may enter the box closer than their
+ * max_dist
+ */
+inline uint64_t IntersectPacket(const BoundingBox& box,
+                                const RayPacket& packet, uint64_t active,
+                                Real& t_near_min) {
+  uint64_t result = 0;
+  t_near_min = std::numeric_limits<Real>::max();
+  // inverted bounds of empty boxes would pass the tests below
+  if (box.IsEmpty()) return result;
+  size_t first_ray = GetFirstRay(active);
+  GeoVec first_pos{packet.origin[0][first_ray], packet.origin[1][first_ray],
+                   packet.origin[2][first_ray]};
+  GeoVec first_inv_dir{packet.inv_dir[0][first_ray],
+                       packet.inv_dir[1][first_ray],
+                       packet.inv_dir[2][first_ray]};
+  Real first_t_far = packet.max_dist[first_ray];
+  t_near_min = 0.0;
+  if (box.ClipRay(first_pos, first_inv_dir, t_near_min, first_t_far)) {
+    return active;
+  }
+  t_near_min = std::numeric_limits<Real>::max();
+  if (packet.is_coherent && !packet.MayEnter(box)) return result;
+  // rays are tested by groups of register width
+  using P = vec_math::Pack<Real>;
+  using Reg = P::Reg;
+  constexpr uint64_t kGroupMask = (1ULL << P::kWidth) - 1;
+  Reg lower[3];
+  Reg upper[3];
+  for (int axis = 0; axis < 3; ++axis) {
+    lower[axis] = P::Set1(GetAxis(box.min, axis));
+    upper[axis] = P::Set1(GetAxis(box.max, axis));
+  }
+  Real t_near[P::kWidth];
+  for (size_t first = 0; first < packet.size; first += P::kWidth) {
+    uint64_t group_active = (active >> first) & kGroupMask;
+    if (!group_active) continue;
+    Reg t_in = P::Set1(0);
+    Reg t_out = P::Load(packet.max_dist + first);
+    for (int axis = 0; axis < 3; ++axis) {
+      Reg origin = P::Load(packet.origin[axis] + first);
+      Reg inv_dir = P::Load(packet.inv_dir[axis] + first);
+      Reg t0 = P::Mul(P::Sub(lower[axis], origin), inv_dir);
+      Reg t1 = P::Mul(P::Sub(upper[axis], origin), inv_dir);
+      // NaN appears when ray starts on the box plane and is parallel to it,
+      // such planes are ignored as in ClipRay. Both bounds of the axis are
+      // made NaN then and Max/Min return the second operand for NaN
+      P::Mask nan = P::Unordered(t0, t1);
+      t_in = P::Max(P::NanWhere(P::Min(t0, t1), nan), t_in);
+      t_out = P::Min(P::NanWhere(P::Max(t0, t1), nan), t_out);
+    }
+    uint64_t hit = P::MoveMask(P::LessEq(t_in, t_out)) & group_active;
+    if (!hit) continue;
+    result |= hit << first;
+    P::Store(t_near, t_in);
+    for (size_t lane = 0; lane < P::kWidth; ++lane) {
+      if (hit & (1ULL << lane)) {
+        t_near_min = std::min(t_near_min, t_near[lane]);
+      }
+    }
+  }
+  return result;
+}
+
+#endif  // RAY_PACKET_H
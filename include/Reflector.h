@@ -1,9 +1,8 @@
 ﻿#ifndef REFLECTOR_H
 #define REFLECTOR_H
 
-#include <random>
-
 #include "GeoVec.h"
+#include "Sampler.h"
 /**
  * Claculates mirror like reflection of an inciden ray
  * Method expects that ray hits the surface - it does not perform additional
@@ -21,35 +20,47 @@ inline GeoVec MirrorReflect(const GeoVec& dir, const GeoVec& norm) {
  * Claculates random reflection of an incident ray
  * Method expects that ray hits the surface - it does not perform additional
  * checks for it. Returned direction is not normed
+ * @param sampler - source of random numbers for the current path
  * @param dir - incident ray direction
  * @param norm - reflective surface normal
  *
  * @return direction obtained by reflection
  */
-GeoVec DiffuseReflect(std::mt19937& rnd, const GeoVec& dir, const GeoVec& norm);
+GeoVec DiffuseReflect(Sampler& sampler, const GeoVec& dir,
+                      const GeoVec& norm);
 /**
  * Method perform calculation of reflection in mixed manner
  * With some probability (based on polishness) reflection will be calculated for
  * mirror like case or random reflection in 2 pi.
  * Returned direction is not normed
  *
+ * @param sampler - source of random numbers for the current path
  * @param polishness - defines distribution of the reflection mix. Should be in
  * range [0, 1]. If it is 0 - all rays will be randomly reflected, if it is 1 -
  * all rays will be reflected mirror-like
  * @param dir - initial ray direction
  * @param norm - reflective surface normal
+ * @param[out] is_diffuse - true if the direction was chosen randomly, such
+ * directions are uniformly distributed over the hemisphere of the normal
  *
  * @return direction obtained by reflection
  */
-inline GeoVec HybridReflect(std::mt19937& rnd, double polishness,
-                            const GeoVec& dir, const GeoVec& norm) {
+inline GeoVec HybridReflect(Sampler& sampler, double polishness,
+                            const GeoVec& dir, const GeoVec& norm,
+                            bool& is_diffuse) {
   assert(polishness >= 0);
   assert(polishness <= 1);
-  std::uniform_real_distribution<double> dist{0, 1};
-  if (dist(rnd) < polishness) {
+  is_diffuse = sampler.Get1D() >= polishness;
+  if (!is_diffuse) {
     return MirrorReflect(dir, norm);
   }
-  return DiffuseReflect(rnd, dir, norm);
+  return DiffuseReflect(sampler, dir, norm);
+}
+/** Same as above, when the kind of the reflection is not needed*/
+inline GeoVec HybridReflect(Sampler& sampler, double polishness,
+                            const GeoVec& dir, const GeoVec& norm) {
+  bool is_diffuse = false;
+  return HybridReflect(sampler, polishness, dir, norm, is_diffuse);
 }
 
 #endif  // REFLECTOR_H
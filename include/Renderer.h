@@ -0,0 +1,161 @@
+﻿/**
+ * @file Renderer.h
+ * Contain multithreaded render engine
+ */
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "Accelerator.h"
+#include "AccumulationBuffer.h"
+#include "Color.h"
+#include "Config.h"
+#include "LightList.h"
+#include "Objects.h"
+#include "Pixel.h"
+#include "Sampler.h"
+#include "ThreadPool.h"
+
+namespace render {
+/** Side of the square pixel block which is rendered as one task*/
+constexpr int kBlockSize = 16;
+/** Height in blocks of the picture strip which is covered by one piece of the
+ * space filling curve. Strips are traced from up to bottom, so rows are
+ * finished in order and can be encoded while the rest is rendered*/
+constexpr int kCurveStripHeight = 4;
+/** Rectangular block of pixels. Coordinates are given in pixels*/
+struct Block {
+  int x0 = 0;
+  int y0 = 0;
+  int width = 0;
+  int height = 0;
+};
+/** @return position of the point on the Z-order curve*/
+uint64_t MortonIndex(uint32_t x, uint32_t y);
+/** @return position of the point on the Hilbert curve which covers square
+ * with the given side. Side should be a power of two*/
+uint64_t HilbertIndex(uint32_t side, uint32_t x, uint32_t y);
+/**
+ * @return all points of the width x height rectangle listed along the given
+ * space filling curve. Neighbouring points of the list are close to each
+ * other, so consecutive work touches nearby geometry
+ */
+std::vector<std::pair<int, int>> CreateCurveOrder(int width, int height,
+                                                  TileOrder order);
+/**
+ * Splits picture into blocks of kBlockSize x kBlockSize pixels. Blocks on the
+ * right and bottom borders can be smaller. With kScanline order blocks are
+ * listed from left to right, from up to bottom. Otherwise picture is split
+ * into strips of kCurveStripHeight block rows, strips are listed from up to
+ * bottom and blocks of a strip follow the curve through its square cells
+ */
+std::vector<Block> CreateBlocks(int width_in_pixel, int height_in_pixel,
+                                TileOrder order = TileOrder::kScanline);
+}  // namespace render
+
+/**
+ * Renders picture described by settings in parallel. Picture is split into
+ * pixel blocks which are scheduled over the thread pool. Traced samples are
+ * summed in the accumulation buffer, so picture can be rendered in several
+ * passes.
+ */
+class Renderer {
+ public:
+  /**
+   * Callback which is invoked after every finished pass.
+   * @param accum - samples accumulated so far
+   * @param sample_num - number of samples per pixel accumulated so far
+   */
+  using PassCallback =
+      std::function<void(const AccumulationBuffer& accum, int sample_num)>;
+  /**
+   * Callback which is invoked from render threads as soon as all pixels of a
+   * row and of every row above it are finished. Rows come in increasing
+   * order, one call at a time, but not always from the same thread.
+   * @param row - index of the finished row
+   * @param colors - final colors of the row pixels
+   */
+  using RowCallback = std::function<void(int row, std::vector<Color> colors)>;
+
+  Renderer(const GeneralSettings& general, const CameraSettings& camera,
+           std::vector<const Object*> objects);
+  /**
+   * Traces all samples of every pixel. If samples_per_pass is set, samples are
+   * traced in passes of that size and on_pass is called after each of them.
+   * Otherwise whole picture is traced in one pass.
+   * on_row is called for rows finished during the last pass.
+   * @return colors of all pixels listed from left to right, from up to
+   * bottom
+   */
+  std::vector<Color> Render(const PassCallback& on_pass = nullptr,
+                            const RowCallback& on_row = nullptr);
+  /** Traces samples [first_sample, first_sample + sample_num) of every pixel
+   * in the pixel range and adds them to the accumulation buffer. on_row is
+   * called for every row once all its blocks and blocks of the rows above
+   * are traced*/
+  void RenderPass(int first_sample, int sample_num,
+                  const RowCallback& on_row = nullptr);
+  /**
+   * Restricts render to pixels [pixel_begin, pixel_end). Pixels are indexed
+   * in the order of pixel::CreateTiles. Other pixels stay empty.
+   */
+  void SetPixelRange(size_t pixel_begin, size_t pixel_end);
+  /** Moves camera, e.g. for the next frame of an animation. Picture size is
+   * not changed*/
+  void SetCamera(const CameraSettings& camera);
+  /**
+   * Updates acceleration structure after objects were moved for the next
+   * frame of an animation. Structure is refitted while its cost stays below
+   * refit_cost_ratio of the cost after the last build, otherwise it is
+   * rebuilt.
+   * @return true if structure was rebuilt
+   */
+  bool UpdateGeometry();
+
+  const AccumulationBuffer& GetAccumulation() const { return accum_; }
+  const Accelerator& GetAccelerator() const { return *accel_; }
+  /** @return time spent on the last build or refit of the acceleration
+   * structure*/
+  double GetBuildTimeInSec() const { return build_time_in_sec_; }
+  size_t GetThreadNumber() const { return pool_.GetThreadNumber(); }
+
+ private:
+  /** Traces given samples of all pixels in the block and stores their sums
+   * in the given buffer*/
+  void RenderBlock(const render::Block& block, int first_sample,
+                   int sample_num, Sampler& sampler,
+                   std::vector<PixelAccum>& block_accum) const;
+  /** Same as RenderBlock, but camera rays of squares of pixels are traced as
+   * packets, see GeneralSettings::ray_packet_side*/
+  void RenderBlockByPackets(const render::Block& block, int first_sample,
+                            int sample_num, Sampler& sampler,
+                            std::vector<PixelAccum>& block_accum) const;
+
+  GeneralSettings general_;
+  std::vector<pixel::Tile> tiles_;
+  GeoVec viewer_;
+  /** Objects the structure is built over, kept for rebuilds*/
+  std::vector<const Object*> objects_;
+  std::unique_ptr<Accelerator> accel_;
+  /** Light sources sampled at diffuse reflections, empty if light sampling
+   * is off. Brightest light color is always found for Russian roulette*/
+  LightList lights_;
+  double build_time_in_sec_ = 0.0;
+  /** Cost of the structure right after its last build*/
+  double built_cost_ = 0.0;
+  std::vector<render::Block> blocks_;
+  /** Order of pixels inside a block, coordinates are relative to the block*/
+  std::vector<std::pair<int, int>> block_pixel_order_;
+  size_t pixel_begin_ = 0;
+  size_t pixel_end_ = 0;
+  AccumulationBuffer accum_;
+  ThreadPool pool_;
+};
+
+#endif  // RENDERER_H
@@ -0,0 +1,67 @@
+/**
+ * @file Sampler.h
+ * Contain source of random numbers for path tracing
+ */
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <cstdint>
+#include <cstdlib>
+
+/**
+ * Counter based random numbers source. Every value is a hash of
+ * (seed, pixel, sample index, bounce, dimension), so value does not depend on
+ * the order in which pixels are traced or on the thread tracing them.
+ * Scene objects do not own any random state, everything random along a path
+ * is drawn from the sampler passed through the tracing functions.
+ */
+class Sampler {
+  uint64_t seed_key_ = 0;
+  uint64_t pixel_key_ = 0;
+  uint64_t sample_key_ = 0;
+  uint64_t bounce_key_ = 0;
+  uint64_t first_sample_ = 0;
+  uint64_t dim_ = 0;
+
+  /** Weyl sequence increment used to walk dimensions of one bounce*/
+  static constexpr uint64_t kGolden = 0x9e3779b97f4a7c15ULL;
+
+ public:
+  /** Finalizer of the SplitMix64 generator - bijective 64 bit hash*/
+  static constexpr uint64_t Mix64(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+
+  explicit Sampler(uint64_t seed) : seed_key_(Mix64(seed + kGolden)) {
+    StartPixel(0, 0);
+  }
+  /**
+   * Selects pixel which is traced next.
+   * @param first_sample - index of the sample which StartSample(0) refers to
+   */
+  void StartPixel(uint64_t pixel_idx, uint64_t first_sample) {
+    pixel_key_ = Mix64(seed_key_ ^ pixel_idx);
+    first_sample_ = first_sample;
+    StartSample(0);
+  }
+  /** Starts n-th sample after the first one of the current pixel. Values of
+   * the sample before its first bounce are used to shoot the camera ray*/
+  void StartSample(uint64_t n) {
+    sample_key_ = Mix64(pixel_key_ ^ (first_sample_ + n));
+    StartBounce(0);
+  }
+  /** Starts new dimensions stream for the given bounce of the current sample*/
+  void StartBounce(uint64_t bounce) {
+    bounce_key_ = Mix64(sample_key_ + bounce * kGolden);
+    dim_ = 0;
+  }
+  /** @return random value uniformly distributed in [0, 1)*/
+  double Get1D() {
+    uint64_t bits = Mix64(bounce_key_ + (++dim_) * kGolden);
+    return static_cast<double>(bits >> 11) * 0x1.0p-53;
+  }
+};
+
+#endif  // SAMPLER_H
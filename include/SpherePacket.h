@@ -0,0 +1,91 @@
+﻿/**
+ * @file SpherePacket.h
+ * Contain test of one ray against several spheres at once with SIMD
+ * instructions
+ */
+#ifndef SPHERE_PACKET_H
+#define SPHERE_PACKET_H
+
+#include <cstdint>
+#include <optional>
+
+#include "GeoVec.h"
+#include "Ray.h"
+#include "VecMath.h"
+
+/** Number of spheres tested at once, leaves of sphere set hierarchies hold
+ * at most this number of spheres*/
+inline constexpr uint32_t kSpherePacketWidth = vec_math::kWideWidth;
+
+/** Spheres stored as arrays of center coordinates and radii. Arrays should
+ * have kSpherePacketWidth elements after the last sphere, so lanes can be
+ * loaded past it*/
+struct SphereSoA {
+  const Real* center[3];
+  const Real* r;
+};
+
+/**
+ * Test of IntersectSphere for spheres [first, first + num) done in lanes of
+ * vec_math::Pack, e.g. eight float or four double spheres at once with AVX.
+ * Spheres missed by the ray line, behind the ray or crossed farther than
+ * max_dist are rejected without square roots, the root is taken only for
+ * lanes which contain a closer hit.
+ * @param[in,out] max_dist - only closer hits are found, reduced to the
+ * distance of the found hit
+ * @return index of the closest crossed sphere
+ */
+inline std::optional<uint32_t> IntersectSpherePacket(const Ray& ray,
+                                                     const SphereSoA& spheres,
+                                                     uint32_t first,
+                                                     uint32_t num,
+                                                     Real& max_dist) {
+  using P = vec_math::Pack<Real>;
+  using Reg = P::Reg;
+  const GeoVec& pos = ray.GetPos();
+  const GeoVec& dir = ray.GetDir();
+  Reg pos_v[3] = {P::Set1(pos.x_), P::Set1(pos.y_), P::Set1(pos.z_)};
+  Reg dir_v[3] = {P::Set1(dir.x_), P::Set1(dir.y_), P::Set1(dir.z_)};
+  Reg zero = P::Set1(0);
+  std::optional<uint32_t> result;
+  for (uint32_t base = 0; base < num; base += P::kWidth) {
+    uint32_t idx = first + base;
+    Reg to_c[3];
+    for (int axis = 0; axis < 3; ++axis) {
+      to_c[axis] = P::Sub(P::Load(spheres.center[axis] + idx), pos_v[axis]);
+    }
+    Reg proj = P::Add(P::Add(P::Mul(dir_v[0], to_c[0]),
+                             P::Mul(dir_v[1], to_c[1])),
+                      P::Mul(dir_v[2], to_c[2]));
+    // squared distance from the center to the ray line is taken from the
+    // perpendicular as in IntersectSphere
+    Reg perp_len2 = zero;
+    for (int axis = 0; axis < 3; ++axis) {
+      Reg perp = P::Sub(to_c[axis], P::Mul(proj, dir_v[axis]));
+      perp_len2 = P::Add(perp_len2, P::Mul(perp, perp));
+    }
+    Reg r = P::Load(spheres.r + idx);
+    Reg disc = P::Sub(P::Mul(r, r), perp_len2);
+    // hit distance proj - sqrt(disc) is closer than max_dist if proj is, or
+    // if (proj - max_dist)^2 < disc
+    Reg behind_max = P::Sub(proj, P::Set1(max_dist));
+    P::Mask is_hit = P::And(
+        P::And(P::Greater(proj, zero), P::Greater(disc, zero)),
+        P::Or(P::Less(behind_max, zero),
+              P::Less(P::Mul(behind_max, behind_max), disc)));
+    unsigned mask = P::MoveMask(is_hit);
+    if (num - base < P::kWidth) mask &= (1U << (num - base)) - 1;
+    if (!mask) continue;
+    Real dist[P::kWidth];
+    P::Store(dist, P::Sub(proj, P::Sqrt(disc)));
+    for (uint32_t lane = 0; mask; ++lane, mask >>= 1) {
+      if ((mask & 1) && dist[lane] < max_dist) {
+        max_dist = dist[lane];
+        result = idx + lane;
+      }
+    }
+  }
+  return result;
+}
+
+#endif  // SPHERE_PACKET_H
@@ -0,0 +1,79 @@
+﻿/**
+ * @file SphereSet.h
+ * Contain many spheres of one material stored as structure of arrays with
+ * their own bounding volume hierarchy
+ */
+#ifndef SPHERE_SET_H
+#define SPHERE_SET_H
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "BoundingBox.h"
+#include "BvhNode.h"
+#include "GeoVec.h"
+#include "Objects.h"
+#include "Ray.h"
+#include "ThreadPool.h"
+
+/**
+ * Spheres with one material, e.g. particles or molecules. Center coordinates
+ * and radii are kept as structure of arrays sorted in the order of the
+ * leaves of the set hierarchy, spheres of a leaf are tested at once with
+ * SIMD instructions (see IntersectSpherePacket). Set is one object in the
+ * scene structure, the crossed sphere is found by the set hierarchy.
+ */
+class SphereSet : public Object {
+ public:
+  /** Every center should have a positive radius, throws std::logic_error
+   * otherwise. Pool, if given, is used to build the hierarchy*/
+  SphereSet(const std::vector<GeoVec>& centers,
+            const std::vector<Real>& radii, ThreadPool* pool = nullptr);
+  /** Set without hierarchy, see NoHierarchy. Spheres keep their order*/
+  SphereSet(const std::vector<GeoVec>& centers,
+            const std::vector<Real>& radii, NoHierarchy);
+
+  std::optional<Real> GetClosesDist(const Ray& ray) const override;
+  bool IsCrossed(const Ray& ray, Real max_dist) const override;
+  /** Normal depends on the crossed sphere, so it cannot be found by the
+   * point only. Throws, GetSurfacePoint should be used instead*/
+  GeoVec GetNorm(const GeoVec& p) const override;
+  BoundingBox GetBoundingBox() const override;
+  SurfacePoint GetSurfacePoint(const Ray& ray, Real dist) const override;
+
+  size_t GetSphereNumber() const { return sphere_num_; }
+  /** Spheres are in the internal order*/
+  GeoVec GetCenter(size_t idx) const { return {x_[idx], y_[idx], z_[idx]}; }
+  Real GetRadius(size_t idx) const { return r_[idx]; }
+  /** @return number of bytes used by spheres and the hierarchy*/
+  size_t GetMemorySize() const;
+
+  /** Moves spheres to their centers in the frame set and refits the
+   * hierarchy, radii are kept. Should not be called during render, throws
+   * std::logic_error if the frame has other number of spheres*/
+  void UpdateCenters(const SphereSet& frame);
+
+ private:
+  BoundingBox GetSphereBox(uint32_t slot) const;
+  /** Stores spheres in the given order, arrays get padding*/
+  void SetSpheres(const std::vector<GeoVec>& centers,
+                  const std::vector<Real>& radii,
+                  const std::vector<uint32_t>& order);
+  /** @return index of the closest crossed sphere, max_dist is reduced to its
+   * distance*/
+  std::optional<uint32_t> FindClosestSphere(const Ray& ray,
+                                            Real& max_dist) const;
+
+  size_t sphere_num_ = 0;
+  /** Arrays are padded by one packet of zero spheres*/
+  std::vector<Real> x_;
+  std::vector<Real> y_;
+  std::vector<Real> z_;
+  std::vector<Real> r_;
+  /** Slot of every sphere given to the constructor in the internal order*/
+  std::vector<uint32_t> sphere_to_slot_;
+  std::vector<BvhNode> nodes_;
+};
+
+#endif  // SPHERE_SET_H
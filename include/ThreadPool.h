@@ -0,0 +1,71 @@
+﻿/**
+ * @file ThreadPool.h
+ * Contain pool of worker threads with work stealing scheduler
+ */
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Pool of persistent worker threads which execute indexed tasks.
+ * Every worker owns a deque of task indices. Worker takes tasks from the front
+ * of its own deque and, when it is empty, steals from the back of the others.
+ */
+class ThreadPool {
+ public:
+  /** Task receives index of the task and index of the worker executing it*/
+  using Task = std::function<void(size_t task_idx, size_t worker_idx)>;
+
+  /** Creates given number of workers. 0 means hardware concurrency*/
+  explicit ThreadPool(size_t thread_num);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+  ThreadPool(ThreadPool&&) = delete;
+  ThreadPool& operator=(ThreadPool&&) = delete;
+
+  size_t GetThreadNumber() const { return workers_.size(); }
+  /**
+   * Executes task for every index in [0, task_num) and returns when all of
+   * them are finished. Indices are dealt to workers round robin, so each worker
+   * processes its share in increasing order.
+   * If any task throws, the first exception is rethrown here.
+   */
+  void Run(size_t task_num, const Task& task);
+
+ private:
+  /** Deques are aligned to the cache line, so locking one of them does not
+   * invalidate the neighbours*/
+  struct alignas(64) WorkQueue {
+    std::mutex mut;
+    std::deque<size_t> tasks;
+  };
+
+  void WorkerLoop(size_t worker_idx);
+  /** Takes task from own deque or steals one from other workers*/
+  bool PopTask(size_t worker_idx, size_t& task_idx);
+
+  std::unique_ptr<WorkQueue[]> queues_;
+  std::vector<std::thread> workers_;
+
+  std::mutex mut_;
+  std::condition_variable job_cv_;
+  std::condition_variable done_cv_;
+  const Task* task_ = nullptr;
+  size_t job_id_ = 0;
+  size_t finished_workers_ = 0;
+  std::exception_ptr error_;
+  bool stop_ = false;
+};
+
+#endif  // THREAD_POOL_H
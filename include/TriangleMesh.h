@@ -0,0 +1,119 @@
+﻿/**
+ * @file TriangleMesh.h
+ * Contain triangle mesh stored as shared vertex and index buffers with its own
+ * bounding volume hierarchy
+ */
+#ifndef TRIANGLE_MESH_H
+#define TRIANGLE_MESH_H
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <optional>
+#include <vector>
+
+#include "BoundingBox.h"
+#include "BvhNode.h"
+#include "GeoVec.h"
+#include "Objects.h"
+#include "Ray.h"
+#include "ThreadPool.h"
+
+/**
+ * Triangles with one material. Equal points are stored once, vertex
+ * coordinates and vertex indices of faces are kept as structure of arrays.
+ * Faces are sorted in the order of the leaves of the mesh hierarchy and
+ * vertices in the order of their first use, so faces tested together are
+ * close in memory. Faces of a leaf are tested at once with SIMD
+ * instructions (see IntersectTrianglePacket). Mesh is one object in the
+ * scene structure, the crossed face is found by the mesh hierarchy. Faces are
+ * visible from the side of the normal (p1 - p0) x (p2 - p0) as Triangle
+ * objects.
+ */
+class TriangleMesh : public Object {
+ public:
+  /** Indices of face points*/
+  using Face = std::array<uint32_t, 3>;
+  /** Vertex of a point which is not used by any face*/
+  static constexpr uint32_t kNoVertex = UINT32_MAX;
+
+  /** Arrays of the built mesh, e.g. to store it in the accelerator cache*/
+  struct Data {
+    std::vector<Real> x;
+    std::vector<Real> y;
+    std::vector<Real> z;
+    std::vector<uint32_t> face_v0;
+    std::vector<uint32_t> face_v1;
+    std::vector<uint32_t> face_v2;
+    /** Vertex of every point given to the build, kNoVertex for points not
+     * used by faces*/
+    std::vector<uint32_t> point_to_vertex;
+    std::vector<BvhNode> nodes;
+  };
+
+  /** Faces should refer to existing points, throws std::logic_error
+   * otherwise. Pool, if given, is used to build the hierarchy*/
+  TriangleMesh(const std::vector<GeoVec>& points,
+               const std::vector<Face>& faces, ThreadPool* pool = nullptr);
+  /** Mesh without hierarchy, see NoHierarchy. Points are not merged and
+   * faces keep their order. Throws std::logic_error if faces refer to
+   * missing points*/
+  TriangleMesh(const std::vector<GeoVec>& points,
+               const std::vector<Face>& faces, NoHierarchy);
+  /** Mesh over arrays made by BuildData. Arrays are not checked, loaders of
+   * stored arrays should check them first*/
+  explicit TriangleMesh(Data data);
+
+  /** Builds hierarchy and arrays of the mesh over the points and faces,
+   * throws std::logic_error if faces refer to missing points*/
+  static Data BuildData(const std::vector<GeoVec>& points,
+                        const std::vector<Face>& faces,
+                        ThreadPool* pool = nullptr);
+
+  std::optional<Real> GetClosesDist(const Ray& ray) const override;
+  bool IsCrossed(const Ray& ray, Real max_dist) const override;
+  /** Normal depends on the crossed face, so it cannot be found by the point
+   * only. Throws, GetSurfacePoint should be used instead*/
+  GeoVec GetNorm(const GeoVec& p) const override;
+  BoundingBox GetBoundingBox() const override;
+  SurfacePoint GetSurfacePoint(const Ray& ray, Real dist) const override;
+
+  size_t GetTriangleNumber() const { return face_v0_.size(); }
+  size_t GetVertexNumber() const { return x_.size(); }
+  /** @return points of the face, faces are in the internal order*/
+  std::array<GeoVec, 3> GetTriangle(size_t face) const {
+    return {GetVertex(face_v0_[face]), GetVertex(face_v1_[face]),
+            GetVertex(face_v2_[face])};
+  }
+  /** @return number of bytes used by vertices, faces and the hierarchy*/
+  size_t GetMemorySize() const;
+
+  /** @return true if the frame mesh is made of the same points and the same
+   * faces in any order and its points can be copied by UpdatePoints*/
+  bool CanUpdatePoints(const TriangleMesh& frame) const;
+  /** Moves points to their positions in the frame mesh and refits the
+   * hierarchy. Should not be called during render, throws std::logic_error
+   * if CanUpdatePoints is false*/
+  void UpdatePoints(const TriangleMesh& frame);
+
+ private:
+  GeoVec GetVertex(uint32_t idx) const { return {x_[idx], y_[idx], z_[idx]}; }
+  BoundingBox GetFaceBox(uint32_t face) const;
+  /** @return index of the closest crossed face, max_dist is reduced to its
+   * distance*/
+  std::optional<uint32_t> FindClosestFace(const Ray& ray,
+                                          Real& max_dist) const;
+
+  std::vector<Real> x_;
+  std::vector<Real> y_;
+  std::vector<Real> z_;
+  std::vector<uint32_t> face_v0_;
+  std::vector<uint32_t> face_v1_;
+  std::vector<uint32_t> face_v2_;
+  /** Vertex of every point given to the constructor, kNoVertex for points
+   * not used by faces*/
+  std::vector<uint32_t> point_to_vertex_;
+  std::vector<BvhNode> nodes_;
+};
+
+#endif  // TRIANGLE_MESH_H
@@ -0,0 +1,180 @@
+﻿/**
+ * @file TrianglePacket.h
+ * Contain watertight test of one ray against several triangles at once with
+ * SIMD instructions
+ */
+#ifndef TRIANGLE_PACKET_H
+#define TRIANGLE_PACKET_H
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+
+#include "BoundingBox.h"
+#include "GeoVec.h"
+#include "Objects.h"
+#include "Ray.h"
+#include "VecMath.h"
+
+/** Number of triangles tested at once, leaves of mesh hierarchies hold at
+ * most this number of faces*/
+inline constexpr uint32_t kTrianglePacketWidth = 4;
+
+/** Triangles given by indices of their vertices in arrays of vertex
+ * coordinates*/
+struct TriangleSoA {
+  /** Arrays of x, y and z coordinates of vertices*/
+  const Real* coor[3];
+  /** Arrays of indices of the first, second and third vertex of faces*/
+  const uint32_t* vertex[3];
+};
+
+namespace triangle_packet {
+/** Lanes of one register, all faces of a packet are tested at once with
+ * SSE for float and AVX for double geometry, by pairs with SSE2 for
+ * double*/
+using P = vec_math::Pack<Real, kTrianglePacketWidth>;
+inline constexpr uint32_t kLaneNum = static_cast<uint32_t>(P::kWidth);
+
+/**
+ * Watertight test of IntersectTriangle done for kLaneNum faces, whose
+ * vertex indices are given by idx[vertex][lane]
+ * @param[out] dist - distance for every lane, set only if some face is hit
+ * @return bit mask of faces crossed closer than max_dist
+ */
+inline unsigned IntersectLanes(const Ray& ray, const TriangleSoA& tris,
+                               const uint32_t* const* idx, Real max_dist,
+                               Real* dist) {
+  using Reg = P::Reg;
+  const RayShear& s = ray.GetShear();
+  const GeoVec& pos = ray.GetPos();
+  Reg pos_x = P::Set1(GetAxis(pos, s.axis_x));
+  Reg pos_y = P::Set1(GetAxis(pos, s.axis_y));
+  Reg pos_z = P::Set1(GetAxis(pos, s.axis_z));
+  Reg shear_x = P::Set1(s.shear_x);
+  Reg shear_y = P::Set1(s.shear_y);
+  // vertices in the ray space
+  Reg x[3];
+  Reg y[3];
+  Reg z[3];
+  for (int k = 0; k < 3; ++k) {
+    z[k] = P::Sub(P::Gather(tris.coor[s.axis_z], idx[k]), pos_z);
+    x[k] = P::Sub(P::Sub(P::Gather(tris.coor[s.axis_x], idx[k]), pos_x),
+                  P::Mul(shear_x, z[k]));
+    y[k] = P::Sub(P::Sub(P::Gather(tris.coor[s.axis_y], idx[k]), pos_y),
+                  P::Mul(shear_y, z[k]));
+  }
+  Reg u = P::DiffOfProducts(x[2], y[1], y[2], x[1]);
+  Reg v = P::DiffOfProducts(x[0], y[2], y[0], x[2]);
+  Reg w = P::DiffOfProducts(x[1], y[0], y[1], x[0]);
+  Reg zero = P::Set1(0);
+  if constexpr (std::is_same_v<Real, float>) {
+    unsigned candidates = P::MoveMask(P::And(
+        P::And(P::GreaterEq(u, zero), P::GreaterEq(v, zero)),
+        P::GreaterEq(w, zero)));
+    // most leaves are missed, then nothing is stored
+    if (!candidates) return 0;
+    // the few faces which may be hit are finished one by one, so zero edge
+    // functions and the plane distance are handled in double as in
+    // IntersectShearedTriangle
+    Real lanes[3][3][kLaneNum];
+    for (int k = 0; k < 3; ++k) {
+      P::Store(lanes[0][k], x[k]);
+      P::Store(lanes[1][k], y[k]);
+      P::Store(lanes[2][k], z[k]);
+    }
+    unsigned mask = 0;
+    for (uint32_t lane = 0; lane < kLaneNum; ++lane) {
+      if (!(candidates & (1U << lane))) continue;
+      ShearedTriangle tri;
+      for (int k = 0; k < 3; ++k) {
+        tri.x[k] = lanes[0][k][lane];
+        tri.y[k] = lanes[1][k][lane];
+        tri.z[k] = lanes[2][k][lane];
+      }
+      std::optional<Real> lane_dist = IntersectShearedTriangle(tri, s.shear_z);
+      if (lane_dist && *lane_dist < max_dist) {
+        dist[lane] = *lane_dist;
+        mask |= 1U << lane;
+      }
+    }
+    return mask;
+  } else {
+    Reg det = P::Add(P::Add(u, v), w);
+    Reg t = P::Mul(P::Set1(s.shear_z),
+                   P::Add(P::Add(P::Mul(u, z[0]), P::Mul(v, z[1])),
+                          P::Mul(w, z[2])));
+    P::Mask is_hit =
+        P::And(P::And(P::And(P::GreaterEq(u, zero), P::GreaterEq(v, zero)),
+                      P::And(P::GreaterEq(w, zero), P::Greater(det, zero))),
+               P::Greater(t, zero));
+    // most leaves are missed, then the division is skipped
+    if (!P::MoveMask(is_hit)) return 0;
+    Reg lanes_dist = P::Div(t, det);
+    P::Store(dist, lanes_dist);
+    return P::MoveMask(
+        P::And(is_hit, P::Greater(P::Set1(max_dist), lanes_dist)));
+  }
+}
+}  // namespace triangle_packet
+
+/**
+ * Watertight test (see IntersectTriangle) of the ray against faces
+ * [first, first + num), num should not exceed kTrianglePacketWidth. With
+ * AVX (or SSE2 for float geometry) vertices of all faces are gathered into
+ * one register per coordinate and tested at once, with SSE2 double faces are
+ * tested by pairs, without SIMD one by one.
+ * @param[in,out] max_dist - only closer hits are found, reduced to the
+ * distance of the found hit
+ * @return index of the closest crossed face
+ */
+inline std::optional<uint32_t> IntersectTrianglePacket(const Ray& ray,
+                                                       const TriangleSoA& tris,
+                                                       uint32_t first,
+                                                       uint32_t num,
+                                                       Real& max_dist) {
+  std::optional<uint32_t> result;
+  using triangle_packet::kLaneNum;
+  if constexpr (kLaneNum == 1) {
+    for (uint32_t face = first; face < first + num; ++face) {
+      auto vertex = [&](int k) {
+        uint32_t idx = tris.vertex[k][face];
+        return GeoVec{tris.coor[0][idx], tris.coor[1][idx],
+                      tris.coor[2][idx]};
+      };
+      std::optional<Real> dist =
+          IntersectTriangle(ray, vertex(0), vertex(1), vertex(2));
+      if (dist && *dist < max_dist) {
+        max_dist = *dist;
+        result = face;
+      }
+    }
+    return result;
+  }
+  for (uint32_t base = 0; base < num; base += kLaneNum) {
+    const uint32_t* idx[3];
+    uint32_t padded[3][kLaneNum];
+    for (int k = 0; k < 3; ++k) {
+      idx[k] = tris.vertex[k] + first + base;
+      if (base + kLaneNum <= num) continue;
+      // missing faces of the last group repeat the last face
+      for (uint32_t lane = 0; lane < kLaneNum; ++lane) {
+        padded[k][lane] = idx[k][std::min(lane, num - 1 - base)];
+      }
+      idx[k] = padded[k];
+    }
+    Real dist[kLaneNum];
+    unsigned mask =
+        triangle_packet::IntersectLanes(ray, tris, idx, max_dist, dist);
+    for (uint32_t lane = 0; mask; ++lane, mask >>= 1) {
+      if ((mask & 1) && dist[lane] < max_dist) {
+        max_dist = dist[lane];
+        result = first + base + lane;
+      }
+    }
+  }
+  return result;
+}
+
+#endif  // TRIANGLE_PACKET_H
@@ -0,0 +1,287 @@
+﻿/**
+ * @file VecMath.h
+ * Contain SIMD registers used by batch kernels of the vector math, packet
+ * tests of primitives and boxes
+ */
+#ifndef VEC_MATH_H
+#define VEC_MATH_H
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace vec_math {
+/** Number of vectors in wide types, eight floats fill one AVX register*/
+inline constexpr size_t kWideWidth = 8;
+
+/**
+ * Register of kWidth float or double lanes, see Pack. Loads and stores do
+ * not require alignment. Comparisons return masks of lanes, MoveMask packs
+ * them into bits of an integer. Min and Max return the second operand if
+ * any of the operands is NaN, as SSE instructions do. DiffOfProducts gives
+ * a * b - c * d with the exact sign as DiffOfProducts of scalars. Only
+ * widths of registers of the build instruction set are defined, a single
+ * scalar lane is always available.
+ */
+template <typename T, size_t kWidth>
+struct Lanes;
+
+template <typename T>
+struct Lanes<T, 1> {
+  using Reg = T;
+  using Mask = bool;
+  static constexpr size_t kWidth = 1;
+
+  static Reg Load(const T* ptr) { return *ptr; }
+  static void Store(T* ptr, Reg a) { *ptr = a; }
+  static Reg Set1(T val) { return val; }
+  /** Loads base[idx[i]] into the i-th lane*/
+  static Reg Gather(const T* base, const uint32_t* idx) { return base[*idx]; }
+  static Reg Add(Reg a, Reg b) { return a + b; }
+  static Reg Sub(Reg a, Reg b) { return a - b; }
+  static Reg Mul(Reg a, Reg b) { return a * b; }
+  static Reg Div(Reg a, Reg b) { return a / b; }
+  static Reg Sqrt(Reg a) { return std::sqrt(a); }
+  static Reg Min(Reg a, Reg b) { return a < b ? a : b; }
+  static Reg Max(Reg a, Reg b) { return a > b ? a : b; }
+  static Mask Less(Reg a, Reg b) { return a < b; }
+  static Mask LessEq(Reg a, Reg b) { return a <= b; }
+  static Mask Greater(Reg a, Reg b) { return a > b; }
+  static Mask GreaterEq(Reg a, Reg b) { return a >= b; }
+  /** @return mask of lanes where any of the operands is NaN*/
+  static Mask Unordered(Reg a, Reg b) {
+    return std::isnan(a) || std::isnan(b);
+  }
+  static Mask And(Mask a, Mask b) { return a && b; }
+  static Mask Or(Mask a, Mask b) { return a || b; }
+  /** @return a with lanes selected by the mask replaced by NaN*/
+  static Reg NanWhere(Reg a, Mask m) {
+    return m ? std::numeric_limits<T>::quiet_NaN() : a;
+  }
+  static unsigned MoveMask(Mask a) { return a; }
+  static Reg DiffOfProducts(Reg a, Reg b, Reg c, Reg d) {
+#if defined(__FMA__)
+    Reg cd = c * d;
+    return std::fma(a, b, -cd) + std::fma(-c, d, cd);
+#else
+    return a * b - c * d;
+#endif
+  }
+};
+
+#if defined(__SSE2__)
+template <>
+struct Lanes<double, 2> {
+  using Reg = __m128d;
+  using Mask = __m128d;
+  static constexpr size_t kWidth = 2;
+
+  static Reg Load(const double* ptr) { return _mm_loadu_pd(ptr); }
+  static void Store(double* ptr, Reg a) { _mm_storeu_pd(ptr, a); }
+  static Reg Set1(double val) { return _mm_set1_pd(val); }
+  static Reg Gather(const double* base, const uint32_t* idx) {
+    return _mm_set_pd(base[idx[1]], base[idx[0]]);
+  }
+  static Reg Add(Reg a, Reg b) { return _mm_add_pd(a, b); }
+  static Reg Sub(Reg a, Reg b) { return _mm_sub_pd(a, b); }
+  static Reg Mul(Reg a, Reg b) { return _mm_mul_pd(a, b); }
+  static Reg Div(Reg a, Reg b) { return _mm_div_pd(a, b); }
+  static Reg Sqrt(Reg a) { return _mm_sqrt_pd(a); }
+  static Reg Min(Reg a, Reg b) { return _mm_min_pd(a, b); }
+  static Reg Max(Reg a, Reg b) { return _mm_max_pd(a, b); }
+  static Mask Less(Reg a, Reg b) { return _mm_cmplt_pd(a, b); }
+  static Mask LessEq(Reg a, Reg b) { return _mm_cmple_pd(a, b); }
+  static Mask Greater(Reg a, Reg b) { return _mm_cmpgt_pd(a, b); }
+  static Mask GreaterEq(Reg a, Reg b) { return _mm_cmpge_pd(a, b); }
+  static Mask Unordered(Reg a, Reg b) { return _mm_cmpunord_pd(a, b); }
+  static Mask And(Mask a, Mask b) { return _mm_and_pd(a, b); }
+  static Mask Or(Mask a, Mask b) { return _mm_or_pd(a, b); }
+  static Reg NanWhere(Reg a, Mask m) { return _mm_or_pd(a, m); }
+  static unsigned MoveMask(Mask a) {
+    return static_cast<unsigned>(_mm_movemask_pd(a));
+  }
+  static Reg DiffOfProducts(Reg a, Reg b, Reg c, Reg d) {
+#if defined(__FMA__)
+    Reg cd = Mul(c, d);
+    return Add(_mm_fmsub_pd(a, b, cd), _mm_fnmadd_pd(c, d, cd));
+#else
+    return Sub(Mul(a, b), Mul(c, d));
+#endif
+  }
+};
+
+template <>
+struct Lanes<float, 4> {
+  using Reg = __m128;
+  using Mask = __m128;
+  static constexpr size_t kWidth = 4;
+
+  static Reg Load(const float* ptr) { return _mm_loadu_ps(ptr); }
+  static void Store(float* ptr, Reg a) { _mm_storeu_ps(ptr, a); }
+  static Reg Set1(float val) { return _mm_set1_ps(val); }
+  static Reg Gather(const float* base, const uint32_t* idx) {
+    return _mm_set_ps(base[idx[3]], base[idx[2]], base[idx[1]], base[idx[0]]);
+  }
+  static Reg Add(Reg a, Reg b) { return _mm_add_ps(a, b); }
+  static Reg Sub(Reg a, Reg b) { return _mm_sub_ps(a, b); }
+  static Reg Mul(Reg a, Reg b) { return _mm_mul_ps(a, b); }
+  static Reg Div(Reg a, Reg b) { return _mm_div_ps(a, b); }
+  static Reg Sqrt(Reg a) { return _mm_sqrt_ps(a); }
+  static Reg Min(Reg a, Reg b) { return _mm_min_ps(a, b); }
+  static Reg Max(Reg a, Reg b) { return _mm_max_ps(a, b); }
+  static Mask Less(Reg a, Reg b) { return _mm_cmplt_ps(a, b); }
+  static Mask LessEq(Reg a, Reg b) { return _mm_cmple_ps(a, b); }
+  static Mask Greater(Reg a, Reg b) { return _mm_cmpgt_ps(a, b); }
+  static Mask GreaterEq(Reg a, Reg b) { return _mm_cmpge_ps(a, b); }
+  static Mask Unordered(Reg a, Reg b) { return _mm_cmpunord_ps(a, b); }
+  static Mask And(Mask a, Mask b) { return _mm_and_ps(a, b); }
+  static Mask Or(Mask a, Mask b) { return _mm_or_ps(a, b); }
+  static Reg NanWhere(Reg a, Mask m) { return _mm_or_ps(a, m); }
+  static unsigned MoveMask(Mask a) {
+    return static_cast<unsigned>(_mm_movemask_ps(a));
+  }
+  static Reg DiffOfProducts(Reg a, Reg b, Reg c, Reg d) {
+#if defined(__FMA__)
+    Reg cd = Mul(c, d);
+    return Add(_mm_fmsub_ps(a, b, cd), _mm_fnmadd_ps(c, d, cd));
+#else
+    return Sub(Mul(a, b), Mul(c, d));
+#endif
+  }
+};
+#endif
+
+#if defined(__AVX__)
+template <>
+struct Lanes<double, 4> {
+  using Reg = __m256d;
+  using Mask = __m256d;
+  static constexpr size_t kWidth = 4;
+
+  static Reg Load(const double* ptr) { return _mm256_loadu_pd(ptr); }
+  static void Store(double* ptr, Reg a) { _mm256_storeu_pd(ptr, a); }
+  static Reg Set1(double val) { return _mm256_set1_pd(val); }
+  /** Separate loads are faster than the gather instruction for so few
+   * lanes*/
+  static Reg Gather(const double* base, const uint32_t* idx) {
+    return _mm256_set_pd(base[idx[3]], base[idx[2]], base[idx[1]],
+                         base[idx[0]]);
+  }
+  static Reg Add(Reg a, Reg b) { return _mm256_add_pd(a, b); }
+  static Reg Sub(Reg a, Reg b) { return _mm256_sub_pd(a, b); }
+  static Reg Mul(Reg a, Reg b) { return _mm256_mul_pd(a, b); }
+  static Reg Div(Reg a, Reg b) { return _mm256_div_pd(a, b); }
+  static Reg Sqrt(Reg a) { return _mm256_sqrt_pd(a); }
+  static Reg Min(Reg a, Reg b) { return _mm256_min_pd(a, b); }
+  static Reg Max(Reg a, Reg b) { return _mm256_max_pd(a, b); }
+  static Mask Less(Reg a, Reg b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+  static Mask LessEq(Reg a, Reg b) {
+    return _mm256_cmp_pd(a, b, _CMP_LE_OQ);
+  }
+  static Mask Greater(Reg a, Reg b) {
+    return _mm256_cmp_pd(a, b, _CMP_GT_OQ);
+  }
+  static Mask GreaterEq(Reg a, Reg b) {
+    return _mm256_cmp_pd(a, b, _CMP_GE_OQ);
+  }
+  static Mask Unordered(Reg a, Reg b) {
+    return _mm256_cmp_pd(a, b, _CMP_UNORD_Q);
+  }
+  static Mask And(Mask a, Mask b) { return _mm256_and_pd(a, b); }
+  static Mask Or(Mask a, Mask b) { return _mm256_or_pd(a, b); }
+  static Reg NanWhere(Reg a, Mask m) { return _mm256_or_pd(a, m); }
+  static unsigned MoveMask(Mask a) {
+    return static_cast<unsigned>(_mm256_movemask_pd(a));
+  }
+  static Reg DiffOfProducts(Reg a, Reg b, Reg c, Reg d) {
+#if defined(__FMA__)
+    Reg cd = Mul(c, d);
+    return Add(_mm256_fmsub_pd(a, b, cd), _mm256_fnmadd_pd(c, d, cd));
+#else
+    return Sub(Mul(a, b), Mul(c, d));
+#endif
+  }
+};
+
+template <>
+struct Lanes<float, 8> {
+  using Reg = __m256;
+  using Mask = __m256;
+  static constexpr size_t kWidth = 8;
+
+  static Reg Load(const float* ptr) { return _mm256_loadu_ps(ptr); }
+  static void Store(float* ptr, Reg a) { _mm256_storeu_ps(ptr, a); }
+  static Reg Set1(float val) { return _mm256_set1_ps(val); }
+  static Reg Gather(const float* base, const uint32_t* idx) {
+    return _mm256_set_ps(base[idx[7]], base[idx[6]], base[idx[5]],
+                         base[idx[4]], base[idx[3]], base[idx[2]],
+                         base[idx[1]], base[idx[0]]);
+  }
+  static Reg Add(Reg a, Reg b) { return _mm256_add_ps(a, b); }
+  static Reg Sub(Reg a, Reg b) { return _mm256_sub_ps(a, b); }
+  static Reg Mul(Reg a, Reg b) { return _mm256_mul_ps(a, b); }
+  static Reg Div(Reg a, Reg b) { return _mm256_div_ps(a, b); }
+  static Reg Sqrt(Reg a) { return _mm256_sqrt_ps(a); }
+  static Reg Min(Reg a, Reg b) { return _mm256_min_ps(a, b); }
+  static Reg Max(Reg a, Reg b) { return _mm256_max_ps(a, b); }
+  static Mask Less(Reg a, Reg b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+  static Mask LessEq(Reg a, Reg b) {
+    return _mm256_cmp_ps(a, b, _CMP_LE_OQ);
+  }
+  static Mask Greater(Reg a, Reg b) {
+    return _mm256_cmp_ps(a, b, _CMP_GT_OQ);
+  }
+  static Mask GreaterEq(Reg a, Reg b) {
+    return _mm256_cmp_ps(a, b, _CMP_GE_OQ);
+  }
+  static Mask Unordered(Reg a, Reg b) {
+    return _mm256_cmp_ps(a, b, _CMP_UNORD_Q);
+  }
+  static Mask And(Mask a, Mask b) { return _mm256_and_ps(a, b); }
+  static Mask Or(Mask a, Mask b) { return _mm256_or_ps(a, b); }
+  static Reg NanWhere(Reg a, Mask m) { return _mm256_or_ps(a, m); }
+  static unsigned MoveMask(Mask a) {
+    return static_cast<unsigned>(_mm256_movemask_ps(a));
+  }
+  static Reg DiffOfProducts(Reg a, Reg b, Reg c, Reg d) {
+#if defined(__FMA__)
+    Reg cd = Mul(c, d);
+    return Add(_mm256_fmsub_ps(a, b, cd), _mm256_fnmadd_ps(c, d, cd));
+#else
+    return Sub(Mul(a, b), Mul(c, d));
+#endif
+  }
+};
+#endif
+
+/** Number of T lanes in the widest register of the build: AVX, SSE2 or a
+ * single scalar lane*/
+template <typename T>
+inline constexpr size_t kNativeWidth =
+#if defined(__AVX__)
+    32 / sizeof(T);
+#elif defined(__SSE2__)
+    16 / sizeof(T);
+#else
+    1;
+#endif
+
+/**
+ * Widest register of T lanes with at most kMaxWidth lanes. Kernels over
+ * arrays take the widest one, kernels over fixed groups (e.g. four children
+ * of a wide node) limit the width to the group size.
+ */
+template <typename T, size_t kMaxWidth = kWideWidth>
+using Pack = Lanes<T, std::min(kNativeWidth<T>, kMaxWidth)>;
+
+static_assert(kWideWidth % Pack<double>::kWidth == 0 &&
+              kWideWidth % Pack<float>::kWidth == 0);
+}  // namespace vec_math
+
+#endif  // VEC_MATH_H
@@ -0,0 +1,103 @@
+﻿/**
+ * @file WideBvh.h
+ * Contain bounding volume hierarchy with 4 children per node, whose child
+ * boxes are tested against a ray at once with SIMD instructions
+ */
+#ifndef WIDE_BVH_H
+#define WIDE_BVH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "Accelerator.h"
+#include "ArrayView.h"
+#include "Bvh.h"
+#include "MappedFile.h"
+#include "Objects.h"
+#include "PrimitiveArrays.h"
+#include "Ray.h"
+
+/**
+ * Node of the wide hierarchy. Child boxes are stored as structure of arrays,
+ * so the same coordinate of all children can be loaded into one register.
+ * Node occupies whole cache lines. Unused child slots have empty boxes.
+ */
+struct alignas(64) WideBvhNode {
+  static constexpr int kWidth = 4;
+
+  Real min_x[kWidth];
+  Real min_y[kWidth];
+  Real min_z[kWidth];
+  Real max_x[kWidth];
+  Real max_y[kWidth];
+  Real max_z[kWidth];
+  /** Inner child - index of the child node, leaf child - index of its first
+   * object*/
+  uint32_t child[kWidth];
+  /** Number of objects in the leaf child, 0 for inner children*/
+  uint32_t obj_num[kWidth];
+};
+
+/** Size of the traversal stacks, every level of the tree leaves at most
+ * kWidth - 1 entries in the stack*/
+inline constexpr size_t kWideBvhStackSize = 256;
+
+/**
+ * Hierarchy made by collapsing binary SAH hierarchy, so every node has up to
+ * 4 children. Makes the tree twice shallower and tests all children of a node
+ * with one sequence of SIMD instructions (AVX, SSE2 or scalar fallback
+ * depending on the target instruction set). With float geometry all four
+ * children fit into one SSE register and a node takes two cache lines
+ * instead of four.
+ * Objects are not owned and should outlive the hierarchy.
+ */
+class WideBvh : public Accelerator {
+ public:
+  explicit WideBvh(std::vector<const Object*> objects,
+                   ThreadPool* pool = nullptr)
+      : WideBvh(Bvh{std::move(objects), pool}) {}
+  explicit WideBvh(const Bvh& bvh);
+  /** Uses nodes stored in the mapped cache file, file is kept mapped while
+   * the hierarchy exists*/
+  WideBvh(std::shared_ptr<const MappedFile> file,
+          ArrayView<WideBvhNode> nodes, std::vector<const Object*> objects)
+      : node_view_(nodes),
+        file_(std::move(file)),
+        objects_(std::move(objects)),
+        primitives_(objects_) {}
+  WideBvh(const WideBvh&) = delete;
+  WideBvh& operator=(const WideBvh&) = delete;
+
+  std::optional<HitRecord> GetClosestHit(const Ray& ray) const override;
+  /** Rays are traced by packets of up to RayPacket::kMaxSize rays*/
+  void GetClosestHits(ArrayView<Ray> rays,
+                      std::optional<HitRecord>* hits) const override;
+  bool IsOccluded(const Ray& ray, Real max_dist) const override;
+  size_t GetMemorySize() const override {
+    return node_view_.size() * sizeof(WideBvhNode) +
+           objects_.capacity() * sizeof(const Object*) +
+           primitives_.GetMemorySize();
+  }
+  /** Recomputes child boxes bottom up, tree topology is kept*/
+  bool Refit() override;
+  double GetCost() const override;
+
+  ArrayView<WideBvhNode> GetNodes() const { return node_view_; }
+  const std::vector<const Object*>& GetObjects() const { return objects_; }
+
+ private:
+  /** Appends node made of binary node children and returns its index*/
+  uint32_t Collapse(ArrayView<BvhNode> bin_nodes, uint32_t bin_node_idx);
+
+  /** Nodes built by this process, empty if nodes are in the mapped file*/
+  std::vector<WideBvhNode> nodes_;
+  ArrayView<WideBvhNode> node_view_;
+  std::shared_ptr<const MappedFile> file_;
+  std::vector<const Object*> objects_;
+  PrimitiveArrays primitives_;
+};
+
+#endif  // WIDE_BVH_H
@@ -0,0 +1,42 @@
+#!/bin/bash
+# Local stand-in for the render farm: renders one picture with several
+# mk_image processes, each of them traces its own band of pixel rows, and
+# combines partial renders with merge_partials.
+#
+# Usage: render_local.sh CONFIG OUTPUT.png PROCESS_NUMBER [BIN_DIR]
+set -e
+
+if [ $# -lt 3 ]; then
+  echo "Usage: $0 CONFIG OUTPUT.png PROCESS_NUMBER [BIN_DIR]"
+  exit 1
+fi
+CONFIG=$1
+OUTPUT=$2
+PROC_NUM=$3
+BIN_DIR=${4:-.}
+
+read -r WIDTH HEIGHT < <(python3 -c "
+import json, sys
+g = json.load(open(sys.argv[1])).get('general', {})
+print(g.get('pic_width_in_pixel', 600), g.get('pic_height_in_pixel', 400))
+" "$CONFIG")
+
+PARTS_DIR=$(mktemp -d)
+trap 'rm -rf "$PARTS_DIR"' EXIT
+
+PIXEL_NUM=$((WIDTH * HEIGHT))
+PIDS=()
+for ((i = 0; i < PROC_NUM; i++)); do
+  # bands are aligned to rows, so every process traces whole rows
+  BEGIN=$((HEIGHT * i / PROC_NUM * WIDTH))
+  END=$((HEIGHT * (i + 1) / PROC_NUM * WIDTH))
+  "$BIN_DIR/mk_image" "$CONFIG" --pixels "$BEGIN" "$END" \
+    --partial "$PARTS_DIR/part_$i.raw" 2>"$PARTS_DIR/part_$i.log" &
+  PIDS+=($!)
+done
+for pid in "${PIDS[@]}"; do
+  wait "$pid"
+done
+
+"$BIN_DIR/merge_partials" "$OUTPUT" "$PARTS_DIR"/part_*.raw
+echo "Merged $PROC_NUM partial renders of $PIXEL_NUM pixels into $OUTPUT"
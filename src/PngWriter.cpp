@@ -32,16 +32,18 @@ PngWriter::~PngWriter() {
 }
 
 void PngWriter::SaveVectorToImage(const std::vector<Color> &vec) {
-  uint8_t row[3 * img_width_];
-  size_t px_num = img_height_ * img_width_;
+  for (size_t i = 0; i < img_height_; i++) {
+    WriteRow(vec.data() + i * img_width_);
+  }
+}
+
+void PngWriter::WriteRow(const Color *row) {
+  row_bytes_.resize(3 * img_width_);
   size_t r_idx = 0;
-  for (size_t i = 0; i < px_num; i++) {
-    row[r_idx++] = vec[i].red;
-    row[r_idx++] = vec[i].green;
-    row[r_idx++] = vec[i].blue;
-    if (!((i + 1) % img_width_)) {
-      r_idx = 0;
-      png_write_row(png_struct_, row);
-    }
+  for (size_t i = 0; i < img_width_; i++) {
+    row_bytes_[r_idx++] = row[i].red;
+    row_bytes_[r_idx++] = row[i].green;
+    row_bytes_[r_idx++] = row[i].blue;
   }
+  png_write_row(png_struct_, row_bytes_.data());
 }
@@ -0,0 +1,23 @@
+﻿#include "Accelerator.h"
+
+#include "Bvh.h"
+#include "Grid.h"
+#include "KdTree.h"
+#include "WideBvh.h"
+
+std::unique_ptr<Accelerator> CreateAccelerator(
+    AcceleratorType type, std::vector<const Object*> objects,
+    ThreadPool* pool) {
+  switch (type) {
+    case AcceleratorType::kBvh:
+      return std::make_unique<Bvh>(std::move(objects), pool);
+    case AcceleratorType::kWideBvh:
+      return std::make_unique<WideBvh>(std::move(objects), pool);
+    case AcceleratorType::kGrid:
+      return std::make_unique<Grid>(std::move(objects));
+    case AcceleratorType::kKdTree:
+      return std::make_unique<KdTree>(std::move(objects));
+    default:
+      throw std::logic_error("Unknown accelerator type");
+  }
+}
@@ -0,0 +1,479 @@
+﻿#include "AcceleratorCache.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <type_traits>
+#include <unordered_map>
+
+#include "ArrayView.h"
+#include "Bvh.h"
+#include "Instance.h"
+#include "MappedFile.h"
+#include "Sampler.h"
+#include "SphereSet.h"
+#include "TriangleMesh.h"
+#include "WideBvh.h"
+
+namespace {
+/** Header of the cache file. Data is stored in the host byte order, nodes
+ * start at kNodesOffset and are followed by object indices*/
+struct CacheHeader {
+  char magic[8] = {'P', 'T', 'A', 'C', 'C', 'E', 'L', '\0'};
+  uint32_t version = 1;
+  uint32_t type = 0;
+  uint64_t geometry_hash = 0;
+  uint64_t object_num = 0;
+  uint64_t node_num = 0;
+  /** Size of one node, differs for builds with other node layout*/
+  uint32_t node_size = 0;
+  uint32_t reserved = 0;
+};
+constexpr size_t kNodesOffset = MappedFile::kAlignment;
+static_assert(sizeof(CacheHeader) <= kNodesOffset);
+/** Header of the mesh cache file. Arrays of TriangleMesh::Data follow it in
+ * the order of their declaration*/
+struct MeshCacheHeader {
+  char magic[8] = {'P', 'T', 'M', 'E', 'S', 'H', '\0', '\0'};
+  uint32_t version = 1;
+  /** Size of coordinates, differs for float and double builds*/
+  uint32_t real_size = sizeof(Real);
+  uint64_t mesh_hash = 0;
+  uint64_t point_num = 0;
+  uint64_t vertex_num = 0;
+  uint64_t face_num = 0;
+  uint64_t node_num = 0;
+  uint32_t node_size = sizeof(BvhNode);
+  uint32_t reserved = 0;
+};
+static_assert(std::is_trivially_copyable_v<BvhNode>);
+static_assert(std::is_trivially_copyable_v<WideBvhNode>);
+static_assert(alignof(WideBvhNode) <= MappedFile::kAlignment);
+
+class GeometryHasher {
+ public:
+  void Add(uint64_t value) { state_ = Sampler::Mix64(state_ ^ value) + 1; }
+  void Add(double value) {
+    uint64_t bits = 0;
+    std::memcpy(&bits, &value, sizeof(bits));
+    Add(bits);
+  }
+  void Add(const GeoVec& vec) {
+    Add(vec.x_);
+    Add(vec.y_);
+    Add(vec.z_);
+  }
+  uint64_t GetHash() const { return state_; }
+
+ private:
+  uint64_t state_ = 0x5054414343454cULL;
+};
+
+/** Structure type stored for the hierarchy node type*/
+template <typename Node>
+constexpr AcceleratorType kNodeType = std::is_same_v<Node, BvhNode>
+                                          ? AcceleratorType::kBvh
+                                          : AcceleratorType::kWideBvh;
+
+/** Name of the temporary file next to the target. Name is unique, so
+ * processes writing the same cache at once do not mix their data*/
+std::string GetTempName(const std::string& file_name) {
+  std::random_device rd;
+  std::ostringstream name;
+  name << file_name << '.';
+#if defined(__unix__) || defined(__APPLE__)
+  name << getpid() << '.';
+#endif
+  name << std::hex << rd() << rd() << ".tmp";
+  return name.str();
+}
+
+/** Writes the file under temporary name and renames it, so readers never
+ * see partially written cache*/
+template <typename WriteData>
+bool WriteFile(const std::string& file_name, WriteData&& write_data) {
+  std::string tmp_name = GetTempName(file_name);
+  std::error_code err;
+  {
+    std::ofstream out{tmp_name, std::ios::binary};
+    if (!out.is_open()) return false;
+    write_data(out);
+    if (!out) {
+      out.close();
+      std::filesystem::remove(tmp_name, err);
+      return false;
+    }
+  }
+  std::filesystem::rename(tmp_name, file_name, err);
+  if (err) {
+    std::error_code remove_err;
+    std::filesystem::remove(tmp_name, remove_err);
+    return false;
+  }
+  return true;
+}
+
+template <typename T>
+void WriteArray(std::ostream& out, const std::vector<T>& arr) {
+  out.write(reinterpret_cast<const char*>(arr.data()),
+            static_cast<std::streamsize>(arr.size() * sizeof(T)));
+}
+
+/** Copies num values from the file starting at offset, offset is moved past
+ * them. @return false if the file is too short*/
+template <typename T>
+bool ReadArray(const MappedFile& file, size_t& offset, uint64_t num,
+               std::vector<T>& out) {
+  if ((file.GetSize() - offset) / sizeof(T) < num) return false;
+  out.resize(num);
+  if (num) std::memcpy(out.data(), file.GetData() + offset, num * sizeof(T));
+  offset += num * sizeof(T);
+  return true;
+}
+
+template <typename Node>
+bool WriteCache(const std::string& file_name, ArrayView<Node> nodes,
+                const std::vector<const Object*>& accel_objects,
+                const std::vector<const Object*>& objects) {
+  std::unordered_map<const Object*, uint32_t> index_of;
+  index_of.reserve(objects.size());
+  for (size_t i = 0; i < objects.size(); ++i) {
+    index_of.emplace(objects[i], static_cast<uint32_t>(i));
+  }
+  std::vector<uint32_t> indices;
+  indices.reserve(accel_objects.size());
+  for (const Object* obj : accel_objects) {
+    auto it = index_of.find(obj);
+    if (it == index_of.end()) return false;
+    indices.push_back(it->second);
+  }
+  CacheHeader header;
+  header.type = static_cast<uint32_t>(kNodeType<Node>);
+  header.geometry_hash = HashGeometry(objects);
+  header.object_num = objects.size();
+  header.node_num = nodes.size();
+  header.node_size = sizeof(Node);
+  return WriteFile(file_name, [&](std::ostream& out) {
+    char padding[kNodesOffset] = {};
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(padding, kNodesOffset - sizeof(header));
+    out.write(reinterpret_cast<const char*>(nodes.data()),
+              static_cast<std::streamsize>(nodes.size() * sizeof(Node)));
+    WriteArray(out, indices);
+  });
+}
+
+bool IsValid(const BvhNode& node, size_t idx, size_t node_num,
+             size_t object_num) {
+  if (node.obj_num) {
+    return node.offset <= object_num &&
+           node.obj_num <= object_num - node.offset;
+  }
+  return node.offset > idx + 1 && node.offset < node_num && node.axis < 3;
+}
+
+bool IsValid(const WideBvhNode& node, size_t idx, size_t node_num,
+             size_t object_num) {
+  for (int i = 0; i < WideBvhNode::kWidth; ++i) {
+    if (node.obj_num[i]) {
+      if (node.child[i] > object_num ||
+          node.obj_num[i] > object_num - node.child[i]) {
+        return false;
+      }
+    } else if (node.child[i] && (node.child[i] <= idx ||
+                                 node.child[i] >= node_num)) {
+      return false;
+    } else if (!node.child[i] && node.min_x[i] <= node.max_x[i]) {
+      // unused slot is never entered, otherwise the root would be pushed
+      return false;
+    }
+  }
+  return true;
+}
+
+/** Checks that traversal stacks cannot overflow. Children follow their
+ * parents in valid files, so depths are found in one pass*/
+bool FitsStack(ArrayView<BvhNode> nodes) {
+  std::vector<size_t> depth(nodes.size(), 0);
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    if (nodes[i].obj_num) continue;
+    // packet traversal pushes both children of the node
+    if (depth[i] + 2 > kBvhMaxDepth + 1) return false;
+    for (size_t child : {i + 1, size_t{nodes[i].offset}}) {
+      depth[child] = std::max(depth[child], depth[i] + 1);
+    }
+  }
+  return true;
+}
+
+bool FitsStack(ArrayView<WideBvhNode> nodes) {
+  constexpr size_t kWidth = WideBvhNode::kWidth;
+  std::vector<size_t> depth(nodes.size(), 0);
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    if ((kWidth - 1) * depth[i] + kWidth > kWideBvhStackSize) return false;
+    const WideBvhNode& node = nodes[i];
+    for (size_t k = 0; k < kWidth; ++k) {
+      if (node.obj_num[k] || !node.child[k]) continue;
+      depth[node.child[k]] = std::max(depth[node.child[k]], depth[i] + 1);
+    }
+  }
+  return true;
+}
+
+template <typename Node, typename Structure>
+std::unique_ptr<Accelerator> ReadCache(
+    const std::string& file_name, uint64_t geometry_hash,
+    const std::vector<const Object*>& objects) {
+  std::shared_ptr<const MappedFile> file = MappedFile::Open(file_name);
+  if (!file || file->GetSize() < kNodesOffset) return nullptr;
+  CacheHeader header;
+  std::memcpy(&header, file->GetData(), sizeof(header));
+  const CacheHeader expected;
+  if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 ||
+      header.version != expected.version ||
+      header.type != static_cast<uint32_t>(kNodeType<Node>) ||
+      header.geometry_hash != geometry_hash ||
+      header.object_num != objects.size() ||
+      header.node_size != sizeof(Node) ||
+      header.node_num > (file->GetSize() - kNodesOffset) / sizeof(Node)) {
+    return nullptr;
+  }
+  size_t indices_offset = kNodesOffset + header.node_num * sizeof(Node);
+  if ((file->GetSize() - indices_offset) / sizeof(uint32_t) <
+      header.object_num) {
+    return nullptr;
+  }
+  ArrayView<Node> nodes{
+      reinterpret_cast<const Node*>(file->GetData() + kNodesOffset),
+      header.node_num};
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    if (!IsValid(nodes[i], i, nodes.size(), objects.size())) return nullptr;
+  }
+  if (!FitsStack(nodes)) return nullptr;
+  std::vector<const Object*> accel_objects;
+  accel_objects.reserve(objects.size());
+  const char* indices = file->GetData() + indices_offset;
+  for (size_t i = 0; i < objects.size(); ++i) {
+    uint32_t idx = 0;
+    std::memcpy(&idx, indices + i * sizeof(idx), sizeof(idx));
+    if (idx >= objects.size()) return nullptr;
+    accel_objects.push_back(objects[idx]);
+  }
+  return std::make_unique<Structure>(std::move(file), nodes,
+                                     std::move(accel_objects));
+}
+
+bool WriteMeshCache(const std::string& file_name, uint64_t mesh_hash,
+                    const TriangleMesh::Data& data) {
+  MeshCacheHeader header;
+  header.mesh_hash = mesh_hash;
+  header.point_num = data.point_to_vertex.size();
+  header.vertex_num = data.x.size();
+  header.face_num = data.face_v0.size();
+  header.node_num = data.nodes.size();
+  return WriteFile(file_name, [&](std::ostream& out) {
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    WriteArray(out, data.x);
+    WriteArray(out, data.y);
+    WriteArray(out, data.z);
+    WriteArray(out, data.face_v0);
+    WriteArray(out, data.face_v1);
+    WriteArray(out, data.face_v2);
+    WriteArray(out, data.point_to_vertex);
+    WriteArray(out, data.nodes);
+  });
+}
+
+std::optional<TriangleMesh::Data> ReadMeshCache(const std::string& file_name,
+                                                uint64_t mesh_hash,
+                                                size_t point_num,
+                                                size_t face_num) {
+  std::shared_ptr<const MappedFile> file = MappedFile::Open(file_name);
+  if (!file || file->GetSize() < sizeof(MeshCacheHeader)) return std::nullopt;
+  MeshCacheHeader header;
+  std::memcpy(&header, file->GetData(), sizeof(header));
+  const MeshCacheHeader expected;
+  if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 ||
+      header.version != expected.version ||
+      header.real_size != expected.real_size ||
+      header.node_size != expected.node_size ||
+      header.mesh_hash != mesh_hash || header.point_num != point_num ||
+      header.face_num != face_num) {
+    return std::nullopt;
+  }
+  TriangleMesh::Data data;
+  size_t offset = sizeof(header);
+  if (!ReadArray(*file, offset, header.vertex_num, data.x) ||
+      !ReadArray(*file, offset, header.vertex_num, data.y) ||
+      !ReadArray(*file, offset, header.vertex_num, data.z) ||
+      !ReadArray(*file, offset, header.face_num, data.face_v0) ||
+      !ReadArray(*file, offset, header.face_num, data.face_v1) ||
+      !ReadArray(*file, offset, header.face_num, data.face_v2) ||
+      !ReadArray(*file, offset, header.point_num, data.point_to_vertex) ||
+      !ReadArray(*file, offset, header.node_num, data.nodes)) {
+    return std::nullopt;
+  }
+  auto is_vertex = [&](uint32_t idx) { return idx < header.vertex_num; };
+  if (!std::all_of(data.face_v0.begin(), data.face_v0.end(), is_vertex) ||
+      !std::all_of(data.face_v1.begin(), data.face_v1.end(), is_vertex) ||
+      !std::all_of(data.face_v2.begin(), data.face_v2.end(), is_vertex) ||
+      !std::all_of(data.point_to_vertex.begin(), data.point_to_vertex.end(),
+                   [&](uint32_t idx) {
+                     return idx == TriangleMesh::kNoVertex || is_vertex(idx);
+                   })) {
+    return std::nullopt;
+  }
+  ArrayView<BvhNode> nodes{data.nodes.data(), data.nodes.size()};
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    if (!IsValid(nodes[i], i, nodes.size(), face_num)) return std::nullopt;
+  }
+  if (!FitsStack(nodes)) return std::nullopt;
+  return data;
+}
+
+std::unique_ptr<Accelerator> LoadWithHash(
+    const std::string& file_name, AcceleratorType type, uint64_t hash,
+    const std::vector<const Object*>& objects) {
+  switch (type) {
+    case AcceleratorType::kBvh:
+      return ReadCache<BvhNode, Bvh>(file_name, hash, objects);
+    case AcceleratorType::kWideBvh:
+      return ReadCache<WideBvhNode, WideBvh>(file_name, hash, objects);
+    default:
+      return nullptr;
+  }
+}
+}  // namespace
+
+uint64_t HashGeometry(const std::vector<const Object*>& objects) {
+  GeometryHasher hasher;
+  hasher.Add(uint64_t{objects.size()});
+  for (const Object* obj : objects) {
+    if (const auto* sphere = dynamic_cast<const Sphere*>(obj)) {
+      hasher.Add(uint64_t{1});
+      hasher.Add(sphere->GetCenter());
+      hasher.Add(sphere->GetRadius());
+    } else if (const auto* tri = dynamic_cast<const Triangle*>(obj)) {
+      hasher.Add(uint64_t{2});
+      hasher.Add(tri->GetPoint0());
+      hasher.Add(tri->GetPoint1());
+      hasher.Add(tri->GetPoint2());
+    } else if (const auto* set = dynamic_cast<const SphereSet*>(obj)) {
+      hasher.Add(uint64_t{4});
+      hasher.Add(uint64_t{set->GetSphereNumber()});
+      BoundingBox box = set->GetBoundingBox();
+      hasher.Add(box.min);
+      hasher.Add(box.max);
+    } else {
+      // meshes, instances and other composite objects are known by their
+      // bounds
+      const auto* mesh = dynamic_cast<const TriangleMesh*>(obj);
+      if (const auto* instance = dynamic_cast<const Instance*>(obj)) {
+        mesh = &instance->GetMesh();
+      }
+      hasher.Add(uint64_t{3});
+      hasher.Add(uint64_t{mesh ? mesh->GetTriangleNumber() : 0});
+      BoundingBox box = obj->GetBoundingBox();
+      hasher.Add(box.min);
+      hasher.Add(box.max);
+    }
+  }
+  return hasher.GetHash();
+}
+
+bool SaveAccelerator(const std::string& file_name, const Accelerator& accel,
+                     const std::vector<const Object*>& objects) {
+  if (const auto* bvh = dynamic_cast<const Bvh*>(&accel)) {
+    return WriteCache(file_name, bvh->GetNodes(), bvh->GetObjects(), objects);
+  }
+  if (const auto* wide_bvh = dynamic_cast<const WideBvh*>(&accel)) {
+    return WriteCache(file_name, wide_bvh->GetNodes(), wide_bvh->GetObjects(),
+                      objects);
+  }
+  return false;
+}
+
+std::unique_ptr<Accelerator> LoadAccelerator(
+    const std::string& file_name, AcceleratorType type,
+    const std::vector<const Object*>& objects) {
+  return LoadWithHash(file_name, type, HashGeometry(objects), objects);
+}
+
+std::unique_ptr<Accelerator> CreateCachedAccelerator(
+    AcceleratorType type, const std::vector<const Object*>& objects,
+    ThreadPool* pool, const std::string& cache_dir) {
+  if (cache_dir.empty() ||
+      (type != AcceleratorType::kBvh && type != AcceleratorType::kWideBvh)) {
+    return CreateAccelerator(type, objects, pool);
+  }
+  uint64_t hash = HashGeometry(objects);
+  std::ostringstream name;
+  name << std::hex << hash << '_' << static_cast<int>(type) << ".accel";
+  std::string file_name = (std::filesystem::path{cache_dir} / name.str())
+                              .string();
+  std::unique_ptr<Accelerator> result =
+      LoadWithHash(file_name, type, hash, objects);
+  if (result) {
+    std::cerr << "Acceleration structure loaded from " << file_name << '\n';
+    return result;
+  }
+  result = CreateAccelerator(type, objects, pool);
+  std::error_code err;
+  std::filesystem::create_directories(cache_dir, err);
+  if (!SaveAccelerator(file_name, *result, objects)) {
+    std::cerr << "Unable to save acceleration structure into " << file_name
+              << '\n';
+  }
+  return result;
+}
+
+uint64_t HashMesh(const std::vector<GeoVec>& points,
+                  const std::vector<TriangleMesh::Face>& faces) {
+  GeometryHasher hasher;
+  hasher.Add(uint64_t{points.size()});
+  for (const GeoVec& p : points) {
+    hasher.Add(p);
+  }
+  hasher.Add(uint64_t{faces.size()});
+  for (const TriangleMesh::Face& face : faces) {
+    for (uint32_t idx : face) {
+      hasher.Add(static_cast<uint64_t>(idx));
+    }
+  }
+  return hasher.GetHash();
+}
+
+std::unique_ptr<TriangleMesh> CreateCachedMesh(
+    const std::vector<GeoVec>& points,
+    const std::vector<TriangleMesh::Face>& faces, ThreadPool* pool,
+    const std::string& cache_dir) {
+  if (cache_dir.empty()) {
+    return std::make_unique<TriangleMesh>(points, faces, pool);
+  }
+  uint64_t hash = HashMesh(points, faces);
+  std::ostringstream name;
+  name << std::hex << hash << ".mesh";
+  std::string file_name = (std::filesystem::path{cache_dir} / name.str())
+                              .string();
+  std::optional<TriangleMesh::Data> data =
+      ReadMeshCache(file_name, hash, points.size(), faces.size());
+  if (data) {
+    return std::make_unique<TriangleMesh>(std::move(*data));
+  }
+  TriangleMesh::Data built = TriangleMesh::BuildData(points, faces, pool);
+  std::error_code err;
+  std::filesystem::create_directories(cache_dir, err);
+  if (!WriteMeshCache(file_name, hash, built)) {
+    std::cerr << "Unable to save mesh into " << file_name << '\n';
+  }
+  return std::make_unique<TriangleMesh>(std::move(built));
+}
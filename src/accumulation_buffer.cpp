@@ -0,0 +1,89 @@
+﻿#include "AccumulationBuffer.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <type_traits>
+
+namespace {
+/** Header of the raw file. Data is stored in the host byte order*/
+struct RawHeader {
+  char magic[8] = {'P', 'T', 'A', 'C', 'C', 'U', 'M', '\0'};
+  uint32_t version = 1;
+  int32_t width = 0;
+  int32_t height = 0;
+  uint32_t reserved = 0;
+  uint64_t pixel_begin = 0;
+  uint64_t pixel_end = 0;
+};
+
+static_assert(std::is_trivially_copyable_v<PixelAccum>);
+
+bool ReadRawHeader(std::ifstream& input, RawHeader& out) {
+  const RawHeader expected;
+  input.read(reinterpret_cast<char*>(&out), sizeof(out));
+  if (!input) return false;
+  return std::equal(std::begin(out.magic), std::end(out.magic),
+                    std::begin(expected.magic)) &&
+         out.version == expected.version && out.width > 0 && out.height > 0 &&
+         out.pixel_begin <= out.pixel_end &&
+         out.pixel_end <= static_cast<uint64_t>(out.width) *
+                              static_cast<uint64_t>(out.height);
+}
+}  // namespace
+
+std::vector<Color> AccumulationBuffer::GetColors() const {
+  std::vector<Color> result;
+  result.reserve(pixels_.size());
+  for (const auto& el : pixels_) {
+    result.push_back(el.GetColor());
+  }
+  return result;
+}
+
+bool AccumulationBuffer::SaveRaw(const std::string& file_name,
+                                 size_t pixel_begin, size_t pixel_end) const {
+  if (pixel_begin > pixel_end || pixel_end > pixels_.size()) return false;
+  std::ofstream out{file_name, std::ios::binary};
+  if (!out.is_open()) return false;
+  RawHeader header;
+  header.width = width_;
+  header.height = height_;
+  header.pixel_begin = pixel_begin;
+  header.pixel_end = pixel_end;
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char*>(pixels_.data() + pixel_begin),
+            static_cast<std::streamsize>((pixel_end - pixel_begin) *
+                                         sizeof(PixelAccum)));
+  return static_cast<bool>(out);
+}
+
+bool AccumulationBuffer::AddRaw(const std::string& file_name) {
+  std::ifstream input{file_name, std::ios::binary};
+  if (!input.is_open()) return false;
+  RawHeader header;
+  if (!ReadRawHeader(input, header) || header.width != width_ ||
+      header.height != height_) {
+    return false;
+  }
+  std::vector<PixelAccum> part(header.pixel_end - header.pixel_begin);
+  input.read(reinterpret_cast<char*>(part.data()),
+             static_cast<std::streamsize>(part.size() * sizeof(PixelAccum)));
+  if (!input) return false;
+  for (size_t i = 0; i < part.size(); ++i) {
+    pixels_[header.pixel_begin + i].Add(part[i]);
+  }
+  return true;
+}
+
+std::optional<AccumulationBuffer> AccumulationBuffer::LoadRaw(
+    const std::string& file_name) {
+  std::ifstream input{file_name, std::ios::binary};
+  if (!input.is_open()) return std::nullopt;
+  RawHeader header;
+  if (!ReadRawHeader(input, header)) return std::nullopt;
+  input.close();
+  AccumulationBuffer result{header.width, header.height};
+  if (!result.AddRaw(file_name)) return std::nullopt;
+  return result;
+}
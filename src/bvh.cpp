@@ -0,0 +1,342 @@
+﻿#include "Bvh.h"
+
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <limits>
+
+namespace {
+/** Objects in a leaf created when splitting does not reduce the cost*/
+constexpr size_t kMaxLeafSize = 4;
+constexpr int kBinNum = 16;
+/** Cost of visiting a node relative to one ray-object intersection*/
+constexpr double kTraversalCost = 1.0;
+/** Loops over fewer objects are not split between threads*/
+constexpr size_t kMinParallelItems = 1 << 14;
+/** Number of independent subtrees per thread, more subtrees give better
+ * balance between threads*/
+constexpr size_t kSubtreesPerThread = 8;
+
+struct BuildItem {
+  BoundingBox box;
+  GeoVec center;
+  uint32_t idx = 0;
+};
+
+struct Bin {
+  BoundingBox box;
+  size_t count = 0;
+};
+
+/** Subtree whose construction is postponed to be done in parallel*/
+struct Subtree {
+  uint32_t node_idx = 0;
+  size_t begin = 0;
+  size_t end = 0;
+  size_t depth = 0;
+};
+
+struct BuildContext {
+  std::vector<BuildItem>& items;
+  /** Pool for the loops over objects of a node, nullptr - single thread*/
+  ThreadPool* pool = nullptr;
+  /** Subtrees of at most this size are postponed, 0 - build everything*/
+  size_t subtree_size = 0;
+  std::vector<Subtree> postponed;
+  /** Number of objects which leaf test checks at the cost of one*/
+  size_t leaf_width = 1;
+
+  /** @return cost of testing the objects in a leaf*/
+  double GetTestCost(size_t obj_num) const {
+    return static_cast<double>((obj_num + leaf_width - 1) / leaf_width);
+  }
+};
+
+/** Splits [begin, end) into chunks, runs func(chunk_begin, chunk_end,
+ * chunk_idx) for them, in parallel for big ranges. @return number of chunks*/
+template <typename Func>
+size_t ForEachChunk(const BuildContext& ctx, size_t begin, size_t end,
+                    size_t max_chunks, Func&& func) {
+  size_t count = end - begin;
+  if (!ctx.pool || count < kMinParallelItems || max_chunks < 2) {
+    func(begin, end, 0);
+    return 1;
+  }
+  size_t chunk_num = std::min(max_chunks, count / (kMinParallelItems / 4));
+  ctx.pool->Run(chunk_num, [&](size_t chunk, size_t /*worker_idx*/) {
+    func(begin + chunk * count / chunk_num,
+         begin + (chunk + 1) * count / chunk_num, chunk);
+  });
+  return chunk_num;
+}
+
+size_t MaxChunks(const BuildContext& ctx) {
+  return ctx.pool ? 4 * ctx.pool->GetThreadNumber() : 1;
+}
+
+/** Builds subtree over items [begin, end) and returns index of its root*/
+uint32_t BuildNode(BuildContext& ctx, size_t begin, size_t end, size_t depth,
+                   std::vector<BvhNode>& nodes) {
+  std::vector<BuildItem>& items = ctx.items;
+  uint32_t node_idx = nodes.size();
+  nodes.emplace_back();
+  size_t item_num = end - begin;
+  if (item_num <= ctx.subtree_size) {
+    ctx.postponed.push_back({node_idx, begin, end, depth});
+    return node_idx;
+  }
+
+  std::vector<BoundingBox> chunk_bounds(MaxChunks(ctx));
+  std::vector<BoundingBox> chunk_centers(MaxChunks(ctx));
+  size_t chunk_num = ForEachChunk(
+      ctx, begin, end, MaxChunks(ctx),
+      [&](size_t chunk_begin, size_t chunk_end, size_t chunk) {
+        for (size_t i = chunk_begin; i < chunk_end; ++i) {
+          chunk_bounds[chunk].Extend(items[i].box);
+          chunk_centers[chunk].Extend(items[i].center);
+        }
+      });
+  BoundingBox bounds;
+  BoundingBox center_bounds;
+  for (size_t chunk = 0; chunk < chunk_num; ++chunk) {
+    bounds.Extend(chunk_bounds[chunk]);
+    center_bounds.Extend(chunk_centers[chunk]);
+  }
+  nodes[node_idx].box = bounds;
+  auto make_leaf = [&] {
+    nodes[node_idx].offset = begin;
+    nodes[node_idx].obj_num = end - begin;
+    return node_idx;
+  };
+  int axis = center_bounds.GetLongestAxis();
+  Real axis_min = GetAxis(center_bounds.min, axis);
+  Real extent = GetAxis(center_bounds.max, axis) - axis_min;
+  if (item_num <= 1 || depth >= kBvhMaxDepth || !(extent > 0)) {
+    return make_leaf();
+  }
+
+  auto bin_of = [&](const BuildItem& item) {
+    int idx = kBinNum * (GetAxis(item.center, axis) - axis_min) / extent;
+    return std::clamp(idx, 0, kBinNum - 1);
+  };
+  std::vector<std::array<Bin, kBinNum>> chunk_bins(MaxChunks(ctx));
+  chunk_num = ForEachChunk(
+      ctx, begin, end, MaxChunks(ctx),
+      [&](size_t chunk_begin, size_t chunk_end, size_t chunk) {
+        for (size_t i = chunk_begin; i < chunk_end; ++i) {
+          Bin& bin = chunk_bins[chunk][bin_of(items[i])];
+          bin.box.Extend(items[i].box);
+          ++bin.count;
+        }
+      });
+  std::array<Bin, kBinNum>& bins = chunk_bins[0];
+  for (size_t chunk = 1; chunk < chunk_num; ++chunk) {
+    for (int i = 0; i < kBinNum; ++i) {
+      bins[i].box.Extend(chunk_bins[chunk][i].box);
+      bins[i].count += chunk_bins[chunk][i].count;
+    }
+  }
+  // area weighted number of objects to the right of every split
+  std::array<double, kBinNum> right_cost{};
+  BoundingBox right_box;
+  size_t right_num = 0;
+  for (int i = kBinNum - 1; i > 0; --i) {
+    right_box.Extend(bins[i].box);
+    right_num += bins[i].count;
+    right_cost[i] = ToDouble(right_box.GetSurfaceArea()) *
+                    ctx.GetTestCost(right_num);
+  }
+  // costs are multiplied by the surface area of the node
+  double best_cost = std::numeric_limits<double>::infinity();
+  int best_split = 0;
+  BoundingBox left_box;
+  size_t left_num = 0;
+  for (int i = 1; i < kBinNum; ++i) {
+    left_box.Extend(bins[i - 1].box);
+    left_num += bins[i - 1].count;
+    if (left_num == 0 || left_num == item_num) continue;
+    double cost =
+        ToDouble(left_box.GetSurfaceArea()) * ctx.GetTestCost(left_num) +
+        right_cost[i];
+    if (cost < best_cost) {
+      best_cost = cost;
+      best_split = i;
+    }
+  }
+  double area = bounds.GetSurfaceArea();
+  double leaf_cost = area * ctx.GetTestCost(item_num);
+  if (item_num <= std::max(kMaxLeafSize, ctx.leaf_width) &&
+      kTraversalCost * area + best_cost >= leaf_cost) {
+    return make_leaf();
+  }
+  auto mid_it = std::partition(
+      items.begin() + begin, items.begin() + end,
+      [&](const BuildItem& item) { return bin_of(item) < best_split; });
+  size_t mid = mid_it - items.begin();
+  nodes[node_idx].axis = axis;
+  BuildNode(ctx, begin, mid, depth + 1, nodes);
+  uint32_t second = BuildNode(ctx, mid, end, depth + 1, nodes);
+  nodes[node_idx].offset = second;
+  return node_idx;
+}
+
+/**
+ * Appends nodes of the top tree into result in depth first order, postponed
+ * subtrees are inserted in place of their placeholder nodes
+ */
+void Flatten(const std::vector<BvhNode>& top_nodes,
+             const std::vector<int>& subtree_of_node,
+             const std::vector<std::vector<BvhNode>>& subtrees,
+             uint32_t top_idx, std::vector<BvhNode>& result) {
+  if (subtree_of_node[top_idx] >= 0) {
+    uint32_t base = result.size();
+    for (BvhNode node : subtrees[subtree_of_node[top_idx]]) {
+      if (!node.obj_num) node.offset += base;
+      result.push_back(node);
+    }
+    return;
+  }
+  const BvhNode& node = top_nodes[top_idx];
+  uint32_t node_idx = result.size();
+  result.push_back(node);
+  if (node.obj_num) return;
+  Flatten(top_nodes, subtree_of_node, subtrees, top_idx + 1, result);
+  result[node_idx].offset = result.size();
+  Flatten(top_nodes, subtree_of_node, subtrees, node.offset, result);
+}
+}  // namespace
+
+std::vector<BvhNode> BuildBvhNodes(
+    size_t box_num, const std::function<BoundingBox(size_t)>& get_box,
+    ThreadPool* pool, std::vector<uint32_t>& order, size_t leaf_width) {
+  std::vector<BvhNode> nodes;
+  order.clear();
+  if (!box_num) return nodes;
+  std::vector<BuildItem> items(box_num);
+  BuildContext ctx{items, pool, 0, {}, std::max<size_t>(leaf_width, 1)};
+  ForEachChunk(ctx, 0, items.size(), MaxChunks(ctx),
+               [&](size_t chunk_begin, size_t chunk_end, size_t /*chunk*/) {
+                 for (size_t i = chunk_begin; i < chunk_end; ++i) {
+                   BoundingBox box = get_box(i);
+                   items[i] = {box, box.GetCenter(), static_cast<uint32_t>(i)};
+                 }
+               });
+  size_t thread_num = pool ? pool->GetThreadNumber() : 1;
+  if (thread_num < 2 || items.size() < kMinParallelItems) {
+    nodes.reserve(2 * items.size());
+    BuildNode(ctx, 0, items.size(), 0, nodes);
+  } else {
+    // top of the tree is built with parallel loops over boxes, then
+    // independent subtrees are built by separate tasks
+    ctx.subtree_size = items.size() / (kSubtreesPerThread * thread_num);
+    std::vector<BvhNode> top_nodes;
+    BuildNode(ctx, 0, items.size(), 0, top_nodes);
+    std::vector<std::vector<BvhNode>> subtrees(ctx.postponed.size());
+    // leaves of a subtree reference items by absolute indices, inner nodes
+    // reference children relative to the subtree root
+    pool->Run(ctx.postponed.size(), [&](size_t task_idx, size_t /*worker*/) {
+      const Subtree& subtree = ctx.postponed[task_idx];
+      BuildContext sub_ctx{items, nullptr, 0, {}, ctx.leaf_width};
+      subtrees[task_idx].reserve(2 * (subtree.end - subtree.begin));
+      BuildNode(sub_ctx, subtree.begin, subtree.end, subtree.depth,
+                subtrees[task_idx]);
+    });
+    std::vector<int> subtree_of_node(top_nodes.size(), -1);
+    for (size_t i = 0; i < ctx.postponed.size(); ++i) {
+      subtree_of_node[ctx.postponed[i].node_idx] = i;
+    }
+    nodes.reserve(2 * items.size());
+    Flatten(top_nodes, subtree_of_node, subtrees, 0, nodes);
+  }
+  nodes.shrink_to_fit();
+  order.reserve(items.size());
+  for (const auto& item : items) {
+    order.push_back(item.idx);
+  }
+  return nodes;
+}
+
+Bvh::Bvh(std::vector<const Object*> objects, ThreadPool* pool) {
+  std::vector<uint32_t> order;
+  nodes_ = BuildBvhNodes(
+      objects.size(),
+      [&](size_t idx) { return objects[idx]->GetBoundingBox(); }, pool, order);
+  node_view_ = nodes_;
+  objects_.reserve(order.size());
+  for (uint32_t idx : order) {
+    objects_.push_back(objects[idx]);
+  }
+  for (const auto& node : nodes_) {
+    if (!node.obj_num) continue;
+    auto first = objects_.begin() + node.offset;
+    std::stable_sort(first, first + node.obj_num,
+                     [](const Object* lhs, const Object* rhs) {
+                       return GetPrimitiveKind(*lhs) < GetPrimitiveKind(*rhs);
+                     });
+  }
+  primitives_ = PrimitiveArrays{objects_};
+}
+
+bool Bvh::Refit() {
+  if (file_) {
+    // mapped nodes are read only
+    nodes_.assign(node_view_.begin(), node_view_.end());
+    node_view_ = nodes_;
+    file_.reset();
+  }
+  primitives_.Update();
+  RefitBvhNodes(nodes_, [&](uint32_t idx) {
+    return objects_[idx]->GetBoundingBox();
+  });
+  return true;
+}
+
+double Bvh::GetCost() const {
+  if (node_view_.empty()) return 0.0;
+  double root_area = node_view_[0].box.GetSurfaceArea();
+  if (root_area <= 0.0) return 0.0;
+  double cost = 0.0;
+  for (const auto& node : node_view_) {
+    cost += ToDouble(node.box.GetSurfaceArea()) / root_area *
+            (node.obj_num ? node.obj_num : kTraversalCost);
+  }
+  return cost;
+}
+
+std::optional<HitRecord> Bvh::GetClosestHit(const Ray& ray) const {
+  HitRecord closest{std::numeric_limits<Real>::max(), nullptr};
+  TraverseBvh(node_view_, ray, closest.dist, [&](uint32_t first, uint32_t num) {
+    for (uint32_t i = first; i < first + num; ++i) {
+      primitives_.Intersect(ray, i, closest);
+    }
+  });
+  if (!closest.obj) return std::nullopt;
+  return closest;
+}
+
+bool Bvh::IsOccluded(const Ray& ray, Real max_dist) const {
+  bool is_occluded = false;
+  TraverseBvh(node_view_, ray, max_dist, [&](uint32_t first, uint32_t num) {
+    for (uint32_t i = first; i < first + num && !is_occluded; ++i) {
+      is_occluded = primitives_.IsCrossed(ray, i, max_dist);
+    }
+    return is_occluded;
+  });
+  return is_occluded;
+}
+
+void Bvh::GetClosestHits(ArrayView<Ray> rays,
+                         std::optional<HitRecord>* hits) const {
+  TraceRayPackets(rays, hits, [&](ArrayView<Ray> part, RayPacket& packet,
+                                  HitRecord* closest) {
+    TraverseBvhPacket(
+        node_view_, packet, [&](uint32_t first, uint32_t num, uint64_t active) {
+          ForEachRay(active, [&](size_t i) {
+            for (uint32_t obj = first; obj < first + num; ++obj) {
+              primitives_.Intersect(part[i], obj, closest[i]);
+            }
+            packet.max_dist[i] = closest[i].dist;
+          });
+        });
+  });
+}
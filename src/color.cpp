@@ -24,3 +24,40 @@ void Color::TruncColorsInTrace(std::vector<Color>& colors) {
     it->TruncByColor(*it_source);
   }
 }
+
+void ColorTrace::Channel::Push(uint8_t value, bool is_counted) {
+  uint32_t count = is_counted;
+  while (!levels.empty() && levels.back().value >= value) {
+    count += levels.back().count;
+    sum -= uint64_t{levels.back().value} * levels.back().count;
+    levels.pop_back();
+  }
+  if (!count) return;
+  levels.push_back({value, count});
+  sum += uint64_t{value} * count;
+}
+
+uint64_t ColorTrace::Channel::GetSum(uint8_t trunc_value) const {
+  uint64_t res = sum;
+  for (auto it = levels.rbegin(); it != levels.rend(); ++it) {
+    if (it->value <= trunc_value) break;
+    res -= static_cast<uint64_t>(it->value - trunc_value) * it->count;
+  }
+  return res;
+}
+
+void ColorTrace::Push(const Color& col) {
+  // empty color truncates previous colors as black one
+  red_.Push(col.red, col.IsColor());
+  green_.Push(col.green, col.IsColor());
+  blue_.Push(col.blue, col.IsColor());
+  color_num_ += col.IsColor();
+}
+
+Radiance ColorTrace::GetColor(const Color& light) const {
+  if (!light.IsColor()) return {};
+  double scale = 1.0 / (color_num_ + 1);
+  return {scale * (red_.GetSum(light.red) + light.red),
+          scale * (green_.GetSum(light.green) + light.green),
+          scale * (blue_.GetSum(light.blue) + light.blue)};
+}
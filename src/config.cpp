@@ -1,12 +1,18 @@
 ﻿#include "Config.h"
 
 #include <fstream>
+#include <map>
 #include <memory>
 #include <nlohmann/json.hpp>
 #include <optional>
 #include <string_view>
+#include <typeinfo>
 #include <vector>
 
+#include "AcceleratorCache.h"
+#include "SphereSet.h"
+#include "ThreadPool.h"
+
 namespace {
 template <typename NumberType>
 bool ReadNonNegativeValue(const nlohmann::json& cfg, const std::string& name,
@@ -71,6 +77,30 @@ bool ReadPoint(const nlohmann::json& point_arr, GeoVec& out) {
   return true;
 }
 
+/** Reads enum value given by its case insensitive name*/
+template <typename EnumType>
+bool ReadEnumValue(
+    const nlohmann::json& cfg, const std::string& name,
+    const std::vector<std::pair<std::string_view, EnumType>>& value_names,
+    EnumType& out, EnumType def_value) {
+  if (!cfg.contains(name)) {
+    out = def_value;
+    return true;
+  }
+  std::string value = cfg[name].get<std::string>();
+  std::transform(
+      value.begin(), value.end(), value.begin(),
+      [](unsigned char ch) { return static_cast<char>(std::toupper(ch)); });
+  for (const auto& [value_name, enum_value] : value_names) {
+    if (value == value_name) {
+      out = enum_value;
+      return true;
+    }
+  }
+  std::cout << "Unknown " << name << " = " << value << '\n';
+  return false;
+}
+
 bool OpenJSONFile(const std::string& file_name, nlohmann::json& json) {
   std::ifstream input{file_name};
   if (!input.is_open()) {
@@ -82,7 +112,13 @@ bool OpenJSONFile(const std::string& file_name, nlohmann::json& json) {
 
 }  // namespace
 
-Config::Config(const std::string& file_name) {
+Config::Config(const std::string& file_name) : Config(file_name, true) {}
+
+Config Config::ReadFrame(const std::string& file_name) {
+  return Config(file_name, false);
+}
+
+Config::Config(const std::string& file_name, bool build_hierarchies) {
   nlohmann::json cfg_json;
   if (!OpenJSONFile(file_name, cfg_json)) {
     std::cout << "Cannot open file " << file_name << '\n';
@@ -90,7 +126,72 @@ Config::Config(const std::string& file_name) {
   }
   general_settings_ = ParseGeneralSettings(cfg_json["general"]);
   camera_settings_ = ParseCameraSettings(cfg_json["camera"]);
-  objects_ = ParseObjects(cfg_json["objects"]);
+  if (!build_hierarchies) {
+    objects_ = ParseObjects(cfg_json["objects"], meshes_, nullptr, "");
+    return;
+  }
+  // mesh hierarchies are built with as many threads as the render uses and
+  // are cached next to the scene structure
+  GeneralSettings mesh_settings = general_settings_.value_or(GeneralSettings{});
+  ThreadPool pool{static_cast<size_t>(mesh_settings.thread_number)};
+  objects_ = ParseObjects(cfg_json["objects"], meshes_, &pool,
+                          mesh_settings.accelerator_cache_dir);
+}
+
+bool Config::UpdateGeometry(const Config& frame) {
+  if (frame.objects_.size() != objects_.size()) return false;
+  // shared mesh of instances and the mesh it takes points from
+  std::map<const TriangleMesh*, const TriangleMesh*> mesh_frames;
+  for (size_t i = 0; i < objects_.size(); ++i) {
+    const Object& obj = *objects_[i];
+    if (typeid(obj) != typeid(*frame.objects_[i])) return false;
+    if (const auto* mesh = dynamic_cast<const TriangleMesh*>(&obj)) {
+      if (!mesh->CanUpdatePoints(
+              static_cast<const TriangleMesh&>(*frame.objects_[i]))) {
+        return false;
+      }
+    } else if (const auto* set = dynamic_cast<const SphereSet*>(&obj)) {
+      if (set->GetSphereNumber() !=
+          static_cast<const SphereSet&>(*frame.objects_[i])
+              .GetSphereNumber()) {
+        return false;
+      }
+    } else if (const auto* inst = dynamic_cast<const Instance*>(&obj)) {
+      const TriangleMesh& mesh = inst->GetMesh();
+      const TriangleMesh& next =
+          static_cast<const Instance&>(*frame.objects_[i]).GetMesh();
+      auto [it, inserted] = mesh_frames.emplace(&mesh, &next);
+      // instances of one mesh cannot take points of different meshes
+      if (!inserted && it->second != &next) return false;
+      if (inserted && !mesh.CanUpdatePoints(next)) return false;
+    } else if (!dynamic_cast<const Sphere*>(&obj) &&
+               !dynamic_cast<const Triangle*>(&obj)) {
+      // objects of other types would stay where they are
+      return false;
+    }
+  }
+  for (auto& mesh : meshes_) {
+    auto it = mesh_frames.find(mesh.get());
+    if (it != mesh_frames.end()) mesh->UpdatePoints(*it->second);
+  }
+  for (size_t i = 0; i < objects_.size(); ++i) {
+    if (auto* sphere = dynamic_cast<Sphere*>(objects_[i].get())) {
+      sphere->SetCenter(
+          static_cast<const Sphere&>(*frame.objects_[i]).GetCenter());
+    } else if (auto* tri = dynamic_cast<Triangle*>(objects_[i].get())) {
+      const auto& next = static_cast<const Triangle&>(*frame.objects_[i]);
+      tri->SetPoints(next.GetPoint0(), next.GetPoint1(), next.GetPoint2());
+    } else if (auto* mesh = dynamic_cast<TriangleMesh*>(objects_[i].get())) {
+      mesh->UpdatePoints(static_cast<const TriangleMesh&>(*frame.objects_[i]));
+    } else if (auto* set = dynamic_cast<SphereSet*>(objects_[i].get())) {
+      set->UpdateCenters(static_cast<const SphereSet&>(*frame.objects_[i]));
+    } else if (auto* inst = dynamic_cast<Instance*>(objects_[i].get())) {
+      // also refreshes the box after points of the mesh moved
+      inst->SetTransform(
+          static_cast<const Instance&>(*frame.objects_[i]).GetTransform());
+    }
+  }
+  return true;
 }
 
 std::optional<GeneralSettings> Config::ParseGeneralSettings(
@@ -112,6 +213,58 @@ std::optional<GeneralSettings> Config::ParseGeneralSettings(
                          result.pic_height_in_pixel, 400)) {
     return std::nullopt;
   }
+  if (!ReadNonNegativeValue(input, "number_of_threads", result.thread_number,
+                            0)) {
+    return std::nullopt;
+  }
+  int64_t seed = 0;
+  if (!ReadNonNegativeValue<int64_t>(input, "seed", seed, 0)) {
+    return std::nullopt;
+  }
+  result.seed = static_cast<uint64_t>(seed);
+  if (!ReadNonNegativeValue(input, "number_of_samples_per_pass",
+                            result.samples_per_pass, 0)) {
+    return std::nullopt;
+  }
+  if (!ReadNonNegativeValue(input, "snapshot_interval_in_seconds",
+                            result.snapshot_interval_in_sec, 0.0)) {
+    return std::nullopt;
+  }
+  if (!ReadEnumValue(input, "tile_order",
+                     {{"SCANLINE", TileOrder::kScanline},
+                      {"MORTON", TileOrder::kMorton},
+                      {"HILBERT", TileOrder::kHilbert}},
+                     result.tile_order, TileOrder::kHilbert)) {
+    return std::nullopt;
+  }
+  if (!ReadNonNegativeValue(input, "ray_packet_side", result.ray_packet_side,
+                            0)) {
+    return std::nullopt;
+  }
+  if (result.ray_packet_side > kMaxRayPacketSide) {
+    std::cout << "ray_packet_side must not exceed " << kMaxRayPacketSide
+              << "!\n";
+    return std::nullopt;
+  }
+  if (!ReadEnumValue(input, "accelerator",
+                     {{"BVH", AcceleratorType::kBvh},
+                      {"WIDE_BVH", AcceleratorType::kWideBvh},
+                      {"GRID", AcceleratorType::kGrid},
+                      {"KD_TREE", AcceleratorType::kKdTree}},
+                     result.accelerator, AcceleratorType::kWideBvh)) {
+    return std::nullopt;
+  }
+  if (input.contains("light_sampling")) {
+    result.light_sampling = input["light_sampling"].get<bool>();
+  }
+  if (!ReadNonNegativeValue(input, "refit_cost_ratio", result.refit_cost_ratio,
+                            1.5)) {
+    return std::nullopt;
+  }
+  if (input.contains("accelerator_cache_dir")) {
+    result.accelerator_cache_dir =
+        input["accelerator_cache_dir"].get<std::string>();
+  }
   result.out_file_name = input.contains("output_file")
                              ? input["output_file"].get<std::string>()
                              : "path_tracer_output.png";
@@ -240,7 +393,7 @@ bool ReadPointVector(const nlohmann::json& node, std::vector<GeoVec>& out) {
 }
 
 bool ReadFacesVector(const nlohmann::json& node,
-                     std::vector<std::tuple<int, int, int>>& out) {
+                     std::vector<TriangleMesh::Face>& out) {
   out.reserve(node.size());
   for (const auto& el : node) {
     if (el.size() != 3) return false;
@@ -248,82 +401,247 @@ bool ReadFacesVector(const nlohmann::json& node,
     int i2 = el.at(1).get<int>();
     int i3 = el.at(2).get<int>();
     if (i1 < 0 || i2 < 0 || i3 < 0) return false;
-    out.push_back(std::make_tuple(i1, i2, i3));
+    out.push_back({static_cast<uint32_t>(i1), static_cast<uint32_t>(i2),
+                   static_cast<uint32_t>(i3)});
   }
   return true;
 }
 
-bool ReadTriangles(const nlohmann::json& node,
-                   std::vector<std::unique_ptr<Object>>& out) {
+/** Material shared by all triangles of one mesh or spheres of one set*/
+struct MeshMaterial {
   Color color;
-  if (!ReadColor(node, "color", color, colors::kGreen)) {
+  Material mat = Material::kNoMaterial;
+  double reflection = 0.0;
+  double polishness = 0.0;
+};
+
+/** Points and faces of a mesh, checked that faces refer to existing points*/
+struct MeshGeometry {
+  std::vector<GeoVec> points;
+  std::vector<TriangleMesh::Face> faces;
+};
+
+bool ReadMeshMaterial(const nlohmann::json& node, MeshMaterial& out) {
+  if (!ReadColor(node, "color", out.color, colors::kGreen)) {
     return false;
   }
   if (!node.contains("is_light_source")) return false;
-  Material mat = node["is_light_source"].get<bool>() ? Material::kLightSource
-                                                     : Material::kReflective;
-  double reflection = std::numeric_limits<double>::quiet_NaN();
-  if (!ReadNonNegativeValue(node, "reflection", reflection, 0.75)) {
+  out.mat = node["is_light_source"].get<bool>() ? Material::kLightSource
+                                                : Material::kReflective;
+  if (!ReadNonNegativeValue(node, "reflection", out.reflection, 0.75)) {
     return false;
   }
-  reflection = std::clamp(reflection, 0.0, 1.0);
+  out.reflection = std::clamp(out.reflection, 0.0, 1.0);
 
-  double polishness = std::numeric_limits<double>::quiet_NaN();
-  if (!ReadNonNegativeValue(node, "polishness", polishness, 0.9)) {
+  if (!ReadNonNegativeValue(node, "polishness", out.polishness, 0.9)) {
     return false;
   }
-  polishness = std::clamp(polishness, 0.0, 1.0);
+  out.polishness = std::clamp(out.polishness, 0.0, 1.0);
+  return true;
+}
 
-  std::vector<GeoVec> points;
-  std::vector<std::tuple<int, int, int>> faces;
-  if (node.contains("description")) {
-    // points and faces are described in separate file
-    nlohmann::json prop_json;
+bool ReadMeshGeometry(const nlohmann::json& node, MeshGeometry& out) {
+  if (!node.contains("points") ||
+      !ReadPointVector(node["points"], out.points)) {
+    return false;
+  }
+  if (!node.contains("faces") || !ReadFacesVector(node["faces"], out.faces)) {
+    return false;
+  }
+  size_t pts_size = out.points.size();
+  return std::none_of(
+      out.faces.begin(), out.faces.end(), [pts_size](const auto& f) {
+        return f[0] >= pts_size || f[1] >= pts_size || f[2] >= pts_size;
+      });
+}
 
-    if (!OpenJSONFile(node["description"], prop_json)) return false;
-    if (!prop_json.contains("points") ||
-        !ReadPointVector(prop_json["points"], points)) {
-      return false;
-    }
-    if (!prop_json.contains("faces") ||
-        !ReadFacesVector(prop_json["faces"], faces)) {
-      return false;
-    }
+/**
+ * Caches meshes parsed from description files, so every file is read once
+ * and gets one shared mesh. Material is kept by instances, so nodes of one
+ * file with different materials share the mesh as well. Meshes are
+ * built with the pool and stored in the accelerator cache directory. Without
+ * the pool meshes get no hierarchies
+ */
+class MeshCache {
+ public:
+  MeshCache(std::vector<std::unique_ptr<TriangleMesh>>& meshes,
+            ThreadPool* pool, std::string cache_dir)
+      : meshes_(meshes), pool_(pool), cache_dir_(std::move(cache_dir)) {}
 
-  } else {
-    if (!node.contains("points") || !ReadPointVector(node["points"], points)) {
-      return false;
+  /** @return geometry of the node, read from the description file if it is
+   * given, nullptr if geometry is incorrect*/
+  const MeshGeometry* GetGeometry(const nlohmann::json& node) {
+    if (!node.contains("description")) {
+      inline_geometry_ = std::make_unique<MeshGeometry>();
+      if (!ReadMeshGeometry(node, *inline_geometry_)) return nullptr;
+      return inline_geometry_.get();
     }
-    if (!node.contains("faces") || !ReadFacesVector(node["faces"], faces)) {
-      return false;
+    std::string file_name = node["description"].get<std::string>();
+    auto it = files_.find(file_name);
+    if (it == files_.end()) {
+      // points and faces are described in separate file
+      nlohmann::json prop_json;
+      std::optional<MeshGeometry> geometry;
+      if (OpenJSONFile(file_name, prop_json)) {
+        geometry.emplace();
+        if (!ReadMeshGeometry(prop_json, *geometry)) geometry.reset();
+      }
+      it = files_.emplace(file_name, std::move(geometry)).first;
     }
+    return it->second ? &*it->second : nullptr;
+  }
+
+  /** @return shared mesh of the node without material. Nodes with inline
+   * points get own mesh*/
+  const TriangleMesh* GetMesh(const nlohmann::json& node,
+                              const MeshGeometry& geometry);
+  /** @return new mesh with the given geometry and material*/
+  std::unique_ptr<TriangleMesh> MakeMesh(const MeshGeometry& geometry,
+                                         const MeshMaterial& material) const;
+
+ private:
+  std::vector<std::unique_ptr<TriangleMesh>>& meshes_;
+  ThreadPool* pool_;
+  std::string cache_dir_;
+  std::map<std::string, std::optional<MeshGeometry>> files_;
+  std::map<std::string, const TriangleMesh*> file_meshes_;
+  std::unique_ptr<MeshGeometry> inline_geometry_;
+};
+
+std::unique_ptr<TriangleMesh> MeshCache::MakeMesh(
+    const MeshGeometry& geometry, const MeshMaterial& material) const {
+  std::unique_ptr<TriangleMesh> mesh =
+      pool_ ? CreateCachedMesh(geometry.points, geometry.faces, pool_,
+                               cache_dir_)
+            : std::make_unique<TriangleMesh>(geometry.points, geometry.faces,
+                                             NoHierarchy{});
+  mesh->SetColor(material.color)
+      .SetMaterial(material.mat)
+      .SetPolishness(material.polishness)
+      .SetReflectionCoef(material.reflection);
+  return mesh;
+}
+
+const TriangleMesh* MeshCache::GetMesh(const nlohmann::json& node,
+                                       const MeshGeometry& geometry) {
+  std::string key;
+  if (node.contains("description")) {
+    key = node["description"].get<std::string>();
+    auto it = file_meshes_.find(key);
+    if (it != file_meshes_.end()) return it->second;
+  }
+  meshes_.push_back(MakeMesh(geometry, MeshMaterial{}));
+  if (!key.empty()) file_meshes_[key] = meshes_.back().get();
+  return meshes_.back().get();
+}
+
+bool ReadScale(const nlohmann::json& node, GeoVec& out) {
+  if (!node.contains("scale")) {
+    out = {1.0, 1.0, 1.0};
+    return true;
+  }
+  const auto& scale = node["scale"];
+  if (scale.is_number()) {
+    double val = scale.get<double>();
+    out = {val, val, val};
+  } else if (!ReadPoint(scale, out)) {
+    return false;
   }
-  size_t pts_size = points.size();
-  if (std::any_of(faces.begin(), faces.end(), [pts_size](const auto& f) {
-        return std::get<0>(f) >= pts_size || std::get<1>(f) >= pts_size ||
-               std::get<2>(f) >= pts_size;
-      })) {
+  if (!(out.x_ > 0 && out.y_ > 0 && out.z_ > 0)) {
+    std::cout << "scale must be positive!\n";
     return false;
   }
+  return true;
+}
 
-  out.reserve(faces.size());
-  for (const auto& f : faces) {
-    auto tri = std::make_unique<Triangle>(
-        points[std::get<0>(f)], points[std::get<1>(f)], points[std::get<2>(f)]);
-    tri->SetColor(color)
-        .SetMaterial(mat)
-        .SetPolishness(polishness)
-        .SetReflectionCoef(reflection);
-    out.push_back(std::move(tri));
+bool ReadTransform(const nlohmann::json& node, Transform& out) {
+  if (node.contains("translation") &&
+      !ReadPoint(node["translation"], out.translation)) {
+    return false;
+  }
+  if (node.contains("rotation") &&
+      !ReadPoint(node["rotation"], out.rotation_in_deg)) {
+    return false;
+  }
+  return ReadScale(node, out.scale);
+}
+
+bool ReadTriangles(const nlohmann::json& node, MeshCache& cache,
+                   std::vector<std::unique_ptr<Object>>& out) {
+  MeshMaterial material;
+  if (!ReadMeshMaterial(node, material)) return false;
+  const MeshGeometry* geometry = cache.GetGeometry(node);
+  if (!geometry) return false;
+
+  if (!node.contains("instances")) {
+    if (!geometry->faces.empty()) {
+      out.push_back(cache.MakeMesh(*geometry, material));
+    }
+    return true;
+  }
+  // mesh is built once and placed by every instance with its own transform
+  std::vector<Transform> transforms;
+  for (const auto& el : node["instances"]) {
+    if (!ReadTransform(el, transforms.emplace_back())) return false;
+  }
+  if (geometry->faces.empty()) return true;
+  const TriangleMesh* mesh = cache.GetMesh(node, *geometry);
+  for (const auto& transform : transforms) {
+    auto instance = std::make_unique<Instance>(*mesh, transform);
+    instance->SetColor(material.color)
+        .SetMaterial(material.mat)
+        .SetPolishness(material.polishness)
+        .SetReflectionCoef(material.reflection);
+    out.push_back(std::move(instance));
   }
   return true;
 }
 
+/** Spheres of one material given by "centers" and either "radius" shared by
+ * all of them or "radii" of every center*/
+std::unique_ptr<Object> ReadSphereSet(const nlohmann::json& node,
+                                      ThreadPool* pool) {
+  MeshMaterial material;
+  if (!ReadMeshMaterial(node, material)) return nullptr;
+  std::vector<GeoVec> centers;
+  if (!node.contains("centers") ||
+      !ReadPointVector(node["centers"], centers) || centers.empty()) {
+    return nullptr;
+  }
+  std::vector<Real> radii;
+  if (node.contains("radii")) {
+    for (const auto& el : node["radii"]) {
+      double radius = el.get<double>();
+      if (radius <= 0) {
+        std::cout << "radii must be positive!\n";
+        return nullptr;
+      }
+      radii.push_back(radius);
+    }
+    if (radii.size() != centers.size()) return nullptr;
+  } else {
+    double radius = 0.0;
+    if (!ReadPositiveValue(node, "radius", radius)) return nullptr;
+    radii.assign(centers.size(), radius);
+  }
+  auto result = pool ? std::make_unique<SphereSet>(centers, radii, pool)
+                     : std::make_unique<SphereSet>(centers, radii,
+                                                   NoHierarchy{});
+  result->SetColor(material.color)
+      .SetMaterial(material.mat)
+      .SetPolishness(material.polishness)
+      .SetReflectionCoef(material.reflection);
+  return result;
+}
+
 }  // namespace
 
 std::vector<std::unique_ptr<Object>> Config::ParseObjects(
-    const nlohmann::json& input) {
+    const nlohmann::json& input,
+    std::vector<std::unique_ptr<TriangleMesh>>& meshes, ThreadPool* pool,
+    const std::string& cache_dir) {
   std::vector<std::unique_ptr<Object>> result;
+  MeshCache mesh_cache{meshes, pool, cache_dir};
   int count = 0;
   std::string type;
   for (auto node : input) {
@@ -343,9 +661,16 @@ std::vector<std::unique_ptr<Object>> Config::ParseObjects(
         continue;
       }
       result.push_back(std::move(sphere));
+    } else if (type == "SPHERES") {
+      std::unique_ptr<Object> spheres = ReadSphereSet(node, pool);
+      if (!spheres) {
+        std::cout << "Bad object with index " << count - 1 << '\n';
+        continue;
+      }
+      result.push_back(std::move(spheres));
     } else if (type == "TRIANGLES") {
       std::vector<std::unique_ptr<Object>> triangles;
-      if (!ReadTriangles(node, triangles)) {
+      if (!ReadTriangles(node, mesh_cache, triangles)) {
         std::cout << "Bad object with index " << count - 1 << '\n';
         continue;
       }
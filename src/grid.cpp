@@ -0,0 +1,160 @@
+﻿#include "Grid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+/** Number of grid cells per scene object*/
+constexpr double kCellsPerObject = 2.0;
+constexpr size_t kMaxResolution = 256;
+}  // namespace
+
+Grid::Grid(std::vector<const Object*> objects)
+    : objects_(std::move(objects)), primitives_(objects_) {
+  if (objects_.empty()) return;
+  std::vector<BoundingBox> boxes;
+  boxes.reserve(objects_.size());
+  for (const Object* obj : objects_) {
+    boxes.push_back(obj->GetBoundingBox());
+    bounds_.Extend(boxes.back());
+  }
+  // margin keeps cells of flat scenes non degenerate and objects on the
+  // border inside the grid
+  GeoVec extent = bounds_.max - bounds_.min;
+  double margin =
+      1e-6 * std::max<double>({extent.x_, extent.y_, extent.z_, 1.0});
+  bounds_.min = bounds_.min - GeoVec{margin, margin, margin};
+  bounds_.max = bounds_.max + GeoVec{margin, margin, margin};
+  extent = bounds_.max - bounds_.min;
+
+  double cells_per_unit =
+      std::cbrt(kCellsPerObject * static_cast<double>(objects_.size()) /
+                ToDouble(extent.x_ * extent.y_ * extent.z_));
+  for (size_t axis = 0; axis < 3; ++axis) {
+    double res = std::round(ToDouble(GetAxis(extent, axis)) * cells_per_unit);
+    res_[axis] = static_cast<size_t>(
+        std::clamp(res, 1.0, static_cast<double>(kMaxResolution)));
+  }
+  cell_size_ = {extent.x_ / static_cast<Real>(res_[0]),
+                extent.y_ / static_cast<Real>(res_[1]),
+                extent.z_ / static_cast<Real>(res_[2])};
+
+  // count objects of every cell, then place them
+  size_t cell_num = res_[0] * res_[1] * res_[2];
+  cell_start_.assign(cell_num + 1, 0);
+  auto for_each_cell = [&](const BoundingBox& box, auto&& func) {
+    std::array<size_t, 3> lo = GetCell(box.min);
+    std::array<size_t, 3> hi = GetCell(box.max);
+    std::array<size_t, 3> cell;
+    for (cell[2] = lo[2]; cell[2] <= hi[2]; ++cell[2]) {
+      for (cell[1] = lo[1]; cell[1] <= hi[1]; ++cell[1]) {
+        for (cell[0] = lo[0]; cell[0] <= hi[0]; ++cell[0]) {
+          func(GetCellIdx(cell));
+        }
+      }
+    }
+  };
+  for (const auto& box : boxes) {
+    for_each_cell(box, [&](size_t idx) { ++cell_start_[idx + 1]; });
+  }
+  for (size_t i = 0; i < cell_num; ++i) {
+    cell_start_[i + 1] += cell_start_[i];
+  }
+  cell_objects_.resize(cell_start_.back());
+  std::vector<uint32_t> filled(cell_start_.begin(), cell_start_.end() - 1);
+  for (uint32_t obj = 0; obj < boxes.size(); ++obj) {
+    for_each_cell(boxes[obj],
+                  [&](size_t idx) { cell_objects_[filled[idx]++] = obj; });
+  }
+}
+
+std::array<size_t, 3> Grid::GetCell(const GeoVec& p) const {
+  std::array<size_t, 3> result;
+  for (size_t axis = 0; axis < 3; ++axis) {
+    double pos = (GetAxis(p, axis) - GetAxis(bounds_.min, axis)) /
+                 GetAxis(cell_size_, axis);
+    result[axis] = static_cast<size_t>(std::clamp(
+        std::floor(pos), 0.0, static_cast<double>(res_[axis] - 1)));
+  }
+  return result;
+}
+
+template <typename CellTest>
+void Grid::Traverse(const Ray& ray, Real& max_dist,
+                    CellTest&& test_cell) const {
+  if (objects_.empty()) return;
+  const GeoVec& pos = ray.GetPos();
+  const GeoVec& dir = ray.GetDir();
+  GeoVec inv_dir{Real{1} / dir.x_, Real{1} / dir.y_, Real{1} / dir.z_};
+  Real t_near = 0.0;
+  Real t_far = max_dist;
+  if (!bounds_.ClipRay(pos, inv_dir, t_near, t_far)) return;
+
+  GeoVec entry = pos + t_near * dir;
+  std::array<size_t, 3> cell = GetCell(entry);
+  // distance along the ray to the next cell border for every axis
+  std::array<Real, 3> next_t;
+  std::array<Real, 3> delta_t;
+  // true if the ray goes to cells with greater coordinates along the axis
+  std::array<bool, 3> forward;
+  for (size_t axis = 0; axis < 3; ++axis) {
+    Real d = GetAxis(dir, axis);
+    Real size = GetAxis(cell_size_, axis);
+    Real cell_min =
+        GetAxis(bounds_.min, axis) + static_cast<Real>(cell[axis]) * size;
+    forward[axis] = d > 0;
+    if (d > 0) {
+      next_t[axis] = t_near + (cell_min + size - GetAxis(entry, axis)) / d;
+      delta_t[axis] = size / d;
+    } else if (d < 0) {
+      next_t[axis] = t_near + (cell_min - GetAxis(entry, axis)) / d;
+      delta_t[axis] = -size / d;
+    } else {
+      // the traversal stops before an infinite border distance is reached
+      next_t[axis] = std::numeric_limits<Real>::infinity();
+      delta_t[axis] = std::numeric_limits<Real>::infinity();
+    }
+  }
+
+  while (true) {
+    if (test_cell(GetCellIdx(cell))) return;
+    size_t axis = 0;
+    if (next_t[1] < next_t[axis]) axis = 1;
+    if (next_t[2] < next_t[axis]) axis = 2;
+    // hit inside the current cell cannot be beaten by farther cells
+    if (max_dist <= next_t[axis] || next_t[axis] > t_far) break;
+    // the ray leaves the grid through its border
+    if (forward[axis]) {
+      if (++cell[axis] == res_[axis]) break;
+    } else {
+      if (cell[axis] == 0) break;
+      --cell[axis];
+    }
+    next_t[axis] += delta_t[axis];
+  }
+}
+
+std::optional<HitRecord> Grid::GetClosestHit(const Ray& ray) const {
+  HitRecord closest{std::numeric_limits<Real>::max(), nullptr};
+  Traverse(ray, closest.dist, [&](size_t idx) {
+    for (uint32_t i = cell_start_[idx]; i < cell_start_[idx + 1]; ++i) {
+      primitives_.Intersect(ray, cell_objects_[i], closest);
+    }
+    return false;
+  });
+  if (!closest.obj) return std::nullopt;
+  return closest;
+}
+
+bool Grid::IsOccluded(const Ray& ray, Real max_dist) const {
+  bool is_occluded = false;
+  Traverse(ray, max_dist, [&](size_t idx) {
+    for (uint32_t i = cell_start_[idx];
+         i < cell_start_[idx + 1] && !is_occluded; ++i) {
+      is_occluded = primitives_.IsCrossed(ray, cell_objects_[i], max_dist);
+    }
+    return is_occluded;
+  });
+  return is_occluded;
+}
@@ -0,0 +1,90 @@
+﻿#include "Instance.h"
+
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+constexpr double kPi = 3.14159265358979323846;
+
+Matrix3x3 RotationX(double angle) {
+  double c = std::cos(angle);
+  double s = std::sin(angle);
+  return {{1, 0, 0}, {0, c, s}, {0, -s, c}};
+}
+
+Matrix3x3 RotationY(double angle) {
+  double c = std::cos(angle);
+  double s = std::sin(angle);
+  return {{c, 0, -s}, {0, 1, 0}, {s, 0, c}};
+}
+
+Matrix3x3 RotationZ(double angle) {
+  double c = std::cos(angle);
+  double s = std::sin(angle);
+  return {{c, s, 0}, {-s, c, 0}, {0, 0, 1}};
+}
+}  // namespace
+
+Matrix3x3 Transform::GetLinearPart() const {
+  constexpr double kDegToRad = kPi / 180.0;
+  Matrix3x3 scale_m{{scale.x_, 0, 0}, {0, scale.y_, 0}, {0, 0, scale.z_}};
+  GeoVec rotation = rotation_in_deg;
+  return RotationZ(ToDouble(rotation.z_) * kDegToRad) *
+         RotationY(ToDouble(rotation.y_) * kDegToRad) *
+         RotationX(ToDouble(rotation.x_) * kDegToRad) * scale_m;
+}
+
+Instance::Instance(const TriangleMesh& mesh, const Transform& transform)
+    : mesh_(&mesh) {
+  SetTransform(transform);
+}
+
+void Instance::SetTransform(const Transform& transform) {
+  Matrix3x3 linear = transform.GetLinearPart();
+  if (Det3x3(linear) == 0) {
+    throw std::logic_error("Instance transform should not have zero scale");
+  }
+  transform_ = transform;
+  translation_ = transform.translation;
+  to_local_ = GetReverse3x3(linear);
+  norm_to_world_ = GetTranspose(to_local_);
+  const BoundingBox& local_box = mesh_->GetBoundingBox();
+  box_ = BoundingBox{};
+  for (int corner = 0; corner < 8; ++corner) {
+    GeoVec p{corner & 1 ? local_box.max.x_ : local_box.min.x_,
+             corner & 2 ? local_box.max.y_ : local_box.min.y_,
+             corner & 4 ? local_box.max.z_ : local_box.min.z_};
+    box_.Extend(ApplyToVec(linear, p) + translation_);
+  }
+}
+
+Ray Instance::ToLocal(const Ray& ray, Real& dist_scale) const {
+  GeoVec dir = ApplyToVec(to_local_, ray.GetDir());
+  dist_scale = dir.Len();
+  return {ApplyToVec(to_local_, ray.GetPos() - translation_), dir};
+}
+
+std::optional<Real> Instance::GetClosesDist(const Ray& ray) const {
+  Real dist_scale = 1.0;
+  std::optional<Real> dist = mesh_->GetClosesDist(ToLocal(ray, dist_scale));
+  if (!dist) return std::nullopt;
+  return *dist / dist_scale;
+}
+
+bool Instance::IsCrossed(const Ray& ray, Real max_dist) const {
+  Real dist_scale = 1.0;
+  Ray local = ToLocal(ray, dist_scale);
+  return mesh_->IsCrossed(local, max_dist * dist_scale);
+}
+
+GeoVec Instance::GetNorm(const GeoVec& /*p*/) const {
+  throw std::logic_error(
+      "Instance normal depends on the crossed triangle, use GetSurfacePoint");
+}
+
+SurfacePoint Instance::GetSurfacePoint(const Ray& ray, Real dist) const {
+  Real dist_scale = 1.0;
+  Ray local = ToLocal(ray, dist_scale);
+  SurfacePoint local_point = mesh_->GetSurfacePoint(local, dist * dist_scale);
+  return {this, ApplyToVec(norm_to_world_, local_point.norm).Norm()};
+}
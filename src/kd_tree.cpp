@@ -0,0 +1,192 @@
+﻿#include "KdTree.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+
+namespace {
+constexpr size_t kBinNum = 32;
+/** Tree depth limit, traversal stack is sized by it*/
+constexpr size_t kMaxDepth = 60;
+/** Cost of visiting a node relative to one ray-object intersection*/
+constexpr double kTraversalCost = 1.0;
+/** Splits which cut off empty space are preferred*/
+constexpr double kEmptyBonus = 0.8;
+}  // namespace
+
+KdTree::KdTree(std::vector<const Object*> objects)
+    : objects_(std::move(objects)), primitives_(objects_) {
+  if (objects_.empty()) return;
+  std::vector<BoundingBox> boxes;
+  boxes.reserve(objects_.size());
+  std::vector<uint32_t> obj_ids(objects_.size());
+  for (uint32_t i = 0; i < objects_.size(); ++i) {
+    boxes.push_back(objects_[i]->GetBoundingBox());
+    bounds_.Extend(boxes.back());
+    obj_ids[i] = i;
+  }
+  double depth_limit =
+      8 + 1.3 * std::log2(static_cast<double>(objects_.size()));
+  size_t max_depth = std::min(kMaxDepth, static_cast<size_t>(depth_limit));
+  BuildNode(boxes, obj_ids, bounds_, 0, max_depth);
+}
+
+void KdTree::BuildNode(const std::vector<BoundingBox>& boxes,
+                       const std::vector<uint32_t>& obj_ids,
+                       const BoundingBox& bounds, size_t depth,
+                       size_t max_depth) {
+  size_t node_idx = nodes_.size();
+  nodes_.emplace_back();
+  auto make_leaf = [&] {
+    nodes_[node_idx].offset = static_cast<uint32_t>(leaf_objects_.size());
+    nodes_[node_idx].obj_num = static_cast<uint32_t>(obj_ids.size());
+    leaf_objects_.insert(leaf_objects_.end(), obj_ids.begin(), obj_ids.end());
+  };
+  size_t obj_num = obj_ids.size();
+  double area = bounds.GetSurfaceArea();
+  if (obj_num <= 1 || depth >= max_depth || !(area > 0)) {
+    make_leaf();
+    return;
+  }
+
+  // costs are multiplied by the surface area of the node
+  double best_cost = static_cast<double>(obj_num) * area;
+  uint32_t best_axis = KdNode::kLeaf;
+  Real best_split = 0.0;
+  for (uint32_t axis = 0; axis < 3; ++axis) {
+    Real lo = GetAxis(bounds.min, axis);
+    Real width = (GetAxis(bounds.max, axis) - lo) / kBinNum;
+    if (!(width > 0)) continue;
+    std::array<size_t, kBinNum> min_hist{};
+    std::array<size_t, kBinNum> max_hist{};
+    auto bin_of = [&](Real v) {
+      return static_cast<size_t>(
+          std::clamp((v - lo) / width, Real{0}, Real{kBinNum - 1}));
+    };
+    for (uint32_t id : obj_ids) {
+      ++min_hist[bin_of(GetAxis(boxes[id].min, axis))];
+      ++max_hist[bin_of(GetAxis(boxes[id].max, axis))];
+    }
+    size_t below_num = 0;
+    size_t above_num = obj_num;
+    for (size_t j = 1; j < kBinNum; ++j) {
+      below_num += min_hist[j - 1];
+      above_num -= max_hist[j - 1];
+      Real split = lo + static_cast<Real>(j) * width;
+      BoundingBox below = bounds;
+      BoundingBox above = bounds;
+      GetAxis(below.max, axis) = split;
+      GetAxis(above.min, axis) = split;
+      double bonus = (below_num == 0 || above_num == 0) ? kEmptyBonus : 1.0;
+      double cost = kTraversalCost * area +
+                    bonus * (ToDouble(below.GetSurfaceArea()) *
+                                 static_cast<double>(below_num) +
+                             ToDouble(above.GetSurfaceArea()) *
+                                 static_cast<double>(above_num));
+      if (cost < best_cost) {
+        best_cost = cost;
+        best_axis = axis;
+        best_split = split;
+      }
+    }
+  }
+  if (best_axis == KdNode::kLeaf) {
+    make_leaf();
+    return;
+  }
+
+  std::vector<uint32_t> below_ids;
+  std::vector<uint32_t> above_ids;
+  for (uint32_t id : obj_ids) {
+    const BoundingBox& box = boxes[id];
+    if (GetAxis(box.min, best_axis) <= best_split) below_ids.push_back(id);
+    if (GetAxis(box.max, best_axis) >= best_split) above_ids.push_back(id);
+  }
+  BoundingBox below = bounds;
+  BoundingBox above = bounds;
+  GetAxis(below.max, best_axis) = best_split;
+  GetAxis(above.min, best_axis) = best_split;
+  nodes_[node_idx].axis = best_axis;
+  nodes_[node_idx].split = best_split;
+  BuildNode(boxes, below_ids, below, depth + 1, max_depth);
+  nodes_[node_idx].offset = static_cast<uint32_t>(nodes_.size());
+  BuildNode(boxes, above_ids, above, depth + 1, max_depth);
+}
+
+template <typename LeafTest>
+void KdTree::Traverse(const Ray& ray, Real& max_dist,
+                      LeafTest&& test_leaf) const {
+  if (nodes_.empty()) return;
+  const GeoVec& pos = ray.GetPos();
+  const GeoVec& dir = ray.GetDir();
+  GeoVec inv_dir{Real{1} / dir.x_, Real{1} / dir.y_, Real{1} / dir.z_};
+  Real t_min = 0.0;
+  Real t_max = max_dist;
+  if (!bounds_.ClipRay(pos, inv_dir, t_min, t_max)) return;
+
+  struct StackEntry {
+    uint32_t node;
+    Real t_min;
+    Real t_max;
+  };
+  std::array<StackEntry, kMaxDepth + 1> stack;
+  size_t stack_size = 0;
+  uint32_t node_idx = 0;
+  while (true) {
+    // leaves are visited front to back, so farther ones cannot be closer
+    if (max_dist < t_min) break;
+    const KdNode& node = nodes_[node_idx];
+    if (node.axis != KdNode::kLeaf) {
+      Real origin = GetAxis(pos, node.axis);
+      Real d = GetAxis(dir, node.axis);
+      bool below_first =
+          origin < node.split || (origin == node.split && d <= 0);
+      uint32_t first = below_first ? node_idx + 1 : node.offset;
+      uint32_t second = below_first ? node.offset : node_idx + 1;
+      // parallel ray never crosses the plane
+      Real t_plane = d != 0
+                           ? (node.split - origin) * GetAxis(inv_dir, node.axis)
+                           : std::numeric_limits<Real>::infinity();
+      if (t_plane > t_max || t_plane <= 0) {
+        node_idx = first;
+      } else if (t_plane < t_min) {
+        node_idx = second;
+      } else {
+        stack[stack_size++] = {second, t_plane, t_max};
+        node_idx = first;
+        t_max = t_plane;
+      }
+      continue;
+    }
+    if (test_leaf(node.offset, node.obj_num)) return;
+    if (!stack_size) break;
+    const StackEntry& entry = stack[--stack_size];
+    node_idx = entry.node;
+    t_min = entry.t_min;
+    t_max = entry.t_max;
+  }
+}
+
+std::optional<HitRecord> KdTree::GetClosestHit(const Ray& ray) const {
+  HitRecord closest{std::numeric_limits<Real>::max(), nullptr};
+  Traverse(ray, closest.dist, [&](uint32_t first, uint32_t num) {
+    for (uint32_t i = first; i < first + num; ++i) {
+      primitives_.Intersect(ray, leaf_objects_[i], closest);
+    }
+    return false;
+  });
+  if (!closest.obj) return std::nullopt;
+  return closest;
+}
+
+bool KdTree::IsOccluded(const Ray& ray, Real max_dist) const {
+  bool is_occluded = false;
+  Traverse(ray, max_dist, [&](uint32_t first, uint32_t num) {
+    for (uint32_t i = first; i < first + num && !is_occluded; ++i) {
+      is_occluded = primitives_.IsCrossed(ray, leaf_objects_[i], max_dist);
+    }
+    return is_occluded;
+  });
+  return is_occluded;
+}
@@ -0,0 +1,121 @@
+﻿#include "LightList.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "SphereSet.h"
+#include "TriangleMesh.h"
+
+namespace {
+constexpr double kPi = 3.14159265358979323846;
+}  // namespace
+
+LightList::LightList(const std::vector<const Object*>& objects,
+                     bool sample_points) {
+  for (const Object* obj : objects) {
+    if (obj->GetMaterial() != Material::kLightSource) continue;
+    // light source of empty color gives black trace
+    if (const Color& col = obj->GetColor(); col.IsColor()) {
+      max_color_.red = std::max(max_color_.red, col.red);
+      max_color_.green = std::max(max_color_.green, col.green);
+      max_color_.blue = std::max(max_color_.blue, col.blue);
+    }
+    if (!sample_points) continue;
+    size_t light_num = area_cdf_.size();
+    if (const auto* sphere = dynamic_cast<const Sphere*>(obj)) {
+      AddSphere(sphere->GetCenter(), sphere->GetRadius(), obj);
+    } else if (const auto* tri = dynamic_cast<const Triangle*>(obj)) {
+      AddTriangle(tri->GetPoint0(), tri->GetPoint1(), tri->GetPoint2(), obj);
+    } else if (const auto* mesh = dynamic_cast<const TriangleMesh*>(obj)) {
+      for (size_t face = 0; face < mesh->GetTriangleNumber(); ++face) {
+        auto [p0, p1, p2] = mesh->GetTriangle(face);
+        AddTriangle(p0, p1, p2, obj);
+      }
+    } else if (const auto* set = dynamic_cast<const SphereSet*>(obj)) {
+      for (size_t i = 0; i < set->GetSphereNumber(); ++i) {
+        AddSphere(set->GetCenter(i), set->GetRadius(i), obj);
+      }
+    }
+    if (area_cdf_.size() > light_num) objects_.push_back(obj);
+  }
+  // spheres are listed before triangles in the running sums
+  std::vector<double> areas;
+  areas.reserve(area_cdf_.size());
+  for (const SphereLight& sphere : spheres_) {
+    double r = sphere.r;
+    areas.push_back(4 * kPi * r * r);
+  }
+  for (const TriangleLight& tri : triangles_) {
+    areas.push_back(0.5 * ToDouble(tri.edge1.Cross(tri.edge2).Len()));
+  }
+  double sum = 0.0;
+  for (size_t i = 0; i < areas.size(); ++i) {
+    sum += areas[i];
+    area_cdf_[i] = sum;
+  }
+  std::sort(objects_.begin(), objects_.end());
+}
+
+void LightList::AddSphere(const GeoVec& center, Real r, const Object* obj) {
+  spheres_.push_back({center, r, obj});
+  area_cdf_.push_back(0.0);
+}
+
+void LightList::AddTriangle(const GeoVec& p0, const GeoVec& p1,
+                            const GeoVec& p2, const Object* obj) {
+  GeoVec edge1{p0, p1};
+  GeoVec edge2{p0, p2};
+  GeoVec norm = edge1.Cross(edge2);
+  // degenerate faces cannot be hit by rays
+  if (norm.Len() == 0) return;
+  triangles_.push_back({p0, edge1, edge2, norm.Norm(), obj});
+  area_cdf_.push_back(0.0);
+}
+
+bool LightList::Contains(const Object* obj) const {
+  return std::binary_search(objects_.begin(), objects_.end(), obj);
+}
+
+std::optional<LightSample> LightList::Sample(const GeoVec& from,
+                                             Sampler& sampler) const {
+  if (IsEmpty()) return std::nullopt;
+  double pick = sampler.Get1D() * area_cdf_.back();
+  size_t idx = std::upper_bound(area_cdf_.begin(), area_cdf_.end(), pick) -
+               area_cdf_.begin();
+  idx = std::min(idx, area_cdf_.size() - 1);
+  double u = sampler.Get1D();
+  double v = sampler.Get1D();
+  GeoVec point;
+  GeoVec norm;
+  const Object* obj = nullptr;
+  if (idx < spheres_.size()) {
+    const SphereLight& sphere = spheres_[idx];
+    double z = 1 - 2 * u;
+    double ring = std::sqrt(std::max(0.0, 1 - z * z));
+    double phi = 2 * kPi * v;
+    norm = {ring * std::cos(phi), ring * std::sin(phi), z};
+    point = sphere.center + sphere.r * norm;
+    obj = sphere.obj;
+  } else {
+    const TriangleLight& tri = triangles_[idx - spheres_.size()];
+    double su = std::sqrt(u);
+    point = tri.p0 + su * (1 - v) * tri.edge1 + su * v * tri.edge2;
+    norm = tri.norm;
+    obj = tri.obj;
+  }
+  double inv_pdf = GetInvPdf(from, point, norm);
+  if (!(inv_pdf > 0)) return std::nullopt;
+  return LightSample{point, obj, inv_pdf};
+}
+
+double LightList::GetInvPdf(const GeoVec& from, const GeoVec& point,
+                            const GeoVec& norm) const {
+  if (IsEmpty()) return 0.0;
+  GeoVec to_from{point, from};
+  double dist2 = to_from.Dot(to_from);
+  if (dist2 == 0) return 0.0;
+  // area density 1 / total area turns into the solid angle density
+  // dist^2 / (cos * total area)
+  double cos_light = ToDouble(to_from.Dot(norm)) / std::sqrt(dist2);
+  return std::max(0.0, area_cdf_.back() * cos_light / dist2);
+}
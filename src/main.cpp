@@ -1,47 +1,223 @@
-﻿#include <fstream>
+﻿#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
 #include <memory>
+#include <optional>
+#include <string>
+#include <system_error>
 #include <utility>
 #include <vector>
 
 #include "GeoVec.h"
 #include "Objects.h"
 #include "Pixel.h"
+#include "PngStreamWriter.h"
 #include "PngWriter.h"
 #include "Ray.h"
+#include "Renderer.h"
 
-int main() {
-  Config cfg("simple_scene.json");
-  if (!cfg.GetCameraSettings() || !cfg.GetGeneralSettings() ||
-      cfg.GetObjects().empty()) {
+namespace {
+/** Saves intermediate picture into the file. Picture is written into
+ * temporary file first, so readers never see partially written image*/
+void SaveSnapshot(const std::string& file_name, int width, int height,
+                  const std::vector<Color>& colors) {
+  std::string tmp_name = file_name + ".snapshot.tmp";
+  {
+    PngWriter pw{tmp_name.c_str(), static_cast<uint32_t>(width),
+                 static_cast<uint32_t>(height)};
+    if (!pw.IsOk()) {
+      throw std::runtime_error("Unable to save png file");
+    }
+    pw.SaveVectorToImage(colors);
+  }
+  std::filesystem::rename(tmp_name, file_name);
+}
+
+/** Options passed in the command line*/
+struct CmdOptions {
+  /** Several configs are frames of an animation with the same topology*/
+  std::vector<std::string> config_files;
+  /** Pixel range rendered by this process, whole picture if not set*/
+  std::optional<std::pair<size_t, size_t>> pixels;
+  /** First sample and number of samples rendered by this process, all
+   * samples if not set*/
+  std::optional<std::pair<int, int>> samples;
+  /** Raw file for the partial render*/
+  std::string partial_file;
+};
+
+void PrintUsage() {
+  std::cout << "Usage: mk_image [config.json ...] [--pixels BEGIN END] "
+               "[--samples FIRST NUMBER] [--partial FILE]\n"
+               "  --pixels and --samples render only part of the picture and "
+               "require --partial.\n"
+               "  Partial files are combined by merge_partials.\n"
+               "  Several configs are rendered as frames of an animation, "
+               "objects may move\n"
+               "  between frames, but their number and types should stay the "
+               "same.\n";
+}
+
+/** Reads the whole argument as a number, false if it is not a number or
+ * does not fit into the type*/
+template <typename NumberType>
+bool ParseNumber(const char* arg, NumberType& out) {
+  const char* end = arg + std::char_traits<char>::length(arg);
+  auto [ptr, err] = std::from_chars(arg, end, out);
+  if (err != std::errc() || ptr != end || ptr == arg) {
+    std::cout << "Bad number in the command line: " << arg << '\n';
+    return false;
+  }
+  return true;
+}
+
+std::optional<CmdOptions> ParseCmdOptions(int argc, char* argv[]) {
+  CmdOptions result;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--pixels" && i + 2 < argc) {
+      std::pair<size_t, size_t> pixels;
+      if (!ParseNumber(argv[i + 1], pixels.first) ||
+          !ParseNumber(argv[i + 2], pixels.second)) {
+        return std::nullopt;
+      }
+      result.pixels = pixels;
+      i += 2;
+    } else if (arg == "--samples" && i + 2 < argc) {
+      std::pair<int, int> samples;
+      if (!ParseNumber(argv[i + 1], samples.first) ||
+          !ParseNumber(argv[i + 2], samples.second)) {
+        return std::nullopt;
+      }
+      if (samples.first < 0 || samples.second <= 0) {
+        std::cout << "--samples needs non negative FIRST and positive "
+                     "NUMBER\n";
+        return std::nullopt;
+      }
+      result.samples = samples;
+      i += 2;
+    } else if (arg == "--partial" && i + 1 < argc) {
+      result.partial_file = argv[++i];
+    } else if (arg.rfind("--", 0) != 0) {
+      result.config_files.push_back(arg);
+    } else {
+      return std::nullopt;
+    }
+  }
+  if ((result.pixels || result.samples) && result.partial_file.empty()) {
+    return std::nullopt;
+  }
+  if (result.config_files.empty()) {
+    result.config_files.push_back("simple_scene.json");
+  }
+  if (result.config_files.size() > 1 && !result.partial_file.empty()) {
+    return std::nullopt;
+  }
+  return result;
+}
+
+bool IsParsed(const Config& cfg) {
+  return cfg.GetCameraSettings() && cfg.GetGeneralSettings() &&
+         !cfg.GetObjects().empty();
+}
+
+/** Renders all samples of the picture and saves it into the file*/
+void RenderPicture(Renderer& renderer, const GeneralSettings& cfg_general,
+                   const std::string& out_file_name) {
+  using Clock = std::chrono::steady_clock;
+  Clock::time_point last_snapshot = Clock::now();
+  Renderer::PassCallback on_pass = nullptr;
+  if (cfg_general.samples_per_pass > 0) {
+    on_pass = [&](const AccumulationBuffer& accum, int sample_num) {
+      std::cerr << "Pass finished: " << sample_num << '/'
+                << cfg_general.sample_per_pixel << " samples per pixel\n";
+      std::chrono::duration<double> elapsed = Clock::now() - last_snapshot;
+      if (sample_num == cfg_general.sample_per_pixel ||
+          elapsed.count() < cfg_general.snapshot_interval_in_sec) {
+        return;
+      }
+      SaveSnapshot(out_file_name, accum.GetWidth(), accum.GetHeight(),
+                   accum.GetColors());
+      last_snapshot = Clock::now();
+    };
+  }
+  // Final picture is encoded row by row while the rest is still rendered
+  std::string tmp_name = out_file_name + ".tmp";
+  {
+    PngStreamWriter pw{tmp_name.c_str(),
+                       static_cast<uint32_t>(cfg_general.pic_width_in_pixel),
+                       static_cast<uint32_t>(cfg_general.pic_height_in_pixel)};
+    if (!pw.IsOk()) {
+      throw std::runtime_error("Unable to save png file");
+    }
+    renderer.Render(on_pass, [&pw](int row, std::vector<Color> colors) {
+      pw.PushRow(row, std::move(colors));
+    });
+    if (!pw.Finish()) {
+      throw std::runtime_error("Not all rows were rendered");
+    }
+  }
+  std::filesystem::rename(tmp_name, out_file_name);
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::optional<CmdOptions> options = ParseCmdOptions(argc, argv);
+  if (!options) {
+    PrintUsage();
+    return 1;
+  }
+  Config cfg(options->config_files[0]);
+  if (!IsParsed(cfg)) {
     std::cout << "Config was not parsed correctly\n";
     return 0;
   }
   GeneralSettings cfg_general = cfg.GetGeneralSettings().value();
   CameraSettings cfg_camera = cfg.GetCameraSettings().value();
-  std::vector<pixel::Tile> tiles = pixel::CreateTiles(
-      cfg_camera.screen_top_left_coor, cfg_camera.screen_top_right_coor,
-      cfg_camera.screen_bot_left_coor, cfg_general.pic_width_in_pixel,
-      cfg_general.pic_height_in_pixel);
-  GeoVec viewer = pixel::CreateViewerPoint(cfg_camera);
-  std::vector<Color> col_vec;
-  col_vec.reserve(tiles.size());
-  std::vector<const Object*> objects = cfg.GetObjects();
-  std::mt19937 rnd{std::time(nullptr)};
-  size_t count = 0;
-  for (const auto& tile : tiles) {
-    count++;
-    col_vec.push_back(pixel::TraceRays(
-        pixel::CreateRays(tile, viewer, rnd, cfg_general.sample_per_pixel),
-        objects, cfg_general.max_bounce_number));
-    if ((10ULL * count) % tiles.size() == 0ULL)
-      std::cerr << 100.0 * count / tiles.size() << "%\n";
-  }
-
-  PngWriter pw{cfg_general.out_file_name.c_str(),
-               cfg_general.pic_width_in_pixel, cfg_general.pic_height_in_pixel};
-  if (!pw.IsOk()) {
-    throw std::runtime_error("Unable to save png file");
-  }
-  pw.SaveVectorToImage(col_vec);
+  Renderer renderer{cfg_general, cfg_camera, cfg.GetObjects()};
+  std::cerr << "Acceleration structure ready in "
+            << renderer.GetBuildTimeInSec() << " s\n";
+  std::cerr << "Rendering with " << renderer.GetThreadNumber()
+            << " threads\n";
+  if (!options->partial_file.empty()) {
+    size_t pixel_num = static_cast<size_t>(cfg_general.pic_width_in_pixel) *
+                       cfg_general.pic_height_in_pixel;
+    auto [pixel_begin, pixel_end] =
+        options->pixels.value_or(std::pair<size_t, size_t>{0, pixel_num});
+    auto [first_sample, sample_num] = options->samples.value_or(
+        std::make_pair(0, cfg_general.sample_per_pixel));
+    renderer.SetPixelRange(pixel_begin, pixel_end);
+    renderer.RenderPass(first_sample, sample_num);
+    if (!renderer.GetAccumulation().SaveRaw(options->partial_file,
+                                            std::min(pixel_begin, pixel_num),
+                                            std::min(pixel_end, pixel_num))) {
+      throw std::runtime_error("Unable to save partial render");
+    }
+    return 0;
+  }
+  RenderPicture(renderer, cfg_general, cfg_general.out_file_name);
+  // next frames move objects of the first one, so the acceleration structure
+  // is refitted instead of being built from scratch
+  for (size_t i = 1; i < options->config_files.size(); ++i) {
+    auto frame_start = std::chrono::steady_clock::now();
+    Config frame = Config::ReadFrame(options->config_files[i]);
+    if (!IsParsed(frame) || !cfg.UpdateGeometry(frame)) {
+      std::cout << "Frame " << options->config_files[i]
+                << " was not parsed correctly or changes scene topology\n";
+      return 0;
+    }
+    renderer.SetCamera(frame.GetCameraSettings().value());
+    bool rebuilt = renderer.UpdateGeometry();
+    std::chrono::duration<double> frame_time =
+        std::chrono::steady_clock::now() - frame_start;
+    std::cerr << "Frame " << i << ": acceleration structure "
+              << (rebuilt ? "rebuilt" : "refitted") << " in "
+              << renderer.GetBuildTimeInSec() << " s, frame ready in "
+              << frame_time.count() << " s\n";
+    RenderPicture(renderer, cfg_general,
+                  frame.GetGeneralSettings()->out_file_name);
+  }
   return 0;
 }
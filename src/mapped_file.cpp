@@ -0,0 +1,49 @@
+﻿#include "MappedFile.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define PTRACER_HAS_MMAP 1
+#else
+#include <fstream>
+#endif
+
+std::shared_ptr<const MappedFile> MappedFile::Open(
+    const std::string& file_name) {
+  std::shared_ptr<MappedFile> result{new MappedFile};
+#ifdef PTRACER_HAS_MMAP
+  int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) return nullptr;
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+    close(fd);
+    return nullptr;
+  }
+  void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  // mapping stays valid after the descriptor is closed
+  close(fd);
+  if (data == MAP_FAILED) return nullptr;
+  result->data_ = static_cast<const char*>(data);
+  result->size_ = info.st_size;
+#else
+  std::ifstream input{file_name, std::ios::binary | std::ios::ate};
+  if (!input.is_open()) return nullptr;
+  std::streamoff size = input.tellg();
+  if (size <= 0) return nullptr;
+  result->buffer_.resize((size + kAlignment - 1) / kAlignment);
+  input.seekg(0);
+  input.read(reinterpret_cast<char*>(result->buffer_.data()), size);
+  if (!input) return nullptr;
+  result->data_ = reinterpret_cast<const char*>(result->buffer_.data());
+  result->size_ = size;
+#endif
+  return result;
+}
+
+MappedFile::~MappedFile() {
+#ifdef PTRACER_HAS_MMAP
+  if (data_) munmap(const_cast<char*>(data_), size_);
+#endif
+}
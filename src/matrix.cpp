@@ -1,19 +1,58 @@
 ﻿#include "Matrix.h"
 
-Matrix3x3 GetReverse3x3(const Matrix3x3& m) {
-  double det = Det3x3(m);
-  Matrix3x3 tr = GetTranspose(m);
+template <typename T>
+BasicMatrix3x3<T> GetReverse3x3(const BasicMatrix3x3<T>& m) {
+  T det = Det3x3(m);
+  BasicMatrix3x3<T> tr = GetTranspose(m);
 
-  double a00 = Det2x2(tr.c1.y_, tr.c2.y_, tr.c1.z_, tr.c2.z_) / det;
-  double a01 = -Det2x2(tr.c0.y_, tr.c2.y_, tr.c0.z_, tr.c2.z_) / det;
-  double a02 = Det2x2(tr.c0.y_, tr.c1.y_, tr.c0.z_, tr.c1.z_) / det;
+  T a00 = Det2x2(tr.c1.y_, tr.c2.y_, tr.c1.z_, tr.c2.z_) / det;
+  T a01 = -Det2x2(tr.c0.y_, tr.c2.y_, tr.c0.z_, tr.c2.z_) / det;
+  T a02 = Det2x2(tr.c0.y_, tr.c1.y_, tr.c0.z_, tr.c1.z_) / det;
 
-  double a10 = -Det2x2(tr.c1.x_, tr.c2.x_, tr.c1.z_, tr.c2.z_) / det;
-  double a11 = Det2x2(tr.c0.x_, tr.c2.x_, tr.c0.z_, tr.c2.z_) / det;
-  double a12 = -Det2x2(tr.c0.x_, tr.c1.x_, tr.c0.z_, tr.c1.z_) / det;
+  T a10 = -Det2x2(tr.c1.x_, tr.c2.x_, tr.c1.z_, tr.c2.z_) / det;
+  T a11 = Det2x2(tr.c0.x_, tr.c2.x_, tr.c0.z_, tr.c2.z_) / det;
+  T a12 = -Det2x2(tr.c0.x_, tr.c1.x_, tr.c0.z_, tr.c1.z_) / det;
 
-  double a20 = Det2x2(tr.c1.x_, tr.c2.x_, tr.c1.y_, tr.c2.y_) / det;
-  double a21 = -Det2x2(tr.c0.x_, tr.c2.x_, tr.c0.y_, tr.c2.y_) / det;
-  double a22 = Det2x2(tr.c0.x_, tr.c1.x_, tr.c0.y_, tr.c1.y_) / det;
-  return {GeoVec{a00, a10, a20}, GeoVec{a01, a11, a21}, GeoVec{a02, a12, a22}};
+  T a20 = Det2x2(tr.c1.x_, tr.c2.x_, tr.c1.y_, tr.c2.y_) / det;
+  T a21 = -Det2x2(tr.c0.x_, tr.c2.x_, tr.c0.y_, tr.c2.y_) / det;
+  T a22 = Det2x2(tr.c0.x_, tr.c1.x_, tr.c0.y_, tr.c1.y_) / det;
+  return {BasicGeoVec<T>{a00, a10, a20}, BasicGeoVec<T>{a01, a11, a21},
+          BasicGeoVec<T>{a02, a12, a22}};
 }
+
+template <typename T>
+BasicMatrix3x3x8<T> GetReverse3x3(const BasicMatrix3x3x8<T>& m) {
+  // rows of the reverse matrix are orthogonal to two columns of the given
+  // one, so all minors are found by three cross products of whole lanes
+  using P = vec_math::Pack<T>;
+  BasicGeoVec8<T> r0 = m.c1.Cross(m.c2);
+  BasicGeoVec8<T> r1 = m.c2.Cross(m.c0);
+  BasicGeoVec8<T> r2 = m.c0.Cross(m.c1);
+  alignas(32) T det[vec_math::kWideWidth];
+  m.c0.Dot(r0, det);
+  BasicMatrix3x3x8<T> res;
+  for (size_t i = 0; i < vec_math::kWideWidth; i += P::kWidth) {
+    auto inv_det = P::Div(P::Set1(T{1}), P::Load(det + i));
+    auto scaled = [&](const T* row) {
+      return P::Mul(P::Load(row + i), inv_det);
+    };
+    // the j-th column of the result is made of j-th coordinates of rows
+    P::Store(res.c0.x_ + i, scaled(r0.x_));
+    P::Store(res.c0.y_ + i, scaled(r1.x_));
+    P::Store(res.c0.z_ + i, scaled(r2.x_));
+    P::Store(res.c1.x_ + i, scaled(r0.y_));
+    P::Store(res.c1.y_ + i, scaled(r1.y_));
+    P::Store(res.c1.z_ + i, scaled(r2.y_));
+    P::Store(res.c2.x_ + i, scaled(r0.z_));
+    P::Store(res.c2.y_ + i, scaled(r1.z_));
+    P::Store(res.c2.z_ + i, scaled(r2.z_));
+  }
+  return res;
+}
+
+template BasicMatrix3x3<float> GetReverse3x3(const BasicMatrix3x3<float>& m);
+template BasicMatrix3x3<double> GetReverse3x3(const BasicMatrix3x3<double>& m);
+template BasicMatrix3x3x8<float> GetReverse3x3(
+    const BasicMatrix3x3x8<float>& m);
+template BasicMatrix3x3x8<double> GetReverse3x3(
+    const BasicMatrix3x3x8<double>& m);
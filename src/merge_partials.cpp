@@ -0,0 +1,37 @@
+﻿#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+#include "AccumulationBuffer.h"
+#include "PngWriter.h"
+
+/**
+ * Combines raw partial renders made by mk_image --partial into the final
+ * picture. Sums of radiance and sample counts of every pixel are added, so
+ * partial files may split the picture by pixels, by samples or both.
+ */
+int main(int argc, char* argv[]) {
+  if (argc < 3) {
+    std::cout << "Usage: merge_partials OUTPUT.png PART.raw [PART.raw ...]\n";
+    return 1;
+  }
+  std::optional<AccumulationBuffer> accum = AccumulationBuffer::LoadRaw(argv[2]);
+  if (!accum) {
+    std::cout << "Cannot read partial render " << argv[2] << '\n';
+    return 1;
+  }
+  for (int i = 3; i < argc; ++i) {
+    if (!accum->AddRaw(argv[i])) {
+      std::cout << "Cannot add partial render " << argv[i] << '\n';
+      return 1;
+    }
+  }
+  PngWriter pw{argv[1], static_cast<uint32_t>(accum->GetWidth()),
+               static_cast<uint32_t>(accum->GetHeight())};
+  if (!pw.IsOk()) {
+    throw std::runtime_error("Unable to save png file");
+  }
+  pw.SaveVectorToImage(accum->GetColors());
+  return 0;
+}
@@ -1,81 +1,190 @@
 ﻿#include "Pixel.h"
 
-Color pixel::RenderRay(const Ray& ray,
-                       const std::vector<const Object*>& universe,
-                       size_t bounce_limit) {
-  if (bounce_limit == 0) return colors::kBlack;
-  std::vector<Color> bounce_colors;
-  bounce_colors.reserve(bounce_limit);
+#include <algorithm>
+
+namespace {
+constexpr double kPi = 3.14159265358979323846;
+/** Inverse probability density of diffuse reflected directions over the
+ * solid angle, they are uniform over the hemisphere*/
+constexpr double kDiffuseInvPdf = 2 * kPi;
+
+/** Reflections after which paths can be terminated by Russian roulette*/
+constexpr size_t kRouletteStartBounce = 3;
+/** Part of the brightest light color below which throughput of a trace is
+ * low and the trace takes part in Russian roulette*/
+constexpr double kRouletteThreshold = 0.25;
+
+/** @return largest channel of the color*/
+double GetMaxChannel(const Radiance& col) {
+  return std::max({col.red, col.green, col.blue});
+}
+
+/**
+ * Probability to continue the trace in Russian roulette. Throughput of the
+ * trace is its color if the next ray hits the brightest light source, scaled
+ * by the weight of the passed roulettes. Traces of throughput below the
+ * threshold are continued with probability proportional to it, so the
+ * throughput of survived traces does not fall below the threshold
+ */
+double GetSurvivalProbability(const ColorTrace& trace, const Color& max_light,
+                              double weight) {
+  double bright = kRouletteThreshold * GetMaxChannel(Radiance{max_light});
+  double throughput = weight * GetMaxChannel(trace.GetColor(max_light));
+  return std::min(1.0, throughput / bright);
+}
+
+/** @return brightest light color, white if lights are not known*/
+const Color& GetMaxLight(const LightList* lights) {
+  return lights ? lights->GetMaxColor() : colors::kWhite;
+}
+
+/**
+ * Balance heuristic weight of a direction toward a light which can be found
+ * both by diffuse reflection and by light sampling. Weight is the same for
+ * both techniques: pdf_diffuse / (pdf_diffuse + pdf_light)
+ */
+double GetMisWeight(double light_inv_pdf) {
+  return light_inv_pdf / (light_inv_pdf + kDiffuseInvPdf);
+}
+
+/**
+ * Estimates color which the trace gets if the ray diffusely reflected from
+ * the point hits a light source of the list: a point of a light is picked
+ * and checked for visibility. Its color is scaled by the ratio of direction
+ * densities of the reflection and of the pick and by the MIS weight, which
+ * together give GetMisWeight, so the estimate never exceeds the color
+ */
+Radiance SampleLight(const ColorTrace& trace, const GeoVec& pos,
+                     const GeoVec& norm, const Accelerator& universe,
+                     const LightList& lights, Sampler& sampler) {
+  std::optional<LightSample> sample = lights.Sample(pos, sampler);
+  // diffuse reflection never goes below the surface
+  if (!sample || GeoVec{pos, sample->point}.Dot(norm) <= 0) return {};
+  if (IsSegmentOccluded(universe, pos, sample->point)) return {};
+  return GetMisWeight(sample->inv_pdf) *
+         trace.GetColor(sample->light->GetColor());
+}
+}  // namespace
+
+Radiance pixel::RenderRay(const Ray& ray, const Accelerator& universe,
+                          size_t bounce_limit, Sampler& sampler,
+                          const LightList* lights) {
+  if (bounce_limit == 0 || GetMaxLight(lights) == colors::kBlack) return {};
+  return RenderRay(ray, universe.GetClosestHit(ray), universe, bounce_limit,
+                   sampler, lights);
+}
+
+Radiance pixel::RenderRay(const Ray& ray,
+                          const std::optional<HitRecord>& first_hit,
+                          const Accelerator& universe, size_t bounce_limit,
+                          Sampler& sampler, const LightList* lights) {
+  const Color& max_light = GetMaxLight(lights);
+  // no light source can give color to the trace
+  if (max_light == colors::kBlack) return {};
+  bool sample_lights = lights && !lights->IsEmpty();
+  ColorTrace trace;
+  Radiance result;
+  // inverse probability of the trace to pass all Russian roulettes
+  double weight = 1.0;
   Ray curr_ray = ray;
-  BounceRecord bc_rec;
-  for (size_t curr_bnc = 0; curr_bnc < bounce_limit - 1; curr_bnc++) {
-    // should take into account all trace ONLY if eventually it hits light
-    // source! so check that last hit separately
-    bc_rec = MakeRayBounce(curr_ray, universe);
+  bool was_diffuse = false;
+  for (size_t curr_bnc = 0; curr_bnc < bounce_limit; curr_bnc++) {
+    sampler.StartBounce(curr_bnc + 1);
+    // bounces after the first one are incoherent and traced one by one
+    BounceRecord bc_rec = curr_bnc == 0
+                              ? MakeRayBounce(curr_ray, first_hit, sampler)
+                              : MakeRayBounce(curr_ray, universe, sampler);
     switch (bc_rec.hit_obj_mat_) {
       case Material::kNoMaterial:
-        return colors::kBlack;
-      case Material::kLightSource:
-        bounce_colors.push_back(bc_rec.hit_obj_color_);
-        Color::TruncColorsInTrace(bounce_colors);
-        return Color::GetAverageColor(bounce_colors);
+        return result;
+      case Material::kLightSource: {
+        Radiance color = trace.GetColor(bc_rec.hit_obj_color_);
+        // light could also be sampled at the diffuse reflection
+        if (sample_lights && was_diffuse &&
+            lights->Contains(bc_rec.hit_obj_)) {
+          color = GetMisWeight(lights->GetInvPdf(curr_ray.GetPos(),
+                                                 bc_rec.hit_point_,
+                                                 bc_rec.hit_norm_)) *
+                  color;
+        }
+        result += weight * color;
+        return result;
+      }
       case Material::kReflective:
-        bounce_colors.push_back(bc_rec.hit_obj_color_);
+        // should take into account all trace ONLY if eventually it hits
+        // light source, which the last bounce does not
+        if (curr_bnc + 1 == bounce_limit) return result;
+        trace.Push(bc_rec.hit_obj_color_);
+        was_diffuse = bc_rec.is_diffuse_;
+        if (sample_lights && was_diffuse) {
+          result += weight * SampleLight(trace, curr_ray.GetPos(),
+                                         bc_rec.hit_norm_, universe, *lights,
+                                         sampler);
+        }
+        if (curr_bnc + 1 >= kRouletteStartBounce) {
+          double survival = GetSurvivalProbability(trace, max_light, weight);
+          if (survival < 1.0) {
+            if (sampler.Get1D() >= survival) return result;
+            weight /= survival;
+          }
+        }
         break;
       default:
         throw std::logic_error("Met unknown material in RenderRay()");
     }
   }
-  bc_rec = MakeRayBounce(curr_ray, universe);
-  if (bc_rec.hit_obj_mat_ != Material::kLightSource) {
-    return colors::kBlack;
-  }
-  bounce_colors.push_back(bc_rec.hit_obj_color_);
-  Color::TruncColorsInTrace(bounce_colors);
-  return Color::GetAverageColor(bounce_colors);
+  return result;
 }
 
-BounceRecord pixel::MakeRayBounce(
-    Ray& ray, const std::vector<const Object*>& all_objects) {
-  std::optional<double> dist = std::nullopt;
-  size_t obj_idx = 0;
-  double min_dist = std::numeric_limits<double>::max();
-  for (size_t i = 0; i < all_objects.size(); i++) {
-    const auto& cur_obj = all_objects[i];
-    dist = cur_obj->GetClosesDist(ray);
-    if (dist && min_dist > *dist) {
-      min_dist = *dist;
-      obj_idx = i;
-    }
-  }
-  if (min_dist == std::numeric_limits<double>::max()) {
+BounceRecord pixel::MakeRayBounce(Ray& ray,
+                                  const Accelerator& all_objects,
+                                  Sampler& sampler) {
+  return MakeRayBounce(ray, all_objects.GetClosestHit(ray), sampler);
+}
+
+BounceRecord pixel::MakeRayBounce(Ray& ray,
+                                  const std::optional<HitRecord>& hit,
+                                  Sampler& sampler) {
+  if (!hit) {
     // hit nothing
     return {Material::kNoMaterial, colors::kNoColor};
   }
-  const Object* hit_obj = all_objects[obj_idx];
+  SurfacePoint surface = hit->obj->GetSurfacePoint(ray, hit->dist);
+  const Object* hit_obj = surface.obj;
+  GeoVec hit_point = ray.GetPos() + hit->dist * ray.GetDir();
+  bool is_diffuse = false;
   switch (hit_obj->GetMaterial()) {
     case Material::kLightSource:
       break;
     case Material::kReflective: {
-      bool success = hit_obj->TryReflect(ray, min_dist);
+      bool success = hit_obj->TryReflect(ray, hit->dist, surface.norm,
+                                         sampler, is_diffuse);
       if (!success) return {Material::kNoMaterial, colors::kNoColor};
       break;
     }
     default:
       throw std::logic_error("Met unknown material in MakeRayBounce");
   }
-  return {hit_obj->GetMaterial(), hit_obj->GetColor()};
+  return {hit_obj->GetMaterial(), hit_obj->GetColor(), hit_obj, hit_point,
+          surface.norm, is_diffuse};
 }
 
-std::vector<Ray> pixel::CreateRays(const Tile& tile, const GeoVec& ray_start,
-                                   std::mt19937& rnd, int ray_num) {
+Ray pixel::CreateRay(const Tile& tile, const GeoVec& ray_start,
+                     Sampler& sampler) {
   GeoVec to_top_left(ray_start, tile.top_left);
+  double w_shift = sampler.Get1D();
+  double h_shift = sampler.Get1D();
+  return {ray_start,
+          to_top_left + w_shift * tile.width_vec + h_shift * tile.height_vec};
+}
+
+std::vector<Ray> pixel::CreateRays(const Tile& tile, const GeoVec& ray_start,
+                                   Sampler& sampler, int ray_num) {
   std::vector<Ray> result;
   result.reserve(ray_num);
-  std::uniform_real_distribution<double> dist{0.0, 1.0};
-  while (ray_num--) {
-    result.emplace_back(ray_start, to_top_left + dist(rnd) * tile.width_vec +
-                                       dist(rnd) * tile.height_vec);
+  for (int n = 0; n < ray_num; ++n) {
+    sampler.StartSample(n);
+    result.push_back(CreateRay(tile, ray_start, sampler));
   }
   return result;
 }
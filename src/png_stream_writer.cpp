@@ -0,0 +1,68 @@
+﻿#include "PngStreamWriter.h"
+
+#include <algorithm>
+#include <utility>
+
+PngStreamWriter::PngStreamWriter(const char* filename, uint32_t width,
+                                 uint32_t height, uint32_t row_window)
+    : writer_(filename, width, height), row_window_(std::max(1U, row_window)) {
+  if (writer_.IsOk()) {
+    encoder_ = std::thread(&PngStreamWriter::EncoderLoop, this);
+  }
+}
+
+PngStreamWriter::~PngStreamWriter() { Finish(); }
+
+void PngStreamWriter::PushRow(uint32_t row_idx, std::vector<Color> row) {
+  {
+    std::unique_lock<std::mutex> lock(mut_);
+    // window does not move without the encoder thread or after Finish
+    window_cv_.wait(lock, [&] {
+      return finishing_ || !writer_.IsOk() ||
+             row_idx < next_row_ + row_window_;
+    });
+    pending_.emplace(row_idx, std::move(row));
+  }
+  cv_.notify_one();
+}
+
+bool PngStreamWriter::Finish() {
+  {
+    std::lock_guard<std::mutex> lock(mut_);
+    finishing_ = true;
+  }
+  cv_.notify_one();
+  window_cv_.notify_all();
+  if (encoder_.joinable()) {
+    encoder_.join();
+  }
+  return next_row_ == writer_.GetHeight();
+}
+
+void PngStreamWriter::EncoderLoop() {
+  while (true) {
+    std::vector<Color> row;
+    {
+      std::unique_lock<std::mutex> lock(mut_);
+      cv_.wait(lock, [&] {
+        return finishing_ || (!pending_.empty() &&
+                              pending_.begin()->first == next_row_);
+      });
+      if (pending_.empty() || pending_.begin()->first != next_row_) {
+        // finishing and the next row will never come
+        return;
+      }
+      row = std::move(pending_.begin()->second);
+      pending_.erase(pending_.begin());
+    }
+    // compression happens outside of the lock, so render threads are not
+    // blocked while pushing rows
+    writer_.WriteRow(row.data());
+    {
+      std::lock_guard<std::mutex> lock(mut_);
+      ++next_row_;
+    }
+    window_cv_.notify_all();
+    if (next_row_ == writer_.GetHeight()) return;
+  }
+}
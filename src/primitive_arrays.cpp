@@ -0,0 +1,76 @@
+﻿#include "PrimitiveArrays.h"
+
+#include <stdexcept>
+#include <typeinfo>
+
+PrimitiveKind GetPrimitiveKind(const Object& obj) {
+  const std::type_info& type = typeid(obj);
+  if (type == typeid(Sphere)) return PrimitiveKind::kSphere;
+  if (type == typeid(Triangle)) return PrimitiveKind::kTriangle;
+  if (type == typeid(TriangleMesh)) return PrimitiveKind::kMesh;
+  if (type == typeid(Instance)) return PrimitiveKind::kInstance;
+  if (type == typeid(SphereSet)) return PrimitiveKind::kSphereSet;
+  return PrimitiveKind::kOther;
+}
+
+PrimitiveArrays::PrimitiveArrays(const std::vector<const Object*>& objects) {
+  if (objects.size() > kIndexMask) {
+    throw std::logic_error("Too many objects for primitive arrays");
+  }
+  slots_.reserve(objects.size());
+  for (const Object* obj : objects) {
+    PrimitiveKind kind = GetPrimitiveKind(*obj);
+    size_t idx = 0;
+    switch (kind) {
+      case PrimitiveKind::kSphere:
+        idx = sphere_objects_.size();
+        sphere_objects_.push_back(static_cast<const Sphere*>(obj));
+        break;
+      case PrimitiveKind::kTriangle:
+        idx = triangle_objects_.size();
+        triangle_objects_.push_back(static_cast<const Triangle*>(obj));
+        break;
+      case PrimitiveKind::kMesh:
+        idx = meshes_.size();
+        meshes_.push_back(static_cast<const TriangleMesh*>(obj));
+        break;
+      case PrimitiveKind::kInstance:
+        idx = instances_.size();
+        instances_.push_back(static_cast<const Instance*>(obj));
+        break;
+      case PrimitiveKind::kSphereSet:
+        idx = sphere_sets_.size();
+        sphere_sets_.push_back(static_cast<const SphereSet*>(obj));
+        break;
+      default:
+        idx = others_.size();
+        others_.push_back(obj);
+    }
+    slots_.push_back(static_cast<uint32_t>(kind) << kKindShift |
+                     static_cast<uint32_t>(idx));
+  }
+  spheres_.resize(sphere_objects_.size());
+  triangles_.resize(triangle_objects_.size());
+  Update();
+}
+
+void PrimitiveArrays::Update() {
+  for (size_t i = 0; i < sphere_objects_.size(); ++i) {
+    spheres_[i] = {sphere_objects_[i]->GetCenter(),
+                   sphere_objects_[i]->GetRadius()};
+  }
+  for (size_t i = 0; i < triangle_objects_.size(); ++i) {
+    const Triangle& tri = *triangle_objects_[i];
+    triangles_[i] = {tri.GetPoint0(), tri.GetPoint1(), tri.GetPoint2()};
+  }
+}
+
+size_t PrimitiveArrays::GetMemorySize() const {
+  return slots_.capacity() * sizeof(uint32_t) +
+         spheres_.capacity() * sizeof(SphereData) +
+         triangles_.capacity() * sizeof(TriangleData) +
+         (sphere_objects_.capacity() + triangle_objects_.capacity() +
+          meshes_.capacity() + instances_.capacity() + sphere_sets_.capacity() +
+          others_.capacity()) *
+             sizeof(const Object*);
+}
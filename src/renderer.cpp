@@ -0,0 +1,321 @@
+﻿#include "Renderer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+
+#include "AcceleratorCache.h"
+
+uint64_t render::MortonIndex(uint32_t x, uint32_t y) {
+  // spreads bits of the value, so there is a zero bit between each of them
+  auto spread = [](uint64_t v) {
+    v = (v | (v << 16)) & 0x0000FFFF0000FFFFULL;
+    v = (v | (v << 8)) & 0x00FF00FF00FF00FFULL;
+    v = (v | (v << 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    v = (v | (v << 2)) & 0x3333333333333333ULL;
+    v = (v | (v << 1)) & 0x5555555555555555ULL;
+    return v;
+  };
+  return spread(x) | (spread(y) << 1);
+}
+
+uint64_t render::HilbertIndex(uint32_t side, uint32_t x, uint32_t y) {
+  uint64_t result = 0;
+  for (uint32_t s = side / 2; s > 0; s /= 2) {
+    uint32_t rx = (x & s) > 0;
+    uint32_t ry = (y & s) > 0;
+    result += static_cast<uint64_t>(s) * s * ((3 * rx) ^ ry);
+    // rotate quadrant, so the curve inside it has the proper orientation
+    if (ry == 0) {
+      if (rx == 1) {
+        x = side - 1 - x;
+        y = side - 1 - y;
+      }
+      std::swap(x, y);
+    }
+  }
+  return result;
+}
+
+std::vector<std::pair<int, int>> render::CreateCurveOrder(int width, int height,
+                                                          TileOrder order) {
+  std::vector<std::pair<int, int>> result;
+  result.reserve(static_cast<size_t>(width) * height);
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      result.emplace_back(x, y);
+    }
+  }
+  if (order == TileOrder::kScanline) return result;
+  uint32_t side = 1;
+  while (side < static_cast<uint32_t>(std::max(width, height))) side *= 2;
+  auto curve_index = [&](const std::pair<int, int>& p) {
+    return order == TileOrder::kMorton
+               ? MortonIndex(p.first, p.second)
+               : HilbertIndex(side, p.first, p.second);
+  };
+  std::sort(result.begin(), result.end(),
+            [&](const auto& lhs, const auto& rhs) {
+              return curve_index(lhs) < curve_index(rhs);
+            });
+  return result;
+}
+
+std::vector<render::Block> render::CreateBlocks(int width_in_pixel,
+                                                int height_in_pixel,
+                                                TileOrder order) {
+  int width_in_blocks = (width_in_pixel + kBlockSize - 1) / kBlockSize;
+  int height_in_blocks = (height_in_pixel + kBlockSize - 1) / kBlockSize;
+  std::vector<Block> result;
+  result.reserve(static_cast<size_t>(width_in_blocks) * height_in_blocks);
+  auto add_block = [&](int bx, int by) {
+    int x = bx * kBlockSize;
+    int y = by * kBlockSize;
+    result.push_back({x, y, std::min(kBlockSize, width_in_pixel - x),
+                      std::min(kBlockSize, height_in_pixel - y)});
+  };
+  if (order == TileOrder::kScanline) {
+    for (const auto& [bx, by] :
+         CreateCurveOrder(width_in_blocks, height_in_blocks, order)) {
+      add_block(bx, by);
+    }
+    return result;
+  }
+  // Curve over the whole picture finishes the top rows only at the very end
+  // of the render. Square cells of a strip are walked from left to right
+  // instead, the curve starts and ends at the top corners of a cell, so
+  // consecutive cells are still joined
+  for (int sy = 0; sy < height_in_blocks; sy += kCurveStripHeight) {
+    int strip_height = std::min(kCurveStripHeight, height_in_blocks - sy);
+    for (int sx = 0; sx < width_in_blocks; sx += kCurveStripHeight) {
+      int cell_width = std::min(kCurveStripHeight, width_in_blocks - sx);
+      for (const auto& [bx, by] :
+           CreateCurveOrder(cell_width, strip_height, order)) {
+        add_block(sx + bx, sy + by);
+      }
+    }
+  }
+  return result;
+}
+
+Renderer::Renderer(const GeneralSettings& general, const CameraSettings& camera,
+                   std::vector<const Object*> objects)
+    : general_(general),
+      tiles_(pixel::CreateTiles(
+          camera.screen_top_left_coor, camera.screen_top_right_coor,
+          camera.screen_bot_left_coor, general.pic_width_in_pixel,
+          general.pic_height_in_pixel)),
+      viewer_(pixel::CreateViewerPoint(camera)),
+      objects_(std::move(objects)),
+      blocks_(render::CreateBlocks(general.pic_width_in_pixel,
+                                   general.pic_height_in_pixel,
+                                   general.tile_order)),
+      block_pixel_order_(render::CreateCurveOrder(
+          render::kBlockSize, render::kBlockSize, general.tile_order)),
+      pixel_end_(tiles_.size()),
+      accum_(general.pic_width_in_pixel, general.pic_height_in_pixel),
+      pool_(general.thread_number) {
+  auto build_start = std::chrono::steady_clock::now();
+  accel_ = CreateCachedAccelerator(general.accelerator, objects_, &pool_,
+                                   general.accelerator_cache_dir);
+  build_time_in_sec_ = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - build_start)
+                           .count();
+  built_cost_ = accel_->GetCost();
+  lights_ = LightList{objects_, general_.light_sampling};
+}
+
+void Renderer::SetCamera(const CameraSettings& camera) {
+  tiles_ = pixel::CreateTiles(
+      camera.screen_top_left_coor, camera.screen_top_right_coor,
+      camera.screen_bot_left_coor, general_.pic_width_in_pixel,
+      general_.pic_height_in_pixel);
+  viewer_ = pixel::CreateViewerPoint(camera);
+}
+
+bool Renderer::UpdateGeometry() {
+  auto start = std::chrono::steady_clock::now();
+  bool rebuild = general_.refit_cost_ratio <= 0.0 || !accel_->Refit() ||
+                 accel_->GetCost() > general_.refit_cost_ratio * built_cost_;
+  if (rebuild) {
+    accel_ = CreateAccelerator(general_.accelerator, objects_, &pool_);
+    built_cost_ = accel_->GetCost();
+  }
+  lights_ = LightList{objects_, general_.light_sampling};
+  build_time_in_sec_ = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+  return rebuild;
+}
+
+void Renderer::SetPixelRange(size_t pixel_begin, size_t pixel_end) {
+  pixel_end_ = std::min(pixel_end, tiles_.size());
+  pixel_begin_ = std::min(pixel_begin, pixel_end_);
+  size_t width = general_.pic_width_in_pixel;
+  blocks_ = render::CreateBlocks(general_.pic_width_in_pixel,
+                                 general_.pic_height_in_pixel,
+                                 general_.tile_order);
+  // keep only blocks which have at least one row inside the range
+  blocks_.erase(
+      std::remove_if(blocks_.begin(), blocks_.end(),
+                     [&](const render::Block& block) {
+                       size_t first = block.y0 * width + block.x0;
+                       size_t last = (block.y0 + block.height - 1) * width +
+                                     block.x0 + block.width;
+                       return last <= pixel_begin_ || first >= pixel_end_;
+                     }),
+      blocks_.end());
+}
+
+void Renderer::RenderBlock(const render::Block& block, int first_sample,
+                           int sample_num, Sampler& sampler,
+                           std::vector<PixelAccum>& block_accum) const {
+  block_accum.assign(static_cast<size_t>(block.width) * block.height, {});
+  if (general_.ray_packet_side > 0 && general_.max_bounce_number > 0) {
+    RenderBlockByPackets(block, first_sample, sample_num, sampler,
+                         block_accum);
+    return;
+  }
+  for (const auto& [local_x, local_y] : block_pixel_order_) {
+    if (local_x >= block.width || local_y >= block.height) continue;
+    size_t pixel_idx =
+        (block.y0 + local_y) * general_.pic_width_in_pixel + block.x0 + local_x;
+    if (pixel_idx < pixel_begin_ || pixel_idx >= pixel_end_) continue;
+    PixelAccum& accum = block_accum[local_y * block.width + local_x];
+    sampler.StartPixel(pixel_idx, first_sample);
+    std::vector<Ray> rays =
+        pixel::CreateRays(tiles_[pixel_idx], viewer_, sampler, sample_num);
+    for (int n = 0; n < sample_num; ++n) {
+      sampler.StartSample(n);
+      accum.Add(pixel::RenderRay(rays[n], *accel_,
+                                 general_.max_bounce_number, sampler,
+                                 &lights_));
+    }
+  }
+}
+
+void Renderer::RenderBlockByPackets(
+    const render::Block& block, int first_sample, int sample_num,
+    Sampler& sampler, std::vector<PixelAccum>& block_accum) const {
+  static_assert(kMaxRayPacketSide * kMaxRayPacketSide <= RayPacket::kMaxSize);
+  int side = general_.ray_packet_side;
+  // picture and block indices of the pixels of a packet
+  std::vector<std::pair<size_t, size_t>> pixels;
+  std::vector<Ray> rays;
+  std::vector<std::optional<HitRecord>> hits;
+  for (int y0 = 0; y0 < block.height; y0 += side) {
+    for (int x0 = 0; x0 < block.width; x0 += side) {
+      pixels.clear();
+      for (int y = y0; y < std::min(y0 + side, block.height); ++y) {
+        for (int x = x0; x < std::min(x0 + side, block.width); ++x) {
+          size_t pixel_idx =
+              (block.y0 + y) * general_.pic_width_in_pixel + block.x0 + x;
+          if (pixel_idx < pixel_begin_ || pixel_idx >= pixel_end_) continue;
+          pixels.emplace_back(pixel_idx, y * block.width + x);
+        }
+      }
+      for (int n = 0; n < sample_num; ++n) {
+        // sampler is restarted for every ray, so values are the same as when
+        // rays are traced one by one
+        rays.clear();
+        for (const auto& [pixel_idx, local_idx] : pixels) {
+          sampler.StartPixel(pixel_idx, first_sample);
+          sampler.StartSample(n);
+          rays.push_back(pixel::CreateRay(tiles_[pixel_idx], viewer_, sampler));
+        }
+        hits.resize(rays.size());
+        accel_->GetClosestHits(rays, hits.data());
+        for (size_t k = 0; k < rays.size(); ++k) {
+          sampler.StartPixel(pixels[k].first, first_sample);
+          sampler.StartSample(n);
+          block_accum[pixels[k].second].Add(
+              pixel::RenderRay(rays[k], hits[k], *accel_,
+                               general_.max_bounce_number, sampler,
+                               &lights_));
+        }
+      }
+    }
+  }
+}
+
+void Renderer::RenderPass(int first_sample, int sample_num,
+                          const RowCallback& on_row) {
+  size_t thread_num = pool_.GetThreadNumber();
+  // Random values depend only on the pixel and sample indices, so picture is
+  // the same for any number of threads and any split into passes
+  std::vector<Sampler> samplers(thread_num, Sampler{general_.seed});
+  // Blocks are traced into per worker buffers and added to the accumulation
+  // buffer only when finished, so workers do not write into the same cache
+  // lines while tracing
+  std::vector<std::vector<PixelAccum>> block_buffers(thread_num);
+  bool log_progress = sample_num == general_.sample_per_pixel;
+  // Blocks are counted per band of block rows. Rows are reported in order:
+  // last finished block of a band reports its rows together with rows of all
+  // following bands which are already finished. Unfinished bands stay only in
+  // the accumulation buffer, so nothing is copied before it can be encoded
+  size_t band_num = (general_.pic_height_in_pixel + render::kBlockSize - 1) /
+                    render::kBlockSize;
+  std::vector<std::atomic<int>> band_blocks_left(band_num);
+  for (const auto& block : blocks_) {
+    band_blocks_left[block.y0 / render::kBlockSize]++;
+  }
+  std::mutex row_mut;
+  size_t next_band = 0;
+  auto report_finished_rows = [&] {
+    std::lock_guard<std::mutex> lock(row_mut);
+    for (; next_band < band_num && band_blocks_left[next_band] == 0;
+         ++next_band) {
+      int row_begin = static_cast<int>(next_band) * render::kBlockSize;
+      int row_end = std::min(general_.pic_height_in_pixel,
+                             row_begin + render::kBlockSize);
+      for (int y = row_begin; y < row_end; ++y) {
+        std::vector<Color> row;
+        row.reserve(general_.pic_width_in_pixel);
+        for (int x = 0; x < general_.pic_width_in_pixel; ++x) {
+          row.push_back(accum_[y * general_.pic_width_in_pixel + x].GetColor());
+        }
+        on_row(y, std::move(row));
+      }
+    }
+  };
+  std::atomic<size_t> done_blocks{0};
+  std::mutex log_mut;
+  pool_.Run(blocks_.size(), [&](size_t block_idx, size_t worker_idx) {
+    const render::Block& block = blocks_[block_idx];
+    std::vector<PixelAccum>& buffer = block_buffers[worker_idx];
+    RenderBlock(block, first_sample, sample_num, samplers[worker_idx], buffer);
+    auto it = buffer.begin();
+    for (int y = block.y0; y < block.y0 + block.height; ++y) {
+      size_t pixel_idx = y * general_.pic_width_in_pixel + block.x0;
+      for (int x = 0; x < block.width; ++x, ++it) {
+        accum_[pixel_idx + x].Add(*it);
+      }
+    }
+    if (on_row && --band_blocks_left[block.y0 / render::kBlockSize] == 0) {
+      report_finished_rows();
+    }
+    size_t count = ++done_blocks;
+    if (log_progress && (10ULL * count) % blocks_.size() < 10ULL) {
+      std::lock_guard<std::mutex> lock(log_mut);
+      std::cerr << 100 * count / blocks_.size() << "%\n";
+    }
+  });
+}
+
+std::vector<Color> Renderer::Render(const PassCallback& on_pass,
+                                   const RowCallback& on_row) {
+  accum_ = AccumulationBuffer{general_.pic_width_in_pixel,
+                              general_.pic_height_in_pixel};
+  int pass_size = general_.samples_per_pass > 0 ? general_.samples_per_pass
+                                                : general_.sample_per_pixel;
+  for (int done = 0; done < general_.sample_per_pixel;) {
+    int sample_num = std::min(pass_size, general_.sample_per_pixel - done);
+    bool is_last = done + sample_num == general_.sample_per_pixel;
+    RenderPass(done, sample_num, is_last ? on_row : nullptr);
+    done += sample_num;
+    if (on_pass) on_pass(accum_, done);
+  }
+  return accum_.GetColors();
+}
@@ -0,0 +1,151 @@
+﻿#include "SphereSet.h"
+
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+
+#include "SpherePacket.h"
+
+namespace {
+void CheckSpheres(const std::vector<GeoVec>& centers,
+                  const std::vector<Real>& radii) {
+  if (radii.size() != centers.size()) {
+    throw std::logic_error("Sphere set needs one radius per center");
+  }
+  for (Real r : radii) {
+    if (!(r > 0)) throw std::logic_error("Sphere radius should be positive");
+  }
+}
+}  // namespace
+
+SphereSet::SphereSet(const std::vector<GeoVec>& centers,
+                     const std::vector<Real>& radii, ThreadPool* pool)
+    : sphere_num_(centers.size()) {
+  CheckSpheres(centers, radii);
+  std::vector<uint32_t> order;
+  nodes_ = BuildBvhNodes(
+      centers.size(),
+      [&](size_t idx) {
+        GeoVec half{radii[idx], radii[idx], radii[idx]};
+        return BoundingBox{}
+            .Extend(centers[idx] - half)
+            .Extend(centers[idx] + half);
+      },
+      pool, order, kSpherePacketWidth);
+  SetSpheres(centers, radii, order);
+}
+
+SphereSet::SphereSet(const std::vector<GeoVec>& centers,
+                     const std::vector<Real>& radii, NoHierarchy)
+    : sphere_num_(centers.size()) {
+  CheckSpheres(centers, radii);
+  std::vector<uint32_t> order(centers.size());
+  std::iota(order.begin(), order.end(), 0);
+  SetSpheres(centers, radii, order);
+}
+
+void SphereSet::SetSpheres(const std::vector<GeoVec>& centers,
+                           const std::vector<Real>& radii,
+                           const std::vector<uint32_t>& order) {
+  size_t padded_num = order.size() + kSpherePacketWidth;
+  x_.reserve(padded_num);
+  y_.reserve(padded_num);
+  z_.reserve(padded_num);
+  r_.reserve(padded_num);
+  sphere_to_slot_.resize(order.size());
+  for (uint32_t idx : order) {
+    sphere_to_slot_[idx] = x_.size();
+    x_.push_back(centers[idx].x_);
+    y_.push_back(centers[idx].y_);
+    z_.push_back(centers[idx].z_);
+    r_.push_back(radii[idx]);
+  }
+  x_.resize(padded_num);
+  y_.resize(padded_num);
+  z_.resize(padded_num);
+  r_.resize(padded_num);
+}
+
+BoundingBox SphereSet::GetSphereBox(uint32_t slot) const {
+  GeoVec half{r_[slot], r_[slot], r_[slot]};
+  return BoundingBox{}
+      .Extend(GetCenter(slot) - half)
+      .Extend(GetCenter(slot) + half);
+}
+
+BoundingBox SphereSet::GetBoundingBox() const {
+  if (!nodes_.empty()) return nodes_[0].box;
+  // set without hierarchy
+  BoundingBox result;
+  for (uint32_t slot = 0; slot < sphere_num_; ++slot) {
+    result.Extend(GetSphereBox(slot));
+  }
+  return result;
+}
+
+std::optional<uint32_t> SphereSet::FindClosestSphere(const Ray& ray,
+                                                     Real& max_dist) const {
+  std::optional<uint32_t> result;
+  SphereSoA spheres{{x_.data(), y_.data(), z_.data()}, r_.data()};
+  TraverseBvh(nodes_, ray, max_dist, [&](uint32_t first, uint32_t num) {
+    std::optional<uint32_t> sphere =
+        IntersectSpherePacket(ray, spheres, first, num, max_dist);
+    if (sphere) result = sphere;
+  });
+  return result;
+}
+
+std::optional<Real> SphereSet::GetClosesDist(const Ray& ray) const {
+  Real dist = std::numeric_limits<Real>::max();
+  if (!FindClosestSphere(ray, dist)) return std::nullopt;
+  return dist;
+}
+
+bool SphereSet::IsCrossed(const Ray& ray, Real max_dist) const {
+  SphereSoA spheres{{x_.data(), y_.data(), z_.data()}, r_.data()};
+  bool is_crossed = false;
+  TraverseBvh(nodes_, ray, max_dist, [&](uint32_t first, uint32_t num) {
+    is_crossed =
+        IntersectSpherePacket(ray, spheres, first, num, max_dist).has_value();
+    return is_crossed;
+  });
+  return is_crossed;
+}
+
+GeoVec SphereSet::GetNorm(const GeoVec& /*p*/) const {
+  throw std::logic_error(
+      "Sphere set normal depends on the crossed sphere, use GetSurfacePoint");
+}
+
+SurfacePoint SphereSet::GetSurfacePoint(const Ray& ray, Real /*dist*/) const {
+  Real dist = std::numeric_limits<Real>::max();
+  std::optional<uint32_t> sphere = FindClosestSphere(ray, dist);
+  if (!sphere) {
+    // ray is the same one which found the set, so it always hits
+    return {this, -ray.GetDir()};
+  }
+  GeoVec p = ray.GetPos() + ray.GetDir() * dist;
+  return {this, (p - GetCenter(*sphere)) / r_[*sphere]};
+}
+
+size_t SphereSet::GetMemorySize() const {
+  return (x_.capacity() + y_.capacity() + z_.capacity() + r_.capacity()) *
+             sizeof(Real) +
+         sphere_to_slot_.capacity() * sizeof(uint32_t) +
+         nodes_.capacity() * sizeof(BvhNode);
+}
+
+void SphereSet::UpdateCenters(const SphereSet& frame) {
+  if (frame.sphere_num_ != sphere_num_) {
+    throw std::logic_error("Frame set has other number of spheres");
+  }
+  // both sets are sorted by their own hierarchies
+  for (size_t i = 0; i < sphere_to_slot_.size(); ++i) {
+    uint32_t slot = sphere_to_slot_[i];
+    uint32_t frame_slot = frame.sphere_to_slot_[i];
+    x_[slot] = frame.x_[frame_slot];
+    y_[slot] = frame.y_[frame_slot];
+    z_[slot] = frame.z_[frame_slot];
+  }
+  RefitBvhNodes(nodes_, [&](uint32_t slot) { return GetSphereBox(slot); });
+}
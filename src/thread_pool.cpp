@@ -0,0 +1,100 @@
+﻿#include "ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t thread_num) {
+  if (!thread_num) {
+    thread_num = std::max(1U, std::thread::hardware_concurrency());
+  }
+  queues_ = std::make_unique<WorkQueue[]>(thread_num);
+  workers_.reserve(thread_num);
+  for (size_t i = 0; i < thread_num; ++i) {
+    workers_.emplace_back(&ThreadPool::WorkerLoop, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mut_);
+    stop_ = true;
+  }
+  job_cv_.notify_all();
+  for (auto& el : workers_) {
+    el.join();
+  }
+}
+
+void ThreadPool::Run(size_t task_num, const Task& task) {
+  if (!task_num) return;
+  size_t thread_num = workers_.size();
+  // tasks are dealt round robin, so all workers advance through the task
+  // list together and early tasks (e.g. top rows of the picture) are
+  // finished first
+  for (size_t w = 0; w < thread_num; ++w) {
+    std::lock_guard<std::mutex> lock(queues_[w].mut);
+    for (size_t i = w; i < task_num; i += thread_num) {
+      queues_[w].tasks.push_back(i);
+    }
+  }
+  std::unique_lock<std::mutex> lock(mut_);
+  task_ = &task;
+  finished_workers_ = 0;
+  error_ = nullptr;
+  ++job_id_;
+  job_cv_.notify_all();
+  done_cv_.wait(lock, [&] { return finished_workers_ == thread_num; });
+  task_ = nullptr;
+  if (error_) {
+    std::rethrow_exception(error_);
+  }
+}
+
+bool ThreadPool::PopTask(size_t worker_idx, size_t& task_idx) {
+  {
+    WorkQueue& own = queues_[worker_idx];
+    std::lock_guard<std::mutex> lock(own.mut);
+    if (!own.tasks.empty()) {
+      task_idx = own.tasks.front();
+      own.tasks.pop_front();
+      return true;
+    }
+  }
+  size_t thread_num = workers_.size();
+  for (size_t i = 1; i < thread_num; ++i) {
+    WorkQueue& victim = queues_[(worker_idx + i) % thread_num];
+    std::lock_guard<std::mutex> lock(victim.mut);
+    if (!victim.tasks.empty()) {
+      task_idx = victim.tasks.back();
+      victim.tasks.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::WorkerLoop(size_t worker_idx) {
+  size_t seen_job = 0;
+  while (true) {
+    const Task* task = nullptr;
+    {
+      std::unique_lock<std::mutex> lock(mut_);
+      job_cv_.wait(lock, [&] { return stop_ || job_id_ != seen_job; });
+      if (stop_) return;
+      seen_job = job_id_;
+      task = task_;
+    }
+    size_t task_idx = 0;
+    while (PopTask(worker_idx, task_idx)) {
+      try {
+        (*task)(task_idx, worker_idx);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mut_);
+        if (!error_) error_ = std::current_exception();
+      }
+    }
+    std::lock_guard<std::mutex> lock(mut_);
+    if (++finished_workers_ == workers_.size()) {
+      done_cv_.notify_one();
+    }
+  }
+}
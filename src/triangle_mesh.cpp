@@ -0,0 +1,257 @@
+﻿#include "TriangleMesh.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+#include "TrianglePacket.h"
+
+namespace {
+struct PointHash {
+  size_t operator()(const GeoVec& p) const {
+    std::hash<Real> hash;
+    size_t result = hash(p.x_);
+    result = result * 31 + hash(p.y_);
+    return result * 31 + hash(p.z_);
+  }
+};
+}  // namespace
+
+TriangleMesh::TriangleMesh(const std::vector<GeoVec>& points,
+                           const std::vector<Face>& faces, ThreadPool* pool)
+    : TriangleMesh(BuildData(points, faces, pool)) {}
+
+TriangleMesh::TriangleMesh(const std::vector<GeoVec>& points,
+                           const std::vector<Face>& faces, NoHierarchy)
+    : point_to_vertex_(points.size(), kNoVertex) {
+  x_.reserve(points.size());
+  y_.reserve(points.size());
+  z_.reserve(points.size());
+  for (const GeoVec& p : points) {
+    x_.push_back(p.x_);
+    y_.push_back(p.y_);
+    z_.push_back(p.z_);
+  }
+  face_v0_.reserve(faces.size());
+  face_v1_.reserve(faces.size());
+  face_v2_.reserve(faces.size());
+  for (const Face& face : faces) {
+    for (uint32_t idx : face) {
+      if (idx >= points.size()) {
+        throw std::logic_error("Mesh face refers to a missing point");
+      }
+      point_to_vertex_[idx] = idx;
+    }
+    face_v0_.push_back(face[0]);
+    face_v1_.push_back(face[1]);
+    face_v2_.push_back(face[2]);
+  }
+}
+
+TriangleMesh::TriangleMesh(Data data)
+    : x_(std::move(data.x)),
+      y_(std::move(data.y)),
+      z_(std::move(data.z)),
+      face_v0_(std::move(data.face_v0)),
+      face_v1_(std::move(data.face_v1)),
+      face_v2_(std::move(data.face_v2)),
+      point_to_vertex_(std::move(data.point_to_vertex)),
+      nodes_(std::move(data.nodes)) {}
+
+TriangleMesh::Data TriangleMesh::BuildData(const std::vector<GeoVec>& points,
+                                           const std::vector<Face>& faces,
+                                           ThreadPool* pool) {
+  for (const Face& face : faces) {
+    for (uint32_t idx : face) {
+      if (idx >= points.size()) {
+        throw std::logic_error("Mesh face refers to a missing point");
+      }
+    }
+  }
+  Data result;
+  result.point_to_vertex.assign(points.size(), kNoVertex);
+  std::vector<uint32_t> order;
+  result.nodes = BuildBvhNodes(
+      faces.size(),
+      [&](size_t idx) {
+        const Face& face = faces[idx];
+        return BoundingBox{}
+            .Extend(points[face[0]])
+            .Extend(points[face[1]])
+            .Extend(points[face[2]]);
+      },
+      pool, order, kTrianglePacketWidth);
+  // vertices get indices in the order of their first use by leaf ordered
+  // faces
+  std::unordered_map<GeoVec, uint32_t, PointHash> vertex_of_point;
+  auto get_vertex = [&](uint32_t point_idx) {
+    uint32_t& vertex = result.point_to_vertex[point_idx];
+    if (vertex != kNoVertex) return vertex;
+    // adding zero turns -0.0 into 0.0, so equal points get the same hash
+    GeoVec p = points[point_idx] + GeoVec{0.0, 0.0, 0.0};
+    auto [it, is_new] = vertex_of_point.emplace(p, result.x.size());
+    if (is_new) {
+      result.x.push_back(p.x_);
+      result.y.push_back(p.y_);
+      result.z.push_back(p.z_);
+    }
+    vertex = it->second;
+    return vertex;
+  };
+  result.face_v0.reserve(order.size());
+  result.face_v1.reserve(order.size());
+  result.face_v2.reserve(order.size());
+  for (uint32_t face_idx : order) {
+    const Face& face = faces[face_idx];
+    result.face_v0.push_back(get_vertex(face[0]));
+    result.face_v1.push_back(get_vertex(face[1]));
+    result.face_v2.push_back(get_vertex(face[2]));
+  }
+  result.x.shrink_to_fit();
+  result.y.shrink_to_fit();
+  result.z.shrink_to_fit();
+  return result;
+}
+
+BoundingBox TriangleMesh::GetFaceBox(uint32_t face) const {
+  return BoundingBox{}
+      .Extend(GetVertex(face_v0_[face]))
+      .Extend(GetVertex(face_v1_[face]))
+      .Extend(GetVertex(face_v2_[face]));
+}
+
+BoundingBox TriangleMesh::GetBoundingBox() const {
+  if (!nodes_.empty()) return nodes_[0].box;
+  // mesh without hierarchy
+  BoundingBox result;
+  for (uint32_t face = 0; face < face_v0_.size(); ++face) {
+    result.Extend(GetFaceBox(face));
+  }
+  return result;
+}
+
+std::optional<uint32_t> TriangleMesh::FindClosestFace(const Ray& ray,
+                                                      Real& max_dist) const {
+  std::optional<uint32_t> result;
+  TriangleSoA faces{{x_.data(), y_.data(), z_.data()},
+                    {face_v0_.data(), face_v1_.data(), face_v2_.data()}};
+  TraverseBvh(nodes_, ray, max_dist, [&](uint32_t first, uint32_t num) {
+    std::optional<uint32_t> face =
+        IntersectTrianglePacket(ray, faces, first, num, max_dist);
+    if (face) result = face;
+  });
+  return result;
+}
+
+std::optional<Real> TriangleMesh::GetClosesDist(const Ray& ray) const {
+  Real dist = std::numeric_limits<Real>::max();
+  if (!FindClosestFace(ray, dist)) return std::nullopt;
+  return dist;
+}
+
+bool TriangleMesh::IsCrossed(const Ray& ray, Real max_dist) const {
+  TriangleSoA faces{{x_.data(), y_.data(), z_.data()},
+                    {face_v0_.data(), face_v1_.data(), face_v2_.data()}};
+  bool is_crossed = false;
+  TraverseBvh(nodes_, ray, max_dist, [&](uint32_t first, uint32_t num) {
+    is_crossed =
+        IntersectTrianglePacket(ray, faces, first, num, max_dist).has_value();
+    return is_crossed;
+  });
+  return is_crossed;
+}
+
+GeoVec TriangleMesh::GetNorm(const GeoVec& /*p*/) const {
+  throw std::logic_error(
+      "Mesh normal depends on the crossed face, use GetSurfacePoint");
+}
+
+SurfacePoint TriangleMesh::GetSurfacePoint(const Ray& ray,
+                                           Real /*dist*/) const {
+  Real dist = std::numeric_limits<Real>::max();
+  std::optional<uint32_t> face = FindClosestFace(ray, dist);
+  if (!face) {
+    // ray is the same one which found the mesh, so it always hits
+    return {this, -ray.GetDir()};
+  }
+  auto [p0, p1, p2] = GetTriangle(*face);
+  return {this, GeoVec{p0, p1}.Cross({p0, p2}).Norm()};
+}
+
+size_t TriangleMesh::GetMemorySize() const {
+  return (x_.capacity() + y_.capacity() + z_.capacity()) * sizeof(Real) +
+         (face_v0_.capacity() + face_v1_.capacity() + face_v2_.capacity() +
+          point_to_vertex_.capacity()) *
+             sizeof(uint32_t) +
+         nodes_.capacity() * sizeof(BvhNode);
+}
+
+bool TriangleMesh::CanUpdatePoints(const TriangleMesh& frame) const {
+  if (frame.point_to_vertex_.size() != point_to_vertex_.size() ||
+      frame.GetTriangleNumber() != GetTriangleNumber()) {
+    return false;
+  }
+  // points merged into one vertex should stay equal in the frame
+  std::vector<uint32_t> first_point(x_.size(), kNoVertex);
+  for (size_t i = 0; i < point_to_vertex_.size(); ++i) {
+    uint32_t vertex = point_to_vertex_[i];
+    uint32_t frame_vertex = frame.point_to_vertex_[i];
+    if ((vertex == kNoVertex) != (frame_vertex == kNoVertex)) return false;
+    if (vertex == kNoVertex) continue;
+    if (first_point[vertex] == kNoVertex) {
+      first_point[vertex] = static_cast<uint32_t>(i);
+    } else {
+      uint32_t merged = frame.point_to_vertex_[first_point[vertex]];
+      if (merged != frame_vertex &&
+          !(frame.GetVertex(merged) == frame.GetVertex(frame_vertex))) {
+        return false;
+      }
+    }
+  }
+  // frame faces are written with vertices of this mesh and compared as sets,
+  // since faces of both meshes are sorted by their own hierarchies
+  std::vector<uint32_t> frame_to_vertex(frame.x_.size(), kNoVertex);
+  for (size_t i = 0; i < point_to_vertex_.size(); ++i) {
+    uint32_t vertex = point_to_vertex_[i];
+    if (vertex == kNoVertex) continue;
+    uint32_t& mapped = frame_to_vertex[frame.point_to_vertex_[i]];
+    if (mapped != kNoVertex && mapped != vertex) return false;
+    mapped = vertex;
+  }
+  // rotation keeps the face and its side, so the least vertex goes first
+  auto get_key = [](Face face) {
+    std::rotate(face.begin(), std::min_element(face.begin(), face.end()),
+                face.end());
+    return face;
+  };
+  std::vector<Face> faces;
+  std::vector<Face> frame_faces;
+  faces.reserve(GetTriangleNumber());
+  frame_faces.reserve(GetTriangleNumber());
+  for (size_t face = 0; face < GetTriangleNumber(); ++face) {
+    faces.push_back(get_key({face_v0_[face], face_v1_[face], face_v2_[face]}));
+    frame_faces.push_back(get_key({frame_to_vertex[frame.face_v0_[face]],
+                                   frame_to_vertex[frame.face_v1_[face]],
+                                   frame_to_vertex[frame.face_v2_[face]]}));
+  }
+  std::sort(faces.begin(), faces.end());
+  std::sort(frame_faces.begin(), frame_faces.end());
+  return faces == frame_faces;
+}
+
+void TriangleMesh::UpdatePoints(const TriangleMesh& frame) {
+  if (!CanUpdatePoints(frame)) {
+    throw std::logic_error("Frame mesh has other points or faces");
+  }
+  for (size_t i = 0; i < point_to_vertex_.size(); ++i) {
+    uint32_t vertex = point_to_vertex_[i];
+    if (vertex == kNoVertex) continue;
+    GeoVec p = frame.GetVertex(frame.point_to_vertex_[i]);
+    x_[vertex] = p.x_;
+    y_[vertex] = p.y_;
+    z_[vertex] = p.z_;
+  }
+  RefitBvhNodes(nodes_, [&](uint32_t face) { return GetFaceBox(face); });
+}
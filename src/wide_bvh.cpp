@@ -0,0 +1,324 @@
+﻿#include "WideBvh.h"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+
+#include "VecMath.h"
+
+namespace {
+constexpr int kWidth = WideBvhNode::kWidth;
+/** Children of a node are tested in lanes of one register, float children
+ * fit into one SSE register, double ones into one AVX register*/
+using P = vec_math::Pack<Real, kWidth>;
+
+/** Ray values prepared for testing against node children*/
+struct TraversalRay {
+  explicit TraversalRay(const Ray& ray) {
+    const GeoVec& pos = ray.GetPos();
+    const GeoVec& dir = ray.GetDir();
+    GeoVec inv{Real{1} / dir.x_, Real{1} / dir.y_, Real{1} / dir.z_};
+    for (int axis = 0; axis < 3; ++axis) {
+      origin[axis] = GetAxis(pos, axis);
+      inv_dir[axis] = GetAxis(inv, axis);
+      // for negative direction the far plane of the box is entered first
+      neg_dir[axis] = inv_dir[axis] < 0;
+      origin_v[axis] = P::Set1(origin[axis]);
+      inv_dir_v[axis] = P::Set1(inv_dir[axis]);
+    }
+  }
+
+  Real origin[3];
+  Real inv_dir[3];
+  bool neg_dir[3];
+  P::Reg origin_v[3];
+  P::Reg inv_dir_v[3];
+};
+
+/**
+ * Slab test of the ray against all child boxes of the node. NaN values which
+ * appear when ray starts on the box plane and is parallel to it are ignored,
+ * as in the binary hierarchy.
+ * @param[out] t_near - distances at which ray enters every child box
+ * @return bit mask of children entered closer than max_dist
+ */
+unsigned IntersectChildren(const WideBvhNode& node, const TraversalRay& ray,
+                           Real max_dist, Real* t_near) {
+  const Real* lower[3] = {node.min_x, node.min_y, node.min_z};
+  const Real* upper[3] = {node.max_x, node.max_y, node.max_z};
+  unsigned mask = 0;
+  for (size_t first = 0; first < kWidth; first += P::kWidth) {
+    P::Reg t_in = P::Set1(0);
+    P::Reg t_out = P::Set1(max_dist);
+    for (int axis = 0; axis < 3; ++axis) {
+      const Real* near = ray.neg_dir[axis] ? upper[axis] : lower[axis];
+      const Real* far = ray.neg_dir[axis] ? lower[axis] : upper[axis];
+      P::Reg t0 = P::Mul(P::Sub(P::Load(near + first), ray.origin_v[axis]),
+                         ray.inv_dir_v[axis]);
+      P::Reg t1 = P::Mul(P::Sub(P::Load(far + first), ray.origin_v[axis]),
+                         ray.inv_dir_v[axis]);
+      // Max/Min return the second operand if any of them is NaN
+      t_in = P::Max(t0, t_in);
+      t_out = P::Min(t1, t_out);
+    }
+    P::Store(t_near + first, t_in);
+    mask |= P::MoveMask(P::LessEq(t_in, t_out)) << first;
+  }
+  return mask;
+}
+
+void SetChildBox(WideBvhNode& node, int i, const BoundingBox& box) {
+  node.min_x[i] = box.min.x_;
+  node.min_y[i] = box.min.y_;
+  node.min_z[i] = box.min.z_;
+  node.max_x[i] = box.max.x_;
+  node.max_y[i] = box.max.y_;
+  node.max_z[i] = box.max.z_;
+}
+
+BoundingBox GetChildBox(const WideBvhNode& node, int i) {
+  return {{node.min_x[i], node.min_y[i], node.min_z[i]},
+          {node.max_x[i], node.max_y[i], node.max_z[i]}};
+}
+
+/** @return box around all children of the node*/
+BoundingBox GetChildrenBox(const WideBvhNode& node) {
+  BoundingBox result;
+  for (int i = 0; i < kWidth; ++i) {
+    result.Extend(GetChildBox(node, i));
+  }
+  return result;
+}
+}  // namespace
+
+WideBvh::WideBvh(const Bvh& bvh)
+    : objects_(bvh.GetObjects()), primitives_(objects_) {
+  ArrayView<BvhNode> bin_nodes = bvh.GetNodes();
+  if (bin_nodes.empty()) return;
+  nodes_.reserve(bin_nodes.size() / 2 + 1);
+  Collapse(bin_nodes, 0);
+  node_view_ = nodes_;
+}
+
+uint32_t WideBvh::Collapse(ArrayView<BvhNode> bin_nodes,
+                           uint32_t bin_node_idx) {
+  // open the largest inner child until node has kWidth children
+  std::vector<uint32_t> children;
+  if (bin_nodes[bin_node_idx].obj_num) {
+    children.push_back(bin_node_idx);
+  } else {
+    children = {bin_node_idx + 1, bin_nodes[bin_node_idx].offset};
+  }
+  while (children.size() < kWidth) {
+    auto largest = children.end();
+    Real largest_area = -1;
+    for (auto it = children.begin(); it != children.end(); ++it) {
+      const BvhNode& child = bin_nodes[*it];
+      if (!child.obj_num && child.box.GetSurfaceArea() > largest_area) {
+        largest_area = child.box.GetSurfaceArea();
+        largest = it;
+      }
+    }
+    if (largest == children.end()) break;
+    uint32_t opened = *largest;
+    *largest = opened + 1;
+    children.push_back(bin_nodes[opened].offset);
+  }
+
+  uint32_t node_idx = nodes_.size();
+  nodes_.emplace_back();
+  for (int i = 0; i < kWidth; ++i) {
+    SetChildBox(nodes_[node_idx], i, BoundingBox{});
+    nodes_[node_idx].child[i] = 0;
+    nodes_[node_idx].obj_num[i] = 0;
+  }
+  for (size_t i = 0; i < children.size(); ++i) {
+    const BvhNode& child = bin_nodes[children[i]];
+    SetChildBox(nodes_[node_idx], i, child.box);
+    if (child.obj_num) {
+      nodes_[node_idx].child[i] = child.offset;
+      nodes_[node_idx].obj_num[i] = child.obj_num;
+    } else {
+      uint32_t child_idx = Collapse(bin_nodes, children[i]);
+      nodes_[node_idx].child[i] = child_idx;
+    }
+  }
+  return node_idx;
+}
+
+bool WideBvh::Refit() {
+  if (file_) {
+    // mapped nodes are read only
+    nodes_.assign(node_view_.begin(), node_view_.end());
+    node_view_ = nodes_;
+    file_.reset();
+  }
+  primitives_.Update();
+  // nodes are appended before their children, so going backwards visits
+  // children before the parent
+  for (size_t i = nodes_.size(); i-- > 0;) {
+    WideBvhNode& node = nodes_[i];
+    for (int k = 0; k < kWidth; ++k) {
+      BoundingBox box;
+      if (node.obj_num[k]) {
+        for (uint32_t obj = node.child[k];
+             obj < node.child[k] + node.obj_num[k]; ++obj) {
+          box.Extend(objects_[obj]->GetBoundingBox());
+        }
+      } else if (node.child[k]) {
+        box = GetChildrenBox(nodes_[node.child[k]]);
+      }
+      SetChildBox(node, k, box);
+    }
+  }
+  return true;
+}
+
+double WideBvh::GetCost() const {
+  if (node_view_.empty()) return 0.0;
+  double root_area = GetChildrenBox(node_view_[0]).GetSurfaceArea();
+  if (root_area <= 0.0) return 0.0;
+  double cost = 0.0;
+  for (const auto& node : node_view_) {
+    cost += ToDouble(GetChildrenBox(node).GetSurfaceArea()) / root_area;
+    for (int k = 0; k < kWidth; ++k) {
+      // inner children are counted by their own nodes
+      if (!node.obj_num[k]) continue;
+      cost += ToDouble(GetChildBox(node, k).GetSurfaceArea()) / root_area *
+              node.obj_num[k];
+    }
+  }
+  return cost;
+}
+
+std::optional<HitRecord> WideBvh::GetClosestHit(const Ray& ray) const {
+  if (node_view_.empty()) return std::nullopt;
+  struct StackEntry {
+    uint32_t node;
+    Real t_near;
+  };
+  std::array<StackEntry, kWideBvhStackSize> stack;
+  size_t stack_size = 0;
+  stack[stack_size++] = {0, 0.0};
+  TraversalRay trav_ray{ray};
+  HitRecord closest{std::numeric_limits<Real>::max(), nullptr};
+  alignas(32) Real t_near[kWidth];
+  while (stack_size) {
+    StackEntry entry = stack[--stack_size];
+    if (entry.t_near > closest.dist) continue;
+    const WideBvhNode& node = node_view_[entry.node];
+    unsigned mask = IntersectChildren(node, trav_ray, closest.dist, t_near);
+    if (!mask) continue;
+    // sort entered children by distance
+    std::array<int, kWidth> order;
+    int hit_num = 0;
+    for (int i = 0; i < kWidth; ++i) {
+      if (!(mask & (1U << i))) continue;
+      int pos = hit_num++;
+      while (pos > 0 && t_near[order[pos - 1]] > t_near[i]) {
+        order[pos] = order[pos - 1];
+        --pos;
+      }
+      order[pos] = i;
+    }
+    for (int k = 0; k < hit_num; ++k) {
+      int i = order[k];
+      if (!node.obj_num[i] || t_near[i] > closest.dist) continue;
+      for (uint32_t obj = node.child[i]; obj < node.child[i] + node.obj_num[i];
+           ++obj) {
+        primitives_.Intersect(ray, obj, closest);
+      }
+    }
+    // the nearest inner child is popped first
+    for (int k = hit_num - 1; k >= 0; --k) {
+      int i = order[k];
+      if (node.obj_num[i] || t_near[i] > closest.dist) continue;
+      stack[stack_size++] = {node.child[i], t_near[i]};
+    }
+  }
+  if (!closest.obj) return std::nullopt;
+  return closest;
+}
+
+bool WideBvh::IsOccluded(const Ray& ray, Real max_dist) const {
+  if (node_view_.empty()) return false;
+  // any hit is enough, so children are not sorted
+  std::array<uint32_t, kWideBvhStackSize> stack;
+  size_t stack_size = 0;
+  stack[stack_size++] = 0;
+  TraversalRay trav_ray{ray};
+  alignas(32) Real t_near[kWidth];
+  while (stack_size) {
+    const WideBvhNode& node = node_view_[stack[--stack_size]];
+    unsigned mask = IntersectChildren(node, trav_ray, max_dist, t_near);
+    for (int i = 0; mask; ++i, mask >>= 1) {
+      if (!(mask & 1)) continue;
+      if (!node.obj_num[i]) {
+        stack[stack_size++] = node.child[i];
+        continue;
+      }
+      for (uint32_t obj = node.child[i]; obj < node.child[i] + node.obj_num[i];
+           ++obj) {
+        if (primitives_.IsCrossed(ray, obj, max_dist)) return true;
+      }
+    }
+  }
+  return false;
+}
+
+void WideBvh::GetClosestHits(ArrayView<Ray> rays,
+                             std::optional<HitRecord>* hits) const {
+  if (node_view_.empty()) {
+    std::fill(hits, hits + rays.size(), std::nullopt);
+    return;
+  }
+  TraceRayPackets(rays, hits, [&](ArrayView<Ray> part, RayPacket& packet,
+                                  HitRecord* closest) {
+    struct StackEntry {
+      uint32_t node;
+      uint64_t rays;
+    };
+    std::array<StackEntry, kWideBvhStackSize> stack;
+    size_t stack_size = 0;
+    stack[stack_size++] = {0, packet.GetAllMask()};
+    while (stack_size) {
+      StackEntry entry = stack[--stack_size];
+      const WideBvhNode& node = node_view_[entry.node];
+      // rays entering every child and the nearest entry into it
+      uint64_t child_rays[kWidth];
+      Real t_near[kWidth];
+      std::array<int, kWidth> order;
+      int hit_num = 0;
+      for (int i = 0; i < kWidth; ++i) {
+        BoundingBox box{{node.min_x[i], node.min_y[i], node.min_z[i]},
+                        {node.max_x[i], node.max_y[i], node.max_z[i]}};
+        child_rays[i] = IntersectPacket(box, packet, entry.rays, t_near[i]);
+        if (!child_rays[i]) continue;
+        int pos = hit_num++;
+        while (pos > 0 && t_near[order[pos - 1]] > t_near[i]) {
+          order[pos] = order[pos - 1];
+          --pos;
+        }
+        order[pos] = i;
+      }
+      for (int k = 0; k < hit_num; ++k) {
+        int i = order[k];
+        if (!node.obj_num[i]) continue;
+        ForEachRay(child_rays[i], [&](size_t ray) {
+          for (uint32_t obj = node.child[i];
+               obj < node.child[i] + node.obj_num[i]; ++obj) {
+            primitives_.Intersect(part[ray], obj, closest[ray]);
+          }
+          packet.max_dist[ray] = closest[ray].dist;
+        });
+      }
+      // the nearest inner child is popped first, its box is tested again
+      // with distances reduced by the tested leaves
+      for (int k = hit_num - 1; k >= 0; --k) {
+        int i = order[k];
+        if (node.obj_num[i]) continue;
+        stack[stack_size++] = {node.child[i], child_rays[i]};
+      }
+    }
+  });
+}
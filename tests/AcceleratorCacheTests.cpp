@@ -0,0 +1,203 @@
+﻿#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "AcceleratorCache.h"
+#include "Bvh.h"
+#include "Objects.h"
+#include "Ray.h"
+#include "TriangleMesh.h"
+#include "WideBvh.h"
+
+namespace {
+/** Random triangles and spheres*/
+class AcceleratorCacheTests
+    : public ::testing::TestWithParam<AcceleratorType> {
+ protected:
+  void SetUp() override {
+    std::mt19937 rnd{9};
+    std::uniform_real_distribution<double> coor{-50.0, 50.0};
+    std::uniform_real_distribution<double> shift{-3.0, 3.0};
+    for (int i = 0; i < 1000; ++i) {
+      GeoVec p{coor(rnd), coor(rnd), coor(rnd)};
+      storage_.push_back(std::make_unique<Triangle>(
+          p, p + GeoVec{shift(rnd), shift(rnd), shift(rnd)},
+          p + GeoVec{shift(rnd), shift(rnd), shift(rnd)}));
+    }
+    for (int i = 0; i < 100; ++i) {
+      storage_.push_back(std::make_unique<Sphere>(
+          GeoVec{coor(rnd), coor(rnd), coor(rnd)}, 1.0));
+    }
+    for (const auto& el : storage_) {
+      objects_.push_back(el.get());
+    }
+  }
+
+  void TearDown() override { std::filesystem::remove_all(cache_dir_); }
+
+  /** Expects the same closest hits from both structures*/
+  void ExpectSameHits(const Accelerator& lhs, const Accelerator& rhs) const {
+    std::mt19937 rnd{4};
+    std::uniform_real_distribution<double> coor{-60.0, 60.0};
+    int hit_num = 0;
+    for (int i = 0; i < 2000; ++i) {
+      Ray ray{{coor(rnd), coor(rnd), coor(rnd)},
+              {coor(rnd), coor(rnd), coor(rnd)}};
+      std::optional<HitRecord> expected = lhs.GetClosestHit(ray);
+      std::optional<HitRecord> actual = rhs.GetClosestHit(ray);
+      ASSERT_EQ(expected.has_value(), actual.has_value());
+      if (!expected) continue;
+      ++hit_num;
+      EXPECT_EQ(expected->dist, actual->dist);
+      EXPECT_EQ(expected->obj, actual->obj);
+    }
+    EXPECT_GT(hit_num, 50);
+  }
+
+  std::string cache_dir_ = "test_accel_cache";
+  std::string file_name_ = "test_accel_cache.accel";
+  std::vector<std::unique_ptr<Object>> storage_;
+  std::vector<const Object*> objects_;
+};
+}  // namespace
+
+TEST_P(AcceleratorCacheTests, LoadedStructureGivesSameHits) {
+  std::unique_ptr<Accelerator> built = CreateAccelerator(GetParam(), objects_);
+  ASSERT_TRUE(SaveAccelerator(file_name_, *built, objects_));
+  std::unique_ptr<Accelerator> loaded =
+      LoadAccelerator(file_name_, GetParam(), objects_);
+  std::filesystem::remove(file_name_);
+  ASSERT_TRUE(loaded);
+  ExpectSameHits(*built, *loaded);
+  EXPECT_DOUBLE_EQ(built->GetCost(), loaded->GetCost());
+  // mapped structure is copied before the refit
+  EXPECT_TRUE(loaded->Refit());
+  ExpectSameHits(*built, *loaded);
+}
+
+TEST_P(AcceleratorCacheTests, RejectsOtherGeometryAndType) {
+  std::unique_ptr<Accelerator> built = CreateAccelerator(GetParam(), objects_);
+  ASSERT_TRUE(SaveAccelerator(file_name_, *built, objects_));
+  AcceleratorType other = GetParam() == AcceleratorType::kBvh
+                              ? AcceleratorType::kWideBvh
+                              : AcceleratorType::kBvh;
+  EXPECT_FALSE(LoadAccelerator(file_name_, other, objects_));
+  std::vector<const Object*> fewer(objects_.begin(), objects_.end() - 1);
+  EXPECT_FALSE(LoadAccelerator(file_name_, GetParam(), fewer));
+  static_cast<Sphere&>(*storage_.back()).SetCenter(GeoVec{0, 0, 0});
+  EXPECT_FALSE(LoadAccelerator(file_name_, GetParam(), objects_));
+  {
+    std::ofstream out{file_name_, std::ios::binary};
+    out << "not a cache file";
+  }
+  EXPECT_FALSE(LoadAccelerator(file_name_, GetParam(), objects_));
+  std::filesystem::remove(file_name_);
+  EXPECT_FALSE(LoadAccelerator(file_name_, GetParam(), objects_));
+}
+
+TEST_P(AcceleratorCacheTests, CachedStructureIsReused) {
+  std::unique_ptr<Accelerator> first =
+      CreateCachedAccelerator(GetParam(), objects_, nullptr, cache_dir_);
+  ASSERT_TRUE(first);
+  ASSERT_TRUE(std::filesystem::is_directory(cache_dir_));
+  auto file_num = [&] {
+    return std::distance(std::filesystem::directory_iterator{cache_dir_},
+                         std::filesystem::directory_iterator{});
+  };
+  EXPECT_EQ(file_num(), 1);
+  std::unique_ptr<Accelerator> second =
+      CreateCachedAccelerator(GetParam(), objects_, nullptr, cache_dir_);
+  EXPECT_EQ(file_num(), 1);
+  ExpectSameHits(*first, *second);
+  // other geometry gets its own file
+  static_cast<Sphere&>(*storage_.back()).SetCenter(GeoVec{0, 0, 0});
+  CreateCachedAccelerator(GetParam(), objects_, nullptr, cache_dir_);
+  EXPECT_EQ(file_num(), 2);
+}
+
+TEST(AcceleratorCacheFileTests, RejectsTooDeepHierarchy) {
+  std::string file_name = "test_deep_cache.accel";
+  Sphere sphere{GeoVec{0, 0, 0}, 1.0};
+  std::vector<const Object*> objects{&sphere};
+  // chain of inner nodes, whose right children are the same leaf
+  auto make_chain = [](size_t depth) {
+    std::vector<BvhNode> nodes(depth + 2);
+    for (size_t i = 0; i < depth; ++i) {
+      nodes[i].offset = depth + 1;
+    }
+    nodes[depth].obj_num = 1;
+    nodes[depth + 1].obj_num = 1;
+    return nodes;
+  };
+  std::vector<BvhNode> deepest = make_chain(kBvhMaxDepth);
+  ASSERT_TRUE(SaveAccelerator(file_name, Bvh{nullptr, deepest, objects},
+                              objects));
+  EXPECT_TRUE(LoadAccelerator(file_name, AcceleratorType::kBvh, objects));
+  std::vector<BvhNode> too_deep = make_chain(kBvhMaxDepth + 1);
+  ASSERT_TRUE(SaveAccelerator(file_name, Bvh{nullptr, too_deep, objects},
+                              objects));
+  EXPECT_FALSE(LoadAccelerator(file_name, AcceleratorType::kBvh, objects));
+  std::filesystem::remove(file_name);
+}
+
+TEST(MeshCacheTests, CachedMeshIsReused) {
+  std::string cache_dir = "test_mesh_cache";
+  std::mt19937 rnd{5};
+  std::uniform_real_distribution<double> coor{-10.0, 10.0};
+  std::vector<GeoVec> points;
+  std::vector<TriangleMesh::Face> faces;
+  for (uint32_t i = 0; i < 500; ++i) {
+    points.push_back({coor(rnd), coor(rnd), coor(rnd)});
+    if (i >= 2) faces.push_back({i - 2, i - 1, i});
+  }
+  TriangleMesh expected{points, faces};
+  auto expect_same_mesh = [&](const TriangleMesh& mesh) {
+    ASSERT_EQ(mesh.GetTriangleNumber(), expected.GetTriangleNumber());
+    EXPECT_EQ(mesh.GetVertexNumber(), expected.GetVertexNumber());
+    for (size_t i = 0; i < mesh.GetTriangleNumber(); ++i) {
+      EXPECT_EQ(mesh.GetTriangle(i), expected.GetTriangle(i));
+    }
+    EXPECT_EQ(mesh.GetBoundingBox().min, expected.GetBoundingBox().min);
+    EXPECT_EQ(mesh.GetBoundingBox().max, expected.GetBoundingBox().max);
+  };
+  std::unique_ptr<TriangleMesh> built =
+      CreateCachedMesh(points, faces, nullptr, cache_dir);
+  expect_same_mesh(*built);
+  std::vector<std::filesystem::path> files{
+      std::filesystem::directory_iterator{cache_dir},
+      std::filesystem::directory_iterator{}};
+  ASSERT_EQ(files.size(), 1);
+  std::unique_ptr<TriangleMesh> loaded =
+      CreateCachedMesh(points, faces, nullptr, cache_dir);
+  expect_same_mesh(*loaded);
+  // loaded mesh can be moved as the built one
+  std::vector<GeoVec> moved = points;
+  for (auto& el : moved) el = el + GeoVec{1, 2, 3};
+  TriangleMesh frame{moved, faces};
+  ASSERT_TRUE(loaded->CanUpdatePoints(frame));
+  loaded->UpdatePoints(frame);
+  EXPECT_EQ(loaded->GetBoundingBox().min,
+            expected.GetBoundingBox().min + GeoVec(1, 2, 3));
+  // broken file is replaced by the rebuilt mesh
+  {
+    std::ofstream out{files.front(), std::ios::binary};
+    out << "not a mesh file";
+  }
+  expect_same_mesh(*CreateCachedMesh(points, faces, nullptr, cache_dir));
+  expect_same_mesh(*CreateCachedMesh(points, faces, nullptr, cache_dir));
+  // other points get their own file
+  CreateCachedMesh(moved, faces, nullptr, cache_dir);
+  EXPECT_EQ(std::distance(std::filesystem::directory_iterator{cache_dir},
+                          std::filesystem::directory_iterator{}),
+            2);
+  std::filesystem::remove_all(cache_dir);
+}
+
+INSTANTIATE_TEST_SUITE_P(Hierarchies, AcceleratorCacheTests,
+                         ::testing::Values(AcceleratorType::kBvh,
+                                           AcceleratorType::kWideBvh));
@@ -0,0 +1,408 @@
+﻿#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "Accelerator.h"
+#include "Bvh.h"
+#include "Grid.h"
+#include "Instance.h"
+#include "KdTree.h"
+#include "Objects.h"
+#include "PrimitiveArrays.h"
+#include "Ray.h"
+#include "RayPacket.h"
+#include "RealExpect.h"
+#include "TriangleMesh.h"
+#include "WideBvh.h"
+
+namespace {
+/** Closest hit found by checking every object*/
+std::optional<HitRecord> LinearClosestHit(
+    const std::vector<const Object*>& objects, const Ray& ray) {
+  std::optional<HitRecord> result;
+  for (const Object* obj : objects) {
+    std::optional<Real> dist = obj->GetClosesDist(ray);
+    if (dist && (!result || *dist < result->dist)) {
+      result = HitRecord{*dist, obj};
+    }
+  }
+  return result;
+}
+
+/** Random triangles and spheres*/
+class AcceleratorSceneTests : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    std::mt19937 rnd{7};
+    std::uniform_real_distribution<double> coor{-50.0, 50.0};
+    std::uniform_real_distribution<double> shift{-3.0, 3.0};
+    std::uniform_real_distribution<double> radius{0.5, 1.5};
+    for (int i = 0; i < 2000; ++i) {
+      GeoVec p{coor(rnd), coor(rnd), coor(rnd)};
+      storage_.push_back(std::make_unique<Triangle>(
+          p, p + GeoVec{shift(rnd), shift(rnd), shift(rnd)},
+          p + GeoVec{shift(rnd), shift(rnd), shift(rnd)}));
+    }
+    for (int i = 0; i < 200; ++i) {
+      storage_.push_back(std::make_unique<Sphere>(
+          GeoVec{coor(rnd), coor(rnd), coor(rnd)}, radius(rnd)));
+    }
+    // large wall crossing many cells and nodes
+    storage_.push_back(std::make_unique<Triangle>(
+        GeoVec{-60, -60, 0}, GeoVec{60, -60, 0}, GeoVec{-60, 60, 0}));
+    for (const auto& el : storage_) {
+      objects_.push_back(el.get());
+    }
+  }
+
+  std::vector<std::unique_ptr<Object>> storage_;
+  std::vector<const Object*> objects_;
+};
+
+/** Sphere which is never hit, derived classes should keep their overridden
+ * methods instead of copied geometry of the base class*/
+class HiddenSphere : public Sphere {
+ public:
+  using Sphere::Sphere;
+
+  std::optional<Real> GetClosesDist(const Ray& /*ray*/) const override {
+    return std::nullopt;
+  }
+};
+
+class AllAcceleratorTests
+    : public AcceleratorSceneTests,
+      public ::testing::WithParamInterface<AcceleratorType> {};
+
+std::string AcceleratorName(
+    const ::testing::TestParamInfo<AcceleratorType>& info) {
+  switch (info.param) {
+    case AcceleratorType::kBvh:
+      return "Bvh";
+    case AcceleratorType::kWideBvh:
+      return "WideBvh";
+    case AcceleratorType::kGrid:
+      return "Grid";
+    case AcceleratorType::kKdTree:
+      return "KdTree";
+  }
+  return "Unknown";
+}
+}  // namespace
+
+TEST(BoundingBoxTests, ExtendAndArea) {
+  BoundingBox box;
+  EXPECT_TRUE(box.IsEmpty());
+  EXPECT_EQ(box.GetSurfaceArea(), 0.0);
+  box.Extend(GeoVec{0, 0, 0}).Extend(GeoVec{1, 2, 3});
+  EXPECT_FALSE(box.IsEmpty());
+  EXPECT_EQ(box.GetSurfaceArea(), 2.0 * (2 + 6 + 3));
+  EXPECT_EQ(box.GetLongestAxis(), 2);
+  EXPECT_EQ(box.GetCenter(), GeoVec(0.5, 1, 1.5));
+  box.Extend(BoundingBox{});
+  EXPECT_EQ(box.min, GeoVec(0, 0, 0));
+  EXPECT_EQ(box.max, GeoVec(1, 2, 3));
+}
+
+TEST(BoundingBoxTests, ClipRay) {
+  BoundingBox box{{1, 1, 1}, {2, 3, 4}};
+  Real t_near = 0.0;
+  Real t_far = 100.0;
+  Real inf = std::numeric_limits<Real>::infinity();
+  EXPECT_TRUE(box.ClipRay({0, 2, 2}, {1, inf, inf}, t_near, t_far));
+  EXPECT_EQ(t_near, 1.0);
+  EXPECT_EQ(t_far, 2.0);
+  t_near = 0.0;
+  t_far = 100.0;
+  EXPECT_FALSE(box.ClipRay({0, 0, 0}, {-1, -1, -1}, t_near, t_far));
+}
+
+TEST_P(AllAcceleratorTests, SameHitAsLinearScan) {
+  std::unique_ptr<Accelerator> accel = CreateAccelerator(GetParam(), objects_);
+  EXPECT_GT(accel->GetMemorySize(), 0);
+  std::mt19937 rnd{11};
+  std::uniform_real_distribution<double> coor{-60.0, 60.0};
+  int hit_num = 0;
+  for (int i = 0; i < 5000; ++i) {
+    Ray ray{{coor(rnd), coor(rnd), coor(rnd)},
+            {coor(rnd), coor(rnd), coor(rnd)}};
+    std::optional<HitRecord> expected = LinearClosestHit(objects_, ray);
+    std::optional<HitRecord> actual = accel->GetClosestHit(ray);
+    ASSERT_EQ(expected.has_value(), actual.has_value());
+    if (!expected) continue;
+    ++hit_num;
+    EXPECT_REAL_EQ(expected->dist, actual->dist);
+    EXPECT_EQ(expected->obj, actual->obj);
+  }
+  EXPECT_GT(hit_num, 100);
+}
+
+TEST_P(AllAcceleratorTests, PacketsFindSameHits) {
+  std::unique_ptr<Accelerator> accel = CreateAccelerator(GetParam(), objects_);
+  std::mt19937 rnd{5};
+  std::uniform_real_distribution<double> coor{-60.0, 60.0};
+  // camera rays through a grid of points, more than fit into one packet
+  std::vector<Ray> rays;
+  for (int y = 0; y < 12; ++y) {
+    for (int x = 0; x < 12; ++x) {
+      rays.emplace_back(GeoVec{0, 0, 100}, GeoVec{x - 5.5, y - 5.5, -10.0});
+    }
+  }
+  // incoherent rays and ray going along a box plane
+  for (int i = 0; i < 40; ++i) {
+    rays.emplace_back(GeoVec{coor(rnd), coor(rnd), coor(rnd)},
+                      GeoVec{coor(rnd), coor(rnd), coor(rnd)});
+  }
+  rays.emplace_back(GeoVec{-60, -60, 0}, GeoVec{1, 0, 0});
+  std::vector<std::optional<HitRecord>> hits(rays.size());
+  accel->GetClosestHits(rays, hits.data());
+  int hit_num = 0;
+  for (size_t i = 0; i < rays.size(); ++i) {
+    std::optional<HitRecord> expected = accel->GetClosestHit(rays[i]);
+    ASSERT_EQ(hits[i].has_value(), expected.has_value()) << i;
+    if (!expected) continue;
+    ++hit_num;
+    EXPECT_REAL_EQ(hits[i]->dist, expected->dist) << i;
+    EXPECT_EQ(hits[i]->obj, expected->obj) << i;
+  }
+  EXPECT_GT(hit_num, 50);
+
+  std::unique_ptr<Accelerator> empty = CreateAccelerator(GetParam(), {});
+  empty->GetClosestHits(rays, hits.data());
+  EXPECT_EQ(std::count(hits.begin(), hits.end(), std::nullopt), rays.size());
+}
+
+TEST_P(AllAcceleratorTests, SmallScenes) {
+  EXPECT_FALSE(CreateAccelerator(GetParam(), {})->GetClosestHit(
+      Ray{{0, 0, 0}, {1, 0, 0}}));
+  Sphere ball{{5, 0, 0}, 1};
+  std::unique_ptr<Accelerator> single = CreateAccelerator(GetParam(), {&ball});
+  std::optional<HitRecord> hit =
+      single->GetClosestHit(Ray{{0, 0, 0}, {1, 0, 0}});
+  ASSERT_TRUE(hit);
+  EXPECT_EQ(hit->obj, &ball);
+  EXPECT_DOUBLE_EQ(hit->dist, 4);
+  EXPECT_FALSE(single->GetClosestHit(Ray{{0, 0, 0}, {-1, 0, 0}}));
+}
+
+TEST_P(AllAcceleratorTests, EveryPrimitiveKind) {
+  Sphere ball{{5, 0, 0}, 1};
+  HiddenSphere hidden{{3, 10, 0}, 1};
+  Triangle tri{{8, 29, -1}, {8, 30, 1}, {8, 31, -1}};
+  TriangleMesh mesh{{{8, 19, -1}, {8, 21, -1}, {8, 20, 1}}, {{0, 2, 1}}};
+  Transform transform;
+  transform.translation = {0, 20, 0};
+  Instance instance{mesh, transform};
+  EXPECT_EQ(GetPrimitiveKind(ball), PrimitiveKind::kSphere);
+  EXPECT_EQ(GetPrimitiveKind(hidden), PrimitiveKind::kOther);
+  EXPECT_EQ(GetPrimitiveKind(tri), PrimitiveKind::kTriangle);
+  EXPECT_EQ(GetPrimitiveKind(mesh), PrimitiveKind::kMesh);
+  EXPECT_EQ(GetPrimitiveKind(instance), PrimitiveKind::kInstance);
+
+  std::unique_ptr<Accelerator> accel = CreateAccelerator(
+      GetParam(), {&ball, &hidden, &tri, &mesh, &instance});
+  std::vector<std::pair<double, const Object*>> expected = {
+      {0, &ball}, {10, nullptr}, {20, &mesh}, {30, &tri}, {40, &instance}};
+  for (const auto& [y, obj] : expected) {
+    std::optional<HitRecord> hit =
+        accel->GetClosestHit(Ray{{0, y, 0}, {1, 0, 0}});
+    ASSERT_EQ(hit.has_value(), obj != nullptr) << y;
+    if (!hit) continue;
+    EXPECT_EQ(hit->obj, obj);
+    EXPECT_DOUBLE_EQ(hit->dist, obj == &ball ? 4.0 : 8.0);
+  }
+}
+
+TEST_P(AllAcceleratorTests, OcclusionAgreesWithClosestHit) {
+  std::unique_ptr<Accelerator> accel = CreateAccelerator(GetParam(), objects_);
+  std::mt19937 rnd{13};
+  std::uniform_real_distribution<double> coor{-60.0, 60.0};
+  std::uniform_real_distribution<double> bound{0.0, 150.0};
+  int occluded_num = 0;
+  int visible_hit_num = 0;
+  for (int i = 0; i < 5000; ++i) {
+    Ray ray{{coor(rnd), coor(rnd), coor(rnd)},
+            {coor(rnd), coor(rnd), coor(rnd)}};
+    Real max_dist = bound(rnd);
+    std::optional<HitRecord> hit = accel->GetClosestHit(ray);
+    bool expected = hit && hit->dist < max_dist;
+    ASSERT_EQ(accel->IsOccluded(ray, max_dist), expected) << i;
+    occluded_num += expected;
+    visible_hit_num += hit && !expected;
+  }
+  EXPECT_GT(occluded_num, 100);
+  EXPECT_GT(visible_hit_num, 100);
+  EXPECT_FALSE(CreateAccelerator(GetParam(), {})->IsOccluded(
+      Ray{{0, 0, 0}, {1, 0, 0}}, 100));
+}
+
+TEST_P(AllAcceleratorTests, SegmentOcclusionOfEveryPrimitiveKind) {
+  Sphere ball{{5, 0, 0}, 1};
+  HiddenSphere hidden{{3, 10, 0}, 1};
+  Triangle tri{{8, 29, -1}, {8, 30, 1}, {8, 31, -1}};
+  TriangleMesh mesh{{{8, 19, -1}, {8, 21, -1}, {8, 20, 1}}, {{0, 2, 1}}};
+  Transform transform;
+  transform.translation = {0, 20, 0};
+  Instance instance{mesh, transform};
+  std::unique_ptr<Accelerator> accel = CreateAccelerator(
+      GetParam(), {&ball, &hidden, &tri, &mesh, &instance});
+  std::vector<std::pair<double, bool>> expected = {
+      {0, true}, {10, false}, {20, true}, {30, true}, {40, true}};
+  for (const auto& [y, is_occluded] : expected) {
+    EXPECT_EQ(IsSegmentOccluded(*accel, {0, y, 0}, {12, y, 0}), is_occluded)
+        << y;
+    // segments which end before the object or on its surface
+    EXPECT_FALSE(IsSegmentOccluded(*accel, {0, y, 0}, {3.5, y, 0})) << y;
+  }
+  EXPECT_FALSE(IsSegmentOccluded(*accel, {0, 0, 0}, {4, 0, 0}));
+  EXPECT_FALSE(IsSegmentOccluded(*accel, {0, 20, 0}, {8, 20, 0}));
+}
+
+TEST_P(AllAcceleratorTests, AxisParallelRay) {
+  // ray starts on the plane of the triangle box and goes along it
+  Triangle floor{{0, 0, 0}, {10, 0, 0}, {0, 10, 0}};
+  Sphere ball{{5, 1, 0}, 0.5};
+  std::unique_ptr<Accelerator> accel =
+      CreateAccelerator(GetParam(), {&floor, &ball});
+  std::optional<HitRecord> hit =
+      accel->GetClosestHit(Ray{{0, 1, 0}, {1, 0, 0}});
+  ASSERT_TRUE(hit);
+  EXPECT_EQ(hit->obj, &ball);
+  EXPECT_DOUBLE_EQ(hit->dist, 4.5);
+}
+
+TEST_P(AllAcceleratorTests, RefitAfterObjectsMoved) {
+  std::unique_ptr<Accelerator> accel = CreateAccelerator(GetParam(), objects_);
+  std::mt19937 rnd{3};
+  std::uniform_real_distribution<double> shift{-5.0, 5.0};
+  for (auto& el : storage_) {
+    GeoVec move{shift(rnd), shift(rnd), shift(rnd)};
+    if (auto* sphere = dynamic_cast<Sphere*>(el.get())) {
+      sphere->SetCenter(sphere->GetCenter() + move);
+    } else if (auto* tri = dynamic_cast<Triangle*>(el.get())) {
+      tri->SetPoints(tri->GetPoint0() + move, tri->GetPoint1() + move,
+                     tri->GetPoint2() + move);
+    }
+  }
+  bool is_hierarchy = GetParam() == AcceleratorType::kBvh ||
+                      GetParam() == AcceleratorType::kWideBvh;
+  ASSERT_EQ(accel->Refit(), is_hierarchy);
+  if (!is_hierarchy) accel = CreateAccelerator(GetParam(), objects_);
+  std::mt19937 ray_rnd{12};
+  std::uniform_real_distribution<double> coor{-60.0, 60.0};
+  for (int i = 0; i < 2000; ++i) {
+    Ray ray{{coor(ray_rnd), coor(ray_rnd), coor(ray_rnd)},
+            {coor(ray_rnd), coor(ray_rnd), coor(ray_rnd)}};
+    std::optional<HitRecord> expected = LinearClosestHit(objects_, ray);
+    std::optional<HitRecord> actual = accel->GetClosestHit(ray);
+    ASSERT_EQ(expected.has_value(), actual.has_value());
+    if (!expected) continue;
+    EXPECT_REAL_EQ(expected->dist, actual->dist);
+    EXPECT_EQ(expected->obj, actual->obj);
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(AllTypes, AllAcceleratorTests,
+                         ::testing::Values(AcceleratorType::kBvh,
+                                           AcceleratorType::kWideBvh,
+                                           AcceleratorType::kGrid,
+                                           AcceleratorType::kKdTree),
+                         AcceleratorName);
+
+TEST_F(AcceleratorSceneTests, BvhLeavesContainEveryObjectOnce) {
+  Bvh bvh{objects_};
+  size_t leaf_objects = 0;
+  for (const auto& node : bvh.GetNodes()) {
+    leaf_objects += node.obj_num;
+  }
+  EXPECT_EQ(leaf_objects, objects_.size());
+  EXPECT_EQ(bvh.GetObjects().size(), objects_.size());
+  EXPECT_LT(bvh.GetNodes().size(), 2 * objects_.size());
+}
+
+TEST_F(AcceleratorSceneTests, WideBvhNodesAreCacheAligned) {
+  WideBvh bvh{objects_};
+  EXPECT_EQ(sizeof(WideBvhNode) % 64, 0);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(bvh.GetNodes().data()) % 64, 0);
+  EXPECT_LT(bvh.GetNodes().size(), objects_.size());
+}
+
+TEST_F(AcceleratorSceneTests, GridResolutionFollowsObjectNumber) {
+  Grid grid{objects_};
+  const std::array<size_t, 3>& res = grid.GetResolution();
+  size_t cell_num = res[0] * res[1] * res[2];
+  EXPECT_GT(cell_num, objects_.size());
+  EXPECT_LT(cell_num, 8 * objects_.size());
+}
+
+TEST_F(AcceleratorSceneTests, RefitCostGrowsWhenObjectsScatter) {
+  Bvh bvh{objects_};
+  WideBvh wide_bvh{objects_};
+  double bvh_cost = bvh.GetCost();
+  double wide_cost = wide_bvh.GetCost();
+  EXPECT_GT(bvh_cost, 0.0);
+  EXPECT_GT(wide_cost, 0.0);
+  // refit without motion keeps the same tree
+  ASSERT_TRUE(bvh.Refit());
+  ASSERT_TRUE(wide_bvh.Refit());
+  EXPECT_DOUBLE_EQ(bvh.GetCost(), bvh_cost);
+  EXPECT_DOUBLE_EQ(wide_bvh.GetCost(), wide_cost);
+  // spheres swap places, so leaves contain objects from the whole scene
+  std::vector<Sphere*> spheres;
+  for (auto& el : storage_) {
+    if (auto* sphere = dynamic_cast<Sphere*>(el.get())) {
+      spheres.push_back(sphere);
+    }
+  }
+  std::vector<GeoVec> centers;
+  for (const Sphere* sphere : spheres) centers.push_back(sphere->GetCenter());
+  std::shuffle(centers.begin(), centers.end(), std::mt19937{1});
+  for (size_t i = 0; i < spheres.size(); ++i) spheres[i]->SetCenter(centers[i]);
+  ASSERT_TRUE(bvh.Refit());
+  ASSERT_TRUE(wide_bvh.Refit());
+  EXPECT_GT(bvh.GetCost(), 1.5 * Bvh{objects_}.GetCost());
+  EXPECT_GT(wide_bvh.GetCost(), 1.5 * WideBvh{objects_}.GetCost());
+}
+
+TEST(BvhTests, ParallelBuildGivesSameTree) {
+  std::mt19937 rnd{5};
+  std::uniform_real_distribution<double> coor{-100.0, 100.0};
+  std::uniform_real_distribution<double> shift{-1.0, 1.0};
+  std::vector<std::unique_ptr<Object>> storage;
+  std::vector<const Object*> objects;
+  for (int i = 0; i < 50000; ++i) {
+    GeoVec p{coor(rnd), coor(rnd), coor(rnd)};
+    storage.push_back(std::make_unique<Triangle>(
+        p, p + GeoVec{shift(rnd), shift(rnd), shift(rnd)},
+        p + GeoVec{shift(rnd), shift(rnd), shift(rnd)}));
+    objects.push_back(storage.back().get());
+  }
+  Bvh single{objects};
+  ThreadPool pool{4};
+  Bvh parallel{objects, &pool};
+  ASSERT_EQ(single.GetNodes().size(), parallel.GetNodes().size());
+  for (size_t i = 0; i < single.GetNodes().size(); ++i) {
+    const BvhNode& lhs = single.GetNodes()[i];
+    const BvhNode& rhs = parallel.GetNodes()[i];
+    ASSERT_EQ(lhs.box.min, rhs.box.min);
+    ASSERT_EQ(lhs.box.max, rhs.box.max);
+    ASSERT_EQ(lhs.offset, rhs.offset);
+    ASSERT_EQ(lhs.obj_num, rhs.obj_num);
+    ASSERT_EQ(lhs.axis, rhs.axis);
+  }
+  EXPECT_EQ(single.GetObjects(), parallel.GetObjects());
+}
+
+TEST(RayPacketTests, EmptyPacketHasNoRays) {
+  std::vector<Ray> rays;
+  RayPacket packet{ArrayView<Ray>{rays}};
+  EXPECT_EQ(packet.size, 0);
+  EXPECT_EQ(packet.GetAllMask(), 0);
+  EXPECT_FALSE(packet.is_coherent);
+}
@@ -0,0 +1,72 @@
+﻿#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <string>
+
+#include "AccumulationBuffer.h"
+
+TEST(AccumulationBufferTests, PixelAverage) {
+  PixelAccum px;
+  EXPECT_EQ(px.GetColor(), colors::kBlack);
+  px.Add(Color{10, 20, 30});
+  px.Add(Color{21, 40, 0});
+  px.Add(colors::kNoColor);
+  EXPECT_EQ(px.sample_num, 2);
+  // the same rounding as Color::GetAverageColor
+  EXPECT_EQ(px.GetColor(),
+            Color::GetAverageColor({Color{10, 20, 30}, Color{21, 40, 0}}));
+
+  PixelAccum other;
+  other.Add(Color{255, 255, 255});
+  px.Add(other);
+  EXPECT_EQ(px.sample_num, 3);
+  EXPECT_EQ(px.GetColor(), Color(95, 105, 95));
+}
+
+TEST(AccumulationBufferTests, GetColors) {
+  AccumulationBuffer buffer{3, 2};
+  EXPECT_EQ(buffer.GetWidth(), 3);
+  EXPECT_EQ(buffer.GetHeight(), 2);
+  ASSERT_EQ(buffer.GetPixels().size(), 6);
+  buffer[4].Add(colors::kRed);
+  std::vector<Color> colors = buffer.GetColors();
+  ASSERT_EQ(colors.size(), 6);
+  EXPECT_EQ(colors[4], colors::kRed);
+  EXPECT_EQ(colors[0], colors::kBlack);
+}
+
+TEST(AccumulationBufferTests, SaveAndAddRaw) {
+  std::string lhs_file = "test_lhs_part.raw";
+  std::string rhs_file = "test_rhs_part.raw";
+  AccumulationBuffer lhs{4, 2};
+  lhs[1].Add(Color{10, 20, 30});
+  lhs[2].Add(Color{100, 0, 0});
+  lhs[6].Add(Color{1, 1, 1});
+  ASSERT_TRUE(lhs.SaveRaw(lhs_file, 1, 3));
+  AccumulationBuffer rhs{4, 2};
+  rhs[2].Add(Color{200, 50, 10});
+  rhs[7].Add(colors::kWhite);
+  ASSERT_TRUE(rhs.SaveRaw(rhs_file, 0, 8));
+  EXPECT_FALSE(rhs.SaveRaw(rhs_file + ".bad", 5, 9));
+
+  std::optional<AccumulationBuffer> merged =
+      AccumulationBuffer::LoadRaw(lhs_file);
+  ASSERT_TRUE(merged);
+  EXPECT_EQ(merged->GetWidth(), 4);
+  EXPECT_EQ(merged->GetHeight(), 2);
+  ASSERT_TRUE(merged->AddRaw(rhs_file));
+  EXPECT_EQ((*merged)[1].sample_num, 1);
+  EXPECT_EQ((*merged)[1].GetColor(), Color(10, 20, 30));
+  EXPECT_EQ((*merged)[2].sample_num, 2);
+  EXPECT_EQ((*merged)[2].GetColor(), Color(150, 25, 5));
+  // pixel 6 was outside of the saved range
+  EXPECT_EQ((*merged)[6].sample_num, 0);
+  EXPECT_EQ((*merged)[7].GetColor(), colors::kWhite);
+
+  AccumulationBuffer other_size{2, 4};
+  EXPECT_FALSE(other_size.AddRaw(lhs_file));
+  EXPECT_FALSE(other_size.AddRaw("not_existing_file.raw"));
+  EXPECT_FALSE(AccumulationBuffer::LoadRaw("not_existing_file.raw"));
+  std::filesystem::remove(lhs_file);
+  std::filesystem::remove(rhs_file);
+}
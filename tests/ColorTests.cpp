@@ -1,6 +1,8 @@
 ﻿#include <gtest/gtest.h>
 
+#include <random>
 #include <sstream>
+#include <vector>
 
 #include "Color.h"
 
@@ -36,3 +38,34 @@ TEST(ColorTests, Truncation) {
     EXPECT_EQ(g.blue, 51);
   }
 }
+
+TEST(ColorTests, TraceGivesSameColorAsTruncatedVector) {
+  std::mt19937 rnd{11};
+  std::uniform_int_distribution<int> channel{0, 255};
+  // few distinct values make truncations merge levels
+  std::uniform_int_distribution<int> coarse{0, 4};
+  std::vector<Color> colors;
+  ColorTrace trace;
+  EXPECT_EQ(trace.GetColor(colors::kNoColor).red, 0.0);
+  for (int i = 0; i < 300; ++i) {
+    Color col;
+    if (i % 37 != 36) {
+      col = i % 2
+                ? Color{channel(rnd), channel(rnd), channel(rnd)}
+                : Color{64 * coarse(rnd), 64 * coarse(rnd), 64 * coarse(rnd)};
+    }
+    colors.push_back(col);
+    trace.Push(col);
+    Color light{channel(rnd), channel(rnd), channel(rnd)};
+    std::vector<Color> truncated = colors;
+    truncated.push_back(light);
+    Color::TruncColorsInTrace(truncated);
+    // unrounded color gives the vector average after rounding down
+    Radiance actual = trace.GetColor(light);
+    EXPECT_EQ(Color(actual.red, actual.green, actual.blue),
+              Color::GetAverageColor(truncated))
+        << i;
+    EXPECT_EQ(trace.GetColorNumber(),
+              static_cast<size_t>(i + 1 - (i + 1) / 37));
+  }
+}
@@ -1,12 +1,15 @@
 ﻿#include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <array>
 #include <filesystem>
 #include <fstream>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "Config.h"
+#include "SphereSet.h"
 
 using ::testing::Each;
 using ::testing::NotNull;
@@ -37,6 +40,25 @@ class RAIIConfigFile {
   std::string created_file_;
 };
 
+/** Checks that mesh has the same faces in any order, points of every face
+ * can be rotated but keep their winding*/
+void ExpectSameFaces(const TriangleMesh& mesh,
+                     const std::vector<std::array<GeoVec, 3>>& expected) {
+  ASSERT_EQ(mesh.GetTriangleNumber(), expected.size());
+  std::vector<bool> is_found(expected.size(), false);
+  for (size_t face = 0; face < mesh.GetTriangleNumber(); ++face) {
+    std::array<GeoVec, 3> tri = mesh.GetTriangle(face);
+    for (size_t i = 0; i < expected.size(); ++i) {
+      for (size_t shift = 0; shift < 3 && !is_found[i]; ++shift) {
+        is_found[i] = tri[0] == expected[i][shift] &&
+                      tri[1] == expected[i][(shift + 1) % 3] &&
+                      tri[2] == expected[i][(shift + 2) % 3];
+      }
+    }
+  }
+  EXPECT_THAT(is_found, Each(true));
+}
+
 }  // namespace
 
 TEST(ConfigTest, ParsingGeneralOptioins1) {
@@ -47,6 +69,15 @@ TEST(ConfigTest, ParsingGeneralOptioins1) {
                     {"number_of_samples_per_pixel", 345},
                     {"pic_width_in_pixel", 1200},
                     {"pic_height_in_pixel", 798},
+                    {"number_of_threads", 3},
+                    {"seed", 1234},
+                    {"number_of_samples_per_pass", 5},
+                    {"snapshot_interval_in_seconds", 2.5},
+                    {"tile_order", "Morton"},
+                    {"ray_packet_side", 8},
+                    {"accelerator", "kd_tree"},
+                    {"refit_cost_ratio", 2.5},
+                    {"light_sampling", false},
                     {"output_file", "test_output.png"}};
   std::unique_ptr<RAIIConfigFile> config_file =
       RAIIConfigFile::CreateFile(file_name, cfg.dump());
@@ -58,6 +89,15 @@ TEST(ConfigTest, ParsingGeneralOptioins1) {
   EXPECT_EQ(res->sample_per_pixel, 345);
   EXPECT_EQ(res->pic_width_in_pixel, 1200);
   EXPECT_EQ(res->pic_height_in_pixel, 798);
+  EXPECT_EQ(res->thread_number, 3);
+  EXPECT_EQ(res->seed, 1234);
+  EXPECT_EQ(res->samples_per_pass, 5);
+  EXPECT_DOUBLE_EQ(res->snapshot_interval_in_sec, 2.5);
+  EXPECT_EQ(res->tile_order, TileOrder::kMorton);
+  EXPECT_EQ(res->ray_packet_side, 8);
+  EXPECT_EQ(res->accelerator, AcceleratorType::kKdTree);
+  EXPECT_DOUBLE_EQ(res->refit_cost_ratio, 2.5);
+  EXPECT_FALSE(res->light_sampling);
   EXPECT_EQ(res->out_file_name, "test_output.png");
 }
 
@@ -90,6 +130,42 @@ TEST(ConfigTest, ParsingGeneralOptions2) {
     const std::optional<GeneralSettings>& res = test.GetGeneralSettings();
     EXPECT_FALSE(res);
   }
+  {
+    // unknown tile order
+    std::string file_name = "test_config.json";
+    nlohmann::json cfg;
+    cfg["general"] = {{"tile_order", "zigzag"}};
+    std::unique_ptr<RAIIConfigFile> config_file =
+        RAIIConfigFile::CreateFile(file_name, cfg.dump());
+    ASSERT_TRUE(config_file);
+    Config test{file_name};
+    const std::optional<GeneralSettings>& res = test.GetGeneralSettings();
+    EXPECT_FALSE(res);
+  }
+  {
+    // packet does not fit into 64 rays
+    std::string file_name = "test_config.json";
+    nlohmann::json cfg;
+    cfg["general"] = {{"ray_packet_side", 9}};
+    std::unique_ptr<RAIIConfigFile> config_file =
+        RAIIConfigFile::CreateFile(file_name, cfg.dump());
+    ASSERT_TRUE(config_file);
+    Config test{file_name};
+    const std::optional<GeneralSettings>& res = test.GetGeneralSettings();
+    EXPECT_FALSE(res);
+  }
+  {
+    // unknown accelerator
+    std::string file_name = "test_config.json";
+    nlohmann::json cfg;
+    cfg["general"] = {{"accelerator", "octree"}};
+    std::unique_ptr<RAIIConfigFile> config_file =
+        RAIIConfigFile::CreateFile(file_name, cfg.dump());
+    ASSERT_TRUE(config_file);
+    Config test{file_name};
+    const std::optional<GeneralSettings>& res = test.GetGeneralSettings();
+    EXPECT_FALSE(res);
+  }
 }
 
 TEST(ConfigTest, ParsingGeneralOptioins3) {
@@ -107,6 +183,14 @@ TEST(ConfigTest, ParsingGeneralOptioins3) {
   EXPECT_EQ(res->sample_per_pixel, 500);
   EXPECT_EQ(res->pic_width_in_pixel, 600);
   EXPECT_EQ(res->pic_height_in_pixel, 400);
+  EXPECT_EQ(res->thread_number, 0);
+  EXPECT_EQ(res->seed, 0);
+  EXPECT_EQ(res->samples_per_pass, 0);
+  EXPECT_DOUBLE_EQ(res->snapshot_interval_in_sec, 0.0);
+  EXPECT_EQ(res->tile_order, TileOrder::kHilbert);
+  EXPECT_EQ(res->ray_packet_side, 0);
+  EXPECT_EQ(res->accelerator, AcceleratorType::kWideBvh);
+  EXPECT_TRUE(res->light_sampling);
   EXPECT_EQ(res->out_file_name, "path_tracer_output.png");
 }
 
@@ -291,52 +375,21 @@ TEST(ConfigTest, ParsingObjectOption3) {
   ASSERT_TRUE(config_file);
   Config test(file_name);
   std::vector<const Object*> res = test.GetObjects();
-  ASSERT_EQ(res.size(), 4);
+  ASSERT_EQ(res.size(), 1);
   ASSERT_THAT(res, Each(NotNull()));
-  {
-    const auto* tri = dynamic_cast<const Triangle*>(res[0]);
-    ASSERT_THAT(tri, NotNull());
-    EXPECT_EQ(tri->GetColor(), colors::kNoColor);
-    EXPECT_EQ(tri->GetMaterial(), Material::kReflective);
-    EXPECT_DOUBLE_EQ(tri->GetPolishness(), 1.0);
-    EXPECT_DOUBLE_EQ(tri->GetReflectionCoefficient(), 0.2);
-    EXPECT_EQ(tri->GetPoint0(), GeoVec(1, 2, 3));
-    EXPECT_EQ(tri->GetPoint1(), GeoVec(4, 5.6, 6));
-    EXPECT_EQ(tri->GetPoint2(), GeoVec(7.2, 8.3, 9));
-  }
-  {
-    const auto* tri = dynamic_cast<const Triangle*>(res[1]);
-    ASSERT_THAT(tri, NotNull());
-    EXPECT_EQ(tri->GetColor(), colors::kNoColor);
-    EXPECT_EQ(tri->GetMaterial(), Material::kReflective);
-    EXPECT_DOUBLE_EQ(tri->GetPolishness(), 1.0);
-    EXPECT_DOUBLE_EQ(tri->GetReflectionCoefficient(), 0.2);
-    EXPECT_EQ(tri->GetPoint0(), GeoVec(1, 2, 3));
-    EXPECT_EQ(tri->GetPoint1(), GeoVec(4, 5.6, 6));
-    EXPECT_EQ(tri->GetPoint2(), GeoVec(-5, -10, -3.7));
-  }
-  {
-    const auto* tri = dynamic_cast<const Triangle*>(res[2]);
-    ASSERT_THAT(tri, NotNull());
-    EXPECT_EQ(tri->GetColor(), colors::kNoColor);
-    EXPECT_EQ(tri->GetMaterial(), Material::kReflective);
-    EXPECT_DOUBLE_EQ(tri->GetPolishness(), 1.0);
-    EXPECT_DOUBLE_EQ(tri->GetReflectionCoefficient(), 0.2);
-    EXPECT_EQ(tri->GetPoint0(), GeoVec(-5, -10, -3.7));
-    EXPECT_EQ(tri->GetPoint1(), GeoVec(7.2, 8.3, 9));
-    EXPECT_EQ(tri->GetPoint2(), GeoVec(4, 5.6, 6));
-  }
-  {
-    const auto* tri = dynamic_cast<const Triangle*>(res[3]);
-    ASSERT_THAT(tri, NotNull());
-    EXPECT_EQ(tri->GetColor(), colors::kNoColor);
-    EXPECT_EQ(tri->GetMaterial(), Material::kReflective);
-    EXPECT_DOUBLE_EQ(tri->GetPolishness(), 1.0);
-    EXPECT_DOUBLE_EQ(tri->GetReflectionCoefficient(), 0.2);
-    EXPECT_EQ(tri->GetPoint2(), GeoVec(-5, -10, -3.7));
-    EXPECT_EQ(tri->GetPoint0(), GeoVec(7.2, 8.3, 9));
-    EXPECT_EQ(tri->GetPoint1(), GeoVec(1, 2, 3));
-  }
+  const auto* mesh = dynamic_cast<const TriangleMesh*>(res[0]);
+  ASSERT_THAT(mesh, NotNull());
+  EXPECT_EQ(mesh->GetColor(), colors::kNoColor);
+  EXPECT_EQ(mesh->GetMaterial(), Material::kReflective);
+  EXPECT_DOUBLE_EQ(mesh->GetPolishness(), 1.0);
+  EXPECT_DOUBLE_EQ(mesh->GetReflectionCoefficient(), 0.2);
+  EXPECT_EQ(mesh->GetVertexNumber(), 4);
+  ExpectSameFaces(
+      *mesh,
+      {{GeoVec(1, 2, 3), GeoVec(4, 5.6, 6), GeoVec(7.2, 8.3, 9)},
+       {GeoVec(1, 2, 3), GeoVec(4, 5.6, 6), GeoVec(-5, -10, -3.7)},
+       {GeoVec(-5, -10, -3.7), GeoVec(7.2, 8.3, 9), GeoVec(4, 5.6, 6)},
+       {GeoVec(7.2, 8.3, 9), GeoVec(1, 2, 3), GeoVec(-5, -10, -3.7)}});
 }
 
 TEST(ConfigTest, ParsingObjectOption4) {
@@ -360,50 +413,132 @@ TEST(ConfigTest, ParsingObjectOption4) {
   ASSERT_TRUE(config_file);
   Config test(file_name);
   std::vector<const Object*> res = test.GetObjects();
-  ASSERT_EQ(res.size(), 4);
+  ASSERT_EQ(res.size(), 1);
   ASSERT_THAT(res, Each(NotNull()));
+  const auto* mesh = dynamic_cast<const TriangleMesh*>(res[0]);
+  ASSERT_THAT(mesh, NotNull());
+  EXPECT_EQ(mesh->GetColor(), colors::kGreen);
+  EXPECT_EQ(mesh->GetMaterial(), Material::kReflective);
+  EXPECT_DOUBLE_EQ(mesh->GetPolishness(), 1.0);
+  EXPECT_DOUBLE_EQ(mesh->GetReflectionCoefficient(), 0.2);
+  EXPECT_EQ(mesh->GetVertexNumber(), 4);
+  ExpectSameFaces(
+      *mesh,
+      {{GeoVec(1, 2, 3), GeoVec(4, 5.6, 6), GeoVec(7.2, 8.3, 9)},
+       {GeoVec(1, 2, 3), GeoVec(4, 5.6, 6), GeoVec(-5, -10, -3.7)},
+       {GeoVec(-5, -10, -3.7), GeoVec(7.2, 8.3, 9), GeoVec(4, 5.6, 6)},
+       {GeoVec(7.2, 8.3, 9), GeoVec(1, 2, 3), GeoVec(-5, -10, -3.7)}});
+}
+
+TEST(ConfigTest, ParsingObjectOption5) {
+  // Parsing sphere sets with shared and own radii
+  std::string file_name = "test_config.json";
+  nlohmann::json cfg;
+  cfg["objects"] = {{{"color", "red"},
+                     {"is_light_source", true},
+                     {"type", "spheres"},
+                     {"radius", 0.5},
+                     {"centers", {{0, 0, 0}, {2, 0, 0}}}},
+                    {{"color", "red"},
+                     {"is_light_source", false},
+                     {"type", "spheres"},
+                     {"radii", {1.0, 2.0, 3.0}},
+                     {"centers", {{0, 0, 0}, {2, 0, 0}, {0, 5, 0}}}},
+                    {{"is_light_source", false},
+                     {"type", "spheres"},
+                     {"radii", {1.0}},
+                     {"centers", {{0, 0, 0}, {2, 0, 0}}}}};
+  std::unique_ptr<RAIIConfigFile> config_file =
+      RAIIConfigFile::CreateFile(file_name, cfg.dump());
+  ASSERT_TRUE(config_file);
+  Config test(file_name);
+  std::vector<const Object*> res = test.GetObjects();
+  ASSERT_EQ(res.size(), 2);
+  const auto* lamps = dynamic_cast<const SphereSet*>(res[0]);
+  ASSERT_THAT(lamps, NotNull());
+  EXPECT_EQ(lamps->GetSphereNumber(), 2);
+  EXPECT_EQ(lamps->GetColor(), colors::kRed);
+  EXPECT_EQ(lamps->GetMaterial(), Material::kLightSource);
+  EXPECT_EQ(lamps->GetBoundingBox().max, GeoVec(2.5, 0.5, 0.5));
+  const auto* balls = dynamic_cast<const SphereSet*>(res[1]);
+  ASSERT_THAT(balls, NotNull());
+  EXPECT_EQ(balls->GetSphereNumber(), 3);
+  EXPECT_EQ(balls->GetMaterial(), Material::kReflective);
+  EXPECT_EQ(balls->GetBoundingBox().min, GeoVec(-3, -2, -3));
+}
+
+TEST(ConfigTest, UpdateGeometryFromNextFrame) {
+  std::string file_name = "test_config.json";
+  nlohmann::json sphere = {{"type", "sphere"},
+                           {"center", {1, 2, 3}},
+                           {"radius", 2.0},
+                           {"is_light_source", true}};
+  nlohmann::json triangles = {{"type", "triangles"},
+                              {"is_light_source", false},
+                              {"points", {{0, 0, 0}, {1, 0, 0}, {0, 1, 0}}},
+                              {"faces", {{0, 1, 2}}}};
+  nlohmann::json spheres = {{"type", "spheres"},
+                            {"radius", 1.0},
+                            {"centers", {{0, 0, 0}, {5, 0, 0}}},
+                            {"is_light_source", false}};
+  nlohmann::json cfg;
+  cfg["objects"] = {sphere, triangles, spheres};
+  std::optional<Config> first;
   {
-    const auto* tri = dynamic_cast<const Triangle*>(res[0]);
-    ASSERT_THAT(tri, NotNull());
-    EXPECT_EQ(tri->GetColor(), colors::kGreen);
-    EXPECT_EQ(tri->GetMaterial(), Material::kReflective);
-    EXPECT_DOUBLE_EQ(tri->GetPolishness(), 1.0);
-    EXPECT_DOUBLE_EQ(tri->GetReflectionCoefficient(), 0.2);
-    EXPECT_EQ(tri->GetPoint0(), GeoVec(1, 2, 3));
-    EXPECT_EQ(tri->GetPoint1(), GeoVec(4, 5.6, 6));
-    EXPECT_EQ(tri->GetPoint2(), GeoVec(7.2, 8.3, 9));
+    auto config_file = RAIIConfigFile::CreateFile(file_name, cfg.dump());
+    ASSERT_TRUE(config_file);
+    first.emplace(file_name);
   }
+  std::vector<const Object*> objects = first->GetObjects();
+  ASSERT_EQ(objects.size(), 3);
+
+  sphere["center"] = {4, 5, 6};
+  triangles["points"] = {{0, 0, 1}, {1, 0, 1}, {0, 1, 1}};
+  spheres["centers"] = {{0, 0, 10}, {5, 0, 10}};
+  cfg["objects"] = {sphere, triangles, spheres};
   {
-    const auto* tri = dynamic_cast<const Triangle*>(res[1]);
-    ASSERT_THAT(tri, NotNull());
-    EXPECT_EQ(tri->GetColor(), colors::kGreen);
-    EXPECT_EQ(tri->GetMaterial(), Material::kReflective);
-    EXPECT_DOUBLE_EQ(tri->GetPolishness(), 1.0);
-    EXPECT_DOUBLE_EQ(tri->GetReflectionCoefficient(), 0.2);
-    EXPECT_EQ(tri->GetPoint0(), GeoVec(1, 2, 3));
-    EXPECT_EQ(tri->GetPoint1(), GeoVec(4, 5.6, 6));
-    EXPECT_EQ(tri->GetPoint2(), GeoVec(-5, -10, -3.7));
+    auto config_file = RAIIConfigFile::CreateFile(file_name, cfg.dump());
+    ASSERT_TRUE(config_file);
+    Config frame = Config::ReadFrame(file_name);
+    // frame objects only carry positions
+    EXPECT_FALSE(frame.GetObjects()[1]->GetClosesDist(
+        Ray{{0.25, 0.25, 2}, {0, 0, -1}}));
+    EXPECT_TRUE(first->UpdateGeometry(frame));
+  }
+  EXPECT_EQ(first->GetObjects(), objects);
+  EXPECT_EQ(static_cast<const Sphere*>(objects[0])->GetCenter(),
+            GeoVec(4, 5, 6));
+  const auto* mesh = static_cast<const TriangleMesh*>(objects[1]);
+  EXPECT_EQ(mesh->GetBoundingBox().min, GeoVec(0, 0, 1));
+  Ray ray{{0.25, 0.25, 2}, {0, 0, -1}};
+  EXPECT_DOUBLE_EQ(mesh->GetClosesDist(ray).value_or(0.0), 1.0);
+  EXPECT_EQ(objects[2]->GetBoundingBox().min, GeoVec(-1, -1, 9));
+
+  // sphere sets keep their number of spheres
+  spheres["centers"] = {{0, 0, 0}};
+  cfg["objects"] = {sphere, triangles, spheres};
+  {
+    auto config_file = RAIIConfigFile::CreateFile(file_name, cfg.dump());
+    ASSERT_TRUE(config_file);
+    Config frame{file_name};
+    EXPECT_FALSE(first->UpdateGeometry(frame));
   }
+
+  // objects of other types or other number of objects change topology
+  cfg["objects"] = {triangles, sphere};
   {
-    const auto* tri = dynamic_cast<const Triangle*>(res[2]);
-    ASSERT_THAT(tri, NotNull());
-    EXPECT_EQ(tri->GetColor(), colors::kGreen);
-    EXPECT_EQ(tri->GetMaterial(), Material::kReflective);
-    EXPECT_DOUBLE_EQ(tri->GetPolishness(), 1.0);
-    EXPECT_DOUBLE_EQ(tri->GetReflectionCoefficient(), 0.2);
-    EXPECT_EQ(tri->GetPoint0(), GeoVec(-5, -10, -3.7));
-    EXPECT_EQ(tri->GetPoint1(), GeoVec(7.2, 8.3, 9));
-    EXPECT_EQ(tri->GetPoint2(), GeoVec(4, 5.6, 6));
+    auto config_file = RAIIConfigFile::CreateFile(file_name, cfg.dump());
+    ASSERT_TRUE(config_file);
+    Config frame{file_name};
+    EXPECT_FALSE(first->UpdateGeometry(frame));
   }
+  cfg["objects"] = {sphere};
   {
-    const auto* tri = dynamic_cast<const Triangle*>(res[3]);
-    ASSERT_THAT(tri, NotNull());
-    EXPECT_EQ(tri->GetColor(), colors::kGreen);
-    EXPECT_EQ(tri->GetMaterial(), Material::kReflective);
-    EXPECT_DOUBLE_EQ(tri->GetPolishness(), 1.0);
-    EXPECT_DOUBLE_EQ(tri->GetReflectionCoefficient(), 0.2);
-    EXPECT_EQ(tri->GetPoint2(), GeoVec(-5, -10, -3.7));
-    EXPECT_EQ(tri->GetPoint0(), GeoVec(7.2, 8.3, 9));
-    EXPECT_EQ(tri->GetPoint1(), GeoVec(1, 2, 3));
+    auto config_file = RAIIConfigFile::CreateFile(file_name, cfg.dump());
+    ASSERT_TRUE(config_file);
+    Config frame{file_name};
+    EXPECT_FALSE(first->UpdateGeometry(frame));
   }
+  EXPECT_EQ(static_cast<const Sphere*>(objects[0])->GetCenter(),
+            GeoVec(4, 5, 6));
 }
@@ -1,6 +1,7 @@
 ﻿#include <gtest/gtest.h>
 
 #include "GeoVec.h"
+#include "RealExpect.h"
 
 TEST(GeoVecTests, Creation) {
   GeoVec x0{1, 2, 3};
@@ -19,17 +20,17 @@ TEST(GeoVecTests, Length) {
   EXPECT_EQ(x1.Len(), 5);
 
   GeoVec x2{-4, 2, -3};
-  EXPECT_EQ(x2.Len(), std::sqrt(29));
+  EXPECT_EQ(x2.Len(), std::sqrt(Real{29}));
 }
 
 TEST(GeoVecTests, Norm) {
   GeoVec x0{0, -4, 3};
   x0.Norm();
 
-  EXPECT_DOUBLE_EQ(x0.Len(), 1);
-  EXPECT_DOUBLE_EQ(x0.x_, 0);
-  EXPECT_DOUBLE_EQ(x0.y_, -0.8);
-  EXPECT_DOUBLE_EQ(x0.z_, 0.6);
+  EXPECT_REAL_EQ(x0.Len(), 1);
+  EXPECT_REAL_EQ(x0.x_, 0);
+  EXPECT_REAL_EQ(x0.y_, -0.8);
+  EXPECT_REAL_EQ(x0.z_, 0.6);
 
 #ifndef NDEBUG
   GeoVec x1{0, 0, 0};
@@ -82,24 +83,24 @@ TEST(GeoVecTests, Cross) {
 }
 
 TEST(GeoVecTests, Operators) {
-  GeoVec x0{1, -2, M_PI};
-  GeoVec x1{6.0, 9.0, -3 * M_PI};
+  GeoVec x0{1, -2, 0.375};
+  GeoVec x1{6.0, 9.0, -1.125};
 
-  GeoVec res1{2.0, 3.0, -M_PI};
+  GeoVec res1{2.0, 3.0, -0.375};
   EXPECT_EQ(x1 / 3, res1);
 
 #ifndef NDEBUG
   EXPECT_DEATH(x1 / 0, "");
 #endif  // NDEBUG
-  GeoVec res2{12.0, 18.0, -6 * M_PI};
+  GeoVec res2{12.0, 18.0, -2.25};
   EXPECT_EQ(res2, x1 * 2);
   EXPECT_EQ(res2, 2 * x1);
 
-  GeoVec res3{7.0, 7.0, -2 * M_PI};
+  GeoVec res3{7.0, 7.0, -0.75};
   EXPECT_EQ(res3, x1 + x0);
   EXPECT_EQ(res3, x0 + x1);
 
-  GeoVec res4{5.0, 11.0, -4 * M_PI};
+  GeoVec res4{5.0, 11.0, -1.5};
   EXPECT_EQ(res4, x1 - x0);
   EXPECT_EQ(res4, -x0 + x1);
 }
@@ -109,6 +110,38 @@ TEST(GeoVecTests, GetDistance) {
   GeoVec p2{3, 4, 5};
 
   EXPECT_EQ(dist_btw_points(p1, p1), 0);
-  EXPECT_EQ(dist_btw_points(p1, p2), std::sqrt(27));
-  EXPECT_EQ(dist_btw_points(p2, p1), std::sqrt(27));
+  EXPECT_EQ(dist_btw_points(p1, p2), std::sqrt(Real{27}));
+  EXPECT_EQ(dist_btw_points(p2, p1), std::sqrt(Real{27}));
+}
+
+TEST(GeoVecTests, WideOperations) {
+  GeoVec lhs[GeoVec8::kWidth];
+  GeoVec rhs[GeoVec8::kWidth];
+  for (size_t i = 0; i < GeoVec8::kWidth; ++i) {
+    lhs[i] = GeoVec{1.0 + i, -2.0 * i, 0.5};
+    rhs[i] = GeoVec{-3.0, 0.25 * i, 4.0 - i};
+  }
+  GeoVec8 wide_lhs{lhs};
+  GeoVec8 wide_rhs{rhs};
+
+  Real len[GeoVec8::kWidth];
+  Real dot[GeoVec8::kWidth];
+  wide_lhs.Len(len);
+  wide_lhs.Dot(wide_rhs, dot);
+  GeoVec8 cross = wide_lhs.Cross(wide_rhs);
+  GeoVec8 norm = wide_lhs;
+  norm.Norm();
+  for (size_t i = 0; i < GeoVec8::kWidth; ++i) {
+    EXPECT_REAL_EQ(len[i], lhs[i].Len());
+    EXPECT_REAL_EQ(dot[i], lhs[i].Dot(rhs[i]));
+    GeoVec exp_cross = lhs[i].Cross(rhs[i]);
+    EXPECT_REAL_EQ(cross.x_[i], exp_cross.x_);
+    EXPECT_REAL_EQ(cross.y_[i], exp_cross.y_);
+    EXPECT_REAL_EQ(cross.z_[i], exp_cross.z_);
+    GeoVec exp_norm = lhs[i];
+    exp_norm.Norm();
+    EXPECT_REAL_EQ(norm.Get(i).x_, exp_norm.x_);
+    EXPECT_REAL_EQ(norm.Get(i).y_, exp_norm.y_);
+    EXPECT_REAL_EQ(norm.Get(i).z_, exp_norm.z_);
+  }
 }
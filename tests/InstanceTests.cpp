@@ -0,0 +1,260 @@
+﻿#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "Accelerator.h"
+#include "Config.h"
+#include "Instance.h"
+#include "Objects.h"
+#include "Ray.h"
+#include "RealExpect.h"
+#include "TriangleMesh.h"
+
+namespace {
+/** Random triangles of one mesh and the same triangles moved into the world
+ * by the transform*/
+class InstanceTests : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    transform_.scale = {2.0, 0.5, 1.5};
+    transform_.rotation_in_deg = {30.0, -45.0, 120.0};
+    transform_.translation = {10.0, -20.0, 5.0};
+    Matrix3x3 linear = transform_.GetLinearPart();
+    auto to_world = [&](const GeoVec& p) {
+      return ApplyToVec(linear, p) + transform_.translation;
+    };
+    std::mt19937 rnd{11};
+    std::uniform_real_distribution<double> coor{-20.0, 20.0};
+    std::uniform_real_distribution<double> shift{-3.0, 3.0};
+    std::vector<GeoVec> points;
+    std::vector<TriangleMesh::Face> faces;
+    for (int i = 0; i < 300; ++i) {
+      GeoVec p0{coor(rnd), coor(rnd), coor(rnd)};
+      GeoVec p1 = p0 + GeoVec{shift(rnd), shift(rnd), shift(rnd)};
+      GeoVec p2 = p0 + GeoVec{shift(rnd), shift(rnd), shift(rnd)};
+      if (i == 0) centroid_ = (p0 + p1 + p2) / 3.0;
+      points.insert(points.end(), {p0, p1, p2});
+      uint32_t first = 3 * i;
+      faces.push_back({first, first + 1, first + 2});
+      world_.push_back(std::make_unique<Triangle>(to_world(p0), to_world(p1),
+                                                  to_world(p2)));
+    }
+    mesh_ = std::make_unique<TriangleMesh>(points, faces);
+  }
+
+  std::optional<HitRecord> LinearClosestHit(const Ray& ray) const {
+    std::optional<HitRecord> result;
+    for (const auto& el : world_) {
+      std::optional<Real> dist = el->GetClosesDist(ray);
+      if (dist && (!result || *dist < result->dist)) {
+        result = HitRecord{*dist, el.get()};
+      }
+    }
+    return result;
+  }
+
+  Transform transform_;
+  GeoVec centroid_;
+  std::unique_ptr<TriangleMesh> mesh_;
+  std::vector<std::unique_ptr<Triangle>> world_;
+};
+}  // namespace
+
+TEST_F(InstanceTests, SameHitAsTransformedTriangles) {
+  Instance instance{*mesh_, transform_};
+  std::mt19937 rnd{5};
+  std::uniform_real_distribution<double> coor{-60.0, 60.0};
+  int hit_num = 0;
+  for (int i = 0; i < 3000; ++i) {
+    Ray ray{{coor(rnd), coor(rnd), coor(rnd)},
+            GeoVec{coor(rnd), coor(rnd), coor(rnd)}};
+    std::optional<HitRecord> expected = LinearClosestHit(ray);
+    std::optional<double> actual = instance.GetClosesDist(ray);
+    ASSERT_EQ(expected.has_value(), actual.has_value()) << i;
+    if (!expected) continue;
+    ++hit_num;
+    EXPECT_NEAR(*actual, expected->dist,
+                RealTolerance(1e-9) * ToDouble(expected->dist))
+        << i;
+    SurfacePoint surface = instance.GetSurfacePoint(ray, *actual);
+    ASSERT_NE(surface.obj, nullptr);
+    GeoVec expected_norm = expected->obj->GetNorm(ray.GetPos());
+    EXPECT_NEAR(surface.norm.Dot(expected_norm), 1.0, RealTolerance(1e-9)) << i;
+  }
+  EXPECT_GT(hit_num, 20);
+}
+
+TEST_F(InstanceTests, BoundingBoxContainsTransformedTriangles) {
+  Instance instance{*mesh_, transform_};
+  BoundingBox box = instance.GetBoundingBox();
+  const Real eps = ToReal(1e-9);
+  for (const auto& el : world_) {
+    BoundingBox tri_box = el->GetBoundingBox();
+    EXPECT_LE(box.min.x_, tri_box.min.x_ + eps);
+    EXPECT_LE(box.min.y_, tri_box.min.y_ + eps);
+    EXPECT_LE(box.min.z_, tri_box.min.z_ + eps);
+    EXPECT_GE(box.max.x_, tri_box.max.x_ - eps);
+    EXPECT_GE(box.max.y_, tri_box.max.y_ - eps);
+    EXPECT_GE(box.max.z_, tri_box.max.z_ - eps);
+  }
+  EXPECT_THROW(instance.GetNorm(GeoVec{0, 0, 0}), std::logic_error);
+}
+
+TEST_F(InstanceTests, TopLevelStructureOverInstances) {
+  // instances placed side by side are found through the top level structure
+  std::vector<std::unique_ptr<Instance>> instances;
+  std::vector<const Object*> objects;
+  for (int i = 0; i < 5; ++i) {
+    Transform transform;
+    transform.translation = {100.0 * i, 0.0, 0.0};
+    instances.push_back(std::make_unique<Instance>(*mesh_, transform));
+    objects.push_back(instances.back().get());
+  }
+  std::unique_ptr<Accelerator> tlas =
+      CreateAccelerator(AcceleratorType::kWideBvh, objects);
+  // one of the rays sees front side of the first mesh triangle
+  int hit_num = 0;
+  for (double dir : {-1.0, 1.0}) {
+    GeoVec target = centroid_ + GeoVec{400.0, 0.0, 0.0};
+    Ray ray{target - GeoVec{0.0, 0.0, 100.0 * dir}, {0.0, 0.0, dir}};
+    std::optional<HitRecord> hit = tlas->GetClosestHit(ray);
+    std::optional<double> dist = instances[4]->GetClosesDist(ray);
+    ASSERT_EQ(hit.has_value(), dist.has_value());
+    if (!hit) continue;
+    ++hit_num;
+    EXPECT_EQ(hit->obj, instances[4].get());
+    EXPECT_REAL_EQ(hit->dist, *dist);
+  }
+  EXPECT_GT(hit_num, 0);
+}
+
+TEST(InstanceConfigTests, MeshIsSharedByInstances) {
+  std::string prop_filename = "instance_description.json";
+  nlohmann::json prop = {
+      {"points", {{0, 0, 0}, {1, 0, 0}, {0, 1, 0}, {0, 0, 1}}},
+      {"faces", {{0, 1, 2}, {0, 1, 3}, {3, 2, 1}}}};
+  std::ofstream{prop_filename} << prop.dump();
+  std::string file_name = "instance_config.json";
+  nlohmann::json mesh_node = {{"type", "triangles"},
+                              {"is_light_source", false},
+                              {"description", prop_filename}};
+  nlohmann::json cfg;
+  mesh_node["instances"] = {
+      {{"translation", {1, 2, 3}}},
+      {{"rotation", {0, 90, 0}}, {"scale", 2.0}},
+      {{"translation", {-5, 0, 0}}, {"scale", {1, 2, 3}}}};
+  nlohmann::json other_node = mesh_node;
+  other_node["instances"] = {{{"translation", {0, 10, 0}}}};
+  // material belongs to instances, so it does not split the mesh
+  other_node["color"] = "red";
+  other_node["is_light_source"] = true;
+  other_node["reflection"] = 0.5;
+  nlohmann::json bad_node = mesh_node;
+  bad_node["instances"] = {{{"scale", 0.0}}};
+  nlohmann::json flat_node = {{"type", "triangles"},
+                              {"is_light_source", false},
+                              {"description", prop_filename}};
+  cfg["objects"] = {mesh_node, other_node, bad_node, flat_node};
+  std::ofstream{file_name} << cfg.dump();
+  Config test(file_name);
+  std::filesystem::remove(prop_filename);
+  std::filesystem::remove(file_name);
+
+  ASSERT_EQ(test.GetMeshes().size(), 1);
+  EXPECT_EQ(test.GetMeshes()[0]->GetTriangleNumber(), 3);
+  std::vector<const Object*> res = test.GetObjects();
+  ASSERT_EQ(res.size(), 5);
+  for (int i = 0; i < 4; ++i) {
+    const auto* instance = dynamic_cast<const Instance*>(res[i]);
+    ASSERT_NE(instance, nullptr);
+    EXPECT_EQ(&instance->GetMesh(), test.GetMeshes()[0].get());
+  }
+  EXPECT_EQ(res[0]->GetColor(), colors::kGreen);
+  EXPECT_EQ(res[3]->GetColor(), colors::kRed);
+  EXPECT_EQ(res[3]->GetMaterial(), Material::kLightSource);
+  EXPECT_DOUBLE_EQ(res[3]->GetReflectionCoefficient(), 0.5);
+  // mesh without instances is a separate object
+  const auto* flat = dynamic_cast<const TriangleMesh*>(res[4]);
+  ASSERT_NE(flat, nullptr);
+  EXPECT_EQ(flat->GetTriangleNumber(), 3);
+  BoundingBox box = res[0]->GetBoundingBox();
+  EXPECT_EQ(box.min, GeoVec(1, 2, 3));
+  EXPECT_EQ(box.max, GeoVec(2, 3, 4));
+}
+
+TEST(InstanceConfigTests, NextFrameMovesInstances) {
+  std::string prop_filename = "instance_description.json";
+  nlohmann::json prop = {{"points", {{0, 0, 0}, {1, 0, 0}, {0, 1, 0}}},
+                         {"faces", {{0, 1, 2}}}};
+  std::ofstream{prop_filename} << prop.dump();
+  std::string file_name = "instance_config.json";
+  nlohmann::json mesh_node = {{"type", "triangles"},
+                              {"is_light_source", false},
+                              {"description", prop_filename}};
+  mesh_node["instances"] = {{{"translation", {1, 2, 3}}}};
+  nlohmann::json cfg;
+  cfg["objects"] = {mesh_node};
+  std::ofstream{file_name} << cfg.dump();
+  Config first(file_name);
+  mesh_node["instances"] = {{{"translation", {5, 2, 3}}, {"scale", 2.0}}};
+  cfg["objects"] = {mesh_node};
+  std::ofstream{file_name} << cfg.dump();
+  Config frame(file_name);
+  std::filesystem::remove(prop_filename);
+  std::filesystem::remove(file_name);
+
+  ASSERT_EQ(first.GetObjects().size(), 1);
+  const Object* instance = first.GetObjects()[0];
+  EXPECT_TRUE(first.UpdateGeometry(frame));
+  EXPECT_EQ(first.GetObjects()[0], instance);
+  BoundingBox box = instance->GetBoundingBox();
+  EXPECT_EQ(box.min, GeoVec(5, 2, 3));
+  EXPECT_EQ(box.max, GeoVec(7, 4, 3));
+  Ray ray{{5.5, 2.5, 10}, {0, 0, -1}};
+  EXPECT_REAL_EQ(instance->GetClosesDist(ray).value_or(0.0), 7.0);
+}
+
+TEST(InstanceConfigTests, NextFrameMovesInstancedMesh) {
+  std::string prop_filename = "instance_description.json";
+  nlohmann::json prop = {{"points", {{0, 0, 0}, {1, 0, 0}, {0, 1, 0}}},
+                         {"faces", {{0, 1, 2}}}};
+  std::ofstream{prop_filename} << prop.dump();
+  std::string file_name = "instance_config.json";
+  nlohmann::json mesh_node = {{"type", "triangles"},
+                              {"is_light_source", false},
+                              {"description", prop_filename}};
+  mesh_node["instances"] = {{{"translation", {1, 2, 3}}},
+                            {{"translation", {-1, 2, 3}}}};
+  nlohmann::json cfg;
+  cfg["objects"] = {mesh_node};
+  std::ofstream{file_name} << cfg.dump();
+  Config first(file_name);
+
+  // the same faces with other points move the shared mesh
+  prop["points"] = {{0, 0, 1}, {1, 0, 1}, {0, 1, 1}};
+  std::ofstream{prop_filename} << prop.dump();
+  EXPECT_TRUE(first.UpdateGeometry(Config::ReadFrame(file_name)));
+  ASSERT_EQ(first.GetMeshes().size(), 1);
+  EXPECT_EQ(first.GetMeshes()[0]->GetBoundingBox().min, GeoVec(0, 0, 1));
+  for (const Object* instance : first.GetObjects()) {
+    EXPECT_REAL_EQ(instance->GetBoundingBox().min.z_, 4.0);
+  }
+  Ray ray{{1.25, 2.25, 10}, {0, 0, -1}};
+  EXPECT_REAL_EQ(first.GetObjects()[0]->GetClosesDist(ray).value_or(0.0),
+                 6.0);
+
+  // other faces cannot be copied into the mesh
+  prop["points"] = {{0, 0, 0}, {1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+  prop["faces"] = {{0, 1, 2}, {0, 1, 3}};
+  std::ofstream{prop_filename} << prop.dump();
+  EXPECT_FALSE(first.UpdateGeometry(Config::ReadFrame(file_name)));
+  std::filesystem::remove(prop_filename);
+  std::filesystem::remove(file_name);
+  EXPECT_REAL_EQ(first.GetObjects()[1]->GetBoundingBox().min.z_, 4.0);
+}
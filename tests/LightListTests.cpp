@@ -0,0 +1,74 @@
+﻿#include <gtest/gtest.h>
+
+#include <cmath>
+#include <optional>
+
+#include "LightList.h"
+#include "Objects.h"
+#include "Sampler.h"
+#include "SphereSet.h"
+#include "TriangleMesh.h"
+
+namespace {
+constexpr double kPi = 3.14159265358979323846;
+}  // namespace
+
+TEST(LightListTests, CollectsLightSources) {
+  Sphere lamp{GeoVec{0, 0, 0}, 1};
+  lamp.SetMaterial(Material::kLightSource);
+  Sphere ball{GeoVec{5, 0, 0}, 1};
+  ball.SetMaterial(Material::kReflective);
+  Triangle panel{GeoVec{0, 5, 0}, GeoVec{1, 5, 0}, GeoVec{0, 5, 1}};
+  panel.SetMaterial(Material::kLightSource);
+  SphereSet bulbs{{{0, -5, 0}, {2, -5, 0}}, {0.5, 0.5}};
+  bulbs.SetMaterial(Material::kLightSource);
+
+  EXPECT_TRUE(LightList{}.IsEmpty());
+  LightList lights{{&lamp, &ball, &panel, &bulbs}};
+  EXPECT_FALSE(lights.IsEmpty());
+  EXPECT_EQ(lights.GetLightNumber(), 4);
+  EXPECT_TRUE(lights.Contains(&lamp));
+  EXPECT_TRUE(lights.Contains(&panel));
+  EXPECT_TRUE(lights.Contains(&bulbs));
+  EXPECT_FALSE(lights.Contains(&ball));
+  EXPECT_TRUE(LightList({&ball}).IsEmpty());
+}
+
+TEST(LightListTests, SamplesVisibleSideOfTriangle) {
+  Triangle panel{GeoVec{0, 0, 0}, GeoVec{2, 0, 0}, GeoVec{0, 2, 0}};
+  panel.SetMaterial(Material::kLightSource);
+  LightList lights{{&panel}};
+  GeoVec norm = panel.GetNorm(GeoVec{0, 0, 0});
+  GeoVec front = 3 * norm;
+  Sampler sampler{7};
+  for (int i = 0; i < 100; ++i) {
+    std::optional<LightSample> sample = lights.Sample(front, sampler);
+    ASSERT_TRUE(sample);
+    EXPECT_EQ(sample->light, &panel);
+    EXPECT_NEAR(sample->point.Dot(norm), 0.0, 1e-6);
+    EXPECT_GE(sample->point.x_, -1e-6);
+    EXPECT_GE(sample->point.y_, -1e-6);
+    EXPECT_LE(sample->point.x_ + sample->point.y_, 2 + 1e-6);
+    EXPECT_DOUBLE_EQ(sample->inv_pdf,
+                     lights.GetInvPdf(front, sample->point, norm));
+    // points of the back side give no light
+    EXPECT_FALSE(lights.Sample(-1 * front, sampler));
+  }
+}
+
+TEST(LightListTests, InversePdfsSumToSolidAngle) {
+  // mean inverse density of visible points is the solid angle of the light
+  Sphere lamp{GeoVec{0, 0, -4}, 1};
+  lamp.SetMaterial(Material::kLightSource);
+  LightList lights{{&lamp}};
+  Sampler sampler{3};
+  constexpr int kSampleNum = 200000;
+  double sum = 0.0;
+  for (int i = 0; i < kSampleNum; ++i) {
+    sampler.StartSample(i);
+    std::optional<LightSample> sample = lights.Sample(GeoVec{0, 0, 0}, sampler);
+    if (sample) sum += sample->inv_pdf;
+  }
+  double expected = 2 * kPi * (1 - std::sqrt(1 - 1.0 / 16));
+  EXPECT_NEAR(sum / kSampleNum, expected, 0.01 * expected);
+}
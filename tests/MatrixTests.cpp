@@ -4,6 +4,7 @@
 #include <gtest/gtest.h>
 
 #include "Matrix.h"
+#include "RealExpect.h"
 
 TEST(MatrixTests, Det2x2) {
   EXPECT_DOUBLE_EQ(Det2x2(1, 0, 0, 1), 1);
@@ -145,3 +146,33 @@ TEST(MatrixTests, Multiply) {
     EXPECT_DOUBLE_EQ(res.c2.z_, 13);
   }
 }
+
+TEST(MatrixTests, WideReverseAndApply) {
+  Matrix3x3x8 wide;
+  for (size_t i = 0; i < GeoVec8::kWidth; ++i) {
+    wide.Set(i, Matrix3x3{{1.0 + i, 0, 5}, {2, 1, 6 - 0.5 * i}, {3, 4, 0}});
+  }
+  Matrix3x3x8 reverse = GetReverse3x3(wide);
+  GeoVec8 vec;
+  for (size_t i = 0; i < GeoVec8::kWidth; ++i) {
+    vec.Set(i, GeoVec{1, -2.0 * i, 3});
+  }
+  GeoVec8 res = ApplyToVec(reverse, ApplyToVec(wide, vec));
+  for (size_t i = 0; i < GeoVec8::kWidth; ++i) {
+    Matrix3x3 exp = GetReverse3x3(wide.Get(i));
+    Matrix3x3 act = reverse.Get(i);
+    EXPECT_REAL_EQ(act.c0.x_, exp.c0.x_);
+    EXPECT_REAL_EQ(act.c0.y_, exp.c0.y_);
+    EXPECT_REAL_EQ(act.c0.z_, exp.c0.z_);
+    EXPECT_REAL_EQ(act.c1.x_, exp.c1.x_);
+    EXPECT_REAL_EQ(act.c1.y_, exp.c1.y_);
+    EXPECT_REAL_EQ(act.c1.z_, exp.c1.z_);
+    EXPECT_REAL_EQ(act.c2.x_, exp.c2.x_);
+    EXPECT_REAL_EQ(act.c2.y_, exp.c2.y_);
+    EXPECT_REAL_EQ(act.c2.z_, exp.c2.z_);
+
+    EXPECT_NEAR(res.x_[i], vec.x_[i], RealTolerance(1e-12));
+    EXPECT_NEAR(res.y_[i], vec.y_[i], RealTolerance(1e-12));
+    EXPECT_NEAR(res.z_[i], vec.z_[i], RealTolerance(1e-12));
+  }
+}
@@ -1,9 +1,11 @@
 ﻿#include <gtest/gtest.h>
 
 #include <cmath>
+#include <vector>
 
 #include "Objects.h"
 #include "Ray.h"
+#include "RealExpect.h"
 #include "Reflector.h"
 
 TEST(SphereTests, GetNorm) {
@@ -31,48 +33,49 @@ TEST(SphereTests, GetNorm) {
     GeoVec p{1, 2.8, 2.4};
     GeoVec n = s2.GetNorm(p);
     GeoVec exp_n{0, 0.8, -0.6};
-    EXPECT_DOUBLE_EQ(n.x_, exp_n.x_);
-    EXPECT_DOUBLE_EQ(n.y_, exp_n.y_);
-    EXPECT_DOUBLE_EQ(n.z_, exp_n.z_);
+    EXPECT_REAL_EQ(n.x_, exp_n.x_);
+    EXPECT_REAL_EQ(n.y_, exp_n.y_);
+    EXPECT_REAL_EQ(n.z_, exp_n.z_);
   }
 }
 
 TEST(SphereTests, Reflect) {
   Sphere s{GeoVec{0, 0, 0}, 3};
   s.SetPolishness(1.0).SetReflectionCoef(1.0);
+  Sampler sampler(42);
 #ifndef NDEBUG
   {
     Ray r{GeoVec{1, 0, 0}, GeoVec{12, 5, 6}};
-    EXPECT_DEATH(s.TryReflect(r, 20), "");
+    EXPECT_DEATH(s.TryReflect(r, 20, sampler), "");
   }
 #endif  // NDEBUG
   {     // 0 degree incident
     Ray r{GeoVec{5, 0, 0}, GeoVec{-1, 0, 0}};
-    EXPECT_TRUE(s.TryReflect(r, 2.0));
+    EXPECT_TRUE(s.TryReflect(r, 2.0, sampler));
     GeoVec exp_pos{3, 0, 0};
     GeoVec exp_dir{1, 0, 0};
     EXPECT_EQ(exp_dir, r.GetDir());
     // EXPECT_NEAR(exp_pos.x_, r.GetPos().x_, 1.1 * s.GetHitPrecision());
     // EXPECT_NEAR(exp_pos.y_, r.GetPos().y_, s.GetHitPrecision());
     // EXPECT_NEAR(exp_pos.z_, r.GetPos().z_, s.GetHitPrecision());
-    EXPECT_DOUBLE_EQ(exp_pos.x_, r.GetPos().x_);
-    EXPECT_DOUBLE_EQ(exp_pos.y_, r.GetPos().y_);
-    EXPECT_DOUBLE_EQ(exp_pos.z_, r.GetPos().z_);
+    EXPECT_REAL_EQ(exp_pos.x_, r.GetPos().x_);
+    EXPECT_REAL_EQ(exp_pos.y_, r.GetPos().y_);
+    EXPECT_REAL_EQ(exp_pos.z_, r.GetPos().z_);
   }
 
   Sphere s2{GeoVec{0, 0, 0}, 5};
   s2.SetPolishness(1.0);
   {  // general case
     Ray r{GeoVec{7, 3, 0}, GeoVec{-1, 0, 0}};
-    EXPECT_TRUE(s2.TryReflect(r, 3));
+    EXPECT_TRUE(s2.TryReflect(r, 3, sampler));
     GeoVec exp_pos{4, 3, 0};
     GeoVec exp_dir{0.28, 0.96, 0};
-    EXPECT_DOUBLE_EQ(exp_dir.x_, r.GetDir().x_);
-    EXPECT_DOUBLE_EQ(exp_dir.y_, r.GetDir().y_);
-    EXPECT_DOUBLE_EQ(exp_dir.z_, r.GetDir().z_);
-    EXPECT_DOUBLE_EQ(exp_pos.x_, r.GetPos().x_);
-    EXPECT_DOUBLE_EQ(exp_pos.y_, r.GetPos().y_);
-    EXPECT_DOUBLE_EQ(exp_pos.z_, r.GetPos().z_);
+    EXPECT_REAL_EQ(exp_dir.x_, r.GetDir().x_);
+    EXPECT_REAL_EQ(exp_dir.y_, r.GetDir().y_);
+    EXPECT_REAL_EQ(exp_dir.z_, r.GetDir().z_);
+    EXPECT_REAL_EQ(exp_pos.x_, r.GetPos().x_);
+    EXPECT_REAL_EQ(exp_pos.y_, r.GetPos().y_);
+    EXPECT_REAL_EQ(exp_pos.z_, r.GetPos().z_);
   }
 }
 
@@ -98,7 +101,7 @@ TEST(SphereTests, GetClosestDistance) {
     Ray r{GeoVec{7, 0, 0}, GeoVec{-3, 3, 0}};
     std::optional<double> res = s.GetClosesDist(r);
     EXPECT_TRUE(res);
-    EXPECT_DOUBLE_EQ(std::sqrt(18), *res);
+    EXPECT_REAL_EQ(std::sqrt(18), *res);
   }
   {  // grazing
     Ray r{GeoVec{7, 5, 0}, GeoVec{-1, 0, 0}};
@@ -128,29 +131,72 @@ TEST(TriangleTests, Creation) {
   }
 }
 
+namespace {
+/** @return true if the ray going against the triangle normal through the
+ * given point crosses the triangle*/
+bool IsHitThrough(const Triangle& tr, const GeoVec& point) {
+  GeoVec norm = tr.GetNorm(point);
+  return tr.GetClosesDist(Ray{point + norm, -norm}).has_value();
+}
+}  // namespace
+
 TEST(TriangleTests, CheckPointInTriangle) {
   {  // in plane z = 0
     Triangle tr{{0, 0, 0}, {0, 1, 0}, {1, 0, 0}};
-    EXPECT_TRUE(tr.CheckInTriangle({0.25, 0.25, 0}));
-    EXPECT_FALSE(tr.CheckInTriangle({1.5, 0.25, 0}));
-    EXPECT_FALSE(tr.CheckInTriangle({0.25, 1.5, 0}));
-    EXPECT_FALSE(tr.CheckInTriangle({-0.25, 0.25, 0}));
-    EXPECT_FALSE(tr.CheckInTriangle({0.25, -0.25, 0}));
+    EXPECT_TRUE(IsHitThrough(tr, {0.25, 0.25, 0}));
+    EXPECT_FALSE(IsHitThrough(tr, {1.5, 0.25, 0}));
+    EXPECT_FALSE(IsHitThrough(tr, {0.25, 1.5, 0}));
+    EXPECT_FALSE(IsHitThrough(tr, {-0.25, 0.25, 0}));
+    EXPECT_FALSE(IsHitThrough(tr, {0.25, -0.25, 0}));
   }
   {  // in plane x = 10
     Triangle tr{{10, 0, 0}, {10, 1, 0}, {10, 0, 1}};
-    EXPECT_TRUE(tr.CheckInTriangle({10, 0.25, 0.25}));
-    EXPECT_FALSE(tr.CheckInTriangle({10, 1.25, 0.25}));
-    EXPECT_FALSE(tr.CheckInTriangle({10, 1.25, -0.25}));
-    EXPECT_FALSE(tr.CheckInTriangle({10, -1.25, -1.25}));
-    EXPECT_FALSE(tr.CheckInTriangle({10, 1.25, 1.25}));
+    EXPECT_TRUE(IsHitThrough(tr, {10, 0.25, 0.25}));
+    EXPECT_FALSE(IsHitThrough(tr, {10, 1.25, 0.25}));
+    EXPECT_FALSE(IsHitThrough(tr, {10, 1.25, -0.25}));
+    EXPECT_FALSE(IsHitThrough(tr, {10, -1.25, -1.25}));
+    EXPECT_FALSE(IsHitThrough(tr, {10, 1.25, 1.25}));
   }
   {  // in plane not parallel to standart plane
     Triangle tr{{0, 0, 0}, {1, 1, -1}, {0, 0, 1}};
-    EXPECT_TRUE(tr.CheckInTriangle({0.25, 0.25, 0.25}));
-    EXPECT_FALSE(tr.CheckInTriangle({0.25, 0.25, -0.7}));
-    EXPECT_FALSE(tr.CheckInTriangle({0.25, 0.25, 0.7}));
-    EXPECT_FALSE(tr.CheckInTriangle({-0.25, -0.25, 0.0}));
+    EXPECT_TRUE(IsHitThrough(tr, {0.25, 0.25, 0.25}));
+    EXPECT_FALSE(IsHitThrough(tr, {0.25, 0.25, -0.7}));
+    EXPECT_FALSE(IsHitThrough(tr, {0.25, 0.25, 0.7}));
+    EXPECT_FALSE(IsHitThrough(tr, {-0.25, -0.25, 0.0}));
+  }
+  {  // vertical edge, which has infinite slope in the plane
+    Triangle tr{{0, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+    EXPECT_TRUE(IsHitThrough(tr, {0, 0.25, 0.25}));
+    EXPECT_FALSE(IsHitThrough(tr, {0, -0.25, 0.25}));
+  }
+}
+
+TEST(TriangleTests, NoLeaksThroughSharedEdges) {
+  // fan of triangles around the center of a square, rays from all sides go
+  // through shared edges and the common vertex
+  GeoVec center{0.3, 0.7, 0};
+  std::vector<GeoVec> corners{{0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0}};
+  std::vector<Triangle> fan;
+  for (size_t i = 0; i < corners.size(); ++i) {
+    fan.emplace_back(center, corners[(i + 1) % corners.size()], corners[i]);
+  }
+  std::vector<GeoVec> targets{center};
+  for (const auto& corner : corners) {
+    for (double f : {0.1, 1.0 / 3, 0.5, 0.7, 0.999}) {
+      targets.push_back(center + f * (corner - center));
+    }
+  }
+  for (const auto& target : targets) {
+    for (const GeoVec& pos : {GeoVec{0.1, 0.2, -5}, GeoVec{7, 3, -1},
+                              GeoVec{-3, 11, -0.01}, GeoVec{0.3, 0.7, -1}}) {
+      Ray ray{pos, target - pos};
+      int hits = 0;
+      for (const auto& tr : fan) {
+        hits += tr.GetClosesDist(ray).has_value();
+      }
+      EXPECT_GE(hits, 1) << target.x_ << " " << target.y_ << " from "
+                         << pos.x_ << " " << pos.y_ << " " << pos.z_;
+    }
   }
 }
 
@@ -176,7 +222,7 @@ TEST(TriangleTests, GetClosestDistance) {
     Ray r{pos, dir};
     std::optional<double> dist = tr.GetClosesDist(r);
     EXPECT_TRUE(dist);
-    EXPECT_DOUBLE_EQ(*dist, 37);
+    EXPECT_REAL_EQ(*dist, 37);
   }
   {
     GeoVec pos{0.25, -3.75, 3};
@@ -184,7 +230,7 @@ TEST(TriangleTests, GetClosestDistance) {
     Ray r{pos, dir};
     std::optional<double> dist = tr.GetClosesDist(r);
     EXPECT_TRUE(dist);
-    EXPECT_DOUBLE_EQ(*dist, 5);
+    EXPECT_REAL_EQ(*dist, 5);
   }
   Triangle tr2{GeoVec{0, 0, 0}, GeoVec{0, 1, 0}, GeoVec{1, 0, 0}};
   {
@@ -199,50 +245,58 @@ TEST(TriangleTests, GetClosestDistance) {
 TEST(TriangleTests, Reflect) {
   Triangle tr{GeoVec{0, 0, 0}, GeoVec{1, 0, 0}, GeoVec{0, 1, 0}};
   tr.SetPolishness(1.0).SetReflectionCoef(1.0);
+  Sampler sampler(42);
   {  // Ray 0 degree
     GeoVec pos{0.25, 0.25, 37};
     GeoVec dir{0.0, 0.0, -1};
     Ray r{pos, dir};
-    EXPECT_TRUE(tr.TryReflect(r, 37));
+    EXPECT_TRUE(tr.TryReflect(r, 37, sampler));
     GeoVec exp_dir{0.0, 0.0, 1.0};
     GeoVec exp_pos{0.25, 0.25, 0.0};
     EXPECT_EQ(exp_dir, r.GetDir());
-    EXPECT_DOUBLE_EQ(exp_pos.x_, r.GetPos().x_);
-    EXPECT_DOUBLE_EQ(exp_pos.y_, r.GetPos().y_);
-    EXPECT_DOUBLE_EQ(exp_pos.z_, r.GetPos().z_);
+    EXPECT_REAL_EQ(exp_pos.x_, r.GetPos().x_);
+    EXPECT_REAL_EQ(exp_pos.y_, r.GetPos().y_);
+    EXPECT_REAL_EQ(exp_pos.z_, r.GetPos().z_);
   }
   {  // General case
     GeoVec pos{0.25, -3.75, 3};
     GeoVec dir{0.0, 4.0, -3};
     Ray r{pos, dir};
-    EXPECT_TRUE(tr.TryReflect(r, 5));
+    EXPECT_TRUE(tr.TryReflect(r, 5, sampler));
     GeoVec exp_dir{0.0, 4.0, 3.0};
     exp_dir.Norm();
     // For some reasons z component fails double comparison
     GeoVec exp_pos{0.25, 0.25, 0.0};
     EXPECT_EQ(exp_dir, r.GetDir());
-    EXPECT_DOUBLE_EQ(exp_pos.x_, r.GetPos().x_);
-    EXPECT_DOUBLE_EQ(exp_pos.y_, r.GetPos().y_);
-    EXPECT_NEAR(exp_pos.z_, r.GetPos().z_, 1e-15);
+    EXPECT_REAL_EQ(exp_pos.x_, r.GetPos().x_);
+    EXPECT_REAL_EQ(exp_pos.y_, r.GetPos().y_);
+    EXPECT_NEAR(exp_pos.z_, r.GetPos().z_, RealTolerance(1e-15));
   }
 }
 
 TEST(ReflectorTests, DiffuseReflector) {
-  std::mt19937 rnd(42);
+  Sampler sampler(42);
   GeoVec dir{0, 0, -1};
   size_t check_num = 1000;
   {
     GeoVec norm{0, 0, 1};
     for (size_t i = 0; i < check_num; i++) {
-      GeoVec vec = DiffuseReflect(rnd, dir, norm);
+      GeoVec vec = DiffuseReflect(sampler, dir, norm);
       EXPECT_GE(vec.Dot(norm), 0);
     }
   }
   {
     GeoVec norm{1, 2, 3};
     for (size_t i = 0; i < check_num; i++) {
-      GeoVec vec = DiffuseReflect(rnd, dir, norm);
+      GeoVec vec = DiffuseReflect(sampler, dir, norm);
       EXPECT_GE(vec.Dot(norm), 0);
     }
   }
 }
+
+TEST(TriangleTests, NoRandomStateInObjects) {
+  // Objects are shared scene data and must stay compact - random numbers are
+  // taken from the sampler passed by the caller
+  EXPECT_LT(sizeof(Sphere), 128);
+  EXPECT_LT(sizeof(Triangle), 512);
+}
@@ -1,18 +1,18 @@
 ﻿#include <gtest/gtest.h>
 
 #include <cmath>
-#include <random>
 
 #include "Pixel.h"
+#include "RealExpect.h"
 
 TEST(PixelTests, CreateRays) {
   // Check that all created rays pathes through the given tile
   pixel::Tile tile{GeoVec(0.0, 1.0, 1.0), GeoVec(0.1, 0.0, 0.0),
                    GeoVec(0.0, 0.0, -0.1)};
-  std::mt19937 rnd(42);
+  Sampler sampler(42);
   GeoVec ray_start{0.0, 0.0, 0.0};
   std::vector<Ray> res_rays =
-      pixel::CreateRays(tile, ray_start, rnd, /*ray_num=*/10000);
+      pixel::CreateRays(tile, ray_start, sampler, /*ray_num=*/10000);
   // move all rays to the screen position and check
   auto move_ray_to_screen = [&](Ray ray, double precision) {
     double rhs_d = 3 * GeoVec(ray_start, tile.top_left).Len();
@@ -21,7 +21,7 @@ TEST(PixelTests, CreateRays) {
     while (num--) {
       double curr_d = (rhs_d + lhs_d) / 2;
       GeoVec pos = ray.GetPos() + curr_d * ray.GetDir();
-      if (pos.y_ > 1.0) {
+      if (pos.y_ > Real{1}) {
         rhs_d = curr_d;
       } else {
         lhs_d = curr_d;
@@ -31,7 +31,7 @@ TEST(PixelTests, CreateRays) {
     return ray;
   };
 
-  double precision = 1e-15;
+  double precision = RealTolerance(1e-15);
   for (const auto& ray : res_rays) {
     Ray moved = move_ray_to_screen(ray, precision);
     EXPECT_NEAR(moved.GetPos().y_, 1.0, precision);  // in screen plane
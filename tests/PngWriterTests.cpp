@@ -0,0 +1,89 @@
+﻿#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "PngStreamWriter.h"
+#include "PngWriter.h"
+
+namespace {
+std::string ReadFile(const std::string& file_name) {
+  std::ifstream input{file_name, std::ios::binary};
+  return {std::istreambuf_iterator<char>(input),
+          std::istreambuf_iterator<char>()};
+}
+}  // namespace
+
+TEST(PngWriterTests, StreamWriterGivesSameFile) {
+  uint32_t width = 37;
+  uint32_t height = 23;
+  std::vector<Color> image;
+  for (uint32_t i = 0; i < width * height; ++i) {
+    image.emplace_back(i % 256, (7 * i) % 256, (13 * i) % 256);
+  }
+  std::string expected_file = "test_expected.png";
+  std::string stream_file = "test_stream.png";
+  {
+    PngWriter pw{expected_file.c_str(), width, height};
+    ASSERT_TRUE(pw.IsOk());
+    pw.SaveVectorToImage(image);
+  }
+  {
+    PngStreamWriter pw{stream_file.c_str(), width, height};
+    ASSERT_TRUE(pw.IsOk());
+    // rows come from several threads in reverse order
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < 3; ++t) {
+      threads.emplace_back([&, t] {
+        for (uint32_t row = height; row-- > 0;) {
+          if (row % 3 != t) continue;
+          pw.PushRow(row, std::vector<Color>(image.begin() + row * width,
+                                             image.begin() + (row + 1) * width));
+        }
+      });
+    }
+    for (auto& el : threads) {
+      el.join();
+    }
+    EXPECT_TRUE(pw.Finish());
+  }
+  std::string expected = ReadFile(expected_file);
+  EXPECT_FALSE(expected.empty());
+  EXPECT_EQ(ReadFile(stream_file), expected);
+  std::filesystem::remove(expected_file);
+  std::filesystem::remove(stream_file);
+}
+
+TEST(PngWriterTests, StreamWriterBlocksRowsBeyondWindow) {
+  uint32_t width = 5;
+  uint32_t height = 6;
+  std::string file_name = "test_window.png";
+  {
+    PngStreamWriter pw{file_name.c_str(), width, height, /*row_window=*/2};
+    ASSERT_TRUE(pw.IsOk());
+    std::atomic<bool> pushed{false};
+    std::thread far_row([&] {
+      pw.PushRow(3, std::vector<Color>(width, colors::kRed));
+      pushed = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    // encoder waits for row 0, so row 3 is out of the window
+    EXPECT_FALSE(pushed.load());
+    for (uint32_t row = 0; row < 3; ++row) {
+      pw.PushRow(row, std::vector<Color>(width, colors::kGreen));
+    }
+    far_row.join();
+    EXPECT_TRUE(pushed.load());
+    for (uint32_t row = 4; row < height; ++row) {
+      pw.PushRow(row, std::vector<Color>(width, colors::kBlue));
+    }
+    EXPECT_TRUE(pw.Finish());
+  }
+  std::filesystem::remove(file_name);
+}
@@ -1,6 +1,9 @@
 ﻿#include <gtest/gtest.h>
 
+#include <cmath>
+
 #include "Ray.h"
+#include "RealExpect.h"
 
 TEST(RayTests, Creation) {
   Ray r{GeoVec{1, 2, 3}, GeoVec{0, 4, 3}};
@@ -8,9 +11,9 @@ TEST(RayTests, Creation) {
   GeoVec exp_dir{0.0, 0.8, 0.6};
   GeoVec exp_pos{1, 2, 3};
 
-  EXPECT_DOUBLE_EQ(r.GetDir().x_, exp_dir.x_);
-  EXPECT_DOUBLE_EQ(r.GetDir().y_, exp_dir.y_);
-  EXPECT_DOUBLE_EQ(r.GetDir().z_, exp_dir.z_);
+  EXPECT_REAL_EQ(r.GetDir().x_, exp_dir.x_);
+  EXPECT_REAL_EQ(r.GetDir().y_, exp_dir.y_);
+  EXPECT_REAL_EQ(r.GetDir().z_, exp_dir.z_);
   EXPECT_EQ(r.GetPos(), exp_pos);
 }
 
@@ -21,9 +24,9 @@ TEST(RayTests, Advance) {
     GeoVec exp_pos{1, 2, 6};
     GeoVec exp_dir{0, 0, 1};
     EXPECT_EQ(r.GetPos(), exp_pos);
-    EXPECT_DOUBLE_EQ(r.GetDir().x_, exp_dir.x_);
-    EXPECT_DOUBLE_EQ(r.GetDir().y_, exp_dir.y_);
-    EXPECT_DOUBLE_EQ(r.GetDir().z_, exp_dir.z_);
+    EXPECT_REAL_EQ(r.GetDir().x_, exp_dir.x_);
+    EXPECT_REAL_EQ(r.GetDir().y_, exp_dir.y_);
+    EXPECT_REAL_EQ(r.GetDir().z_, exp_dir.z_);
 #ifndef NDEBUG
     EXPECT_DEATH(r.Advance(-7), "");
 #endif  // NDEBUG
@@ -42,8 +45,25 @@ TEST(RayTests, Advance) {
     GeoVec exp_pos{1, 10, 9};
     GeoVec exp_dir{0, 0.8, 0.6};
     EXPECT_EQ(r.GetPos(), exp_pos);
-    EXPECT_DOUBLE_EQ(r.GetDir().x_, exp_dir.x_);
-    EXPECT_DOUBLE_EQ(r.GetDir().y_, exp_dir.y_);
-    EXPECT_DOUBLE_EQ(r.GetDir().z_, exp_dir.z_);
+    EXPECT_REAL_EQ(r.GetDir().x_, exp_dir.x_);
+    EXPECT_REAL_EQ(r.GetDir().y_, exp_dir.y_);
+    EXPECT_REAL_EQ(r.GetDir().z_, exp_dir.z_);
+  }
+}
+
+TEST(RayTests, ShearTurnsRayAlongZ) {
+  Ray r{GeoVec{1, 2, 3}, GeoVec{0.3, -4, 2}};
+  for (const GeoVec& dir : {GeoVec{0.3, -4, 2}, GeoVec{-5, 1, 1},
+                            GeoVec{0, 0, -1}, GeoVec{1, 1, 1}}) {
+    r.UpdateDirection(dir);
+    const RayShear& shear = r.GetShear();
+    const GeoVec& d = r.GetDir();
+    EXPECT_NEAR(d.*shear.x - shear.shear_x * d.*shear.z, 0,
+                RealTolerance(1e-15));
+    EXPECT_NEAR(d.*shear.y - shear.shear_y * d.*shear.z, 0,
+                RealTolerance(1e-15));
+    EXPECT_REAL_EQ(shear.shear_z * d.*shear.z, 1);
+    EXPECT_GE(std::abs(d.*shear.z), std::abs(d.*shear.x));
+    EXPECT_GE(std::abs(d.*shear.z), std::abs(d.*shear.y));
   }
 }
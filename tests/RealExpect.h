@@ -0,0 +1,32 @@
+﻿/**
+ * @file RealExpect.h
+ * Contain assertions for values of the scene geometry precision (see Real),
+ * so tests written for double geometry also check float builds
+ */
+#ifndef REAL_EXPECT_H
+#define REAL_EXPECT_H
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+
+#include "GeoVec.h"
+
+/** Same as EXPECT_DOUBLE_EQ or EXPECT_FLOAT_EQ depending on Real*/
+#ifdef PATH_TRACER_FLOAT
+#define EXPECT_REAL_EQ(val1, val2) EXPECT_FLOAT_EQ(val1, val2)
+#else
+#define EXPECT_REAL_EQ(val1, val2) EXPECT_DOUBLE_EQ(val1, val2)
+#endif
+
+/** @return tolerance of a check written for double geometry, for float
+ * geometry it is widened to several float epsilons*/
+constexpr double RealTolerance(double tolerance) {
+  if (std::is_same_v<Real, double>) return tolerance;
+  double epsilon = std::numeric_limits<Real>::epsilon();
+  return std::max(tolerance, 64.0 * epsilon);
+}
+
+#endif  // REAL_EXPECT_H
@@ -0,0 +1,377 @@
+﻿#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Objects.h"
+#include "Renderer.h"
+
+TEST(RendererTests, CreateBlocks) {
+  std::vector<render::Block> blocks = render::CreateBlocks(
+      /*width_in_pixel=*/render::kBlockSize + 3,
+      /*height_in_pixel=*/2 * render::kBlockSize);
+  ASSERT_EQ(blocks.size(), 4);
+  EXPECT_EQ(blocks[0].x0, 0);
+  EXPECT_EQ(blocks[0].y0, 0);
+  EXPECT_EQ(blocks[0].width, render::kBlockSize);
+  EXPECT_EQ(blocks[0].height, render::kBlockSize);
+
+  EXPECT_EQ(blocks[1].x0, render::kBlockSize);
+  EXPECT_EQ(blocks[1].y0, 0);
+  EXPECT_EQ(blocks[1].width, 3);
+  EXPECT_EQ(blocks[1].height, render::kBlockSize);
+
+  EXPECT_EQ(blocks[2].x0, 0);
+  EXPECT_EQ(blocks[2].y0, render::kBlockSize);
+  EXPECT_EQ(blocks[3].x0, render::kBlockSize);
+  EXPECT_EQ(blocks[3].y0, render::kBlockSize);
+  EXPECT_EQ(blocks[3].width, 3);
+}
+
+TEST(RendererTests, MortonIndex) {
+  EXPECT_EQ(render::MortonIndex(0, 0), 0);
+  EXPECT_EQ(render::MortonIndex(1, 0), 1);
+  EXPECT_EQ(render::MortonIndex(0, 1), 2);
+  EXPECT_EQ(render::MortonIndex(1, 1), 3);
+  EXPECT_EQ(render::MortonIndex(2, 0), 4);
+  EXPECT_EQ(render::MortonIndex(3, 5), 0b100111);
+}
+
+TEST(RendererTests, HilbertCurveIsContinuous) {
+  // Neighbouring points on the curve are neighbouring pixels
+  std::vector<std::pair<int, int>> order =
+      render::CreateCurveOrder(8, 8, TileOrder::kHilbert);
+  ASSERT_EQ(order.size(), 64);
+  EXPECT_EQ(order.front(), std::make_pair(0, 0));
+  for (size_t i = 1; i < order.size(); ++i) {
+    EXPECT_EQ(std::abs(order[i].first - order[i - 1].first) +
+                  std::abs(order[i].second - order[i - 1].second),
+              1);
+  }
+}
+
+TEST(RendererTests, CurveOrderCoversAllPoints) {
+  for (TileOrder order :
+       {TileOrder::kScanline, TileOrder::kMorton, TileOrder::kHilbert}) {
+    std::vector<std::pair<int, int>> points =
+        render::CreateCurveOrder(13, 6, order);
+    ASSERT_EQ(points.size(), 13 * 6);
+    std::sort(points.begin(), points.end(),
+              [](const auto& lhs, const auto& rhs) {
+                return std::make_pair(lhs.second, lhs.first) <
+                       std::make_pair(rhs.second, rhs.first);
+              });
+    for (size_t i = 0; i < points.size(); ++i) {
+      EXPECT_EQ(points[i], std::make_pair(static_cast<int>(i % 13),
+                                          static_cast<int>(i / 13)));
+    }
+  }
+}
+
+TEST(RendererTests, CurveBlocksFinishStripsInOrder) {
+  // 9 x 10 blocks, so the last strip and the last cell of a strip are partial
+  int width = 9 * render::kBlockSize - 5;
+  int height = 10 * render::kBlockSize;
+  int width_in_blocks = 9;
+  for (TileOrder order : {TileOrder::kMorton, TileOrder::kHilbert}) {
+    std::vector<render::Block> blocks =
+        render::CreateBlocks(width, height, order);
+    ASSERT_EQ(blocks.size(), 90);
+    for (size_t i = 0; i < blocks.size(); ++i) {
+      // every block of a strip comes before any block of the next strip
+      int strip = blocks[i].y0 / render::kBlockSize / render::kCurveStripHeight;
+      EXPECT_LT(i, static_cast<size_t>((strip + 1) * render::kCurveStripHeight *
+                                       width_in_blocks));
+      EXPECT_GE(i, static_cast<size_t>(strip * render::kCurveStripHeight *
+                                       width_in_blocks));
+    }
+    std::vector<render::Block> scanline = render::CreateBlocks(width, height);
+    auto by_position = [](const render::Block& lhs, const render::Block& rhs) {
+      return std::make_pair(lhs.y0, lhs.x0) < std::make_pair(rhs.y0, rhs.x0);
+    };
+    std::sort(blocks.begin(), blocks.end(), by_position);
+    for (size_t i = 0; i < blocks.size(); ++i) {
+      EXPECT_EQ(blocks[i].x0, scanline[i].x0);
+      EXPECT_EQ(blocks[i].y0, scanline[i].y0);
+      EXPECT_EQ(blocks[i].width, scanline[i].width);
+      EXPECT_EQ(blocks[i].height, scanline[i].height);
+    }
+  }
+}
+
+TEST(RendererTests, HilbertBlocksAreContinuous) {
+  std::vector<render::Block> blocks = render::CreateBlocks(
+      3 * render::kCurveStripHeight * render::kBlockSize,
+      render::kCurveStripHeight * render::kBlockSize, TileOrder::kHilbert);
+  for (size_t i = 1; i < blocks.size(); ++i) {
+    EXPECT_EQ(std::abs(blocks[i].x0 - blocks[i - 1].x0) +
+                  std::abs(blocks[i].y0 - blocks[i - 1].y0),
+              render::kBlockSize);
+  }
+}
+
+TEST(RendererTests, RenderLightSource) {
+  // Camera looks at the huge light source - every pixel has its color
+  Sphere lamp{GeoVec{10, 10, -2e4}, 1e4};
+  lamp.SetColor(colors::kOrange).SetMaterial(Material::kLightSource);
+  GeneralSettings general;
+  general.pic_width_in_pixel = 37;
+  general.pic_height_in_pixel = 21;
+  general.sample_per_pixel = 3;
+  general.max_bounce_number = 5;
+  general.thread_number = 4;
+  CameraSettings camera;
+  camera.screen_top_left_coor = GeoVec{0, 20, 0};
+  camera.screen_top_right_coor = GeoVec{20, 20, 0};
+  camera.screen_bot_left_coor = GeoVec{0, 0, 0};
+  camera.distance_to_screen = 100;
+  Renderer renderer{general, camera, {&lamp}};
+  EXPECT_EQ(renderer.GetThreadNumber(), 4);
+  std::vector<Color> frame = renderer.Render();
+  ASSERT_EQ(frame.size(), 37 * 21);
+  for (const auto& el : frame) {
+    EXPECT_EQ(el, colors::kOrange);
+  }
+}
+
+namespace {
+/** Small scene with light source, diffuse and polished objects*/
+class RendererSceneTests : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    lamp_.SetColor(colors::kWhite).SetMaterial(Material::kLightSource);
+    ball_.SetColor(colors::kRed)
+        .SetMaterial(Material::kReflective)
+        .SetPolishness(0.3)
+        .SetReflectionCoef(0.9);
+    floor_.SetColor(colors::kGrey)
+        .SetMaterial(Material::kReflective)
+        .SetPolishness(0.0)
+        .SetReflectionCoef(1.0);
+    general_.pic_width_in_pixel = 2 * render::kBlockSize + 5;
+    general_.pic_height_in_pixel = render::kBlockSize + 7;
+    general_.sample_per_pixel = 4;
+    general_.max_bounce_number = 10;
+    general_.seed = 17;
+    camera_.screen_top_left_coor = GeoVec{0, 20, 0};
+    camera_.screen_top_right_coor = GeoVec{20, 20, 0};
+    camera_.screen_bot_left_coor = GeoVec{0, 0, 0};
+    camera_.distance_to_screen = 30;
+  }
+
+  std::vector<const Object*> GetObjects() const {
+    return {&lamp_, &ball_, &floor_};
+  }
+
+  Sphere lamp_{GeoVec{10, 30, -50}, 15};
+  Sphere ball_{GeoVec{10, 0, -60}, 20};
+  Triangle floor_{GeoVec{-100, -20, 100}, GeoVec{100, -20, 100},
+                  GeoVec{0, -20, -300}};
+  GeneralSettings general_;
+  CameraSettings camera_;
+};
+}  // namespace
+
+TEST_F(RendererSceneTests, SameImageForAnyThreadNumber) {
+  general_.thread_number = 1;
+  std::vector<Color> single = Renderer{general_, camera_, GetObjects()}.Render();
+  general_.thread_number = 3;
+  std::vector<Color> multi = Renderer{general_, camera_, GetObjects()}.Render();
+  EXPECT_EQ(single, multi);
+  EXPECT_NE(std::count(single.begin(), single.end(), colors::kBlack),
+            single.size());
+}
+
+TEST_F(RendererSceneTests, ProgressivePassesGiveSameImage) {
+  general_.thread_number = 2;
+  std::vector<Color> one_pass =
+      Renderer{general_, camera_, GetObjects()}.Render();
+
+  general_.samples_per_pass = 3;
+  Renderer renderer{general_, camera_, GetObjects()};
+  std::vector<int> pass_samples;
+  std::vector<Color> progressive =
+      renderer.Render([&](const AccumulationBuffer& accum, int sample_num) {
+        pass_samples.push_back(sample_num);
+        EXPECT_EQ(accum[0].sample_num, sample_num);
+      });
+  EXPECT_EQ(pass_samples, std::vector<int>({3, 4}));
+  EXPECT_EQ(one_pass, progressive);
+  EXPECT_EQ(renderer.GetAccumulation().GetColors(), progressive);
+}
+
+TEST_F(RendererSceneTests, MergedPartialRendersGiveSameImage) {
+  // Stand-in for several render processes: every part is traced by its own
+  // renderer and saved into its own raw file
+  general_.thread_number = 2;
+  std::vector<Color> full = Renderer{general_, camera_, GetObjects()}.Render();
+
+  size_t pixel_num = full.size();
+  struct Part {
+    size_t pixel_begin;
+    size_t pixel_end;
+    int first_sample;
+    int sample_num;
+  };
+  std::vector<Part> parts{{0, 100, 0, 4},
+                          {100, pixel_num, 0, 1},
+                          {100, pixel_num, 1, 3}};
+  std::vector<std::string> files;
+  for (const auto& part : parts) {
+    Renderer renderer{general_, camera_, GetObjects()};
+    renderer.SetPixelRange(part.pixel_begin, part.pixel_end);
+    renderer.RenderPass(part.first_sample, part.sample_num);
+    files.push_back("test_part_" + std::to_string(files.size()) + ".raw");
+    ASSERT_TRUE(renderer.GetAccumulation().SaveRaw(
+        files.back(), part.pixel_begin, part.pixel_end));
+  }
+  std::optional<AccumulationBuffer> merged =
+      AccumulationBuffer::LoadRaw(files.front());
+  ASSERT_TRUE(merged);
+  for (size_t i = 1; i < files.size(); ++i) {
+    ASSERT_TRUE(merged->AddRaw(files[i]));
+  }
+  EXPECT_EQ(merged->GetColors(), full);
+  for (const auto& el : files) {
+    std::filesystem::remove(el);
+  }
+}
+
+TEST_F(RendererSceneTests, ReportsFinishedRows) {
+  general_.thread_number = 3;
+  general_.samples_per_pass = 2;
+  Renderer renderer{general_, camera_, GetObjects()};
+  std::mutex mut;
+  std::vector<int> row_counts(general_.pic_height_in_pixel);
+  std::vector<int> row_order;
+  std::vector<Color> rows_image(renderer.GetAccumulation().GetPixels().size());
+  std::vector<Color> image =
+      renderer.Render(nullptr, [&](int row, std::vector<Color> colors) {
+        std::lock_guard<std::mutex> lock(mut);
+        ASSERT_EQ(colors.size(), general_.pic_width_in_pixel);
+        row_counts[row]++;
+        row_order.push_back(row);
+        std::copy(colors.begin(), colors.end(),
+                  rows_image.begin() + row * general_.pic_width_in_pixel);
+      });
+  // rows are reported only once - in the last pass
+  EXPECT_EQ(row_counts, std::vector<int>(general_.pic_height_in_pixel, 1));
+  // rows come in order, so the png encoder never waits for a skipped row
+  EXPECT_TRUE(std::is_sorted(row_order.begin(), row_order.end()));
+  EXPECT_EQ(rows_image, image);
+}
+
+TEST_F(RendererSceneTests, ReportsRowsBeforeRenderFinishes) {
+  // With one thread blocks are traced in their list order, so the last row
+  // has no samples yet when the first strip is reported
+  general_.thread_number = 1;
+  general_.sample_per_pixel = 1;
+  general_.pic_height_in_pixel =
+      2 * render::kCurveStripHeight * render::kBlockSize;
+  for (TileOrder order :
+       {TileOrder::kScanline, TileOrder::kMorton, TileOrder::kHilbert}) {
+    general_.tile_order = order;
+    Renderer renderer{general_, camera_, GetObjects()};
+    size_t last_pixel = renderer.GetAccumulation().GetPixels().size() - 1;
+    std::vector<int> early_rows;
+    renderer.Render(nullptr, [&](int row, std::vector<Color> /*colors*/) {
+      if (renderer.GetAccumulation()[last_pixel].sample_num == 0) {
+        early_rows.push_back(row);
+      }
+    });
+    EXPECT_GE(early_rows.size(),
+              static_cast<size_t>(render::kCurveStripHeight *
+                                  render::kBlockSize));
+  }
+}
+
+TEST_F(RendererSceneTests, SameImageForAnyTileOrder) {
+  general_.thread_number = 2;
+  general_.tile_order = TileOrder::kScanline;
+  std::vector<Color> scanline =
+      Renderer{general_, camera_, GetObjects()}.Render();
+  general_.tile_order = TileOrder::kMorton;
+  EXPECT_EQ(Renderer(general_, camera_, GetObjects()).Render(), scanline);
+  general_.tile_order = TileOrder::kHilbert;
+  EXPECT_EQ(Renderer(general_, camera_, GetObjects()).Render(), scanline);
+}
+
+TEST_F(RendererSceneTests, UpdatedGeometryGivesSameImageAsNewRenderer) {
+  general_.thread_number = 2;
+  Renderer renderer{general_, camera_, GetObjects()};
+  std::vector<Color> first = renderer.Render();
+  // next frame moves objects and camera
+  ball_.SetCenter(GeoVec{5, 2, -55});
+  floor_.SetPoints(GeoVec{-100, -25, 100}, GeoVec{100, -25, 100},
+                   GeoVec{0, -15, -300});
+  camera_.screen_top_left_coor = GeoVec{-2, 20, 0};
+  camera_.screen_top_right_coor = GeoVec{18, 20, 0};
+  camera_.screen_bot_left_coor = GeoVec{-2, 0, 0};
+  renderer.SetCamera(camera_);
+  EXPECT_FALSE(renderer.UpdateGeometry());
+  std::vector<Color> second = renderer.Render();
+  EXPECT_NE(first, second);
+  EXPECT_EQ(Renderer(general_, camera_, GetObjects()).Render(), second);
+  // with zero ratio structure is rebuilt for every frame
+  general_.refit_cost_ratio = 0.0;
+  Renderer rebuilding{general_, camera_, GetObjects()};
+  EXPECT_TRUE(rebuilding.UpdateGeometry());
+  EXPECT_EQ(rebuilding.Render(), second);
+}
+
+TEST_F(RendererSceneTests, SameImageForAnyRayPacketSide) {
+  for (AcceleratorType type :
+       {AcceleratorType::kBvh, AcceleratorType::kWideBvh}) {
+    general_.accelerator = type;
+    general_.ray_packet_side = 0;
+    std::vector<Color> single =
+        Renderer{general_, camera_, GetObjects()}.Render();
+    // side 3 does not divide the block, so some packets are partial
+    for (int side : {3, 4, kMaxRayPacketSide}) {
+      general_.ray_packet_side = side;
+      EXPECT_EQ(Renderer(general_, camera_, GetObjects()).Render(), single);
+    }
+  }
+}
+
+TEST_F(RendererSceneTests, SameImageForAnyAccelerator) {
+  general_.accelerator = AcceleratorType::kBvh;
+  std::vector<Color> bvh = Renderer{general_, camera_, GetObjects()}.Render();
+  for (AcceleratorType type : {AcceleratorType::kWideBvh,
+                               AcceleratorType::kGrid,
+                               AcceleratorType::kKdTree}) {
+    general_.accelerator = type;
+    EXPECT_EQ(Renderer(general_, camera_, GetObjects()).Render(), bvh);
+  }
+}
+
+TEST_F(RendererSceneTests, LightSamplingKeepsMeanBrightness) {
+  general_.sample_per_pixel = 16;
+  general_.light_sampling = false;
+  std::vector<Color> traced =
+      Renderer{general_, camera_, GetObjects()}.Render();
+  general_.light_sampling = true;
+  std::vector<Color> sampled =
+      Renderer{general_, camera_, GetObjects()}.Render();
+  EXPECT_NE(traced, sampled);
+  double traced_sum = 0.0;
+  double sampled_sum = 0.0;
+  for (size_t i = 0; i < traced.size(); ++i) {
+    traced_sum += traced[i].red + traced[i].green + traced[i].blue;
+    sampled_sum += sampled[i].red + sampled[i].green + sampled[i].blue;
+  }
+  // both estimators are unbiased, images differ by noise only
+  EXPECT_NEAR(sampled_sum / traced_sum, 1.0, 0.02);
+}
+
+TEST_F(RendererSceneTests, BlackLightGivesBlackImage) {
+  lamp_.SetColor(colors::kBlack);
+  std::vector<Color> image = Renderer{general_, camera_, GetObjects()}.Render();
+  for (const Color& el : image) {
+    EXPECT_EQ(el, colors::kBlack);
+  }
+}
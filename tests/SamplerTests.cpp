@@ -0,0 +1,47 @@
+﻿#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "Sampler.h"
+
+TEST(SamplerTests, ValuesInUnitInterval) {
+  Sampler sampler{7};
+  double sum = 0.0;
+  size_t num = 100000;
+  for (size_t i = 0; i < num; ++i) {
+    double val = sampler.Get1D();
+    EXPECT_GE(val, 0.0);
+    EXPECT_LT(val, 1.0);
+    sum += val;
+  }
+  EXPECT_NEAR(sum / num, 0.5, 0.01);
+}
+
+TEST(SamplerTests, ValuesDependOnlyOnKey) {
+  // Values of the same (pixel, sample, bounce, dimension) do not depend on
+  // what was drawn before
+  auto draw = [](Sampler& sampler, uint64_t pixel, uint64_t sample,
+                 uint64_t bounce) {
+    sampler.StartPixel(pixel, 0);
+    sampler.StartSample(sample);
+    sampler.StartBounce(bounce);
+    return std::vector<double>{sampler.Get1D(), sampler.Get1D()};
+  };
+  Sampler lhs{42};
+  Sampler rhs{42};
+  std::vector<double> expected = draw(lhs, 12, 3, 5);
+  draw(rhs, 1, 2, 3);
+  rhs.Get1D();
+  EXPECT_EQ(draw(rhs, 12, 3, 5), expected);
+  // first sample offset selects the same stream
+  rhs.StartPixel(12, 2);
+  rhs.StartSample(1);
+  rhs.StartBounce(5);
+  EXPECT_EQ(rhs.Get1D(), expected[0]);
+
+  EXPECT_NE(draw(rhs, 13, 3, 5), expected);
+  EXPECT_NE(draw(rhs, 12, 4, 5), expected);
+  EXPECT_NE(draw(rhs, 12, 3, 6), expected);
+  Sampler other_seed{43};
+  EXPECT_NE(draw(other_seed, 12, 3, 5), expected);
+}
@@ -0,0 +1,156 @@
+﻿#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "Objects.h"
+#include "Ray.h"
+#include "RealExpect.h"
+#include "SpherePacket.h"
+#include "SphereSet.h"
+
+TEST(SphereSetTests, BoundsAndWrongRadii) {
+  SphereSet set{{{0, 0, 0}, {3, 1, 0}}, {1.0, 0.5}};
+  EXPECT_EQ(set.GetSphereNumber(), 2);
+  BoundingBox box = set.GetBoundingBox();
+  EXPECT_EQ(box.min, GeoVec(-1, -1, -1));
+  EXPECT_EQ(box.max, GeoVec(3.5, 1.5, 1));
+
+  EXPECT_THROW(SphereSet({{0, 0, 0}}, {1.0, 2.0}), std::logic_error);
+  EXPECT_THROW(SphereSet({{0, 0, 0}}, {0.0}), std::logic_error);
+  EXPECT_THROW(set.GetNorm(GeoVec{0, 0, 0}), std::logic_error);
+}
+
+TEST(SphereSetTests, SameHitsAsSeparateSpheres) {
+  std::mt19937 rnd{5};
+  std::uniform_real_distribution<double> coor{-20.0, 20.0};
+  std::uniform_real_distribution<double> radius{0.2, 2.0};
+  std::vector<GeoVec> centers;
+  std::vector<Real> radii;
+  std::vector<Sphere> spheres;
+  for (int i = 0; i < 500; ++i) {
+    centers.push_back({coor(rnd), coor(rnd), coor(rnd)});
+    radii.push_back(radius(rnd));
+    spheres.emplace_back(centers.back(), radii.back());
+  }
+  SphereSet set{centers, radii};
+  int hit_num = 0;
+  for (int i = 0; i < 3000; ++i) {
+    Ray ray{{coor(rnd), coor(rnd), coor(rnd)},
+            GeoVec{coor(rnd), coor(rnd), coor(rnd)}};
+    std::optional<Real> expected;
+    const Sphere* expected_sphere = nullptr;
+    for (const auto& el : spheres) {
+      std::optional<Real> dist = el.GetClosesDist(ray);
+      if (dist && (!expected || *dist < *expected)) {
+        expected = dist;
+        expected_sphere = &el;
+      }
+    }
+    std::optional<Real> actual = set.GetClosesDist(ray);
+    ASSERT_EQ(expected.has_value(), actual.has_value()) << i;
+    EXPECT_EQ(set.IsCrossed(ray, 40.0), expected && *expected < Real{40}) << i;
+    if (!expected) continue;
+    ++hit_num;
+    EXPECT_NEAR(*actual, *expected, RealTolerance(1e-12) * 40.0) << i;
+    SurfacePoint surface = set.GetSurfacePoint(ray, *actual);
+    EXPECT_EQ(surface.obj, &set);
+    GeoVec expected_norm = expected_sphere->GetNorm(
+        ray.GetPos() + ray.GetDir() * *expected);
+    // hit point error grows with the distance from the origin, which is up
+    // to a hundred radii
+    EXPECT_NEAR(surface.norm.Dot(expected_norm), 1.0,
+                10 * RealTolerance(1e-9))
+        << i;
+  }
+  EXPECT_GT(hit_num, 100);
+}
+
+TEST(SphereSetTests, UpdatedCentersGiveSameHitsAsNewSet) {
+  std::mt19937 rnd{7};
+  std::uniform_real_distribution<double> coor{-20.0, 20.0};
+  std::vector<GeoVec> centers;
+  std::vector<GeoVec> moved;
+  std::vector<Real> radii;
+  for (int i = 0; i < 300; ++i) {
+    centers.push_back({coor(rnd), coor(rnd), coor(rnd)});
+    moved.push_back({coor(rnd), coor(rnd), coor(rnd)});
+    radii.push_back(1.0 + i % 3);
+  }
+  SphereSet set{centers, radii};
+  SphereSet frame{moved, radii};
+  set.UpdateCenters(frame);
+  EXPECT_EQ(set.GetBoundingBox().min, frame.GetBoundingBox().min);
+  EXPECT_EQ(set.GetBoundingBox().max, frame.GetBoundingBox().max);
+  int hit_num = 0;
+  for (int i = 0; i < 1000; ++i) {
+    // origins are outside of the spheres
+    GeoVec origin{coor(rnd), coor(rnd), 60.0};
+    Ray ray{origin, GeoVec{coor(rnd), coor(rnd), coor(rnd)} - origin};
+    std::optional<Real> expected = frame.GetClosesDist(ray);
+    std::optional<Real> actual = set.GetClosesDist(ray);
+    ASSERT_EQ(expected.has_value(), actual.has_value()) << i;
+    if (!expected) continue;
+    ++hit_num;
+    EXPECT_REAL_EQ(*actual, *expected) << i;
+  }
+  EXPECT_GT(hit_num, 100);
+
+  // frame without hierarchy gives the same centers
+  SphereSet other{centers, radii};
+  SphereSet plain_frame{moved, radii, NoHierarchy{}};
+  EXPECT_EQ(plain_frame.GetBoundingBox().min, frame.GetBoundingBox().min);
+  other.UpdateCenters(plain_frame);
+  EXPECT_EQ(other.GetBoundingBox().min, frame.GetBoundingBox().min);
+  EXPECT_EQ(other.GetBoundingBox().max, frame.GetBoundingBox().max);
+
+  SphereSet fewer{{{0, 0, 0}}, {1.0}};
+  EXPECT_THROW(set.UpdateCenters(fewer), std::logic_error);
+}
+
+TEST(SphereSetTests, PacketFindsSameSphereAsOneByOneTest) {
+  std::mt19937 rnd{13};
+  std::uniform_real_distribution<double> coor{-1.0, 1.0};
+  std::vector<Real> centers[3];
+  std::vector<Real> radii;
+  // arrays are padded by one packet as in SphereSet
+  for (uint32_t i = 0; i < 4 * kSpherePacketWidth; ++i) {
+    for (auto& el : centers) el.push_back(coor(rnd));
+    radii.push_back(0.1 + 0.2 * (coor(rnd) + 1));
+  }
+  SphereSoA spheres{{centers[0].data(), centers[1].data(), centers[2].data()},
+                    radii.data()};
+  int hit_num = 0;
+  for (int i = 0; i < 2000; ++i) {
+    // packets of every size, the closest hit limit rejects some spheres
+    uint32_t first = i % (2 * kSpherePacketWidth);
+    uint32_t num = 1 + i % kSpherePacketWidth;
+    Real max_dist = i % 3 ? 10.0 : 3.5;
+    Ray ray{{4 * coor(rnd), 4 * coor(rnd), 4 * coor(rnd)},
+            GeoVec{0.5 * coor(rnd), 0.5 * coor(rnd), 0.5 * coor(rnd)}};
+    ray.UpdateDirection(GeoVec{0.5 * coor(rnd), 0.5 * coor(rnd), 0} -
+                        ray.GetPos());
+    Real expected_dist = max_dist;
+    std::optional<uint32_t> expected;
+    for (uint32_t idx = first; idx < first + num; ++idx) {
+      std::optional<Real> dist = IntersectSphere(
+          ray, {centers[0][idx], centers[1][idx], centers[2][idx]},
+          radii[idx]);
+      if (dist && *dist < expected_dist) {
+        expected_dist = *dist;
+        expected = idx;
+      }
+    }
+    Real actual_dist = max_dist;
+    std::optional<uint32_t> actual =
+        IntersectSpherePacket(ray, spheres, first, num, actual_dist);
+    ASSERT_EQ(actual, expected) << i;
+    if (!expected) continue;
+    ++hit_num;
+    EXPECT_NEAR(actual_dist, expected_dist, RealTolerance(1e-12) * 10.0) << i;
+  }
+  EXPECT_GT(hit_num, 200);
+}
@@ -0,0 +1,77 @@
+﻿#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+#include "ThreadPool.h"
+
+TEST(ThreadPoolTests, RunsEveryTaskOnce) {
+  ThreadPool pool{4};
+  EXPECT_EQ(pool.GetThreadNumber(), 4);
+  std::vector<std::atomic<int>> counters(1000);
+  pool.Run(counters.size(), [&](size_t task_idx, size_t worker_idx) {
+    EXPECT_LT(worker_idx, 4);
+    counters[task_idx]++;
+  });
+  for (const auto& el : counters) {
+    EXPECT_EQ(el.load(), 1);
+  }
+  // pool can be reused for the next job
+  pool.Run(counters.size(),
+           [&](size_t task_idx, size_t /*worker_idx*/) { counters[task_idx]++; });
+  for (const auto& el : counters) {
+    EXPECT_EQ(el.load(), 2);
+  }
+}
+
+TEST(ThreadPoolTests, StartsWithFirstTasks) {
+  // Every worker waits in its first task until all workers have started, so
+  // nothing is stolen before each of them takes the front of its own deque
+  size_t thread_num = 4;
+  ThreadPool pool{thread_num};
+  std::vector<size_t> first_tasks(thread_num, 0);
+  std::vector<bool> started(thread_num, false);
+  std::atomic<size_t> started_num{0};
+  pool.Run(10 * thread_num, [&](size_t task_idx, size_t worker_idx) {
+    if (started[worker_idx]) return;
+    started[worker_idx] = true;
+    first_tasks[worker_idx] = task_idx;
+    started_num++;
+    while (started_num.load() != thread_num) {
+      std::this_thread::yield();
+    }
+  });
+  std::sort(first_tasks.begin(), first_tasks.end());
+  EXPECT_EQ(first_tasks, std::vector<size_t>({0, 1, 2, 3}));
+}
+
+TEST(ThreadPoolTests, StealsFromBusyWorker) {
+  // Worker which takes the first task gets stuck until all other tasks are
+  // finished. Without stealing its remaining tasks would never be executed.
+  ThreadPool pool{2};
+  size_t task_num = 10;
+  std::atomic<size_t> done{0};
+  pool.Run(task_num, [&](size_t task_idx, size_t /*worker_idx*/) {
+    if (task_idx == 0) {
+      while (done.load() != task_num - 1) {
+        std::this_thread::yield();
+      }
+    }
+    done++;
+  });
+  EXPECT_EQ(done.load(), task_num);
+}
+
+TEST(ThreadPoolTests, RethrowsTaskException) {
+  ThreadPool pool{3};
+  std::atomic<size_t> done{0};
+  EXPECT_THROW(pool.Run(20,
+                        [&](size_t task_idx, size_t /*worker_idx*/) {
+                          done++;
+                          if (task_idx == 7) throw std::runtime_error("fail");
+                        }),
+               std::runtime_error);
+  EXPECT_EQ(done.load(), 20);
+}
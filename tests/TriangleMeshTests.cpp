@@ -0,0 +1,184 @@
+﻿#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "Objects.h"
+#include "Ray.h"
+#include "RealExpect.h"
+#include "TriangleMesh.h"
+#include "TrianglePacket.h"
+
+namespace {
+/** Square of two faces, every face lists its own copies of the points*/
+std::vector<GeoVec> SquarePoints(double z) {
+  return {{0, 0, z}, {1, 0, z}, {1, 1, z}, {0, 0, z}, {1, 1, z}, {0, 1, z}};
+}
+
+const std::vector<TriangleMesh::Face> kSquareFaces = {{0, 1, 2}, {3, 4, 5}};
+}  // namespace
+
+TEST(TriangleMeshTests, EqualPointsAreStoredOnce) {
+  TriangleMesh mesh{SquarePoints(0.0), kSquareFaces};
+  EXPECT_EQ(mesh.GetTriangleNumber(), 2);
+  EXPECT_EQ(mesh.GetVertexNumber(), 4);
+  BoundingBox box = mesh.GetBoundingBox();
+  EXPECT_EQ(box.min, GeoVec(0, 0, 0));
+  EXPECT_EQ(box.max, GeoVec(1, 1, 0));
+
+  EXPECT_THROW(TriangleMesh(SquarePoints(0.0), {{0, 1, 6}}),
+               std::logic_error);
+  EXPECT_THROW(mesh.GetNorm(GeoVec{0, 0, 0}), std::logic_error);
+}
+
+TEST(TriangleMeshTests, SameHitsAsSeparateTriangles) {
+  std::mt19937 rnd{7};
+  std::uniform_real_distribution<double> coor{-20.0, 20.0};
+  std::uniform_real_distribution<double> shift{-3.0, 3.0};
+  std::vector<GeoVec> points;
+  std::vector<TriangleMesh::Face> faces;
+  std::vector<Triangle> triangles;
+  for (uint32_t i = 0; i < 500; ++i) {
+    GeoVec p0{coor(rnd), coor(rnd), coor(rnd)};
+    GeoVec p1 = p0 + GeoVec{shift(rnd), shift(rnd), shift(rnd)};
+    GeoVec p2 = p0 + GeoVec{shift(rnd), shift(rnd), shift(rnd)};
+    points.insert(points.end(), {p0, p1, p2});
+    faces.push_back({3 * i, 3 * i + 1, 3 * i + 2});
+    triangles.emplace_back(p0, p1, p2);
+  }
+  TriangleMesh mesh{points, faces};
+  int hit_num = 0;
+  for (int i = 0; i < 3000; ++i) {
+    Ray ray{{coor(rnd), coor(rnd), coor(rnd)},
+            GeoVec{coor(rnd), coor(rnd), coor(rnd)}};
+    std::optional<double> expected;
+    const Triangle* expected_tri = nullptr;
+    for (const auto& el : triangles) {
+      std::optional<double> dist = el.GetClosesDist(ray);
+      if (dist && (!expected || *dist < *expected)) {
+        expected = dist;
+        expected_tri = &el;
+      }
+    }
+    std::optional<double> actual = mesh.GetClosesDist(ray);
+    ASSERT_EQ(expected.has_value(), actual.has_value()) << i;
+    if (!expected) continue;
+    ++hit_num;
+    // SIMD test rounds intermediate values in its own way
+    EXPECT_NEAR(*actual, *expected, RealTolerance(1e-12) * *expected) << i;
+    SurfacePoint surface = mesh.GetSurfacePoint(ray, *actual);
+    EXPECT_EQ(surface.obj, &mesh);
+    GeoVec expected_norm = expected_tri->GetNorm(ray.GetPos());
+    EXPECT_NEAR(surface.norm.Dot(expected_norm), 1.0, RealTolerance(1e-9)) << i;
+  }
+  EXPECT_GT(hit_num, 20);
+}
+
+TEST(TriangleMeshTests, UpdatePointsMovesFaces) {
+  TriangleMesh mesh{SquarePoints(0.0), kSquareFaces};
+  TriangleMesh frame{SquarePoints(2.0), kSquareFaces};
+  ASSERT_TRUE(mesh.CanUpdatePoints(frame));
+  mesh.UpdatePoints(frame);
+  EXPECT_EQ(mesh.GetBoundingBox().min, GeoVec(0, 0, 2));
+  Ray ray{{0.75, 0.25, 5}, {0, 0, -1}};
+  EXPECT_REAL_EQ(mesh.GetClosesDist(ray).value_or(0.0), 3.0);
+
+  // merged points which are split in the frame cannot be updated in place
+  std::vector<GeoVec> torn = SquarePoints(2.0);
+  torn[3] = {0, 0, 3};
+  TriangleMesh torn_frame{torn, kSquareFaces};
+  EXPECT_FALSE(mesh.CanUpdatePoints(torn_frame));
+  EXPECT_THROW(mesh.UpdatePoints(torn_frame), std::logic_error);
+  TriangleMesh other_frame{SquarePoints(2.0), {{0, 1, 2}}};
+  EXPECT_FALSE(mesh.CanUpdatePoints(other_frame));
+}
+
+TEST(TriangleMeshTests, FrameWithOtherFacesIsRejected) {
+  std::vector<GeoVec> points = {{0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0}};
+  TriangleMesh mesh{points, {{0, 1, 2}, {2, 3, 0}}};
+  for (auto& p : points) p.z_ = 1.0;
+  // the same faces listed in other order and from other vertex
+  EXPECT_TRUE(mesh.CanUpdatePoints(
+      TriangleMesh{points, {{3, 0, 2}, {1, 2, 0}}, NoHierarchy{}}));
+  // the same number of faces over the same points, but other diagonal
+  TriangleMesh other{points, {{0, 1, 3}, {1, 2, 3}}, NoHierarchy{}};
+  EXPECT_FALSE(mesh.CanUpdatePoints(other));
+  EXPECT_THROW(mesh.UpdatePoints(other), std::logic_error);
+  // flipped face
+  EXPECT_FALSE(mesh.CanUpdatePoints(
+      TriangleMesh{points, {{0, 2, 1}, {2, 3, 0}}, NoHierarchy{}}));
+}
+
+TEST(TriangleMeshTests, FrameWithoutHierarchyMovesFaces) {
+  TriangleMesh mesh{SquarePoints(0.0), kSquareFaces};
+  TriangleMesh frame{SquarePoints(2.0), kSquareFaces, NoHierarchy{}};
+  EXPECT_EQ(frame.GetVertexNumber(), 6);
+  EXPECT_EQ(frame.GetBoundingBox().min, GeoVec(0, 0, 2));
+  EXPECT_EQ(frame.GetBoundingBox().max, GeoVec(1, 1, 2));
+  ASSERT_TRUE(mesh.CanUpdatePoints(frame));
+  mesh.UpdatePoints(frame);
+  EXPECT_EQ(mesh.GetBoundingBox().min, GeoVec(0, 0, 2));
+  Ray ray{{0.75, 0.25, 5}, {0, 0, -1}};
+  EXPECT_REAL_EQ(mesh.GetClosesDist(ray).value_or(0.0), 3.0);
+
+  std::vector<GeoVec> torn = SquarePoints(2.0);
+  torn[3] = {0, 0, 3};
+  EXPECT_FALSE(
+      mesh.CanUpdatePoints(TriangleMesh{torn, kSquareFaces, NoHierarchy{}}));
+  EXPECT_THROW(TriangleMesh(SquarePoints(0.0), {{0, 1, 6}}, NoHierarchy{}),
+               std::logic_error);
+}
+
+TEST(TriangleMeshTests, PacketFindsSameFaceAsOneByOneTest) {
+  std::mt19937 rnd{11};
+  std::uniform_real_distribution<double> coor{-1.0, 1.0};
+  std::vector<Real> coors[3];
+  std::vector<uint32_t> vertices[3];
+  for (uint32_t i = 0; i < 3 * kTrianglePacketWidth; ++i) {
+    for (int k = 0; k < 3; ++k) {
+      vertices[k].push_back(coors[0].size());
+      for (auto& el : coors) el.push_back(0.5 * coor(rnd));
+    }
+  }
+  TriangleSoA tris{{coors[0].data(), coors[1].data(), coors[2].data()},
+                   {vertices[0].data(), vertices[1].data(),
+                    vertices[2].data()}};
+  auto vertex = [&](int k, uint32_t face) {
+    uint32_t idx = vertices[k][face];
+    return GeoVec{coors[0][idx], coors[1][idx], coors[2][idx]};
+  };
+  int hit_num = 0;
+  for (int i = 0; i < 2000; ++i) {
+    // packets of every size, including the ones which need padding
+    uint32_t first = i % (2 * kTrianglePacketWidth);
+    uint32_t num = 1 + i % kTrianglePacketWidth;
+    Ray ray{{4 * coor(rnd), 4 * coor(rnd), 4 * coor(rnd)},
+            GeoVec{0.2 * coor(rnd), 0.2 * coor(rnd), 0.2 * coor(rnd)}};
+    ray.UpdateDirection(GeoVec{0.2 * coor(rnd), 0.2 * coor(rnd), 0} -
+                        ray.GetPos());
+    double expected_dist = 10.0;
+    std::optional<uint32_t> expected;
+    for (uint32_t face = first; face < first + num; ++face) {
+      std::optional<double> dist =
+          IntersectTriangle(ray, vertex(0, face), vertex(1, face),
+                            vertex(2, face));
+      if (dist && *dist < expected_dist) {
+        expected_dist = *dist;
+        expected = face;
+      }
+    }
+    Real actual_dist = 10.0;
+    std::optional<uint32_t> actual =
+        IntersectTrianglePacket(ray, tris, first, num, actual_dist);
+    ASSERT_EQ(actual, expected) << i;
+    EXPECT_NEAR(actual_dist, expected_dist,
+                RealTolerance(1e-12) * expected_dist)
+        << i;
+    hit_num += expected.has_value();
+  }
+  EXPECT_GT(hit_num, 100);
+}